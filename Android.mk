@@ -12,5 +12,6 @@ endif
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/include $(LOCAL_PATH)/src
 LOCAL_EXPORT_C_INCLUDES += $(LOCAL_PATH)/include
 LOCAL_SHARED_LIBRARIES := SDL2 SDL2_gpu SDL2_ttf pixman
+LOCAL_LDLIBS := -lz
 
 include $(BUILD_SHARED_LIBRARY)
@@ -0,0 +1,217 @@
+#include <math.h>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+#include "arc.h"
+#include "util.h"
+
+/*
+ * Arcs are tessellated into triangles relative to the top left corner of their bounding box.
+ * The result is cached in a small LRU cache, because clients tend to draw the same small arcs
+ * (radio buttons, check marks, scrollbar arrows, ...) over and over again.
+ */
+
+#define FULL_CIRCLE (360 * 64)
+
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+    int angle1;
+    int angle2;
+    Bool filled;
+    int arcMode;
+    unsigned int lineWidth;
+} ArcKey;
+
+typedef struct ArcCacheEntry {
+    ArcKey key;
+    float* points;
+    size_t numPoints;
+    struct ArcCacheEntry* newer;
+    struct ArcCacheEntry* older;
+    struct ArcCacheEntry* nextInBucket;
+} ArcCacheEntry;
+
+static ArcCacheEntry* buckets[ARC_CACHE_BUCKETS] = {NULL};
+static ArcCacheEntry* newestEntry = NULL;
+static ArcCacheEntry* oldestEntry = NULL;
+static size_t numEntries = 0;
+
+static size_t hashArcKey(const ArcKey* key) {
+    size_t hash = key->width;
+    hash = hash * 31 + key->height;
+    hash = hash * 31 + (unsigned int) key->angle1;
+    hash = hash * 31 + (unsigned int) key->angle2;
+    hash = hash * 31 + (key->filled ? (unsigned int) key->arcMode + 1 : 0);
+    hash = hash * 31 + key->lineWidth;
+    return hash % ARC_CACHE_BUCKETS;
+}
+
+static Bool isSameArcKey(const ArcKey* key1, const ArcKey* key2) {
+    return key1->width == key2->width && key1->height == key2->height
+           && key1->angle1 == key2->angle1 && key1->angle2 == key2->angle2
+           && key1->filled == key2->filled && key1->arcMode == key2->arcMode
+           && key1->lineWidth == key2->lineWidth;
+}
+
+static void unlinkEntry(ArcCacheEntry* entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else newestEntry = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else oldestEntry = entry->newer;
+    entry->newer = entry->older = NULL;
+}
+
+static void linkNewestEntry(ArcCacheEntry* entry) {
+    entry->older = newestEntry;
+    entry->newer = NULL;
+    if (newestEntry != NULL) newestEntry->newer = entry;
+    newestEntry = entry;
+    if (oldestEntry == NULL) oldestEntry = entry;
+}
+
+static void evictOldestEntry() {
+    ArcCacheEntry* entry = oldestEntry;
+    ArcCacheEntry** bucketEntry = &buckets[hashArcKey(&entry->key)];
+    while (*bucketEntry != entry) {
+        bucketEntry = &(*bucketEntry)->nextInBucket;
+    }
+    *bucketEntry = entry->nextInBucket;
+    unlinkEntry(entry);
+    free(entry->points);
+    free(entry);
+    numEntries--;
+}
+
+/*
+ * Calculate the position of the point at the given angle on the ellipse relative to its center.
+ * X measures the angles on the circle and skews them onto the ellipse, so the point is where a
+ * ray from the center at this angle intersects the ellipse.
+ */
+static void getEllipseAngleParameter(float radiusX, float radiusY, double angle,
+                                     double* cosine, double* sine) {
+    double parameter = atan2(radiusX * sin(angle), radiusY * cos(angle));
+    *cosine = cos(parameter);
+    *sine = sin(parameter);
+}
+
+static size_t getArcSegments(float radiusX, float radiusY, double extent) {
+    double segmentsPerCircle = MIN(MAX((radiusX + radiusY) * 1.5, 12), 360);
+    return (size_t) MAX(1, ceil(segmentsPerCircle * fabs(extent) / (2 * M_PI)));
+}
+
+static float* tessellateArc(const ArcKey* key, size_t* numPoints) {
+    float radiusX = key->width / 2.0f, radiusY = key->height / 2.0f;
+    double startAngle = key->angle1 * M_PI / (180 * 64);
+    double extent = key->angle2 * M_PI / (180 * 64);
+    size_t i, segments = getArcSegments(radiusX, radiusY, extent);
+    float* points = malloc(sizeof(float) * segments * 6 * (key->filled ? 1 : 2));
+    if (points == NULL) return NULL;
+    float* point = points;
+    double cosine, sine, previousCosine, previousSine;
+    getEllipseAngleParameter(radiusX, radiusY, startAngle, &previousCosine, &previousSine);
+    if (key->filled) {
+        double firstCosine = previousCosine, firstSine = previousSine;
+        for (i = 1; i <= segments; i++) {
+            getEllipseAngleParameter(radiusX, radiusY, startAngle + extent * i / segments,
+                                     &cosine, &sine);
+            // Chords are fanned out from the first point, so the first segment is empty.
+            if (key->arcMode == ArcPieSlice || i > 1) {
+                if (key->arcMode == ArcPieSlice) {
+                    *point++ = radiusX;
+                    *point++ = radiusY;
+                } else {
+                    *point++ = (float) (radiusX + radiusX * firstCosine);
+                    *point++ = (float) (radiusY - radiusY * firstSine);
+                }
+                *point++ = (float) (radiusX + radiusX * previousCosine);
+                *point++ = (float) (radiusY - radiusY * previousSine);
+                *point++ = (float) (radiusX + radiusX * cosine);
+                *point++ = (float) (radiusY - radiusY * sine);
+            }
+            previousCosine = cosine;
+            previousSine = sine;
+        }
+    } else {
+        // The outline runs through the pixel centers.
+        float halfWidth = MAX(1, key->lineWidth) / 2.0f;
+        float centerX = radiusX + 0.5f, centerY = radiusY + 0.5f;
+        float outerX = radiusX + halfWidth, outerY = radiusY + halfWidth;
+        float innerX = MAX(0, radiusX - halfWidth), innerY = MAX(0, radiusY - halfWidth);
+        for (i = 1; i <= segments; i++) {
+            getEllipseAngleParameter(radiusX, radiusY, startAngle + extent * i / segments,
+                                     &cosine, &sine);
+            float outer1X = (float) (centerX + outerX * previousCosine);
+            float outer1Y = (float) (centerY - outerY * previousSine);
+            float outer2X = (float) (centerX + outerX * cosine);
+            float outer2Y = (float) (centerY - outerY * sine);
+            float inner1X = (float) (centerX + innerX * previousCosine);
+            float inner1Y = (float) (centerY - innerY * previousSine);
+            float inner2X = (float) (centerX + innerX * cosine);
+            float inner2Y = (float) (centerY - innerY * sine);
+            *point++ = outer1X; *point++ = outer1Y;
+            *point++ = outer2X; *point++ = outer2Y;
+            *point++ = inner2X; *point++ = inner2Y;
+            *point++ = outer1X; *point++ = outer1Y;
+            *point++ = inner2X; *point++ = inner2Y;
+            *point++ = inner1X; *point++ = inner1Y;
+            previousCosine = cosine;
+            previousSine = sine;
+        }
+    }
+    *numPoints = (size_t) (point - points) / 2;
+    return points;
+}
+
+/*
+ * Get the triangles of an arc with a bounding box of the given size, relative to the top left
+ * corner of the bounding box. The angles are in 1/64 degree, as specified by X. Filled arcs are
+ * closed according to the arc mode, outlines are drawn with the given line width.
+ * The returned points are owned by the cache and stay valid until the next call.
+ * The number of points is stored in numPoints. Returns NULL if we ran out of memory.
+ */
+const float* getArcTriangles(unsigned int width, unsigned int height, int angle1, int angle2,
+                             Bool filled, int arcMode, unsigned int lineWidth, size_t* numPoints) {
+    ArcKey key;
+    key.width = width;
+    key.height = height;
+    key.angle2 = MAX(-FULL_CIRCLE, MIN(angle2, FULL_CIRCLE));
+    // Normalize the start angle, so equal arcs share the same cache entry.
+    key.angle1 = key.angle2 == FULL_CIRCLE || key.angle2 == -FULL_CIRCLE ? 0 : angle1 % FULL_CIRCLE;
+    if (key.angle1 < 0) key.angle1 += FULL_CIRCLE;
+    key.filled = filled;
+    key.arcMode = filled ? arcMode : 0;
+    key.lineWidth = filled ? 0 : lineWidth;
+    size_t bucket = hashArcKey(&key);
+    ArcCacheEntry* entry;
+    for (entry = buckets[bucket]; entry != NULL; entry = entry->nextInBucket) {
+        if (isSameArcKey(&entry->key, &key)) {
+            unlinkEntry(entry);
+            linkNewestEntry(entry);
+            *numPoints = entry->numPoints;
+            return entry->points;
+        }
+    }
+    if (numEntries >= ARC_CACHE_SIZE) {
+        evictOldestEntry();
+    }
+    entry = malloc(sizeof(ArcCacheEntry));
+    if (entry == NULL) return NULL;
+    entry->key = key;
+    entry->points = tessellateArc(&key, &entry->numPoints);
+    if (entry->points == NULL) {
+        free(entry);
+        return NULL;
+    }
+    entry->nextInBucket = buckets[bucket];
+    buckets[bucket] = entry;
+    linkNewestEntry(entry);
+    numEntries++;
+    *numPoints = entry->numPoints;
+    return entry->points;
+}
+
+void freeArcCache() {
+    while (oldestEntry != NULL) {
+        evictOldestEntry();
+    }
+}
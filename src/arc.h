@@ -0,0 +1,15 @@
+#ifndef _ARC_H_
+#define _ARC_H_
+
+#include "X11/Xlib.h"
+
+/* The number of tessellated arcs that are kept in the arc cache. */
+#define ARC_CACHE_SIZE 128
+/* The number of hash buckets of the arc cache. */
+#define ARC_CACHE_BUCKETS 256
+
+const float* getArcTriangles(unsigned int width, unsigned int height, int angle1, int angle2,
+                             Bool filled, int arcMode, unsigned int lineWidth, size_t* numPoints);
+void freeArcCache(void);
+
+#endif /* _ARC_H_ */
@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include "clip.h"
+#include "util.h"
+#include "drawing.h"
+#include "glFunctions.h"
+
+/*
+ * Clip regions with a single rectangle are applied with the scissor test of the draw state.
+ * Regions with more rectangles are rendered into the stencil buffer of the target once and the
+ * draw commands are drawn with a stencil test. The stencil buffer remembers which clip region
+ * it contains, so consecutive draws with the same clip region don't need to rebuild it.
+ * The highest bit of the stencil buffer is used by single draws, which draw every pixel only
+ * once, even if their triangles overlap. The bit is cleared in the drawn area before the draw
+ * and set by the draw, so a pixel fails the stencil test once it was drawn. The clip test
+ * ignores the bit.
+ */
+
+/* The stencil bit that marks the pixels a single draw has drawn. */
+#define SINGLE_DRAW_STENCIL_BIT 0x80
+/* The stencil bits that hold the clip region. */
+#define CLIP_STENCIL_MASK 0x7F
+
+/* The stencil buffer of a render target. */
+typedef struct {
+    GPU_Target* target;
+    /* The renderbuffer that was attached to the framebuffer of an image target. */
+    GLuint renderbuffer;
+    /* Whether the target has no usable stencil buffer. */
+    Bool unsupported;
+    /* Whether the target draws to the framebuffer of a window. */
+    Bool isWindowFramebuffer;
+    /* The id of the clip region in the stencil buffer or 0, if it contains none. */
+    unsigned long clipId;
+    /* The viewport that the clip region was rendered with. */
+    GPU_Rect viewport;
+} ClipStencil;
+
+static unsigned long nextClipId = 1;
+static Array clipStencils = {NULL, 0, 0};
+
+/*
+ * Create a clip region from the region relative to the clip origin.
+ * Returns NULL if we ran out of memory.
+ */
+ClipRegion* createClipRegion(pixman_region16_t* region, int originX, int originY) {
+    ClipRegion* clip = malloc(sizeof(ClipRegion));
+    if (clip == NULL) return NULL;
+    pixman_region_init(&clip->region);
+    if (!pixman_region_copy(&clip->region, region)) {
+        pixman_region_fini(&clip->region);
+        free(clip);
+        return NULL;
+    }
+    pixman_region_translate(&clip->region, originX, originY);
+    clip->refCount = 1;
+    clip->id = nextClipId++;
+    return clip;
+}
+
+ClipRegion* retainClipRegion(ClipRegion* clip) {
+    if (clip != NULL) clip->refCount++;
+    return clip;
+}
+
+void releaseClipRegion(ClipRegion* clip) {
+    if (clip == NULL || --clip->refCount > 0) return;
+    pixman_region_fini(&clip->region);
+    free(clip);
+}
+
+/*
+ * Initialize the region with the pixels of the bitmap that are set.
+ * Returns False if we ran out of memory or failed to read the bitmap.
+ */
+Bool createRegionFromBitmap(GPU_Image* bitmap, pixman_region16_t* region) {
+    flushDisplayListForTarget(bitmap->target);
+    SDL_Surface* surface = GPU_CopySurfaceFromImage(bitmap);
+    if (surface == NULL) {
+        LOG("Failed to read the bitmap in %s: %s\n", __func__, GPU_PopErrorCode().details);
+        return False;
+    }
+    pixman_box16_t* boxes = NULL;
+    size_t numBoxes = 0, capacity = 0;
+    Bool success = True;
+    int x, y;
+    for (y = 0; y < surface->h && success; y++) {
+        Uint32* row = (Uint32*) ((Uint8*) surface->pixels + y * surface->pitch);
+        int spanStart = -1;
+        for (x = 0; x <= surface->w; x++) {
+            Uint8 r, g, b, a = 0;
+            if (x < surface->w) SDL_GetRGBA(row[x], surface->format, &r, &g, &b, &a);
+            // The set bits of a bitmap have an alpha of one.
+            if (a != 0 && spanStart == -1) {
+                spanStart = x;
+            } else if (a == 0 && spanStart != -1) {
+                if (numBoxes == capacity) {
+                    capacity = MAX(16, capacity * 2);
+                    pixman_box16_t* newBoxes = realloc(boxes, sizeof(pixman_box16_t) * capacity);
+                    if (newBoxes == NULL) {
+                        success = False;
+                        break;
+                    }
+                    boxes = newBoxes;
+                }
+                boxes[numBoxes].x1 = (int16_t) spanStart;
+                boxes[numBoxes].y1 = (int16_t) y;
+                boxes[numBoxes].x2 = (int16_t) x;
+                boxes[numBoxes].y2 = (int16_t) (y + 1);
+                numBoxes++;
+                spanStart = -1;
+            }
+        }
+    }
+    SDL_FreeSurface(surface);
+    if (success) {
+        success = pixman_region_init_rects(region, boxes, (int) numBoxes) ? True : False;
+    }
+    free(boxes);
+    return success;
+}
+
+static Bool hasStencilFunctions(const GLFunctions* gl) {
+    return gl->enable != NULL && gl->disable != NULL && gl->colorMask != NULL
+           && gl->stencilFunc != NULL && gl->stencilOp != NULL && gl->stencilMask != NULL
+           && gl->getIntegerv != NULL;
+}
+
+static ClipStencil* getClipStencil(GPU_Target* target) {
+    size_t i;
+    for (i = 0; i < clipStencils.length; i++) {
+        ClipStencil* stencil = clipStencils.array[i];
+        if (stencil->target == target) return stencil;
+    }
+    ClipStencil* stencil = malloc(sizeof(ClipStencil));
+    if (stencil == NULL || !insertArray(&clipStencils, stencil)) {
+        free(stencil);
+        return NULL;
+    }
+    stencil->target = target;
+    stencil->renderbuffer = 0;
+    stencil->unsupported = False;
+    stencil->isWindowFramebuffer = False;
+    stencil->clipId = 0;
+    return stencil;
+}
+
+/*
+ * Make sure that the currently bound framebuffer of the target has a stencil buffer.
+ * Framebuffers of images don't have one, so a stencil renderbuffer is attached to them.
+ */
+static Bool ensureStencilBuffer(ClipStencil* stencil) {
+    const GLFunctions* gl = getGLFunctions();
+    GLint framebuffer = 0;
+    gl->getIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    if (framebuffer == 0) {
+        int stencilSize = 0;
+        stencil->isWindowFramebuffer = True;
+        if (SDL_GL_GetAttribute(SDL_GL_STENCIL_SIZE, &stencilSize) != 0 || stencilSize == 0) {
+            LOG("The window framebuffer has no stencil buffer\n");
+            return False;
+        }
+        return True;
+    }
+    if (stencil->renderbuffer != 0) return True;
+    GPU_Image* image = stencil->target->image;
+    if (image == NULL || gl->genRenderbuffers == NULL || gl->bindRenderbuffer == NULL
+        || gl->renderbufferStorage == NULL || gl->framebufferRenderbuffer == NULL
+        || gl->checkFramebufferStatus == NULL || gl->deleteRenderbuffers == NULL) {
+        return False;
+    }
+    gl->genRenderbuffers(1, &stencil->renderbuffer);
+    gl->bindRenderbuffer(GL_RENDERBUFFER, stencil->renderbuffer);
+    gl->renderbufferStorage(GL_RENDERBUFFER, GL_STENCIL_INDEX8,
+                            image->texture_w, image->texture_h);
+    gl->framebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                stencil->renderbuffer);
+    gl->bindRenderbuffer(GL_RENDERBUFFER, 0);
+    if (gl->checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOG("Failed to attach a stencil buffer to the target %p\n", stencil->target);
+        gl->framebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, 0);
+        gl->deleteRenderbuffers(1, &stencil->renderbuffer);
+        stencil->renderbuffer = 0;
+        return False;
+    }
+    return True;
+}
+
+/*
+ * Render the clip region into the stencil buffer of the target. The pixels in the region are set
+ * to one, all other pixels in the viewport are set to zero.
+ */
+static Bool buildClipStencil(ClipStencil* stencil, const GPU_Rect* viewport,
+                             const ClipRegion* clip) {
+    const GLFunctions* gl = getGLFunctions();
+    GPU_Target* target = stencil->target;
+    GPU_Rect clipRect = target->clip_rect;
+    Bool useClipRect = target->use_clip_rect ? True : False;
+    SDL_Color color = {0, 0, 0, 0};
+    int numRects, i;
+    pixman_box16_t* boxes = pixman_region_rectangles((pixman_region16_t*) &clip->region, &numRects);
+    GPU_FlushBlitBuffer();
+    gl->colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    gl->enable(GL_STENCIL_TEST);
+    gl->stencilMask(0xFF);
+    gl->stencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
+    gl->stencilFunc(GL_ALWAYS, 0, 0xFF);
+    setRenderTargetClip(target, False, clipRect);
+    GPU_RectangleFilled(target, 0, 0, viewport->w, viewport->h, color);
+    GPU_FlushBlitBuffer();
+    Bool success = ensureStencilBuffer(stencil);
+    if (success) {
+        // Clear again, the stencil buffer might have just been attached.
+        GPU_RectangleFilled(target, 0, 0, viewport->w, viewport->h, color);
+        gl->stencilFunc(GL_ALWAYS, 1, 0xFF);
+        for (i = 0; i < numRects; i++) {
+            GPU_RectangleFilled(target, boxes[i].x1, boxes[i].y1, boxes[i].x2, boxes[i].y2, color);
+        }
+        GPU_FlushBlitBuffer();
+        stencil->clipId = clip->id;
+        stencil->viewport = *viewport;
+    } else {
+        stencil->unsupported = True;
+        gl->disable(GL_STENCIL_TEST);
+    }
+    gl->colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    setRenderTargetClip(target, useClipRect, clipRect);
+    return success;
+}
+
+/*
+ * Enable the stencil test so only pixels in the clip region are drawn on the target.
+ * The viewport must be the current viewport of the target. Returns False if the target
+ * has no stencil buffer, in which case endStencilClip must not be called.
+ */
+Bool beginStencilClip(GPU_Target* target, const GPU_Rect* viewport, const ClipRegion* clip) {
+    const GLFunctions* gl = getGLFunctions();
+    if (!hasStencilFunctions(gl)) return False;
+    ClipStencil* stencil = getClipStencil(target);
+    if (stencil == NULL || stencil->unsupported) return False;
+    if (stencil->clipId != clip->id || stencil->viewport.x != viewport->x
+        || stencil->viewport.y != viewport->y || stencil->viewport.w != viewport->w
+        || stencil->viewport.h != viewport->h) {
+        getRenderStateCounters()->stencilClipBuilds++;
+        if (!buildClipStencil(stencil, viewport, clip)) return False;
+    } else {
+        GPU_FlushBlitBuffer();
+    }
+    gl->enable(GL_STENCIL_TEST);
+    gl->stencilMask(0);
+    gl->stencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    gl->stencilFunc(GL_EQUAL, 1, CLIP_STENCIL_MASK);
+    return True;
+}
+
+void endStencilClip() {
+    const GLFunctions* gl = getGLFunctions();
+    GPU_FlushBlitBuffer();
+    gl->stencilMask(0xFF);
+    gl->disable(GL_STENCIL_TEST);
+}
+
+/*
+ * Let the following draws on the target draw every pixel in the area at most once. The area is
+ * in viewport coordinates, the viewport and clip rectangle of the target must be set. If the
+ * draws are clipped with beginStencilClip, isStencilClip must be True. Returns False if the
+ * target has no stencil buffer, in which case endSingleDraw must not be called.
+ */
+Bool beginSingleDraw(GPU_Target* target, const GPU_Rect* area, Bool isStencilClip) {
+    const GLFunctions* gl = getGLFunctions();
+    SDL_Color color = {0, 0, 0, 0};
+    if (!hasStencilFunctions(gl)) return False;
+    ClipStencil* stencil = getClipStencil(target);
+    if (stencil == NULL || stencil->unsupported) return False;
+    GPU_FlushBlitBuffer();
+    gl->colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    if (!isStencilClip) {
+        // Draw nothing to bind the framebuffer of the target.
+        GPU_RectangleFilled(target, area->x, area->y, area->x + 1, area->y + 1, color);
+        GPU_FlushBlitBuffer();
+        if (!ensureStencilBuffer(stencil)) {
+            stencil->unsupported = True;
+            gl->colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            return False;
+        }
+        gl->enable(GL_STENCIL_TEST);
+    }
+    // The content of the bit is unknown, e.g. after a window framebuffer was presented.
+    gl->stencilMask(SINGLE_DRAW_STENCIL_BIT);
+    gl->stencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
+    gl->stencilFunc(GL_ALWAYS, 0, 0xFF);
+    GPU_RectangleFilled(target, area->x, area->y, area->x + area->w, area->y + area->h, color);
+    GPU_FlushBlitBuffer();
+    gl->colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gl->stencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+    if (isStencilClip) {
+        gl->stencilFunc(GL_EQUAL, 1, CLIP_STENCIL_MASK | SINGLE_DRAW_STENCIL_BIT);
+    } else {
+        gl->stencilFunc(GL_EQUAL, 0, SINGLE_DRAW_STENCIL_BIT);
+    }
+    return True;
+}
+
+/*
+ * Stop drawing every pixel only once. If the draws are clipped with beginStencilClip,
+ * isStencilClip must be True, the stencil clip stays active.
+ */
+void endSingleDraw(Bool isStencilClip) {
+    const GLFunctions* gl = getGLFunctions();
+    GPU_FlushBlitBuffer();
+    gl->stencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    if (isStencilClip) {
+        gl->stencilMask(0);
+        gl->stencilFunc(GL_EQUAL, 1, CLIP_STENCIL_MASK);
+    } else {
+        gl->stencilMask(0xFF);
+        gl->disable(GL_STENCIL_TEST);
+    }
+}
+
+/*
+ * Forget the content of the stencil buffers of window framebuffers,
+ * because it is undefined after the framebuffer was presented.
+ */
+void invalidateWindowClipStencils() {
+    size_t i;
+    for (i = 0; i < clipStencils.length; i++) {
+        ClipStencil* stencil = clipStencils.array[i];
+        if (stencil->isWindowFramebuffer) {
+            stencil->clipId = 0;
+        }
+    }
+}
+
+/*
+ * Free the stencil buffer of the target. This must be called before the target is freed.
+ */
+void freeClipStencil(GPU_Target* target) {
+    size_t i;
+    for (i = 0; i < clipStencils.length; i++) {
+        ClipStencil* stencil = clipStencils.array[i];
+        if (stencil->target == target) {
+            if (stencil->renderbuffer != 0) {
+                getGLFunctions()->deleteRenderbuffers(1, &stencil->renderbuffer);
+            }
+            free(removeArray(&clipStencils, i, False));
+            return;
+        }
+    }
+}
+
+void freeClipStencils() {
+    while (clipStencils.length > 0) {
+        freeClipStencil(((ClipStencil*) clipStencils.array[0])->target);
+    }
+    freeArray(&clipStencils);
+}
@@ -0,0 +1,30 @@
+#ifndef _CLIP_H_
+#define _CLIP_H_
+
+#include "X11/Xlib.h"
+#include <SDL_gpu.h>
+#include "pixman.h"
+
+/* A clip region of a graphic context, shared by the queued draw commands that use it. */
+typedef struct {
+    /* How many graphic contexts and draw commands reference the clip region. */
+    size_t refCount;
+    /* A unique id of the clip region, used to detect whether a stencil buffer contains it. */
+    unsigned long id;
+    /* The clip region with the clip origin applied, relative to the drawable origin. */
+    pixman_region16_t region;
+} ClipRegion;
+
+ClipRegion* createClipRegion(pixman_region16_t* region, int originX, int originY);
+ClipRegion* retainClipRegion(ClipRegion* clip);
+void releaseClipRegion(ClipRegion* clip);
+Bool createRegionFromBitmap(GPU_Image* bitmap, pixman_region16_t* region);
+Bool beginStencilClip(GPU_Target* target, const GPU_Rect* viewport, const ClipRegion* clip);
+void endStencilClip(void);
+Bool beginSingleDraw(GPU_Target* target, const GPU_Rect* area, Bool isStencilClip);
+void endSingleDraw(Bool isStencilClip);
+void invalidateWindowClipStencils(void);
+void freeClipStencil(GPU_Target* target);
+void freeClipStencils(void);
+
+#endif /* _CLIP_H_ */
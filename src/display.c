@@ -13,6 +13,17 @@
 #include "atoms.h"
 #include "visual.h"
 #include "font.h"
+#include "arc.h"
+#include "headless.h"
+#include "rfbServer.h"
+#include "readback.h"
+#include "glFunctions.h"
+#include "image.h"
+#include "presentScheduler.h"
+#include "pixelFormat.h"
+#include "imageCache.h"
+#include "renderThread.h"
+#include "rasterOp.h"
 #include <jni.h>
 #include <SDL_gpu.h>
 #include <X11/X.h>
@@ -37,8 +48,22 @@ static const int releaseVersion = 1;
 int XCloseDisplay(Display* display) {
     // https://tronche.com/gui/x/xlib/display/XCloseDisplay.html
     if (numDisplaysOpen == 1) {
+        stopRenderThread();
+        stopRfbServer();
+        freeHeadlessMode();
         freeAtomStorage();
         freeFontStorage();
+        freeDrawingResources();
+        freeImageResources();
+        freeImageCache();
+        freeDisplayList();
+        freeReadbacks();
+        freePresentScheduler();
+        freeArcCache();
+        freeClipStencils();
+        freeRasterOp();
+        freePlaneShader();
+        freeGLFunctions();
         destroyScreenWindow(display);
         TTF_Quit();
         GPU_Quit();
@@ -64,7 +89,7 @@ Display* XOpenDisplay(_Xconst char* display_name) {
     }
     if (!SDL_WasInit(SDL_INIT_VIDEO)) {
         SDL_SetMainReady();
-        if (SDL_Init(SDL_INIT_VIDEO) == -1) {
+        if (!initHeadlessVideo()) {
             LOG("Failed to initialize SDL: %s\n", SDL_GetError());
             free(display);
             return NULL;
@@ -161,6 +186,8 @@ Display* XOpenDisplay(_Xconst char* display_name) {
             display->screens[screenIndex].root = SCREEN_WINDOW;
         }
     }
+    // Clip regions with more than one rectangle are drawn with the stencil buffer.
+    SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
     GET_WINDOW_STRUCT(SCREEN_WINDOW)->sdlWindow = SDL_CreateWindow(NULL, 0, 0, 10, 10, SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
     if (GET_WINDOW_STRUCT(SCREEN_WINDOW)->sdlWindow == NULL) {
         LOG("XOpenDisplay: Initializing the SDL screen window failed: %s!\n", SDL_GetError());
@@ -174,6 +201,26 @@ Display* XOpenDisplay(_Xconst char* display_name) {
         XCloseDisplay(display);
         return NULL;
     }
+    if (!initHeadlessMode()) {
+        LOG("XOpenDisplay: Failed to initialize the headless mode!\n");
+        XCloseDisplay(display);
+        return NULL;
+    }
+    if (!initPixelConversion()) {
+        LOG("XOpenDisplay: Invalid pixel conversion, using the default kernels\n");
+    }
+    if (!initImageCache()) {
+        LOG("XOpenDisplay: Invalid image cache size, the image cache is disabled\n");
+    }
+    if (!initPresentScheduler()) {
+        LOG("XOpenDisplay: Failed to initialize the present scheduler, presenting immediately\n");
+    }
+    if (!initRfbServer()) {
+        LOG("XOpenDisplay: Failed to start the RFB server\n");
+    }
+    if (!initRenderThread()) {
+        LOG("XOpenDisplay: Failed to start the render thread, rendering on the client thread\n");
+    }
     if (numDisplaysOpen == 1) {
         // Init the font search path
         XSetFontPath(display, NULL, 0);
@@ -0,0 +1,849 @@
+#include "displayList.h"
+#include "util.h"
+#include "drawing.h"
+#include "rasterOp.h"
+#include "clip.h"
+#include "renderThread.h"
+#include "pixmanBackend.h"
+#include "headless.h"
+#include "readback.h"
+#include "presentScheduler.h"
+#include "polygon.h"
+
+/*
+ * The display list records the drawing requests of the client with their resolved state instead
+ * of executing them immediately. Commands with the same state are merged into batches, which are
+ * executed with a single draw call once the list is flushed. A command may join a batch that was
+ * created before other commands, if none of the commands in between touch the same pixels or
+ * read from the target of the command. This preserves the painter's order of the X protocol.
+ */
+
+#define FLOATS_PER_VERTEX(state) ((state)->image != NULL ? 8 : 6)
+#define IS_CLIPPED_OUT(state) \
+    ((state)->useClipRect && ((state)->clipRect.w <= 0 || (state)->clipRect.h <= 0))
+#define TEXTURE_S(state, x) ((state)->image != NULL ? (x) / (state)->image->texture_w : 0)
+#define TEXTURE_T(state, y) ((state)->image != NULL ? (y) / (state)->image->texture_h : 0)
+
+typedef struct {
+    DrawState state;
+    /* The union of the bounds of all commands in this batch in viewport coordinates. */
+    GPU_Rect bounds;
+    float* vertices;
+    size_t numVertices;
+    size_t vertexCapacity;
+    unsigned short* indices;
+    size_t numIndices;
+    size_t indexCapacity;
+    /* Whether the batch was already executed during the current flush. */
+    Bool executed;
+} DrawBatch;
+
+static DrawBatch* batches = NULL;
+static size_t numBatches = 0;
+static size_t batchCapacity = 0;
+static size_t numQueuedVertices = 0;
+/* Images which are used by queued commands and must be freed after the next flush. */
+static Array pendingImageFrees = {NULL, 0, 0};
+
+/* A display list that was flushed and is being executed, possibly by the render thread. */
+typedef struct {
+    DrawBatch* batches;
+    size_t numBatches;
+    size_t batchCapacity;
+    Array imageFrees;
+    /* The top level windows when the list was flushed, for the headless framebuffer. */
+    StackedWindows windows;
+} FlushedDisplayList;
+
+/*
+ * The flushed display lists, which are used in turn. The render thread can have
+ * RENDER_QUEUE_SIZE unfinished lists, so the next list in turn was always finished.
+ */
+static FlushedDisplayList flushedLists[RENDER_QUEUE_SIZE + 1];
+static size_t numFlushedLists = 0;
+
+void initDrawState(DrawState* state, GPU_Target* target, GPU_Image* image) {
+    state->target = target;
+    getRenderTargetView(target, &state->viewport, &state->clipRect, &state->useClipRect);
+    state->image = image;
+    state->function = GXcopy;
+    state->planeMask = PLANE_MASK_ALL_PLANES;
+    state->clip = NULL;
+    state->plane = 0;
+    state->singleDraw = False;
+}
+
+/*
+ * Clip the commands of the draw state to the clip region, which is relative to the origin of the
+ * drawable. The extents of the region are applied to the clip rectangle. The region itself
+ * is only needed if it consists of more than one rectangle.
+ */
+void setDrawStateClip(DrawState* state, ClipRegion* clip) {
+    pixman_box16_t* extents = pixman_region_extents(&clip->region);
+    float x1 = state->viewport.x + extents->x1, y1 = state->viewport.y + extents->y1;
+    float x2 = state->viewport.x + extents->x2, y2 = state->viewport.y + extents->y2;
+    if (state->useClipRect) {
+        x1 = MAX(x1, state->clipRect.x);
+        y1 = MAX(y1, state->clipRect.y);
+        x2 = MIN(x2, state->clipRect.x + state->clipRect.w);
+        y2 = MIN(y2, state->clipRect.y + state->clipRect.h);
+    }
+    state->clipRect = GPU_MakeRect(x1, y1, MAX(0, x2 - x1), MAX(0, y2 - y1));
+    state->useClipRect = True;
+    state->clip = pixman_region_n_rects(&clip->region) > 1 ? clip : NULL;
+}
+
+/*
+ * Draw the image of the draw state in two colors: The pixels that have the plane bit set are
+ * drawn in the foreground color, all other pixels in the background color or not at all.
+ */
+void setDrawStatePlane(DrawState* state, unsigned long plane, SDL_Color foreground,
+                       SDL_Color background, PlaneBackgroundMode backgroundMode) {
+    state->plane = plane;
+    state->planeForeground = foreground;
+    state->planeBackground = background;
+    state->planeBackgroundMode = backgroundMode;
+}
+
+static Bool isSameColor(SDL_Color color1, SDL_Color color2) {
+    return color1.r == color2.r && color1.g == color2.g
+           && color1.b == color2.b && color1.a == color2.a;
+}
+
+static Bool isSameRect(const GPU_Rect* rect1, const GPU_Rect* rect2) {
+    return rect1->x == rect2->x && rect1->y == rect2->y
+           && rect1->w == rect2->w && rect1->h == rect2->h;
+}
+
+static Bool isOverlapping(const GPU_Rect* rect1, const GPU_Rect* rect2) {
+    return rect1->x < rect2->x + rect2->w && rect2->x < rect1->x + rect1->w
+           && rect1->y < rect2->y + rect2->h && rect2->y < rect1->y + rect1->h;
+}
+
+static void unionRect(GPU_Rect* rect, const GPU_Rect* other) {
+    float x2 = MAX(rect->x + rect->w, other->x + other->w);
+    float y2 = MAX(rect->y + rect->h, other->y + other->h);
+    rect->x = MIN(rect->x, other->x);
+    rect->y = MIN(rect->y, other->y);
+    rect->w = x2 - rect->x;
+    rect->h = y2 - rect->y;
+}
+
+static Bool isSameDrawState(const DrawState* state1, const DrawState* state2) {
+    return state1->target == state2->target && state1->image == state2->image
+           && state1->function == state2->function && state1->planeMask == state2->planeMask
+           && state1->clip == state2->clip && state1->plane == state2->plane
+           && state1->singleDraw == state2->singleDraw
+           && (state1->plane == 0
+               || (isSameColor(state1->planeForeground, state2->planeForeground)
+                   && isSameColor(state1->planeBackground, state2->planeBackground)
+                   && state1->planeBackgroundMode == state2->planeBackgroundMode))
+           && state1->useClipRect == state2->useClipRect
+           && isSameRect(&state1->viewport, &state2->viewport)
+           && (!state1->useClipRect || isSameRect(&state1->clipRect, &state2->clipRect));
+}
+
+/*
+ * Check if a command with the given state and bounds can not be moved in front of the batch.
+ */
+static Bool isConflicting(const DrawBatch* batch, const DrawState* state, const GPU_Rect* bounds) {
+    if (batch->state.target == state->target) {
+        // Bounds of batches with different viewports are not comparable.
+        if (!isSameRect(&batch->state.viewport, &state->viewport)) return True;
+        if (isOverlapping(&batch->bounds, bounds)) return True;
+    }
+    if (batch->state.image != NULL && batch->state.image == state->target->image) return True;
+    return state->image != NULL && batch->state.target->image == state->image;
+}
+
+static Bool reserveBatchSpace(DrawBatch* batch, size_t numVertices, size_t numIndices) {
+    if (batch->numVertices + numVertices > batch->vertexCapacity) {
+        size_t capacity = MAX(batch->numVertices + numVertices, batch->vertexCapacity * 2);
+        float* vertices = realloc(batch->vertices,
+                                  sizeof(float) * FLOATS_PER_VERTEX(&batch->state) * capacity);
+        if (vertices == NULL) return False;
+        batch->vertices = vertices;
+        batch->vertexCapacity = capacity;
+    }
+    if (batch->numIndices + numIndices > batch->indexCapacity) {
+        size_t capacity = MAX(batch->numIndices + numIndices, batch->indexCapacity * 2);
+        unsigned short* indices = realloc(batch->indices, sizeof(unsigned short) * capacity);
+        if (indices == NULL) return False;
+        batch->indices = indices;
+        batch->indexCapacity = capacity;
+    }
+    return True;
+}
+
+/*
+ * Get a batch with the given state that has space for the given number of vertices and indices.
+ * The batch is either an existing batch that the command can safely join or a new batch at the end
+ * of the display list. Commands that read the destination in the raster op shader only join
+ * batches that they don't overlap.
+ */
+static DrawBatch* getBatch(const DrawState* state, const GPU_Rect* bounds,
+                           size_t numVertices, size_t numIndices) {
+    DrawBatch* batch = NULL;
+    size_t i = numBatches, searched = 0;
+    Bool readsDestination = isDestinationRasterOp(state->function, state->planeMask);
+    while (!state->singleDraw && i > 0 && searched++ < DISPLAY_LIST_SEARCH_DEPTH) {
+        DrawBatch* candidate = &batches[--i];
+        if (isSameDrawState(&candidate->state, state)) {
+            // The raster op shader reads the destination once for the whole batch.
+            if (candidate->numVertices + numVertices <= DISPLAY_LIST_MAX_BATCH_VERTICES
+                && !(readsDestination && isOverlapping(&candidate->bounds, bounds))) {
+                batch = candidate;
+            }
+            break;
+        }
+        if (isConflicting(candidate, state, bounds)) break;
+    }
+    if (batch == NULL) {
+        if (numBatches == batchCapacity) {
+            size_t capacity = MAX(16, batchCapacity * 2);
+            DrawBatch* newBatches = realloc(batches, sizeof(DrawBatch) * capacity);
+            if (newBatches == NULL) return NULL;
+            memset(&newBatches[batchCapacity], 0, sizeof(DrawBatch) * (capacity - batchCapacity));
+            batches = newBatches;
+            batchCapacity = capacity;
+        }
+        batch = &batches[numBatches];
+        if (batch->state.image != state->image && batch->vertexCapacity > 0
+            && FLOATS_PER_VERTEX(&batch->state) < FLOATS_PER_VERTEX(state)) {
+            // The recycled vertex buffer is too small for the new vertex format.
+            free(batch->vertices);
+            batch->vertices = NULL;
+            batch->vertexCapacity = 0;
+        }
+        batch->state = *state;
+        retainClipRegion(batch->state.clip);
+        batch->bounds = *bounds;
+        batch->numVertices = 0;
+        batch->numIndices = 0;
+        numBatches++;
+    } else {
+        unionRect(&batch->bounds, bounds);
+    }
+    if (!reserveBatchSpace(batch, numVertices, numIndices)) {
+        LOG("Out of memory: Failed to grow the draw batch in %s!\n", __func__);
+        return NULL;
+    }
+    return batch;
+}
+
+static void addVertex(DrawBatch* batch, float x, float y, float s, float t, SDL_Color color) {
+    float* vertex = &batch->vertices[batch->numVertices * FLOATS_PER_VERTEX(&batch->state)];
+    *vertex++ = x;
+    *vertex++ = y;
+    if (batch->state.image != NULL) {
+        *vertex++ = s;
+        *vertex++ = t;
+    }
+    *vertex++ = color.r / 255.0f;
+    *vertex++ = color.g / 255.0f;
+    *vertex++ = color.b / 255.0f;
+    *vertex   = color.a / 255.0f;
+    batch->numVertices++;
+}
+
+static void checkFlushThreshold(size_t numVertices) {
+    numQueuedVertices += numVertices;
+    if (numQueuedVertices >= DISPLAY_LIST_FLUSH_THRESHOLD) {
+        flushDisplayList();
+    }
+}
+
+/*
+ * Queue a list of triangles. If the draw state has an image, it is repeated over the triangles
+ * with its top left corner at the origin.
+ */
+static Bool queueTriangleList(const DrawState* state, const float* points, size_t numPoints,
+                              SDL_Color color, float originX, float originY) {
+    const size_t maxChunkPoints = (DISPLAY_LIST_MAX_BATCH_VERTICES / 3) * 3;
+    size_t i, offset = 0;
+    numPoints -= numPoints % 3;
+    if (numPoints == 0 || IS_NOOP_RASTER_OP(state->function, state->planeMask)
+        || IS_CLIPPED_OUT(state)) {
+        return True;
+    }
+    float minX = points[0], minY = points[1], maxX = points[0], maxY = points[1];
+    for (i = 1; i < numPoints; i++) {
+        minX = MIN(minX, points[i * 2]);
+        maxX = MAX(maxX, points[i * 2]);
+        minY = MIN(minY, points[i * 2 + 1]);
+        maxY = MAX(maxY, points[i * 2 + 1]);
+    }
+    GPU_Rect bounds = {minX, minY, maxX - minX, maxY - minY};
+    while (offset < numPoints) {
+        size_t count = MIN(numPoints - offset, maxChunkPoints);
+        DrawBatch* batch = getBatch(state, &bounds, count, count);
+        if (batch == NULL) return False;
+        for (i = offset; i < offset + count; i++) {
+            float x = points[i * 2], y = points[i * 2 + 1];
+            batch->indices[batch->numIndices++] = (unsigned short) batch->numVertices;
+            addVertex(batch, x, y, TEXTURE_S(state, x - originX), TEXTURE_T(state, y - originY),
+                      color);
+        }
+        offset += count;
+    }
+    checkFlushThreshold(numPoints);
+    return True;
+}
+
+/*
+ * Queue a list of filled rectangles. If the draw state has an image, it is repeated over the
+ * rectangles with its top left corner at the origin.
+ */
+static Bool queueRectangleList(const DrawState* state, const GPU_Rect* rectangles,
+                               size_t numRectangles, SDL_Color color,
+                               float originX, float originY) {
+    size_t maxChunkRectangles = DISPLAY_LIST_MAX_BATCH_VERTICES / 4;
+    size_t i, offset = 0;
+    if (IS_NOOP_RASTER_OP(state->function, state->planeMask) || IS_CLIPPED_OUT(state)) {
+        return True;
+    }
+    if (isDestinationRasterOp(state->function, state->planeMask)) {
+        // The rectangles might overlap each other, so each must be checked against the batch.
+        maxChunkRectangles = 1;
+    }
+    while (offset < numRectangles) {
+        size_t count = MIN(numRectangles - offset, maxChunkRectangles);
+        GPU_Rect bounds = rectangles[offset];
+        for (i = offset + 1; i < offset + count; i++) {
+            unionRect(&bounds, &rectangles[i]);
+        }
+        DrawBatch* batch = getBatch(state, &bounds, count * 4, count * 6);
+        if (batch == NULL) return False;
+        for (i = offset; i < offset + count; i++) {
+            const GPU_Rect* rect = &rectangles[i];
+            float s1 = TEXTURE_S(state, rect->x - originX);
+            float t1 = TEXTURE_T(state, rect->y - originY);
+            float s2 = TEXTURE_S(state, rect->x + rect->w - originX);
+            float t2 = TEXTURE_T(state, rect->y + rect->h - originY);
+            unsigned short base = (unsigned short) batch->numVertices;
+            addVertex(batch, rect->x, rect->y, s1, t1, color);
+            addVertex(batch, rect->x + rect->w, rect->y, s2, t1, color);
+            addVertex(batch, rect->x + rect->w, rect->y + rect->h, s2, t2, color);
+            addVertex(batch, rect->x, rect->y + rect->h, s1, t2, color);
+            batch->indices[batch->numIndices++] = base;
+            batch->indices[batch->numIndices++] = base + (unsigned short) 1;
+            batch->indices[batch->numIndices++] = base + (unsigned short) 2;
+            batch->indices[batch->numIndices++] = base;
+            batch->indices[batch->numIndices++] = base + (unsigned short) 2;
+            batch->indices[batch->numIndices++] = base + (unsigned short) 3;
+        }
+        offset += count;
+    }
+    checkFlushThreshold(numRectangles * 4);
+    return True;
+}
+
+/*
+ * Queue a list of triangles. Every three consecutive points (x, y pairs) form one triangle.
+ */
+Bool queueTriangles(const DrawState* state, const float* points, size_t numPoints, SDL_Color color) {
+    return queueTriangleList(state, points, numPoints, color, 0, 0);
+}
+
+/*
+ * Queue a list of filled rectangles.
+ */
+Bool queueRectangles(const DrawState* state, const GPU_Rect* rectangles, size_t numRectangles,
+                     SDL_Color color) {
+    return queueRectangleList(state, rectangles, numRectangles, color, 0, 0);
+}
+
+/*
+ * Queue a list of triangles that are filled with the repeat-wrapped image of the draw state.
+ * The top left corner of the image is placed at the origin.
+ */
+Bool queueTiledTriangles(const DrawState* state, const float* points, size_t numPoints,
+                         float originX, float originY) {
+    SDL_Color color = state->plane != 0 ? state->planeForeground : state->image->color;
+    return queueTriangleList(state, points, numPoints, color, originX, originY);
+}
+
+/*
+ * Queue a list of rectangles that are filled with the repeat-wrapped image of the draw state.
+ * The top left corner of the image is placed at the origin.
+ */
+Bool queueTiledRectangles(const DrawState* state, const GPU_Rect* rectangles,
+                          size_t numRectangles, float originX, float originY) {
+    SDL_Color color = state->plane != 0 ? state->planeForeground : state->image->color;
+    return queueRectangleList(state, rectangles, numRectangles, color, originX, originY);
+}
+
+static Bool queueTexturedQuad(const DrawState* state, float x, float y, float w, float h,
+                              float s1, float t1, float s2, float t2) {
+    GPU_Rect bounds = {x, y, w, h};
+    SDL_Color color = state->plane != 0 ? state->planeForeground : state->image->color;
+    if (IS_NOOP_RASTER_OP(state->function, state->planeMask) || IS_CLIPPED_OUT(state)) {
+        return True;
+    }
+    DrawBatch* batch = getBatch(state, &bounds, 4, 6);
+    if (batch == NULL) return False;
+    unsigned short base = (unsigned short) batch->numVertices;
+    addVertex(batch, x, y, s1, t1, color);
+    addVertex(batch, x + w, y, s2, t1, color);
+    addVertex(batch, x + w, y + h, s2, t2, color);
+    addVertex(batch, x, y + h, s1, t2, color);
+    batch->indices[batch->numIndices++] = base;
+    batch->indices[batch->numIndices++] = base + (unsigned short) 1;
+    batch->indices[batch->numIndices++] = base + (unsigned short) 2;
+    batch->indices[batch->numIndices++] = base;
+    batch->indices[batch->numIndices++] = base + (unsigned short) 2;
+    batch->indices[batch->numIndices++] = base + (unsigned short) 3;
+    checkFlushThreshold(4);
+    return True;
+}
+
+/*
+ * Queue a blit of the sourceRect of the image of the draw state to x and y on the target.
+ * The source rectangle may exceed the image if the image wraps.
+ */
+Bool queueBlit(const DrawState* state, const GPU_Rect* sourceRect, float x, float y) {
+    GPU_Image* image = state->image;
+    return queueTexturedQuad(state, x, y, sourceRect->w, sourceRect->h,
+                             sourceRect->x / image->texture_w, sourceRect->y / image->texture_h,
+                             (sourceRect->x + sourceRect->w) / image->texture_w,
+                             (sourceRect->y + sourceRect->h) / image->texture_h);
+}
+
+/*
+ * Like queueBlit, but the rows of the source rectangle are stored bottom up in the image,
+ * like the rows of textures that were copied from a window framebuffer.
+ */
+Bool queueFlippedBlit(const DrawState* state, const GPU_Rect* sourceRect, float x, float y) {
+    GPU_Image* image = state->image;
+    return queueTexturedQuad(state, x, y, sourceRect->w, sourceRect->h,
+                             sourceRect->x / image->texture_w,
+                             (sourceRect->y + sourceRect->h) / image->texture_h,
+                             (sourceRect->x + sourceRect->w) / image->texture_w,
+                             sourceRect->y / image->texture_h);
+}
+
+/*
+ * Free the image and its target.
+ */
+static void freeImage(GPU_Image* image) {
+    if (getRenderBackend() != NULL) {
+        getRenderBackend()->freeImage(image);
+    }
+    if (image->target != NULL) {
+        freeClipStencil(image->target);
+        GPU_FreeTarget(image->target);
+        image->target = NULL;
+    }
+    GPU_FreeImage(image);
+}
+
+/*
+ * Free the image and its target once all queued commands that might use them have been
+ * executed. This does not wait for the render thread, the image is freed by the thread
+ * that executes the display list.
+ */
+Bool queueImageFree(GPU_Image* image) {
+    if (!insertArray(&pendingImageFrees, image)) {
+        flushDisplayList();
+        freeImage(image);
+    }
+    return True;
+}
+
+/*
+ * Check if there are queued commands that draw on the target.
+ */
+Bool hasPendingDraws(GPU_Target* target) {
+    size_t i;
+    for (i = 0; i < numBatches; i++) {
+        if (batches[i].state.target == target) return True;
+    }
+    return False;
+}
+
+/*
+ * Check if there are queued commands that sample the image.
+ */
+Bool hasPendingReads(GPU_Image* image) {
+    size_t i;
+    for (i = 0; i < numBatches; i++) {
+        if (batches[i].state.image == image) return True;
+    }
+    return False;
+}
+
+/*
+ * Flush the display list if it contains commands which sample the image.
+ * This must be called before the content of the image is changed directly.
+ */
+void flushDisplayListForImage(GPU_Image* image) {
+    if (hasPendingReads(image)) {
+        flushDisplayList();
+    }
+    syncRenderThread();
+    if (getRenderBackend() != NULL) {
+        getRenderBackend()->releaseImage(image);
+    }
+}
+
+/*
+ * Flush the display list if it contains commands which draw on the target.
+ * This must be called before the content of the target is read directly.
+ */
+void flushDisplayListForTarget(GPU_Target* target) {
+    if (hasPendingDraws(target)) {
+        flushDisplayList();
+    }
+    syncRenderThread();
+    if (getRenderBackend() != NULL && target->image != NULL) {
+        getRenderBackend()->uploadImage(target->image);
+    }
+}
+
+/*
+ * Replace the pixels in the rectangle of the image (or all pixels if it is NULL) with the
+ * RGBA pixels, after the queued commands that use the image have been executed.
+ */
+void updateImageBytes(GPU_Image* image, const GPU_Rect* rect, const Uint8* pixels, int pitch) {
+    if (hasPendingReads(image) || (image->target != NULL && hasPendingDraws(image->target))) {
+        flushDisplayList();
+    }
+    syncRenderThread();
+    if (getRenderBackend() != NULL
+        && getRenderBackend()->updateImage(image, rect, pixels, pitch)) {
+        return;
+    }
+    GPU_UpdateImageBytes(image, rect, pixels, pitch);
+}
+
+static void drawBatch(const DrawBatch* batch) {
+    GPU_TriangleBatch(batch->state.image, batch->state.target,
+                      (unsigned short) batch->numVertices, batch->vertices,
+                      (unsigned int) batch->numIndices, batch->indices,
+                      batch->state.image != NULL ? GPU_BATCH_XY_ST_RGBA : GPU_BATCH_XY_RGBA);
+}
+
+/*
+ * Draw the batch once for every rectangle of its clip region with the rectangle as the
+ * clip rectangle. This is the fallback for targets without a stencil buffer.
+ */
+static void drawBatchPerClipRectangle(const DrawBatch* batch) {
+    const DrawState* state = &batch->state;
+    int numRects, i;
+    pixman_box16_t* boxes = pixman_region_rectangles(&state->clip->region, &numRects);
+    for (i = 0; i < numRects; i++) {
+        float x1 = MAX(state->viewport.x + boxes[i].x1, state->clipRect.x);
+        float y1 = MAX(state->viewport.y + boxes[i].y1, state->clipRect.y);
+        float x2 = MIN(state->viewport.x + boxes[i].x2, state->clipRect.x + state->clipRect.w);
+        float y2 = MIN(state->viewport.y + boxes[i].y2, state->clipRect.y + state->clipRect.h);
+        if (x1 >= x2 || y1 >= y2) continue;
+        setRenderTargetClip(state->target, True, GPU_MakeRect(x1, y1, x2 - x1, y2 - y1));
+        drawBatch(batch);
+    }
+}
+
+/*
+ * Merge the overlapping triangles of a single draw batch on the CPU, for targets and backends
+ * without a stencil buffer. The batch holds the triangle list of a single command, whose
+ * vertices have the same color and texture coordinates that follow the position.
+ */
+static void mergeBatchTriangles(DrawBatch* batch) {
+    size_t floatsPerVertex = FLOATS_PER_VERTEX(&batch->state), i;
+    float first[8];
+    TriangleList triangles = {NULL, 0, 0};
+    if (batch->numIndices <= 3) return;
+    if (!reserveTriangleList(&triangles, batch->numIndices)) {
+        LOG("Out of memory: Failed to merge the triangles of a single draw!\n");
+        return;
+    }
+    for (i = 0; i < batch->numIndices; i++) {
+        const float* vertex = &batch->vertices[batch->indices[i] * floatsPerVertex];
+        triangles.points[i * 2] = vertex[0];
+        triangles.points[i * 2 + 1] = vertex[1];
+    }
+    triangles.numPoints = batch->numIndices;
+    if (!mergeTriangles(&triangles, 0) || triangles.numPoints > DISPLAY_LIST_MAX_BATCH_VERTICES) {
+        LOG("Failed to merge the triangles of a single draw, overlapping pixels are drawn "
+            "more than once\n");
+        freeTriangleList(&triangles);
+        return;
+    }
+    memcpy(first, batch->vertices, sizeof(float) * floatsPerVertex);
+    batch->numVertices = batch->numIndices = 0;
+    if (!reserveBatchSpace(batch, triangles.numPoints, triangles.numPoints)) {
+        LOG("Out of memory: Failed to merge the triangles of a single draw!\n");
+        freeTriangleList(&triangles);
+        return;
+    }
+    for (i = 0; i < triangles.numPoints; i++) {
+        float* vertex = &batch->vertices[i * floatsPerVertex];
+        memcpy(vertex, first, sizeof(float) * floatsPerVertex);
+        vertex[0] = triangles.points[i * 2];
+        vertex[1] = triangles.points[i * 2 + 1];
+        if (batch->state.image != NULL) {
+            vertex[2] = first[2] + TEXTURE_S(&batch->state, vertex[0] - first[0]);
+            vertex[3] = first[3] + TEXTURE_T(&batch->state, vertex[1] - first[1]);
+        }
+        batch->indices[i] = (unsigned short) i;
+    }
+    batch->numVertices = batch->numIndices = triangles.numPoints;
+    freeTriangleList(&triangles);
+}
+
+static void executeBatch(DrawBatch* batch) {
+    static GPU_Target* lastTarget = NULL;
+    batch->executed = True;
+    if (batch->numIndices == 0) return;
+    if (batch->state.target != lastTarget) {
+        getRenderStateCounters()->targetSwitches++;
+        lastTarget = batch->state.target;
+    }
+    if (isFramebufferExported()) {
+        GPU_Rect damage = {batch->state.viewport.x + batch->bounds.x,
+                           batch->state.viewport.y + batch->bounds.y,
+                           batch->bounds.w, batch->bounds.h};
+        addHeadlessDamage(batch->state.target, &damage);
+    }
+    // The drawing requests do not make the context of their target current.
+    if (GPU_GetContextTarget() == NULL && batch->state.target->context != NULL) {
+        makeRenderTargetCurrent(batch->state.target, batch->state.target->context->windowID);
+    }
+    const RenderBackend* backend = getRenderBackend();
+    if (backend != NULL) {
+        if (batch->state.singleDraw) {
+            mergeBatchTriangles(batch);
+        }
+        if (backend->drawBatch(&batch->state, batch->vertices, batch->numVertices,
+                               batch->indices, batch->numIndices)) {
+            getRenderStateCounters()->backendBatches++;
+            return;
+        }
+        // SDL_gpu must see what the backend has drawn on the images of the batch
+        // and the backend must not keep a copy of the target that SDL_gpu draws on.
+        if (batch->state.target->image != NULL) {
+            backend->releaseImage(batch->state.target->image);
+        }
+        if (batch->state.image != NULL) {
+            backend->uploadImage(batch->state.image);
+        }
+    }
+    setRenderTargetViewport(batch->state.target, batch->state.viewport);
+    setRenderTargetClip(batch->state.target, batch->state.useClipRect, batch->state.clipRect);
+    Bool isStencilClip = batch->state.clip != NULL && beginStencilClip(
+            batch->state.target, &batch->state.viewport, batch->state.clip);
+    Bool isSingleDraw = batch->state.singleDraw && backend == NULL
+                        && (batch->state.clip == NULL || isStencilClip)
+                        && beginSingleDraw(batch->state.target, &batch->bounds, isStencilClip);
+    if (batch->state.singleDraw && backend == NULL && !isSingleDraw) {
+        mergeBatchTriangles(batch);
+    }
+    GPU_Rect area = {batch->state.viewport.x + batch->bounds.x,
+                     batch->state.viewport.y + batch->bounds.y,
+                     batch->bounds.w, batch->bounds.h};
+    Bool isDestinationOp = isDestinationRasterOp(batch->state.function, batch->state.planeMask)
+                           && beginDestinationRasterOp(
+            batch->state.target, &area, batch->state.function, batch->state.planeMask,
+            batch->state.image, batch->state.plane, batch->state.planeBackground,
+            batch->state.planeBackgroundMode);
+    Bool isPlaneShader = !isDestinationOp && batch->state.plane != 0 && beginPlaneShader(
+            batch->state.plane, batch->state.planeBackground,
+            batch->state.planeBackgroundMode);
+    Bool isRasterOp = !isDestinationOp && beginRasterOp(
+            batch->state.function, batch->state.planeMask, batch->state.image,
+            batch->vertices, batch->numVertices, FLOATS_PER_VERTEX(&batch->state));
+    if (batch->state.clip != NULL && !isStencilClip) {
+        drawBatchPerClipRectangle(batch);
+    } else {
+        drawBatch(batch);
+    }
+    if (isDestinationOp) {
+        endDestinationRasterOp(batch->state.image);
+    }
+    if (isSingleDraw) {
+        endSingleDraw(isStencilClip);
+    }
+    if (isRasterOp) {
+        endRasterOp(batch->state.function, batch->state.planeMask, batch->state.image);
+    }
+    if (isPlaneShader) {
+        endPlaneShader();
+    }
+    if (isStencilClip) {
+        endStencilClip();
+    }
+}
+
+/*
+ * Check if the later batch must be executed after the earlier batch, because one of them
+ * samples the target of the other or because they draw on the same target.
+ */
+static Bool dependsOn(const DrawBatch* later, const DrawBatch* earlier) {
+    if (later->state.target == earlier->state.target) return True;
+    if (earlier->state.image != NULL && earlier->state.image == later->state.target->image) {
+        return True;
+    }
+    return later->state.image != NULL && later->state.image == earlier->state.target->image;
+}
+
+/*
+ * Execute all commands of the flushed display list and schedule the present of every target
+ * that was drawn on.
+ * To avoid switching the render target more often than necessary, the batches of a target
+ * are executed together, unless a batch depends on a batch of another target in between.
+ */
+static void executeDisplayList(void* data) {
+    FlushedDisplayList* list = data;
+    DrawBatch* batchList = list->batches;
+    size_t i, j, k, count = list->numBatches;
+    useHeadlessWindows(&list->windows);
+    for (i = 0; i < count; i++) {
+        batchList[i].executed = False;
+    }
+    for (i = 0; i < count; i++) {
+        if (batchList[i].executed) continue;
+        // All batches before this one were executed, so it can always be executed.
+        executeBatch(&batchList[i]);
+        for (j = i + 1; j < count; j++) {
+            if (batchList[j].executed || batchList[j].state.target != batchList[i].state.target) {
+                continue;
+            }
+            for (k = i + 1; k < j && (batchList[k].executed
+                                      || !dependsOn(&batchList[j], &batchList[k])); k++);
+            if (k == j) {
+                executeBatch(&batchList[j]);
+            }
+        }
+    }
+    if (getRenderBackend() != NULL) {
+        getRenderBackend()->releaseAllImages(True);
+    }
+    // The window targets must be read back before their back buffers are swapped.
+    updateHeadlessFramebuffer();
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < i && batchList[j].state.target != batchList[i].state.target; j++);
+        if (j == i) {
+            schedulePresent(batchList[i].state.target);
+        }
+    }
+    // Windows that were not drawn on might have a deferred present that is due now.
+    presentScheduledFrames(False);
+    invalidateWindowClipStencils();
+    for (i = 0; i < list->imageFrees.length; i++) {
+        freeImage(list->imageFrees.array[i]);
+    }
+    list->imageFrees.length = 0;
+    logRenderStateCounters();
+}
+
+/*
+ * Release the resources of the executed display list on the client thread.
+ */
+static void finishDisplayList(void* data) {
+    FlushedDisplayList* list = data;
+    size_t i;
+    for (i = 0; i < list->numBatches; i++) {
+        releaseClipRegion(list->batches[i].state.clip);
+        list->batches[i].state.clip = NULL;
+    }
+    list->numBatches = 0;
+}
+
+/*
+ * Move the queued commands into the next flushed display list and start recording into the
+ * empty list that it held before. Returns the flushed list.
+ */
+static FlushedDisplayList* swapDisplayLists() {
+    FlushedDisplayList* list = &flushedLists[numFlushedLists++ % (RENDER_QUEUE_SIZE + 1)];
+    DrawBatch* swappedBatches = list->batches;
+    size_t swappedCapacity = list->batchCapacity;
+    Array swappedImageFrees = list->imageFrees;
+    LOG("Flushing display list: %lu batches, %lu vertices\n",
+        (unsigned long) numBatches, (unsigned long) numQueuedVertices);
+    list->batches = batches;
+    list->numBatches = numBatches;
+    list->batchCapacity = batchCapacity;
+    list->imageFrees = pendingImageFrees;
+    batches = swappedBatches;
+    batchCapacity = swappedCapacity;
+    pendingImageFrees = swappedImageFrees;
+    numBatches = 0;
+    numQueuedVertices = 0;
+    // The client might change the windows while the render thread composes them.
+    recordHeadlessWindows(&list->windows);
+    if (isRenderThreadEnabled()) {
+        logRenderStateCounters();
+    }
+    return list;
+}
+
+/*
+ * Execute all queued commands in order and present every target that was drawn on.
+ * The commands have been executed once this returns.
+ */
+void flushDisplayList() {
+    syncRenderThread();
+    completeReadbacks(False);
+    if (numBatches == 0 && pendingImageFrees.length == 0) {
+        presentScheduledFrames(False);
+        return;
+    }
+    FlushedDisplayList* list = swapDisplayLists();
+    executeDisplayList(list);
+    finishDisplayList(list);
+}
+
+/*
+ * Flush the queued commands without waiting for their execution. If the render thread is
+ * enabled, it executes the commands while the client continues and records the next lists,
+ * otherwise this is the same as flushDisplayList.
+ */
+void submitDisplayList() {
+    if (!isRenderThreadEnabled()) {
+        flushDisplayList();
+        return;
+    }
+    if (numBatches == 0 && pendingImageFrees.length == 0) {
+        // Deferred presents must be executed even if the client stops drawing.
+        // A list that is still executed handles them when it is done.
+        if (!isRenderThreadBusy() && hasDeferredPresents()) {
+            flushDisplayList();
+        }
+        return;
+    }
+    FlushedDisplayList* list = swapDisplayLists();
+    if (!submitRenderJob(executeDisplayList, finishDisplayList, list)) {
+        syncRenderThread();
+        executeDisplayList(list);
+        finishDisplayList(list);
+    }
+}
+
+void freeDisplayList() {
+    size_t i;
+    flushDisplayList();
+    if (getRenderBackend() != NULL) {
+        getRenderBackend()->releaseAllImages(False);
+    }
+    for (i = 0; i < batchCapacity; i++) {
+        free(batches[i].vertices);
+        free(batches[i].indices);
+    }
+    free(batches);
+    batches = NULL;
+    numBatches = batchCapacity = 0;
+    freeArray(&pendingImageFrees);
+    for (i = 0; i < RENDER_QUEUE_SIZE + 1; i++) {
+        FlushedDisplayList* list = &flushedLists[i];
+        size_t j;
+        for (j = 0; j < list->batchCapacity; j++) {
+            free(list->batches[j].vertices);
+            free(list->batches[j].indices);
+        }
+        free(list->batches);
+        list->batches = NULL;
+        list->numBatches = list->batchCapacity = 0;
+        freeArray(&list->imageFrees);
+        freeHeadlessWindows(&list->windows);
+    }
+    numFlushedLists = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef _DISPLAY_LIST_H_
+#define _DISPLAY_LIST_H_
+
+#include "SDL.h"
+#include <SDL_gpu.h>
+#include "X11/Xlib.h"
+#include "clip.h"
+#include "planeShader.h"
+
+/* Flush the display list once this many vertices are queued. */
+#define DISPLAY_LIST_FLUSH_THRESHOLD (1 << 16)
+/* The maximum number of vertices in one batch (limited by the 16 bit indices). */
+#define DISPLAY_LIST_MAX_BATCH_VERTICES 0xFFFF
+/* How many batches are searched backwards for a batch that a new command can join. */
+#define DISPLAY_LIST_SEARCH_DEPTH 32
+
+/* The resolved GPU state a queued draw command is executed with. */
+typedef struct {
+    /* The target to draw on. */
+    GPU_Target* target;
+    /* The viewport of the target at the time the command was recorded. */
+    GPU_Rect viewport;
+    /* The clip rectangle of the target at the time the command was recorded. */
+    GPU_Rect clipRect;
+    Bool useClipRect;
+    /* The texture that is sampled by the command or NULL for untextured geometry. */
+    GPU_Image* image;
+    /* The GC function and plane mask the command is drawn with. */
+    int function;
+    unsigned long planeMask;
+    /* The clip region if the command is clipped to more than one rectangle or NULL. */
+    ClipRegion* clip;
+    /* The bit plane of the image that selects between the plane colors or 0 to draw the image. */
+    unsigned long plane;
+    SDL_Color planeForeground;
+    SDL_Color planeBackground;
+    PlaneBackgroundMode planeBackgroundMode;
+    /*
+     * Whether the triangles of the command must draw every pixel only once, because they
+     * overlap and overdraw would be visible. Such commands don't join other commands.
+     */
+    Bool singleDraw;
+} DrawState;
+
+void initDrawState(DrawState* state, GPU_Target* target, GPU_Image* image);
+void setDrawStateClip(DrawState* state, ClipRegion* clip);
+void setDrawStatePlane(DrawState* state, unsigned long plane, SDL_Color foreground,
+                       SDL_Color background, PlaneBackgroundMode backgroundMode);
+Bool queueTriangles(const DrawState* state, const float* points, size_t numPoints, SDL_Color color);
+Bool queueRectangles(const DrawState* state, const GPU_Rect* rectangles, size_t numRectangles,
+                     SDL_Color color);
+Bool queueTiledTriangles(const DrawState* state, const float* points, size_t numPoints,
+                         float originX, float originY);
+Bool queueTiledRectangles(const DrawState* state, const GPU_Rect* rectangles,
+                          size_t numRectangles, float originX, float originY);
+Bool queueBlit(const DrawState* state, const GPU_Rect* sourceRect, float x, float y);
+Bool queueFlippedBlit(const DrawState* state, const GPU_Rect* sourceRect, float x, float y);
+Bool queueImageFree(GPU_Image* image);
+Bool hasPendingDraws(GPU_Target* target);
+Bool hasPendingReads(GPU_Image* image);
+void flushDisplayListForTarget(GPU_Target* target);
+void flushDisplayListForImage(GPU_Image* image);
+void updateImageBytes(GPU_Image* image, const GPU_Rect* rect, const Uint8* pixels, int pitch);
+void flushDisplayList(void);
+void submitDisplayList(void);
+void freeDisplayList(void);
+
+#endif /* _DISPLAY_LIST_H_ */
@@ -6,19 +6,40 @@
 #include "display.h"
 #include "util.h"
 #include "gc.h"
+#include "arc.h"
+#include "line.h"
+#include "polygon.h"
+#include "planeShader.h"
+#include "rasterOp.h"
+#include "colors.h"
+#include "events.h"
+#include "pixman.h"
+#include "glFunctions.h"
+#include "renderThread.h"
+#include "presentScheduler.h"
+#include "pixmanBackend.h"
 
+/* The render state counters of the client thread and of the render thread. */
+static RenderStateCounters clientCounters = {0};
+static RenderStateCounters renderThreadCounters = {0};
+/* The scratch image of XCopyArea. */
+static GPU_Image* copyScratchImage = NULL;
 /*
- * Flip all screen children and cause them to draw their content to the screen.
+ * The viewport and clip rectangle of the target that GET_RENDER_TARGET returned last.
+ * The state of the target itself belongs to the code that executes the display list, which
+ * might be the render thread, so the drawing requests record their own copy.
+ */
+static GPU_Target* viewTarget = NULL;
+static GPU_Rect viewViewport = {0, 0, 0, 0};
+static GPU_Rect viewClipRect = {0, 0, 0, 0};
+
+/*
+ * Execute all queued drawing requests and present every window that was drawn on,
+ * including the presents that the present scheduler deferred.
  */
 void flipScreen() {
-    Window* children = GET_CHILDREN(SCREEN_WINDOW);
-    size_t i;
-    for (i = 0; i < GET_WINDOW_STRUCT(SCREEN_WINDOW)->children.length; i++) {
-        if (GET_WINDOW_STRUCT(children[i])->renderTarget != NULL) {
-            GPU_Target* target = GET_WINDOW_STRUCT(children[i])->renderTarget;
-            GPU_Flip(target);
-        }
-    }
+    flushDisplayList();
+    presentScheduledFrames(True);
 #ifdef DEBUG_WINDOWS
 //    printWindowsHierarchy();
 //    drawWindowsDebugSurfacePlane();
@@ -27,17 +48,19 @@ void flipScreen() {
 }
 
 /*
- * Get a render target for this window. If this window is unmapped, a render target to
- * its own unmappedContent image is returned. If the window is a mapped top level window,
+ * Get a render target for drawing requests on this window. If this window is unmapped, a render
+ * target to its own unmappedContent image is returned. If the window is a mapped top level window,
  * then the target to the window is returned. If None of the above applies to the given
  * window, a parent of the window is searched that meets the requirements. The render
- * target of that parent is then returned, but with the correct viewport of the original
- * window.
+ * target of that parent is then returned, and the viewport and clip rectangle of the
+ * original window are recorded for getRenderTargetView. The state of the target is not changed,
+ * so this does not wait for the render thread unless the target has to be created.
  */
-GPU_Target* getWindowRenderTarget(Window window) {
+GPU_Target* getWindowDrawTarget(Window window) {
     Window targetWindow = window;
     int x = 0, y = 0, w = 0, h = 0;
     GPU_Rect clipRect = {0, 0, 0, 0};
+    viewTarget = NULL;
     GET_WINDOW_DIMS(window, clipRect.w, clipRect.h);
     while (GET_PARENT(targetWindow) != None && GET_WINDOW_STRUCT(targetWindow)->sdlWindow == NULL
            && GET_WINDOW_STRUCT(targetWindow)->mapState != UnMapped) {
@@ -58,6 +81,10 @@ GPU_Target* getWindowRenderTarget(Window window) {
     }
     WindowStruct* windowStruct = GET_WINDOW_STRUCT(targetWindow);
     if (windowStruct->mapState == UnMapped) {
+        if (windowStruct->unmappedContent == NULL || windowStruct->renderTarget == NULL) {
+            // The render thread must not use the GPU while the target is created.
+            syncRenderThread();
+        }
         if (windowStruct->unmappedContent == NULL) {
             windowStruct->unmappedContent = GPU_CreateImage((Uint16) windowStruct->w,
                                                             (Uint16) windowStruct->h,
@@ -82,24 +109,262 @@ GPU_Target* getWindowRenderTarget(Window window) {
                 window, SDL_GetWindowID(windowStruct->sdlWindow), __func__);
             return NULL;
         }
-        if (GPU_GetContextTarget() == NULL) {
-            GPU_MakeCurrent(windowStruct->renderTarget, SDL_GetWindowID(windowStruct->sdlWindow));
-        }
     } else {
         LOG("Failed to find a render target in %s for window %lu!\n", __func__, window);
         return NULL;
     }
-    GPU_SetClipRect(windowStruct->renderTarget, clipRect);
-    GPU_Rect viewPort;
-    viewPort.x = clipRect.x;
-    viewPort.y = clipRect.y;
-    GET_WINDOW_DIMS(SCREEN_WINDOW, viewPort.w, viewPort.h);
-    GPU_SetViewport(windowStruct->renderTarget, viewPort);
+    viewTarget = windowStruct->renderTarget;
+    viewClipRect = clipRect;
+    viewViewport.x = clipRect.x;
+    viewViewport.y = clipRect.y;
+    GET_WINDOW_DIMS(SCREEN_WINDOW, viewViewport.w, viewViewport.h);
     LOG("Render viewport is {x = %d, y = %d, w = %d, h = %d}\n",
-        (int) viewPort.x, (int) viewPort.y, (int) viewPort.w, (int) viewPort.h);
+        (int) viewViewport.x, (int) viewViewport.y, (int) viewViewport.w, (int) viewViewport.h);
     return windowStruct->renderTarget;
 }
 
+/*
+ * Get the render target of the window like getWindowDrawTarget, for drawing on it directly.
+ * This waits for the render thread and applies the viewport and clip rectangle of the window
+ * to the target.
+ */
+GPU_Target* getWindowRenderTarget(Window window) {
+    syncRenderThread();
+    GPU_Target* target = getWindowDrawTarget(window);
+    if (target == NULL) return NULL;
+    // Offscreen targets of the headless mode have no context of their own.
+    if (GPU_GetContextTarget() == NULL && target->context != NULL) {
+        makeRenderTargetCurrent(target, target->context->windowID);
+    }
+    setRenderTargetClip(target, True, viewClipRect);
+    setRenderTargetViewport(target, viewViewport);
+    return target;
+}
+
+/*
+ * Get the render target of the pixmap for drawing requests. Pixmaps are drawn on as a whole.
+ */
+GPU_Target* getPixmapDrawTarget(Pixmap pixmap) {
+    viewTarget = NULL;
+    return GET_PIXMAP_IMAGE(pixmap)->target;
+}
+
+/*
+ * Get the viewport and clip rectangle that drawing requests on the target must use.
+ * These are the ones of the window that GET_RENDER_TARGET returned the target for last,
+ * or the whole target for all other targets.
+ */
+void getRenderTargetView(GPU_Target* target, GPU_Rect* viewport, GPU_Rect* clipRect,
+                         Bool* useClipRect) {
+    if (target == viewTarget) {
+        *viewport = viewViewport;
+        *clipRect = viewClipRect;
+        *useClipRect = True;
+        return;
+    }
+    *viewport = GPU_MakeRect(0, 0, target->w, target->h);
+    *clipRect = *viewport;
+    *useClipRect = False;
+}
+
+/*
+ * Get the render state counters of the calling thread.
+ */
+RenderStateCounters* getRenderStateCounters() {
+    return isRenderThread() ? &renderThreadCounters : &clientCounters;
+}
+
+/*
+ * Log and reset the render state counters of the calling thread.
+ */
+void logRenderStateCounters() {
+    RenderStateCounters* counters = getRenderStateCounters();
+    LOG("Render state changes on the %s thread: %lu GC switches, %lu GC value updates, "
+        "%lu target state changes, %lu skipped target state changes, %lu stencil clip builds, "
+        "%lu target switches, %lu context switches, %lu skipped context switches, "
+        "%lu backend batches\n", counters == &renderThreadCounters ? "render" : "client",
+        counters->gcSwitches, counters->gcValueUpdates,
+        counters->targetStateChanges, counters->skippedTargetStateChanges,
+        counters->stencilClipBuilds, counters->targetSwitches,
+        counters->contextSwitches, counters->skippedContextSwitches,
+        counters->backendBatches);
+    memset(counters, 0, sizeof(RenderStateCounters));
+}
+
+/*
+ * Make the context of the target current for the window, unless it already is.
+ */
+void makeRenderTargetCurrent(GPU_Target* target, Uint32 windowId) {
+    GPU_Target* contextTarget = GPU_GetContextTarget();
+    if (contextTarget != NULL && contextTarget->context == target->context
+        && target->context->windowID == windowId) {
+        getRenderStateCounters()->skippedContextSwitches++;
+        return;
+    }
+    getRenderStateCounters()->contextSwitches++;
+    GPU_MakeCurrent(target, windowId);
+}
+
+/*
+ * Set the viewport of the target, unless it already has this viewport.
+ */
+void setRenderTargetViewport(GPU_Target* target, GPU_Rect viewport) {
+    if (target->viewport.x == viewport.x && target->viewport.y == viewport.y
+        && target->viewport.w == viewport.w && target->viewport.h == viewport.h) {
+        getRenderStateCounters()->skippedTargetStateChanges++;
+        return;
+    }
+    getRenderStateCounters()->targetStateChanges++;
+    GPU_SetViewport(target, viewport);
+}
+
+/*
+ * Set or unset the clip rectangle of the target, unless it is already in this state.
+ */
+void setRenderTargetClip(GPU_Target* target, Bool useClipRect, GPU_Rect clipRect) {
+    if (!useClipRect) {
+        if (!target->use_clip_rect) {
+            getRenderStateCounters()->skippedTargetStateChanges++;
+            return;
+        }
+        getRenderStateCounters()->targetStateChanges++;
+        GPU_UnsetClip(target);
+        return;
+    }
+    if (target->use_clip_rect && target->clip_rect.x == clipRect.x
+        && target->clip_rect.y == clipRect.y && target->clip_rect.w == clipRect.w
+        && target->clip_rect.h == clipRect.h) {
+        getRenderStateCounters()->skippedTargetStateChanges++;
+        return;
+    }
+    getRenderStateCounters()->targetStateChanges++;
+    GPU_SetClipRect(target, clipRect);
+}
+
+/*
+ * Initialize the draw state of a fill with the fill style of the graphic context.
+ * Returns False if the texture of the tile or stipple could not be created.
+ */
+static Bool initFillDrawState(DrawState* drawState, GPU_Target* target, GraphicContext* gContext) {
+    static Bool reportedStippleFunction = False;
+    GPU_Image* fillImage = NULL;
+    if (gContext->fillStyle == FillStippled
+        && !IS_COPY_RASTER_OP(gContext->function, gContext->planeMask)) {
+        // The GC function would also combine the transparent pixels of the fill image with
+        // the destination, so the unset bits of the stipple are discarded by the plane shader
+        // or the CPU rasterizer of the render backend. Its set bits have an opaque alpha.
+        if (getRenderBackend() != NULL || isPlaneShaderAvailable()) {
+            fillImage = getGCStippleImage(gContext);
+            if (fillImage == NULL) return False;
+            initGCDrawState(drawState, target, fillImage, gContext);
+            setDrawStatePlane(drawState, 1UL << ALPHA_SHIFT, gContext->foregroundColor,
+                              gContext->backgroundColor, PLANE_BACKGROUND_TRANSPARENT);
+            return True;
+        }
+        if (!reportedStippleFunction) {
+            LOG("The plane shader is not available, stippled fills with GC function %d "
+                "also change the pixels of the unset stipple bits\n", gContext->function);
+            reportedStippleFunction = True;
+        }
+    }
+    if (gContext->fillStyle != FillSolid) {
+        fillImage = getGCFillImage(gContext);
+        if (fillImage == NULL) return False;
+    }
+    initGCDrawState(drawState, target, fillImage, gContext);
+    return True;
+}
+
+/*
+ * Queue filled triangles with the fill style of the graphic context.
+ * The tile or stipple is aligned to the tile-stipple origin of the graphic context.
+ */
+static Bool queueFillTriangles(const DrawState* drawState, const GraphicContext* gContext,
+                               const float* points, size_t numPoints) {
+    if (drawState->image == NULL) {
+        return queueTriangles(drawState, points, numPoints, gContext->foregroundColor);
+    }
+    return queueTiledTriangles(drawState, points, numPoints,
+                               gContext->tileStipOriginX, gContext->tileStipOriginY);
+}
+
+/*
+ * Queue the tessellated lines and empty the triangle lists. The on triangles are filled with
+ * the fill style of the graphic context, the off triangles with the background color.
+ */
+static Bool queueLineTriangles(GPU_Target* target, GraphicContext* gContext, Bool singleDraw,
+                               TriangleList* onTriangles, TriangleList* offTriangles) {
+    DrawState drawState;
+    Bool success = True;
+    if (onTriangles->numPoints > 0) {
+        success = initFillDrawState(&drawState, target, gContext);
+        drawState.singleDraw = singleDraw;
+        success = success && queueFillTriangles(&drawState, gContext, onTriangles->points,
+                                                onTriangles->numPoints);
+    }
+    if (success && offTriangles->numPoints > 0) {
+        initGCDrawState(&drawState, target, NULL, gContext);
+        drawState.singleDraw = singleDraw;
+        success = queueTriangles(&drawState, offTriangles->points, offTriangles->numPoints,
+                                 gContext->backgroundColor);
+    }
+    onTriangles->numPoints = offTriangles->numPoints = 0;
+    return success;
+}
+
+/*
+ * Tessellate and queue lines with the line attributes of the graphic context. The points are
+ * split into polylines of pointsPerLine points, the dash pattern starts anew for each of them.
+ * The segments, joins and caps of a polyline overlap, but X draws each of its pixels only once.
+ * That is only visible if the pixels are combined with the destination, so only then every
+ * polyline is queued as a single draw on its own, otherwise all lines are queued together.
+ */
+static int drawLines(Display* display, Drawable d, GC gc, const XPoint* points, size_t numPoints,
+                     size_t pointsPerLine, int mode) {
+    GPU_Target* renderTarget;
+    GET_RENDER_TARGET(d, renderTarget);
+    if (renderTarget == NULL) {
+        LOG("Failed to get the render target of %lu in %s\n", d, __func__);
+        handleError(0, display, d, 0, BadDrawable, 0);
+        return 0;
+    }
+    GraphicContext* gContext = getResolvedGC(gc);
+    LineStyle lineStyle;
+    lineStyle.lineWidth = (unsigned int) MAX(0, gContext->lineWidth);
+    lineStyle.lineStyle = gContext->lineStyle;
+    lineStyle.capStyle = gContext->capStyle;
+    lineStyle.joinStyle = gContext->joinStyle;
+    lineStyle.dashes = gContext->dashes;
+    lineStyle.numDashes = gContext->numDashes;
+    Bool singleDraw = pointsPerLine > 2
+                      && (!IS_COPY_RASTER_OP(gContext->function, gContext->planeMask)
+                          || gContext->foregroundColor.a != 0xFF
+                          || (gContext->lineStyle == LineDoubleDash
+                              && gContext->backgroundColor.a != 0xFF));
+    TriangleList onTriangles = {NULL, 0, 0}, offTriangles = {NULL, 0, 0};
+    Bool success = True;
+    size_t i;
+    for (i = 0; i < numPoints && success; i += pointsPerLine) {
+        float dashPosition = gContext->dashOffset;
+        success = tessellateLines(&lineStyle, &points[i], MIN(pointsPerLine, numPoints - i), mode,
+                                  &dashPosition, &onTriangles, &offTriangles);
+        if (success && singleDraw) {
+            success = queueLineTriangles(renderTarget, gContext, True, &onTriangles,
+                                         &offTriangles);
+        }
+    }
+    if (success) {
+        success = queueLineTriangles(renderTarget, gContext, False, &onTriangles, &offTriangles);
+    }
+    freeTriangleList(&onTriangles);
+    freeTriangleList(&offTriangles);
+    if (!success) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    return 1;
+}
+
 int XFillPolygon(Display* display, Drawable d, GC gc, XPoint *points, int npoints, int shape, int mode) {
     // https://tronche.com/gui/x/xlib/graphics/filling-areas/XFillPolygon.html
     SET_X_SERVER_REQUEST(display, X_FillPoly);
@@ -116,55 +381,136 @@ int XFillPolygon(Display* display, Drawable d, GC gc, XPoint *points, int npoint
         handleError(0, display, d, 0, BadDrawable, 0);
         return 0;
     }
-    float* fPoints = malloc(sizeof(float) * npoints * 2);
-    if (fPoints == NULL) {
+    if (shape != Complex && shape != Nonconvex && shape != Convex) {
+        LOG("BadValue: Invalid shape %d in %s\n", shape, __func__);
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    if (mode != CoordModeOrigin && mode != CoordModePrevious) {
+        LOG("BadValue: Invalid coordinate mode %d in %s\n", mode, __func__);
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GraphicContext* gContext = getResolvedGC(gc);
+    TriangleList triangles = {NULL, 0, 0};
+    if (!tessellatePolygon(points, (size_t) npoints, shape, mode, gContext->fillRule,
+                           &triangles)) {
+        freeTriangleList(&triangles);
         handleOutOfMemory(0, display, 0, 0);
         return 0;
     }
-    GraphicContext* gContext = GET_GC(gc);
-    GPU_SetLineThickness(gContext->lineWidth);
-    SDL_Color drawColor = {
-            GET_RED_FROM_COLOR(gContext->foreground),
-            GET_GREEN_FROM_COLOR(gContext->foreground),
-            GET_BLUE_FROM_COLOR(gContext->foreground),
-            GET_ALPHA_FROM_COLOR(gContext->foreground),
-    };
-    size_t i;
-    fPoints[0] = points[0].x;
-    fPoints[1] = points[0].y;
-    for (i = 2; i < npoints * 2; i += 2) {
-        if (mode == CoordModePrevious) {
-            fPoints[i]     = fPoints[i - 2] + points[i].x;
-            fPoints[i + 1] = fPoints[i - 1] + points[i].y;
-        } else {
-            fPoints[i]     = points[i].x;
-            fPoints[i + 1] = points[i].y;
+    DrawState drawState;
+    Bool success = initFillDrawState(&drawState, renderTarget, gContext)
+                   && queueFillTriangles(&drawState, gContext, triangles.points,
+                                         triangles.numPoints);
+    freeTriangleList(&triangles);
+    if (!success) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Tessellate all arcs and queue their triangles as one submission.
+ */
+static int drawArcs(Display* display, Drawable d, GC gc, XArc* arcs, int narcs, Bool filled) {
+    TYPE_CHECK(d, DRAWABLE, display, 0);
+    if (narcs < 0) {
+        LOG("Invalid number of arcs in %s: %d\n", __func__, narcs);
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GPU_Target* renderTarget;
+    GET_RENDER_TARGET(d, renderTarget);
+    if (renderTarget == NULL) {
+        LOG("Failed to get the render target of %lu in %s\n", d, __func__);
+        handleError(0, display, d, 0, BadDrawable, 0);
+        return 0;
+    }
+    GraphicContext* gContext = getResolvedGC(gc);
+    float* fPoints = NULL;
+    size_t numPoints = 0, capacity = 0;
+    int i;
+    for (i = 0; i < narcs; i++) {
+        if (arcs[i].angle2 == 0) continue;
+        size_t numArcPoints, j;
+        const float* arcPoints = getArcTriangles(arcs[i].width, arcs[i].height, arcs[i].angle1,
+                                                 arcs[i].angle2, filled, gContext->arcMode,
+                                                 (unsigned int) gContext->lineWidth, &numArcPoints);
+        if (arcPoints == NULL) {
+            free(fPoints);
+            handleOutOfMemory(0, display, 0, 0);
+            return 0;
+        }
+        if (numPoints + numArcPoints > capacity) {
+            capacity = MAX(numPoints + numArcPoints, capacity * 2);
+            float* newPoints = realloc(fPoints, sizeof(float) * capacity * 2);
+            if (newPoints == NULL) {
+                free(fPoints);
+                handleOutOfMemory(0, display, 0, 0);
+                return 0;
+            }
+            fPoints = newPoints;
+        }
+        for (j = 0; j < numArcPoints; j++) {
+            fPoints[(numPoints + j) * 2] = arcPoints[j * 2] + arcs[i].x;
+            fPoints[(numPoints + j) * 2 + 1] = arcPoints[j * 2 + 1] + arcs[i].y;
         }
+        numPoints += numArcPoints;
     }
-    GPU_PolygonFilled(renderTarget, (unsigned int) npoints, fPoints, drawColor);
+    if (numPoints == 0) return 1;
+    DrawState drawState;
+    if (!initFillDrawState(&drawState, renderTarget, gContext)) {
+        free(fPoints);
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    Bool success = queueFillTriangles(&drawState, gContext, fPoints, numPoints);
     free(fPoints);
+    if (!success) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
     return 1;
 }
 
 int XFillArc(Display *display, Drawable d, GC gc, int x, int y, unsigned int width, unsigned int height, int angle1, int angle2) {
     // https://tronche.com/gui/x/xlib/graphics/filling-areas/XFillArc.html
+    XArc arc;
+    arc.x = (short) x;
+    arc.y = (short) y;
+    arc.width = (unsigned short) width;
+    arc.height = (unsigned short) height;
+    // Reduce the angles to the range of the arc structure without changing the arc.
+    arc.angle1 = (short) (angle1 % (360 * 64));
+    arc.angle2 = (short) MAX(-360 * 64, MIN(angle2, 360 * 64));
+    return XFillArcs(display, d, gc, &arc, 1);
+}
+
+int XFillArcs(Display *display, Drawable d, GC gc, XArc *arcs, int narcs) {
+    // https://tronche.com/gui/x/xlib/graphics/filling-areas/XFillArcs.html
     SET_X_SERVER_REQUEST(display, X_PolyFillArc);
-    WARN_UNIMPLEMENTED;
-    return 1;
+    return drawArcs(display, d, gc, arcs, narcs, True);
 }
 
 int XDrawArc(Display *display, Drawable d, GC gc, int x, int y, unsigned int width, unsigned int height, int angle1, int angle2) {
     // https://tronche.com/gui/x/xlib/graphics/drawing/XDrawArc.html
-    SET_X_SERVER_REQUEST(display, X_PolyArc);
-    WARN_UNIMPLEMENTED;
-    return 1;
+    XArc arc;
+    arc.x = (short) x;
+    arc.y = (short) y;
+    arc.width = (unsigned short) width;
+    arc.height = (unsigned short) height;
+    // Reduce the angles to the range of the arc structure without changing the arc.
+    arc.angle1 = (short) (angle1 % (360 * 64));
+    arc.angle2 = (short) MAX(-360 * 64, MIN(angle2, 360 * 64));
+    return XDrawArcs(display, d, gc, &arc, 1);
 }
 
-int XCopyPlane(Display *display, Drawable src, Drawable dest, GC gc, int src_x, int src_y, unsigned int width, unsigned int height, int dest_x, int dest_y, unsigned long plane) {
-    // https://tronche.com/gui/x/xlib/graphics/XCopyPlane.html
-    SET_X_SERVER_REQUEST(display, X_CopyPlane);
-    WARN_UNIMPLEMENTED;
-    return 1;
+int XDrawArcs(Display *display, Drawable d, GC gc, XArc *arcs, int narcs) {
+    // https://tronche.com/gui/x/xlib/graphics/drawing/XDrawArcs.html
+    SET_X_SERVER_REQUEST(display, X_PolyArc);
+    return drawArcs(display, d, gc, arcs, narcs, False);
 }
 
 extern int XDrawPoint(Display* display, Drawable d, GC gc, int x, int y) {
@@ -175,8 +521,39 @@ extern int XDrawPoint(Display* display, Drawable d, GC gc, int x, int y) {
 
 int XDrawLine(Display* display, Drawable d, GC gc, int x1, int y1, int x2, int y2) {
     // https://tronche.com/gui/x/xlib/graphics/drawing/XDrawLine.html
-    WARN_UNIMPLEMENTED;
-    return 1;
+    XSegment segment;
+    segment.x1 = (short) x1;
+    segment.y1 = (short) y1;
+    segment.x2 = (short) x2;
+    segment.y2 = (short) y2;
+    return XDrawSegments(display, d, gc, &segment, 1);
+}
+
+int XDrawSegments(Display *display, Drawable d, GC gc, XSegment *segments, int nsegments) {
+    // https://tronche.com/gui/x/xlib/graphics/drawing/XDrawSegments.html
+    SET_X_SERVER_REQUEST(display, X_PolySegment);
+    TYPE_CHECK(d, DRAWABLE, display, 0);
+    if (nsegments < 0) {
+        LOG("Invalid number of segments in %s: %d\n", __func__, nsegments);
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    if (nsegments == 0) return 1;
+    XPoint* points = malloc(sizeof(XPoint) * nsegments * 2);
+    if (points == NULL) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    int i;
+    for (i = 0; i < nsegments; i++) {
+        points[i * 2].x = segments[i].x1;
+        points[i * 2].y = segments[i].y1;
+        points[i * 2 + 1].x = segments[i].x2;
+        points[i * 2 + 1].y = segments[i].y2;
+    }
+    int result = drawLines(display, d, gc, points, (size_t) nsegments * 2, 2, CoordModeOrigin);
+    free(points);
+    return result;
 }
 
 int XDrawLines(Display *display, Drawable d, GC gc, XPoint *points, int npoints, int mode) {
@@ -194,47 +571,256 @@ int XDrawLines(Display *display, Drawable d, GC gc, XPoint *points, int npoints,
         handleError(0, display, None, 0, BadValue, 0);
         return 0;
     }
-    GPU_Target* renderTarget;
-    GET_RENDER_TARGET(d, renderTarget);
-    if (renderTarget == NULL) {
-        LOG("Failed to get the render target of %lu in %s\n", d, __func__);
-        handleError(0, display, d, 0, BadDrawable, 0);
-        return 0;
+    return drawLines(display, d, gc, points, (size_t) npoints, (size_t) npoints, mode);
+}
+
+/*
+ * Get the scratch image that XCopyArea uses as a temporary copy of the source area.
+ * The image grows to the largest requested size and is reused between calls.
+ */
+static GPU_Image* getCopyScratchImage(unsigned int width, unsigned int height) {
+    if (copyScratchImage != NULL && copyScratchImage->w >= width && copyScratchImage->h >= height) {
+        return copyScratchImage;
+    }
+    syncRenderThread();
+    GPU_Image* image = GPU_CreateImage(
+            (Uint16) MAX(width, copyScratchImage == NULL ? 0 : copyScratchImage->w),
+            (Uint16) MAX(height, copyScratchImage == NULL ? 0 : copyScratchImage->h), GPU_FORMAT_RGBA);
+    if (image == NULL) {
+        LOG("Failed to create the copy scratch image: %s\n", GPU_PopErrorCode().details);
+        return NULL;
+    }
+    if (GPU_LoadTarget(image) == NULL) {
+        LOG("Failed to create the copy scratch target: %s\n", GPU_PopErrorCode().details);
+        GPU_FreeImage(image);
+        return NULL;
+    }
+    if (copyScratchImage != NULL) {
+        queueImageFree(copyScratchImage);
+    }
+    copyScratchImage = image;
+    return copyScratchImage;
+}
+
+/*
+ * Copy the sourceRect of a window framebuffer into the top left corner of the image.
+ * SDL_gpu can only copy whole targets, so this uses OpenGL directly. Because the framebuffer
+ * is stored bottom up, the rows of the copy are flipped compared to normal images.
+ */
+static Bool copyWindowFramebuffer(GPU_Target* target, const GPU_Rect* sourceRect, GPU_Image* image) {
+    const GLFunctions* gl = getGLFunctions();
+    if (gl->bindFramebuffer == NULL || gl->bindTexture == NULL || gl->copyTexSubImage2D == NULL) {
+        LOG("Failed to load the OpenGL functions in %s: %s\n", __func__, SDL_GetError());
+        return False;
+    }
+    GPU_FlushBlitBuffer();
+    makeRenderTargetCurrent(target, target->context->windowID);
+    gl->bindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl->bindTexture(GL_TEXTURE_2D, (GLuint) GPU_GetTextureHandle(image));
+    gl->copyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (GLint) sourceRect->x,
+                          (GLint) (target->h - sourceRect->y - sourceRect->h),
+                          (GLsizei) sourceRect->w, (GLsizei) sourceRect->h);
+    // Let SDL_gpu restore the OpenGL state it expects.
+    GPU_ResetRendererState();
+    return True;
+}
+
+void freeDrawingResources() {
+    if (copyScratchImage != NULL) {
+        queueImageFree(copyScratchImage);
+        copyScratchImage = NULL;
+    }
+}
+
+/*
+ * Calculate the region of the drawable in drawable coordinates whose content is available.
+ * For windows, this excludes the parts that lie outside of an ancestor or are covered by
+ * a mapped sibling of the window or of one of its ancestors. If the subwindow mode is
+ * ClipByChildren, the parts covered by the mapped children of the window are excluded, too.
+ */
+static void getAvailableDrawableRegion(Drawable drawable, int subwindowMode,
+                                       pixman_region16_t* region) {
+    if (!IS_TYPE(drawable, WINDOW)) {
+        GPU_Image* image = GET_PIXMAP_IMAGE(drawable);
+        pixman_region_init_rect(region, 0, 0, image->w, image->h);
+        return;
     }
-    LOG("%s: Drawing on render target %p\n", __func__, renderTarget);
-    GraphicContext* gContext = GET_GC(gc);
-    GPU_SetLineThickness(gContext->lineWidth);
-    SDL_Color drawColor = {
-            GET_RED_FROM_COLOR(gContext->foreground),
-            GET_GREEN_FROM_COLOR(gContext->foreground),
-            GET_BLUE_FROM_COLOR(gContext->foreground),
-            GET_ALPHA_FROM_COLOR(gContext->foreground),
-    };
+    int width, height, x, y, offsetX = 0, offsetY = 0;
     size_t i;
-    XPoint last, current;
-    last = points[0];
-    for (i = 1; i < npoints; i++) {
-        current = points[i];
-        if (mode == CoordModePrevious) {
-            current.x += last.x;
-            current.y += last.y;
+    GET_WINDOW_DIMS(drawable, width, height);
+    pixman_region_init_rect(region, 0, 0, (unsigned int) width, (unsigned int) height);
+    if (subwindowMode == ClipByChildren) {
+        Window* children = GET_CHILDREN(drawable);
+        for (i = 0; i < GET_WINDOW_STRUCT(drawable)->children.length; i++) {
+            if (GET_WINDOW_STRUCT(children[i])->mapState == Mapped
+                && !IS_INPUT_ONLY(children[i])) {
+                pixman_region16_t childRegion;
+                GET_WINDOW_POS(children[i], x, y);
+                GET_WINDOW_DIMS(children[i], width, height);
+                pixman_region_init_rect(&childRegion, x, y,
+                                        (unsigned int) width, (unsigned int) height);
+                pixman_region_subtract(region, region, &childRegion);
+                pixman_region_fini(&childRegion);
+            }
         }
-        LOG("Drawing line {x1 = %d, y1 = %d, x2 = %d, y2 = %d}\n",
-            last.x, last.y, current.x, current.y);
-        GPU_Line(renderTarget, last.x, last.y, current.x, current.y, drawColor);
-        last = current;
     }
-    GPU_Flip(renderTarget);
-    return 1;
+    Window window = drawable;
+    while (GET_PARENT(window) != None && GET_WINDOW_STRUCT(window)->sdlWindow == NULL
+           && GET_WINDOW_STRUCT(window)->mapState != UnMapped) {
+        Window parent = GET_PARENT(window);
+        GET_WINDOW_POS(window, x, y);
+        offsetX += x;
+        offsetY += y;
+        GET_WINDOW_DIMS(parent, width, height);
+        pixman_region_intersect_rect(region, region, -offsetX, -offsetY,
+                                     (unsigned int) width, (unsigned int) height);
+        // Siblings later in the child list are stacked above the window.
+        Window* siblings = GET_CHILDREN(parent);
+        Bool isAbove = False;
+        for (i = 0; i < GET_WINDOW_STRUCT(parent)->children.length; i++) {
+            if (siblings[i] == window) {
+                isAbove = True;
+            } else if (isAbove && GET_WINDOW_STRUCT(siblings[i])->mapState == Mapped
+                       && !IS_INPUT_ONLY(siblings[i])) {
+                pixman_region16_t siblingRegion;
+                GET_WINDOW_POS(siblings[i], x, y);
+                GET_WINDOW_DIMS(siblings[i], width, height);
+                pixman_region_init_rect(&siblingRegion, x - offsetX, y - offsetY,
+                                        (unsigned int) width, (unsigned int) height);
+                pixman_region_subtract(region, region, &siblingRegion);
+                pixman_region_fini(&siblingRegion);
+            }
+        }
+        window = parent;
+    }
 }
 
-int XCopyArea(Display* display, Drawable src, Drawable dest, GC gc, int src_x, int src_y,
-               unsigned int width, unsigned int height, int dest_x, int dest_y) {
-    // https://tronche.com/gui/x/xlib/graphics/XCopyArea.html
-    SET_X_SERVER_REQUEST(display, X_CopyArea);
-    TYPE_CHECK(src, DRAWABLE, display, 0);
-    TYPE_CHECK(dest, DRAWABLE, display, 0);
-    LOG("%s: Copy area from %lu to %lu\n", __func__, src, dest);
+/*
+ * Calculate the region of the source area that can be copied from the source drawable.
+ * If the graphics exposures of the GC are enabled, a GraphicsExpose event is generated for
+ * each destination area whose source is not available, or a NoExpose event if all of the
+ * source is available.
+ */
+static void getCopyRegion(Display* display, Drawable src, Drawable dest, GraphicContext* gContext,
+                          int src_x, int src_y, unsigned int width, unsigned int height,
+                          int dest_x, int dest_y, int majorCode, pixman_region16_t* copyRegion) {
+    pixman_region16_t availableRegion;
+    getAvailableDrawableRegion(src, gContext->subWindowMode, &availableRegion);
+    pixman_region_init_rect(copyRegion, src_x, src_y, width, height);
+    if (gContext->graphicsExposures) {
+        pixman_region16_t exposedRegion;
+        pixman_region_init(&exposedRegion);
+        pixman_region_subtract(&exposedRegion, copyRegion, &availableRegion);
+        pixman_region_translate(&exposedRegion, dest_x - src_x, dest_y - src_y);
+        int numRects, i;
+        pixman_box16_t* boxes = pixman_region_rectangles(&exposedRegion, &numRects);
+        if (numRects == 0) {
+            postEvent(display, dest, NoExpose, majorCode);
+        }
+        for (i = 0; i < numRects; i++) {
+            SDL_Rect exposeRect = {boxes[i].x1, boxes[i].y1,
+                                   boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1};
+            postEvent(display, dest, GraphicsExpose, &exposeRect, (size_t) (numRects - i - 1),
+                      majorCode);
+        }
+        pixman_region_fini(&exposedRegion);
+    }
+    pixman_region_intersect(copyRegion, copyRegion, &availableRegion);
+    pixman_region_fini(&availableRegion);
+}
+
+/*
+ * Initialize the state to draw the image on the target with the GC. If plane is not 0,
+ * the pixels of the image are drawn in the foreground or background color of the GC,
+ * depending on whether their plane bit is set.
+ */
+static void initCopyDrawState(DrawState* drawState, GPU_Target* target, GPU_Image* image,
+                              GraphicContext* gContext, unsigned long plane) {
+    initGCDrawState(drawState, target, image, gContext);
+    if (plane != 0) {
+        // A stippled GC leaves the pixels without the plane bit untouched.
+        setDrawStatePlane(drawState, plane, gContext->foregroundColor,
+                          gContext->backgroundColor, gContext->fillStyle == FillStippled ?
+                          PLANE_BACKGROUND_TRANSPARENT : PLANE_BACKGROUND_OPAQUE);
+    }
+}
+
+/*
+ * Draw the plane of the copy region of the source target on the CPU.
+ * This is the fallback for renderers without support for the plane shader.
+ */
+static Bool queueCpuPlaneCopy(GPU_Target* sourceTarget, const GPU_Rect* sourceViewport,
+                              GPU_Target* renderDest, GraphicContext* gContext,
+                              pixman_region16_t* copyRegion, int offsetX, int offsetY,
+                              unsigned long plane) {
+    int numRects, i, x, y;
+    pixman_box16_t* boxes = pixman_region_rectangles(copyRegion, &numRects);
+    pixman_box16_t* extents = pixman_region_extents(copyRegion);
+    int sourceX = (int) sourceViewport->x + extents->x1;
+    int sourceY = (int) sourceViewport->y + extents->y1;
+    int width = extents->x2 - extents->x1, height = extents->y2 - extents->y1;
+    flushDisplayListForTarget(sourceTarget);
+    SDL_Surface* source = GPU_CopySurfaceFromTarget(sourceTarget);
+    if (source == NULL) {
+        LOG("Failed to read the source in %s: %s\n", __func__, GPU_PopErrorCode().details);
+        return False;
+    }
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, SDL_SURFACE_DEPTH,
+                                                          SDL_PIXELFORMAT_RGBA8888);
+    if (surface == NULL) {
+        LOG("SDL_CreateRGBSurfaceWithFormat failed in %s: %s\n", __func__, SDL_GetError());
+        SDL_FreeSurface(source);
+        return False;
+    }
+    Uint32 foreground = SDL_MapRGBA(surface->format, gContext->foregroundColor.r,
+            gContext->foregroundColor.g, gContext->foregroundColor.b, gContext->foregroundColor.a);
+    Uint32 background = SDL_MapRGBA(surface->format, 0, 0, 0, 0);
+    if (gContext->fillStyle != FillStippled) {
+        background = SDL_MapRGBA(surface->format, gContext->backgroundColor.r,
+                gContext->backgroundColor.g, gContext->backgroundColor.b, gContext->backgroundColor.a);
+    }
+    for (y = 0; y < height; y++) {
+        Uint32* row = (Uint32*) ((Uint8*) surface->pixels + y * surface->pitch);
+        for (x = 0; x < width; x++) {
+            Uint8 r = 0, g = 0, b = 0, a = 0;
+            if (sourceX + x >= 0 && sourceX + x < source->w
+                && sourceY + y >= 0 && sourceY + y < source->h) {
+                Uint8* pixel = (Uint8*) source->pixels + (sourceY + y) * source->pitch
+                               + (sourceX + x) * source->format->BytesPerPixel;
+                SDL_GetRGBA(*(Uint32*) pixel, source->format, &r, &g, &b, &a);
+            }
+            unsigned long value = (unsigned long) r << RED_SHIFT | (unsigned long) g << GREEN_SHIFT
+                                  | (unsigned long) b << BLUE_SHIFT
+                                  | (unsigned long) a << ALPHA_SHIFT;
+            row[x] = value & plane ? foreground : background;
+        }
+    }
+    SDL_FreeSurface(source);
+    GPU_Image* image = GPU_CopyImageFromSurface(surface);
+    SDL_FreeSurface(surface);
+    if (image == NULL) {
+        LOG("GPU_CopyImageFromSurface failed in %s: %s\n", __func__, GPU_PopErrorCode().details);
+        return False;
+    }
+    Bool success = True;
+    DrawState drawState;
+    initGCDrawState(&drawState, renderDest, image, gContext);
+    for (i = 0; i < numRects && success; i++) {
+        GPU_Rect sourceRect = GPU_MakeRect(boxes[i].x1 - extents->x1, boxes[i].y1 - extents->y1,
+                                           boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1);
+        success = queueBlit(&drawState, &sourceRect, boxes[i].x1 + offsetX, boxes[i].y1 + offsetY);
+    }
+    queueImageFree(image);
+    return success;
+}
+
+/*
+ * Copy an area of the source drawable to the destination. If plane is not 0,
+ * the single bit plane of the source is drawn in the foreground and background color of the GC.
+ */
+static int copyArea(Display* display, Drawable src, Drawable dest, GC gc, int src_x, int src_y,
+                    unsigned int width, unsigned int height, int dest_x, int dest_y,
+                    unsigned long plane, int majorCode) {
     if (IS_TYPE(src, WINDOW)) {
         if (IS_INPUT_ONLY(src)) {
             LOG("BadMatch: Got input only window as the source in %s!\n", __func__);
@@ -249,68 +835,149 @@ int XCopyArea(Display* display, Drawable src, Drawable dest, GC gc, int src_x, i
         handleError(0, display, dest, 0, BadMatch, 0);
         return 0;
     }
+    GraphicContext* gContext = getResolvedGC(gc);
+    pixman_region16_t copyRegion;
+    getCopyRegion(display, src, dest, gContext, src_x, src_y, width, height, dest_x, dest_y,
+                  majorCode, &copyRegion);
+    if (!pixman_region_not_empty(&copyRegion)) {
+        pixman_region_fini(&copyRegion);
+        return 1;
+    }
+    int numRects, i;
+    pixman_box16_t* boxes = pixman_region_rectangles(&copyRegion, &numRects);
+    pixman_box16_t* extents = pixman_region_extents(&copyRegion);
+    int offsetX = dest_x - src_x, offsetY = dest_y - src_y;
     GPU_Target* sourceTarget;
     GET_RENDER_TARGET(src, sourceTarget);
     if (sourceTarget == NULL) {
         LOG("BadMatch: Failed to get render target of source drawable %lu in %s!\n", src, __func__);
+        pixman_region_fini(&copyRegion);
         handleError(0, display, src, 0, BadMatch, 0);
         return 0;
     }
-    GPU_Image* sourceImage = GPU_CopyImageFromTarget(sourceTarget);
-    if (sourceImage == NULL) {
-        LOG("BadMatch: Failed to get the image from the target "
-                    "of the source drawable %lu in %s!\n", src, __func__);
-        handleError(0, display, src, 0, BadMatch, 0);
-        return 0;
-    }
+    // The viewport of the target is positioned at the origin of the source drawable.
+    GPU_Rect sourceViewport, sourceClipRect;
+    Bool sourceUseClipRect;
+    getRenderTargetView(sourceTarget, &sourceViewport, &sourceClipRect, &sourceUseClipRect);
+    float sourceX = sourceViewport.x, sourceY = sourceViewport.y;
     GPU_Target* renderDest;
     GET_RENDER_TARGET(dest, renderDest);
     if (renderDest == NULL) {
         LOG("BadMatch: Failed to get render target of destination drawable %lu in %s!\n",
             dest, __func__);
+        pixman_region_fini(&copyRegion);
         handleError(0, display, dest, 0, BadMatch, 0);
         return 0;
     }
-    LOG("%s: Copy area from target %p to target %p\n", __func__, sourceTarget, renderDest);
-    GPU_Rect sourceRect = { src_x, src_y, width, height };
-
-    LOG("Copy area {x = %f, y = %f, w = %f, h = %f}\n",
-        sourceRect.x, sourceRect.y, sourceRect.w, sourceRect.h);
-    GPU_Blit(sourceImage, &sourceRect, renderDest, dest_x + sourceRect.w / 2, dest_y + sourceRect.h / 2);
-    GPU_FreeImage(sourceImage);
-    GPU_Flip(renderDest);
-    
-    // TODO: Events
+    LOG("%s: Copy %d areas from target %p to target %p\n", __func__,
+        numRects, sourceTarget, renderDest);
+    Bool success = True;
+    DrawState drawState;
+    GPU_Rect sourceRect;
+    if (plane != 0 && !isPlaneShaderAvailable()) {
+        success = queueCpuPlaneCopy(sourceTarget, &sourceViewport, renderDest, gContext,
+                                    &copyRegion, offsetX, offsetY, plane);
+    } else if (sourceTarget->image != NULL && sourceTarget != renderDest) {
+        // Sample the source image directly.
+        initCopyDrawState(&drawState, renderDest, sourceTarget->image, gContext, plane);
+        for (i = 0; i < numRects && success; i++) {
+            sourceRect = GPU_MakeRect(sourceX + boxes[i].x1, sourceY + boxes[i].y1,
+                                      boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1);
+            success = queueBlit(&drawState, &sourceRect,
+                                boxes[i].x1 + offsetX, boxes[i].y1 + offsetY);
+        }
+    } else {
+        // Copy the extents of the area into the scratch image and copy the areas from there.
+        unsigned int extentsWidth = (unsigned int) (extents->x2 - extents->x1);
+        unsigned int extentsHeight = (unsigned int) (extents->y2 - extents->y1);
+        GPU_Image* scratchImage = getCopyScratchImage(extentsWidth, extentsHeight);
+        if (scratchImage == NULL) {
+            pixman_region_fini(&copyRegion);
+            handleOutOfMemory(0, display, 0, 0);
+            return 0;
+        }
+        initCopyDrawState(&drawState, renderDest, scratchImage, gContext, plane);
+        sourceRect = GPU_MakeRect(sourceX + extents->x1, sourceY + extents->y1,
+                                  extentsWidth, extentsHeight);
+        Bool flipped = sourceTarget->image == NULL;
+        if (flipped) {
+            // The source is a window framebuffer, which can not be sampled.
+            flushDisplayListForTarget(sourceTarget);
+            flushDisplayListForImage(scratchImage);
+            if (!copyWindowFramebuffer(sourceTarget, &sourceRect, scratchImage)) {
+                pixman_region_fini(&copyRegion);
+                handleError(0, display, src, 0, BadMatch, 0);
+                return 0;
+            }
+        } else {
+            // The source and destination are the same texture, which can not be sampled
+            // while drawing on it.
+            DrawState scratchState;
+            initDrawState(&scratchState, scratchImage->target, sourceTarget->image);
+            success = queueBlit(&scratchState, &sourceRect, 0, 0);
+        }
+        for (i = 0; i < numRects && success; i++) {
+            sourceRect = GPU_MakeRect(boxes[i].x1 - extents->x1, boxes[i].y1 - extents->y1,
+                                      boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1);
+            if (flipped) {
+                // The rows of the scratch image are stored bottom up.
+                sourceRect.y = extentsHeight - sourceRect.y - sourceRect.h;
+                success = queueFlippedBlit(&drawState, &sourceRect,
+                                           boxes[i].x1 + offsetX, boxes[i].y1 + offsetY);
+            } else {
+                success = queueBlit(&drawState, &sourceRect,
+                                    boxes[i].x1 + offsetX, boxes[i].y1 + offsetY);
+            }
+        }
+    }
+    pixman_region_fini(&copyRegion);
+    if (!success) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
     return 1;
 }
 
+int XCopyArea(Display* display, Drawable src, Drawable dest, GC gc, int src_x, int src_y,
+               unsigned int width, unsigned int height, int dest_x, int dest_y) {
+    // https://tronche.com/gui/x/xlib/graphics/XCopyArea.html
+    SET_X_SERVER_REQUEST(display, X_CopyArea);
+    TYPE_CHECK(src, DRAWABLE, display, 0);
+    TYPE_CHECK(dest, DRAWABLE, display, 0);
+    LOG("%s: Copy area from %lu to %lu\n", __func__, src, dest);
+    return copyArea(display, src, dest, gc, src_x, src_y, width, height, dest_x, dest_y,
+                    0, X_CopyArea);
+}
+
+int XCopyPlane(Display *display, Drawable src, Drawable dest, GC gc, int src_x, int src_y, unsigned int width, unsigned int height, int dest_x, int dest_y, unsigned long plane) {
+    // https://tronche.com/gui/x/xlib/graphics/XCopyPlane.html
+    SET_X_SERVER_REQUEST(display, X_CopyPlane);
+    TYPE_CHECK(src, DRAWABLE, display, 0);
+    TYPE_CHECK(dest, DRAWABLE, display, 0);
+    LOG("%s: Copy plane %lu from %lu to %lu\n", __func__, plane, src, dest);
+    if (plane == 0 || (plane & (plane - 1)) != 0 || (plane & ~PLANE_MASK_ALL_PLANES) != 0) {
+        LOG("BadValue: Plane %lu does not have exactly one valid bit set in %s!\n",
+            plane, __func__);
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    return copyArea(display, src, dest, gc, src_x, src_y, width, height, dest_x, dest_y,
+                    plane, X_CopyPlane);
+}
+
 int XDrawRectangle(Display *display, Drawable d, GC gc, int x, int y, unsigned int width, unsigned int height) {
     // https://tronche.com/gui/x/xlib/graphics/drawing/XDrawRectangle.html
     SET_X_SERVER_REQUEST(display, X_PolyRectangle);
     TYPE_CHECK(d, DRAWABLE, display, 0);
-    LOG("%s: Drawing on %lu\n", __func__, d);
-    GPU_Target* renderTarget;
-    GET_RENDER_TARGET(d, renderTarget);
-    if (renderTarget == NULL) {
-        LOG("Failed to get the render target of %lu in %s\n", d, __func__);
-        handleError(0, display, d, 0, BadDrawable, 0);
-        return 0;
-    }
-    GraphicContext* gContext = GET_GC(gc);
-    GPU_SetLineThickness(gContext->lineWidth);
-    SDL_Color drawColor = {
-            GET_RED_FROM_COLOR(gContext->foreground),
-            GET_GREEN_FROM_COLOR(gContext->foreground),
-            GET_BLUE_FROM_COLOR(gContext->foreground),
-            GET_ALPHA_FROM_COLOR(gContext->foreground),
-    };
-    LOG("{x = %d, y = %d, w = %d, h = %d}\n", x, y, width, height);
-    GPU_Rect rectangle = {x, y, width, height};
-    LOG("Drawing rectangle {x = %f, y = %f, w = %f, h = %f}\n",
-        rectangle.x, rectangle.y, rectangle.w, rectangle.h);
-    GPU_Rectangle2(renderTarget, rectangle, drawColor);
-    GPU_Flip(renderTarget);
-    return 1;
+    LOG("Drawing rectangle {x = %d, y = %d, w = %d, h = %d}\n", x, y, width, height);
+    // The outline is drawn like a closed polyline, so the corners are joined.
+    XPoint points[5];
+    points[0].x = points[3].x = points[4].x = (short) x;
+    points[0].y = points[1].y = points[4].y = (short) y;
+    points[1].x = points[2].x = (short) (x + width);
+    points[2].y = points[3].y = (short) (y + height);
+    return drawLines(display, d, gc, points, ARRAY_LENGTH(points), ARRAY_LENGTH(points),
+                     CoordModeOrigin);
 }
 
 int XFillRectangle(Display* display, Drawable d, GC gc, int x, int y,
@@ -344,74 +1011,36 @@ int XFillRectangles(Display *display, Drawable d, GC gc, XRectangle *rectangles,
         LOG("%s: Render target: %p, render target context = %p\n", __func__,
                 renderTarget, (SDL_GLContext) renderTarget->context->context);
     }
-    GraphicContext* gContext = GET_GC(gc);
-    GPU_SetLineThickness(gContext->lineWidth);
+    GraphicContext* gContext = getResolvedGC(gc);
     LOG("bgColor: 0x%08lx, fgColor: 0x%08lx\n", gContext->background, gContext->foreground);
-    if (gContext->fillStyle == FillSolid) {
-        size_t i;
-        SDL_Color drawColor = {
-                GET_RED_FROM_COLOR(gContext->foreground),
-                GET_GREEN_FROM_COLOR(gContext->foreground),
-                GET_BLUE_FROM_COLOR(gContext->foreground),
-                GET_ALPHA_FROM_COLOR(gContext->foreground),
-        };
-        LOG("%s: Color {r = %d, g = %d, b = %d, a = %d}\n",
-            __func__, drawColor.r, drawColor.g, drawColor.b, drawColor.a);
-        LOG("Render viewport is {x = %f, y = %f, w = %f, h = %f}\n",
-            renderTarget->viewport.x, renderTarget->viewport.y,
-            renderTarget->viewport.w, renderTarget->viewport.h);
-        GPU_Rect rectangle;
-        for (i = 0; i < nrectangles; i++) {
-            rectangle.x = rectangles[i].x;
-            rectangle.y = rectangles[i].y;
-            rectangle.w = rectangles[i].width;
-            rectangle.h = rectangles[i].height;
-            LOG("Drawing filled rectangle {x = %f, y = %f, w = %f, h = %f}\n",
-                rectangle.x, rectangle.y, rectangle.w, rectangle.h);
-            GPU_RectangleFilled2(renderTarget, rectangle, drawColor);
-        }
-    } else if (gContext->fillStyle == FillTiled) {
-        LOG("Fill_style is %s\n", "FillTiled");
-    } else if (gContext->fillStyle == FillOpaqueStippled) {
-        LOG("Fill_style is %s\n", "FillOpaqueStippled");
-        GPU_Image* stipple = GET_PIXMAP_IMAGE(gContext->stipple);
-        GPU_Image* tile = GPU_CopyImage(stipple);
-        if (tile == NULL) {
-            LOG("Failed to copy image from gc->stipple: %s\n", GPU_PopErrorCode().details);
-            handleError(0, display, gContext->stipple, 0 , BadMatch, 0);
-            return 0;
-        }
-        GPU_Target* tileTarget = GPU_LoadTarget(tile);
-        if (tileTarget == NULL) {
-            LOG("Failed to create image target from gc->stipple: %s\n", GPU_PopErrorCode().details);
-            handleError(0, display, gContext->stipple, 0 , BadMatch, 0);
-            return 0;
-        }
-        GPU_SetShapeBlendFunction(GPU_FUNC_SRC_COLOR, GPU_FUNC_ZERO, GPU_FUNC_ZERO, GPU_FUNC_DST_ALPHA);
-        SDL_Color color = GPU_MakeColor(GET_RED_FROM_COLOR(gContext->foreground), GET_GREEN_FROM_COLOR(gContext->foreground), GET_BLUE_FROM_COLOR(gContext->foreground), GET_ALPHA_FROM_COLOR(gContext->foreground));
-        GPU_RectangleFilled(tileTarget, 0, 0, tile->w, tile->h, color);
-        GPU_SetShapeBlendFunction(GPU_FUNC_SRC_COLOR, GPU_FUNC_ZERO, GPU_FUNC_ZERO, GPU_FUNC_ONE_MINUS_DST_ALPHA);
-        color = GPU_MakeColor(GET_RED_FROM_COLOR(gContext->background), GET_GREEN_FROM_COLOR(gContext->background), GET_BLUE_FROM_COLOR(gContext->background), GET_ALPHA_FROM_COLOR(gContext->background));
-        GPU_RectangleFilled(tileTarget, 0, 0, tile->w, tile->h, color);
-        GPU_SetShapeBlendMode(GPU_BLEND_NORMAL);
-        GPU_SetWrapMode(tile, GPU_WRAP_REPEAT, GPU_WRAP_REPEAT);
-        
-        size_t i;
-        GPU_Rect rectangle;
-        rectangle.x = 0;
-        rectangle.y = 0;
-        for (i = 0; i < nrectangles; i++) {
-            rectangle.w = rectangles[i].width;
-            rectangle.h = rectangles[i].height;
-            LOG("Drawing filled rectangle using FillOpaqueStippled "
-                        "{x = %f, y = %f, w = %f, h = %f}\n",
-                rectangle.x, rectangle.y, rectangle.w, rectangle.h);
-            GPU_Blit(tile, &rectangle, renderTarget, rectangles[i].x, rectangles[i].y);
-        }
-        GPU_FreeImage(tile);
-    } else if (gContext->fillStyle == FillStippled) {
-        LOG("Fill_style is %s\n", "FillStippled");
+    size_t i;
+    GPU_Rect* fillRects = malloc(sizeof(GPU_Rect) * nrectangles);
+    if (fillRects == NULL) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    for (i = 0; i < nrectangles; i++) {
+        fillRects[i] = GPU_MakeRect(rectangles[i].x, rectangles[i].y,
+                                    rectangles[i].width, rectangles[i].height);
+    }
+    DrawState drawState;
+    if (!initFillDrawState(&drawState, renderTarget, gContext)) {
+        free(fillRects);
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    Bool success;
+    if (drawState.image == NULL) {
+        success = queueRectangles(&drawState, fillRects, (size_t) nrectangles,
+                                  gContext->foregroundColor);
+    } else {
+        success = queueTiledRectangles(&drawState, fillRects, (size_t) nrectangles,
+                                       gContext->tileStipOriginX, gContext->tileStipOriginY);
+    }
+    free(fillRects);
+    if (!success) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
     }
-    GPU_Flip(renderTarget);
     return 1;
 }
@@ -5,23 +5,60 @@
 #include "colors.h"
 #include "resourceTypes.h"
 #include "window.h"
+#include "displayList.h"
 
 #define SDL_SURFACE_DEPTH 32
 
 #define GET_PIXMAP_IMAGE(pixmap) (IS_TYPE(pixmap, PIXMAP) ? ((GPU_Image*) GET_XID_VALUE(pixmap)) : NULL)
 #define GET_RENDER_TARGET(drawable, renderer) \
 if (IS_TYPE(drawable, WINDOW)) {\
-    LOG("getWindowRenderTarget of window %lu in %s.\n", drawable, __func__);\
-    renderer = getWindowRenderTarget(drawable);\
+    LOG("getWindowDrawTarget of window %lu in %s.\n", drawable, __func__);\
+    renderer = getWindowDrawTarget(drawable);\
 } else if (IS_TYPE(drawable, PIXMAP)) {\
-    renderer = GET_PIXMAP_IMAGE(drawable)->target;\
+    renderer = getPixmapDrawTarget(drawable);\
 } else {\
     LOG("Got unknown drawable type while trying to get renderer in %s, %s, %d\n",\
         __FILE__, __func__, __LINE__);\
     renderer = NULL;\
 }
 
+/*
+ * Counters of the render state changes since they were last logged. The client thread and the
+ * render thread count into their own counters.
+ */
+typedef struct {
+    /* How often a different GC than the last one was used for drawing. */
+    unsigned long gcSwitches;
+    /* How many changed GC values had to be resolved. */
+    unsigned long gcValueUpdates;
+    /* How often the viewport or clip rectangle of a target was changed. */
+    unsigned long targetStateChanges;
+    /* How often setting the viewport or clip rectangle was skipped because it did not change. */
+    unsigned long skippedTargetStateChanges;
+    /* How often a clip region had to be rendered into a stencil buffer. */
+    unsigned long stencilClipBuilds;
+    /* How often the display list switched to drawing on a different target. */
+    unsigned long targetSwitches;
+    /* How often the current OpenGL context or its window was changed. */
+    unsigned long contextSwitches;
+    /* How often changing the current context was skipped because it did not change. */
+    unsigned long skippedContextSwitches;
+    /* How many batches were drawn by the selected render backend instead of SDL_gpu. */
+    unsigned long backendBatches;
+} RenderStateCounters;
+
+RenderStateCounters* getRenderStateCounters(void);
+void logRenderStateCounters(void);
+
+GPU_Target* getWindowDrawTarget(Window window);
 GPU_Target* getWindowRenderTarget(Window window);
+GPU_Target* getPixmapDrawTarget(Pixmap pixmap);
+void getRenderTargetView(GPU_Target* target, GPU_Rect* viewport, GPU_Rect* clipRect,
+                         Bool* useClipRect);
+void makeRenderTargetCurrent(GPU_Target* target, Uint32 windowId);
+void setRenderTargetViewport(GPU_Target* target, GPU_Rect viewport);
+void setRenderTargetClip(GPU_Target* target, Bool useClipRect, GPU_Rect clipRect);
 void flipScreen(void);
+void freeDrawingResources(void);
 
 #endif /* _DRAWING_H_ */
@@ -1,6 +1,7 @@
 #include "errors.h"
 #include <stdio.h>
 #include "display.h"
+#include "sharedMemory.h"
 
 typedef int (*errorHandlerFunction)(Display*, XErrorEvent*);
 errorHandlerFunction error_handler = defaultErrorHandler;
@@ -87,6 +88,8 @@ unsigned char resourceTypeToErrorCode(XResourceType resourceType) {
             return BadFont;
         case CURSOR:
             return BadCursor;
+        case SHM_SEGMENT:
+            return SHM_ERROR_BASE + BadShmSeg;
         default:
             return BadMatch;
     }
@@ -8,6 +8,13 @@
 #include "display.h"
 #include "atoms.h"
 #include "util.h"
+#include "drawing.h"
+#include "rfbServer.h"
+#include "renderThread.h"
+#include "presentScheduler.h"
+#include "headless.h"
+#include "readback.h"
+#include "xwd.h"
 
 int eventFds[2];
 #define READ_EVENT_FD eventFds[0]
@@ -151,10 +158,12 @@ int convertEvent(Display* display, SDL_Event* sdlEvent, XEvent* xEvent) {
     //TODO: this needs to update the window attributes
     switch (sdlEvent->type) {
         case SDL_KEYDOWN:
+            if (handleXwdDumpKey(display, sdlEvent)) return -1;
             type = KeyPress;
             LOG("SDL_KEYDOWN\n");
         case SDL_KEYUP:
             if (sdlEvent->type == SDL_KEYUP) {
+                if (handleXwdDumpKey(display, sdlEvent)) return -1;
                 LOG("SDL_KEYUP\n");
                 type = KeyRelease;
             }
@@ -315,10 +324,13 @@ int convertEvent(Display* display, SDL_Event* sdlEvent, XEvent* xEvent) {
                         || sdlEvent->window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
                         xEvent->xconfigure.width  = sdlEvent->window.data1;
                         xEvent->xconfigure.height = sdlEvent->window.data2;
-                        if (GET_WINDOW_STRUCT(eventWindow)->renderTarget != NULL) {
+                        if (GET_WINDOW_STRUCT(eventWindow)->renderTarget != NULL
+                            && GET_WINDOW_STRUCT(eventWindow)->renderTarget->context != NULL) {
                             // This is necessary, because sdl gpu will otherwise use an incorrect virtual resolution
                             // which will offset the rendering.
-                            GPU_MakeCurrent(GET_WINDOW_STRUCT(eventWindow)->renderTarget, sdlEvent->window.windowID);
+                            syncRenderThread();
+                            makeRenderTargetCurrent(GET_WINDOW_STRUCT(eventWindow)->renderTarget,
+                                                    sdlEvent->window.windowID);
                             GPU_SetWindowResolution((Uint16) sdlEvent->window.data1,
                                                     (Uint16) sdlEvent->window.data2);
                         }
@@ -683,7 +695,12 @@ int convertEvent(Display* display, SDL_Event* sdlEvent, XEvent* xEvent) {
                             memcpy(&xEvent->xclient, allocEvent, sizeof(XClientMessageEvent)); break;
                         case MappingNotify:
                             memcpy(&xEvent->xmapping, allocEvent, sizeof(XMappingEvent)); break;
-                        default: break;
+                        default:
+                            // Extension events are allocated with the size of any event.
+                            if (type >= LASTEvent) {
+                                memcpy(xEvent, allocEvent, sizeof(XEvent));
+                            }
+                            break;
                     }
                     free(allocEvent);
                     break;
@@ -691,6 +708,10 @@ int convertEvent(Display* display, SDL_Event* sdlEvent, XEvent* xEvent) {
                     memcpy(xEvent, sdlEvent->user.data1, sizeof(XEvent));
                     free(sdlEvent->user.data1);
                     return 0;
+                } else if (sdlEvent->user.code == REMOTE_INPUT_EVENT_CODE) {
+                    // Input from a remote viewer is converted like input from SDL.
+                    if (!convertRemoteInputEvent(sdlEvent)) return -1;
+                    return convertEvent(display, sdlEvent, xEvent);
                 }
             }
             return -1;
@@ -705,11 +726,15 @@ int convertEvent(Display* display, SDL_Event* sdlEvent, XEvent* xEvent) {
 void updateWindowRenderTargets(Display* display) {
     size_t i;
     LOG("Resetting window render targets\n");
+    flushDisplayList();
     Window* children = GET_CHILDREN(SCREEN_WINDOW);
     for (i = 0; i < GET_WINDOW_STRUCT(SCREEN_WINDOW)->children.length; i++) {
-        if (GET_WINDOW_STRUCT(children[i])->sdlWindow != NULL) {
+        // The offscreen targets of the headless mode are not bound to the windows.
+        if (GET_WINDOW_STRUCT(children[i])->sdlWindow != NULL && !isHeadless()) {
             WindowStruct* windowStruct = GET_WINDOW_STRUCT(children[i]);
             LOG("Resetting render target of window %lu\n", children[i]);
+            freeClipStencil(windowStruct->renderTarget);
+            forgetPresentTarget(windowStruct->renderTarget);
             GPU_FreeTarget(windowStruct->renderTarget);
             windowStruct->renderTarget = GPU_CreateTargetFromWindow(SDL_GetWindowID(windowStruct->sdlWindow));
             SDL_Rect exposeRect;
@@ -772,10 +797,30 @@ void printEventInfo(XEvent* event) {
     LOG("%s\n", msg);
 }
 
+/*
+ * Wait for the next SDL event. Deferred presents are executed while waiting, once they are due.
+ * Pending readbacks are completed before waiting, because no later flush might deliver them.
+ * Returns False if waiting failed.
+ */
+static Bool waitForSdlEvent(SDL_Event* event) {
+    int timeout;
+    // The render thread might still be deferring presents or starting readbacks.
+    syncRenderThread();
+    if (hasPendingReadbacks()) {
+        completeReadbacks(True);
+    }
+    while ((timeout = getPresentTimeout()) >= 0) {
+        if (SDL_WaitEventTimeout(event, timeout) == 1) return True;
+        presentScheduledFrames(False);
+    }
+    return SDL_WaitEvent(event) == 1;
+}
+
 int XNextEvent(Display* display, XEvent* event_return) {
     // https://tronche.com/gui/x/xlib/event-handling/manipulating-event-queue/XNextEvent.html
     SDL_Event event;
     Bool done = False;
+    submitDisplayList();
     while (!done) {
         int qlen;
         getEventQueueLength(&qlen);
@@ -801,7 +846,7 @@ int XNextEvent(Display* display, XEvent* event_return) {
             event_return->xexpose.count = 0;
             break;
         }
-        if (eventWaiting || SDL_WaitEvent(&event) == 1) {
+        if (eventWaiting || waitForSdlEvent(&event)) {
             tmpVar = False;
             if (eventWaiting) {
                 event = waitingEvent;
@@ -908,8 +953,11 @@ Bool XFilterEvent(XEvent *event, Window w) {
 int XEventsQueued(Display *display, int mode) {
     // https://tronche.com/gui/x/xlib/event-handling/XEventsQueued.html
 //    SET_X_SERVER_REQUEST(display, XCB_);
-    if (GET_DISPLAY(display)->qlen == 0 && mode != QueuedAlready) {
-        SDL_PumpEvents();
+    if (mode != QueuedAlready) {
+        submitDisplayList();
+        if (GET_DISPLAY(display)->qlen == 0) {
+            SDL_PumpEvents();
+        }
     }
     return GET_DISPLAY(display)->qlen;
 }
@@ -918,6 +966,7 @@ int XFlush(Display *display) {
     // https://tronche.com/gui/x/xlib/event-handling/XFlush.html
 //    SET_X_SERVER_REQUEST(display, XCB_);
 //    SDL_PumpEvents(); // TODO: This locks up the main thread
+    submitDisplayList();
     return 1;
 }
 
@@ -1188,10 +1237,36 @@ Bool postEvent(Display* display, Window eventWindow, unsigned int eventId, ...)
 //            memcpy(&xEvent->xfocus, allocEvent, sizeof(XFocusChangeEvent)); break;
         case KeymapNotify:
 //            memcpy(&xEvent->xexpose, allocEvent, sizeof(XExposeEvent)); break;
-        case GraphicsExpose:
-//            memcpy(&xEvent->xgraphicsexpose, allocEvent, sizeof(XGraphicsExposeEvent)); break;
-        case NoExpose:
-            /*memcpy(&xEvent->xnoexpose, allocEvent, sizeof(XNoExposeEvent)); */break; // TODO
+        case GraphicsExpose: {
+            XGraphicsExposeEvent* event = malloc(sizeof(XGraphicsExposeEvent));
+            if (event == NULL) break;
+            event->type = eventId;
+            event->send_event = False;
+            event->display = display;
+            event->drawable = eventWindow;
+            SDL_Rect* exposeRect = va_arg(args, SDL_Rect*);
+            event->x = exposeRect->x;
+            event->y = exposeRect->y;
+            event->width = exposeRect->w;
+            event->height = exposeRect->h;
+            event->count = (int) va_arg(args, size_t);
+            event->major_code = va_arg(args, int);
+            event->minor_code = 0;
+            eventData = event;
+            break;
+        }
+        case NoExpose: {
+            XNoExposeEvent* event = malloc(sizeof(XNoExposeEvent));
+            if (event == NULL) break;
+            event->type = eventId;
+            event->send_event = False;
+            event->display = display;
+            event->drawable = eventWindow;
+            event->major_code = va_arg(args, int);
+            event->minor_code = 0;
+            eventData = event;
+            break;
+        }
         case VisibilityNotify:
 //            memcpy(&xEvent->xvisibility, allocEvent, sizeof(XVisibilityEvent)); break;
         case GravityNotify:
@@ -6,11 +6,13 @@
 
 #define SEND_EVENT_CODE 1
 #define INTERNAL_EVENT_CODE 2
+#define REMOTE_INPUT_EVENT_CODE 3
 
 #define HAS_EVENT_MASK(window, mask) ((GET_WINDOW_STRUCT(window)->eventMask & mask) == mask)
 
 int initEventPipe(Display* display);
 unsigned int convertModifierState(Uint16 mod);
+Bool enqueueEvent(Display* display, Window eventWindow, void* event);
 Bool postEvent(Display* display, Window eventWindow, unsigned int eventId, ...);
 void postExposeEvent(Display* display, Window window, const SDL_Rect* damagedAreaList, size_t numAreas);
 
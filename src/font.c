@@ -16,6 +16,7 @@
 #include "gc.h"
 #include "util.h"
 #include "font.h"
+#include "renderThread.h"
 
 // TODO: Maybe implement character atlas
 // TODO: Convert text decoding to Utf-8
@@ -581,27 +582,25 @@ int XTextWidth(XFontStruct* font_struct, _Xconst char* string, int count) {
 Bool renderText(GPU_Target* renderTarget, GC gc, int x, int y, const char* string) {
     LOG("Rendering text: '%s'\n", string);
     if (string == NULL || string[0] == '\0') { return True; }
-    GraphicContext* gContext = GET_GC(gc);
-    SDL_Color color = {
-            GET_RED_FROM_COLOR(gContext->foreground),
-            GET_GREEN_FROM_COLOR(gContext->foreground),
-            GET_BLUE_FROM_COLOR(gContext->foreground),
-            GET_ALPHA_FROM_COLOR(gContext->foreground),
-    };
-    SDL_Surface* fontSurface = TTF_RenderUTF8_Blended(GET_FONT(gContext->font), string, color);
+    GraphicContext* gContext = getResolvedGC(gc);
+    SDL_Surface* fontSurface = TTF_RenderUTF8_Blended(GET_FONT(gContext->font), string,
+                                                      gContext->foregroundColor);
     if (fontSurface == NULL) {
         return False;
     }
+    syncRenderThread();
     GPU_Image* fontImage = GPU_CopyImageFromSurface(fontSurface);
     SDL_FreeSurface(fontSurface);
     if (fontImage == NULL) {
         return False;
     }
     y -= TTF_FontAscent(GET_FONT(gContext->font));
-    GPU_Blit(fontImage, NULL, renderTarget, x + fontImage->w / 2, y + fontImage->h / 2);
-    GPU_FreeImage(fontImage);
-    GPU_Flip(renderTarget);
-    return True;
+    DrawState drawState;
+    initGCDrawState(&drawState, renderTarget, fontImage, gContext);
+    GPU_Rect sourceRect = {0, 0, fontImage->w, fontImage->h};
+    Bool success = queueBlit(&drawState, &sourceRect, x, y);
+    queueImageFree(fontImage);
+    return success;
 }
 
 int XDrawString16(Display* display, Drawable drawable, GC gc, int x, int y, _Xconst XChar2b* string, int length) {
@@ -2,7 +2,23 @@
 #include "gc.h"
 #include "display.h"
 #include "drawing.h"
+#include "renderThread.h"
 
+/* The GC that was last used for drawing. */
+static GC lastResolvedGC = NULL;
+
+/*
+ * Replace the clip region of the graphic context. The graphic context takes ownership of the
+ * region, NULL disables clipping.
+ */
+static void setClipRegion(GraphicContext* gContext, pixman_region16_t* region) {
+    if (gContext->clipRegion != NULL) {
+        pixman_region_fini(gContext->clipRegion);
+        free(gContext->clipRegion);
+    }
+    gContext->clipRegion = region;
+    MARK_GC_DIRTY(gContext, GCClipMask);
+}
 
 int XFreeGC(Display* display, GC gc) {
     SET_X_SERVER_REQUEST(display, X_FreeGC);
@@ -19,6 +35,11 @@ int XFreeGC(Display* display, GC gc) {
     if (gContext->dashes != NULL) {
         free(gContext->dashes);
     }
+    if (gContext->fillImage != NULL) {
+        queueImageFree(gContext->fillImage);
+    }
+    setClipRegion(gContext, NULL);
+    releaseClipRegion(gContext->clip);
     free(gContext);
     XExtData* extData = gc->ext_data;
     while (extData != NULL) {
@@ -30,6 +51,9 @@ int XFreeGC(Display* display, GC gc) {
         free(gc->ext_data);
     }
     FREE_XID(gc->gid);
+    if (gc == lastResolvedGC) {
+        lastResolvedGC = NULL;
+    }
     free(gc);
     return 1;
 }
@@ -96,6 +120,10 @@ GC XCreateGC(Display* display, Drawable d, unsigned long valuemask, XGCValues* v
     gc->clipOriginY = 0;
     gc->clipMask = None;
     gc->dashOffset = 0;
+    gc->dirtyValues = ~0UL;
+    gc->fillImage = NULL;
+    gc->clipRegion = NULL;
+    gc->clip = NULL;
     if (!XChangeGC(display, graphicContextStruct, valuemask, values)) {
         XFreeGC(display, graphicContextStruct);
         return NULL;
@@ -111,6 +139,7 @@ GC XCreateGC(Display* display, Drawable d, unsigned long valuemask, XGCValues* v
         color.r = GET_RED_FROM_COLOR(gc->foreground);
         color.g = GET_GREEN_FROM_COLOR(gc->foreground);
         color.b = GET_BLUE_FROM_COLOR(gc->foreground);
+        flushDisplayListForImage(GET_PIXMAP_IMAGE(gc->tile));
         GPU_RectangleFilled(GET_PIXMAP_IMAGE(gc->tile)->target, 0 , 0, 2, 2, color);
     }
     if (gc->stipple == None) {
@@ -120,7 +149,8 @@ GC XCreateGC(Display* display, Drawable d, unsigned long valuemask, XGCValues* v
             return NULL;
         }
         SDL_Color color = {0xFF, 0xFF, 0xFF, 0xFF};
-        GPU_RectangleFilled(GET_PIXMAP_IMAGE(gc->tile)->target, 0 , 0, 2, 2, color);
+        flushDisplayListForImage(GET_PIXMAP_IMAGE(gc->stipple));
+        GPU_RectangleFilled(GET_PIXMAP_IMAGE(gc->stipple)->target, 0 , 0, 2, 2, color);
     }
     return graphicContextStruct;
 }
@@ -154,6 +184,27 @@ Bool setDashes(Display* display, GraphicContext* gc, const char dashes[], size_t
     return True;
 }
 
+/*
+ * Create a copy of a tile, stipple or clip mask pixmap, because every graphic context owns its
+ * pixmaps and the client may free or draw on the pixmap it set. Returns None and reports
+ * an error if the copy could not be created.
+ */
+static Pixmap copyPixmap(Display* display, Pixmap pixmap, unsigned int depth) {
+    GPU_Image* image = GET_PIXMAP_IMAGE(pixmap);
+    Pixmap copy = XCreatePixmap(display, pixmap, image->w, image->h, depth);
+    if (copy == None) return None;
+    XGCValues values;
+    values.graphics_exposures = False;
+    GC gc = XCreateGC(display, copy, GCGraphicsExposures, &values);
+    if (gc == NULL) {
+        XFreePixmap(display, copy);
+        return None;
+    }
+    XCopyArea(display, pixmap, copy, gc, 0, 0, image->w, image->h, 0, 0);
+    XFreeGC(display, gc);
+    return copy;
+}
+
 int XChangeGC(Display* display, GC gc, unsigned long valuemask, XGCValues* values) {
     // https://tronche.com/gui/x/xlib/GC/XChangeGC.html
     SET_X_SERVER_REQUEST(display, X_ChangeGC);
@@ -174,15 +225,19 @@ int XChangeGC(Display* display, GC gc, unsigned long valuemask, XGCValues* value
     if (HAS_VALUE(valuemask, GCFillRule)) {graphicContext->fillRule = values->fill_rule;}
     if (HAS_VALUE(valuemask, GCTile)) {
         TYPE_CHECK(values->tile, PIXMAP, display, 0);
+        Pixmap tile = copyPixmap(display, values->tile, 32);
+        if (tile == None) return 0;
         if (graphicContext->tile != None) {XFreePixmap(display, graphicContext->tile);}
         SET_X_SERVER_REQUEST(display, X_ChangeGC);
-        graphicContext->tile = values->tile;
+        graphicContext->tile = tile;
     }
     if (HAS_VALUE(valuemask, GCStipple)) {
         TYPE_CHECK(values->stipple, PIXMAP, display, 0);
+        Pixmap stipple = copyPixmap(display, values->stipple, 1);
+        if (stipple == None) return 0;
         if (graphicContext->stipple != None) {XFreePixmap(display, graphicContext->stipple);}
         SET_X_SERVER_REQUEST(display, X_ChangeGC);
-        graphicContext->stipple = values->stipple;
+        graphicContext->stipple = stipple;
     }
     if (HAS_VALUE(valuemask, GCTileStipXOrigin)) {graphicContext->tileStipOriginX = values->ts_x_origin;}
     if (HAS_VALUE(valuemask, GCTileStipYOrigin)) {graphicContext->tileStipOriginY = values->ts_y_origin;}
@@ -202,6 +257,7 @@ int XChangeGC(Display* display, GC gc, unsigned long valuemask, XGCValues* value
         if (!setDashes(display, graphicContext, value, 2, true)) return 0;
     }
     if (HAS_VALUE(valuemask, GCArcMode)) {graphicContext->arcMode = values->arc_mode;}
+    MARK_GC_DIRTY(graphicContext, valuemask);
     return 1;
 }
 
@@ -211,8 +267,40 @@ int XCopyGC(Display *display, GC src, unsigned long valuemask, GC dest) {
     XGCValues gcValues;
     if (!XGetGCValues(display, src, valuemask, &gcValues)) return 0;
     GraphicContext* srcGraphicContext = GET_GC(src);
-    gcValues.clip_mask = srcGraphicContext->clipMask;
-    if (!XChangeGC(display, dest, valuemask, &gcValues)) return 0;
+    if (!XChangeGC(display, dest, valuemask & ~GCClipMask, &gcValues)) return 0;
+    if (HAS_VALUE(valuemask, GCClipMask)) {
+        // The clip mask is copied together with its region, so both stay consistent.
+        Pixmap clipMask = None;
+        if (srcGraphicContext->clipMask != None) {
+            clipMask = copyPixmap(display, srcGraphicContext->clipMask, 1);
+            if (clipMask == None) return 0;
+            SET_X_SERVER_REQUEST(display, X_CopyGC);
+        }
+        pixman_region16_t* clipRegion = NULL;
+        if (srcGraphicContext->clipRegion != NULL) {
+            clipRegion = malloc(sizeof(pixman_region16_t));
+            if (clipRegion != NULL) {
+                pixman_region_init(clipRegion);
+                if (!pixman_region_copy(clipRegion, srcGraphicContext->clipRegion)) {
+                    pixman_region_fini(clipRegion);
+                    free(clipRegion);
+                    clipRegion = NULL;
+                }
+            }
+            if (clipRegion == NULL) {
+                if (clipMask != None) {XFreePixmap(display, clipMask);}
+                handleOutOfMemory(0, display, 0, 0);
+                return 0;
+            }
+        }
+        GraphicContext* destGraphicContext = GET_GC(dest);
+        if (destGraphicContext->clipMask != None) {
+            XFreePixmap(display, destGraphicContext->clipMask);
+            SET_X_SERVER_REQUEST(display, X_CopyGC);
+        }
+        destGraphicContext->clipMask = clipMask;
+        setClipRegion(destGraphicContext, clipRegion);
+    }
     return setDashes(display, GET_GC(dest), srcGraphicContext->dashes, srcGraphicContext->numDashes, false) ? 1 : 0;
 }
 
@@ -234,7 +322,7 @@ Status XGetGCValues(Display* display, GC gc, unsigned long valuemask, XGCValues*
         else {values_return->tile = graphicContext->tile;}
     }
     if (HAS_VALUE(valuemask, GCStipple)) {
-        if (graphicContext->stipple != None) {values_return->stipple = 0xFFFFFFFF;}
+        if (graphicContext->stipple == None) {values_return->stipple = 0xFFFFFFFF;}
         else {values_return->stipple = graphicContext->stipple;}
     }
     if (HAS_VALUE(valuemask, GCTileStipXOrigin)) {values_return->ts_x_origin = graphicContext->tileStipOriginX;}
@@ -257,6 +345,7 @@ int XSetTSOrigin(Display* display, GC gc, int ts_x_origin, int ts_y_origin) {
     (void) display;
     GET_GC(gc)->tileStipOriginX = ts_x_origin;
     GET_GC(gc)->tileStipOriginY = ts_y_origin;
+    MARK_GC_DIRTY(GET_GC(gc), GCTileStipXOrigin | GCTileStipYOrigin);
     return 1;
 }
 
@@ -265,6 +354,7 @@ int XSetClipOrigin(Display* display, GC gc, int clip_x_origin, int clip_y_origin
     (void) display;
     GET_GC(gc)->clipOriginX = clip_x_origin;
     GET_GC(gc)->clipOriginY = clip_y_origin;
+    MARK_GC_DIRTY(GET_GC(gc), GCClipXOrigin | GCClipYOrigin);
     return 1;
 }
 
@@ -277,16 +367,83 @@ int XSetDashes(Display* display, GC gc, int dash_offset, _Xconst char dash_list[
     GraphicContext* graphicContext = GET_GC(gc);
     if (!setDashes(display, graphicContext, dash_list, (size_t) n, true)) return 0;
     graphicContext->dashOffset = dash_offset;
+    MARK_GC_DIRTY(graphicContext, GCDashList | GCDashOffset);
     return 1;
 }
 
 int XSetClipMask(Display* display, GC gc, Pixmap pixmap) {
     // http://www.net.uom.gr/Books/Manuals/xlib/GC/convenience-functions/XSetClipMask.html
-    TYPE_CHECK(pixmap, PIXMAP, display, 0);
+    pixman_region16_t* clipRegion = NULL;
+    if (pixmap != None) {
+        TYPE_CHECK(pixmap, PIXMAP, display, 0);
+        // The clip mask is converted into the region of its set pixels.
+        clipRegion = malloc(sizeof(pixman_region16_t));
+        if (clipRegion == NULL || !createRegionFromBitmap(GET_PIXMAP_IMAGE(pixmap), clipRegion)) {
+            free(clipRegion);
+            handleOutOfMemory(0, display, 0, 0);
+            return 0;
+        }
+    }
+    Pixmap clipMask = None;
+    if (pixmap != None) {
+        clipMask = copyPixmap(display, pixmap, 1);
+        if (clipMask == None) {
+            pixman_region_fini(clipRegion);
+            free(clipRegion);
+            return 0;
+        }
+    }
     GraphicContext* graphicContext = GET_GC(gc);
     if (graphicContext->clipMask != None) {XFreePixmap(display, graphicContext->clipMask);}
     SET_X_SERVER_REQUEST(display, X_ChangeGC);
-    graphicContext->clipMask = pixmap;
+    graphicContext->clipMask = clipMask;
+    setClipRegion(graphicContext, clipRegion);
+    return 1;
+}
+
+int XSetClipRectangles(Display* display, GC gc, int clip_x_origin, int clip_y_origin,
+                       XRectangle* rectangles, int n, int ordering) {
+    // https://tronche.com/gui/x/xlib/GC/XSetClipRectangles.html
+    SET_X_SERVER_REQUEST(display, X_SetClipRectangles);
+    if (ordering != Unsorted && ordering != YSorted && ordering != YXSorted
+        && ordering != YXBanded) {
+        LOG("Bad ordering given to %s: %d\n", __func__, ordering);
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    pixman_region16_t* clipRegion = malloc(sizeof(pixman_region16_t));
+    pixman_box16_t* boxes = n > 0 ? malloc(sizeof(pixman_box16_t) * n) : NULL;
+    if (clipRegion == NULL || (n > 0 && boxes == NULL)) {
+        free(clipRegion);
+        free(boxes);
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    int i;
+    for (i = 0; i < n; i++) {
+        boxes[i].x1 = rectangles[i].x;
+        boxes[i].y1 = rectangles[i].y;
+        boxes[i].x2 = (int16_t) (rectangles[i].x + rectangles[i].width);
+        boxes[i].y2 = (int16_t) (rectangles[i].y + rectangles[i].height);
+    }
+    // The rectangles may be in any order, pixman sorts and merges them.
+    Bool success = pixman_region_init_rects(clipRegion, boxes, n) ? True : False;
+    free(boxes);
+    if (!success) {
+        free(clipRegion);
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    GraphicContext* graphicContext = GET_GC(gc);
+    if (graphicContext->clipMask != None) {
+        XFreePixmap(display, graphicContext->clipMask);
+        SET_X_SERVER_REQUEST(display, X_SetClipRectangles);
+        graphicContext->clipMask = None;
+    }
+    graphicContext->clipOriginX = clip_x_origin;
+    graphicContext->clipOriginY = clip_y_origin;
+    setClipRegion(graphicContext, clipRegion);
+    MARK_GC_DIRTY(graphicContext, GCClipXOrigin | GCClipYOrigin);
     return 1;
 }
 
@@ -294,6 +451,7 @@ int XSetForeground(Display* display, GC gc, unsigned long foreground) {
     // https://linux.die.net/man/3/xsetforeground
     (void) display;
     GET_GC(gc)->foreground = foreground;
+    MARK_GC_DIRTY(GET_GC(gc), GCForeground);
     return 1;
 }
 
@@ -301,5 +459,262 @@ int XSetFont(Display* display, GC gc, Font font) {
     // http://www.net.uom.gr/Books/Manuals/xlib/GC/convenience-functions/XSetFont.html
     TYPE_CHECK(font, FONT, display, 0);
     GET_GC(gc)->font = font;
+    MARK_GC_DIRTY(GET_GC(gc), GCFont);
+    return 1;
+}
+
+int XSetBackground(Display* display, GC gc, unsigned long background) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetBackground.html
+    (void) display;
+    GET_GC(gc)->background = background;
+    MARK_GC_DIRTY(GET_GC(gc), GCBackground);
+    return 1;
+}
+
+int XSetState(Display* display, GC gc, unsigned long foreground, unsigned long background,
+              int function, unsigned long plane_mask) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetState.html
+    XGCValues values;
+    values.foreground = foreground;
+    values.background = background;
+    values.function = function;
+    values.plane_mask = plane_mask;
+    return XChangeGC(display, gc, GCForeground | GCBackground | GCFunction | GCPlaneMask, &values);
+}
+
+int XSetFunction(Display* display, GC gc, int function) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetFunction.html
+    SET_X_SERVER_REQUEST(display, X_ChangeGC);
+    if (function < GXclear || function > GXset) {
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GET_GC(gc)->function = function;
+    MARK_GC_DIRTY(GET_GC(gc), GCFunction);
+    return 1;
+}
+
+int XSetPlaneMask(Display* display, GC gc, unsigned long plane_mask) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetPlaneMask.html
+    (void) display;
+    GET_GC(gc)->planeMask = plane_mask;
+    MARK_GC_DIRTY(GET_GC(gc), GCPlaneMask);
+    return 1;
+}
+
+int XSetLineAttributes(Display* display, GC gc, unsigned int line_width, int line_style,
+                       int cap_style, int join_style) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetLineAttributes.html
+    SET_X_SERVER_REQUEST(display, X_ChangeGC);
+    if (line_style < LineSolid || line_style > LineDoubleDash || cap_style < CapNotLast
+        || cap_style > CapProjecting || join_style < JoinMiter || join_style > JoinBevel) {
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GraphicContext* graphicContext = GET_GC(gc);
+    graphicContext->lineWidth = line_width;
+    graphicContext->lineStyle = line_style;
+    graphicContext->capStyle = cap_style;
+    graphicContext->joinStyle = join_style;
+    MARK_GC_DIRTY(graphicContext, GCLineWidth | GCLineStyle | GCCapStyle | GCJoinStyle);
+    return 1;
+}
+
+int XSetFillStyle(Display* display, GC gc, int fill_style) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetFillStyle.html
+    SET_X_SERVER_REQUEST(display, X_ChangeGC);
+    if (fill_style < FillSolid || fill_style > FillOpaqueStippled) {
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GET_GC(gc)->fillStyle = fill_style;
+    MARK_GC_DIRTY(GET_GC(gc), GCFillStyle);
+    return 1;
+}
+
+int XSetFillRule(Display* display, GC gc, int fill_rule) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetFillRule.html
+    SET_X_SERVER_REQUEST(display, X_ChangeGC);
+    if (fill_rule != EvenOddRule && fill_rule != WindingRule) {
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GET_GC(gc)->fillRule = fill_rule;
+    MARK_GC_DIRTY(GET_GC(gc), GCFillRule);
+    return 1;
+}
+
+int XSetArcMode(Display* display, GC gc, int arc_mode) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetArcMode.html
+    SET_X_SERVER_REQUEST(display, X_ChangeGC);
+    if (arc_mode != ArcChord && arc_mode != ArcPieSlice) {
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GET_GC(gc)->arcMode = arc_mode;
+    MARK_GC_DIRTY(GET_GC(gc), GCArcMode);
+    return 1;
+}
+
+int XSetSubwindowMode(Display* display, GC gc, int subwindow_mode) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetSubwindowMode.html
+    SET_X_SERVER_REQUEST(display, X_ChangeGC);
+    if (subwindow_mode != ClipByChildren && subwindow_mode != IncludeInferiors) {
+        handleError(0, display, None, 0, BadValue, 0);
+        return 0;
+    }
+    GET_GC(gc)->subWindowMode = subwindow_mode;
+    MARK_GC_DIRTY(GET_GC(gc), GCSubwindowMode);
+    return 1;
+}
+
+int XSetGraphicsExposures(Display* display, GC gc, Bool graphics_exposures) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetGraphicsExposures.html
+    (void) display;
+    GET_GC(gc)->graphicsExposures = graphics_exposures;
+    MARK_GC_DIRTY(GET_GC(gc), GCGraphicsExposures);
     return 1;
 }
+
+int XSetTile(Display* display, GC gc, Pixmap tile) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetTile.html
+    XGCValues values;
+    values.tile = tile;
+    return XChangeGC(display, gc, GCTile, &values);
+}
+
+int XSetStipple(Display* display, GC gc, Pixmap stipple) {
+    // https://tronche.com/gui/x/xlib/GC/convenience-functions/XSetStipple.html
+    XGCValues values;
+    values.stipple = stipple;
+    return XChangeGC(display, gc, GCStipple, &values);
+}
+
+/*
+ * Get the graphic context of the GC and resolve the values that changed since the last call.
+ */
+GraphicContext* getResolvedGC(GC gc) {
+    GraphicContext* gContext = GET_GC(gc);
+    if (gc != lastResolvedGC) {
+        getRenderStateCounters()->gcSwitches++;
+        lastResolvedGC = gc;
+    }
+    if (gContext->dirtyValues == 0) return gContext;
+    if (HAS_VALUE(gContext->dirtyValues, GCForeground)) {
+        gContext->foregroundColor.r = GET_RED_FROM_COLOR(gContext->foreground);
+        gContext->foregroundColor.g = GET_GREEN_FROM_COLOR(gContext->foreground);
+        gContext->foregroundColor.b = GET_BLUE_FROM_COLOR(gContext->foreground);
+        gContext->foregroundColor.a = GET_ALPHA_FROM_COLOR(gContext->foreground);
+        getRenderStateCounters()->gcValueUpdates++;
+    }
+    if (HAS_VALUE(gContext->dirtyValues, GCBackground)) {
+        gContext->backgroundColor.r = GET_RED_FROM_COLOR(gContext->background);
+        gContext->backgroundColor.g = GET_GREEN_FROM_COLOR(gContext->background);
+        gContext->backgroundColor.b = GET_BLUE_FROM_COLOR(gContext->background);
+        gContext->backgroundColor.a = GET_ALPHA_FROM_COLOR(gContext->background);
+        getRenderStateCounters()->gcValueUpdates++;
+    }
+    if (gContext->fillImage != NULL && HAS_VALUE(gContext->dirtyValues, (GCFillStyle | GCTile
+                                                 | GCStipple | GCForeground | GCBackground))) {
+        queueImageFree(gContext->fillImage);
+        gContext->fillImage = NULL;
+    }
+    if (HAS_VALUE(gContext->dirtyValues, (GCClipMask | GCClipXOrigin | GCClipYOrigin))) {
+        releaseClipRegion(gContext->clip);
+        gContext->clip = NULL;
+        if (gContext->clipRegion != NULL) {
+            gContext->clip = createClipRegion(gContext->clipRegion,
+                                              gContext->clipOriginX, gContext->clipOriginY);
+            if (gContext->clip == NULL) {
+                LOG("Out of memory: Failed to create the clip region in %s!\n", __func__);
+            }
+        }
+        getRenderStateCounters()->gcValueUpdates++;
+    }
+    gContext->dirtyValues = 0;
+    return gContext;
+}
+
+/*
+ * Initialize the draw state of a command that draws on the target with the graphic context.
+ */
+void initGCDrawState(DrawState* state, GPU_Target* target, GPU_Image* image,
+                     const GraphicContext* gContext) {
+    initDrawState(state, target, image);
+    state->function = gContext->function;
+    state->planeMask = gContext->planeMask;
+    if (gContext->clip != NULL) {
+        setDrawStateClip(state, gContext->clip);
+    }
+}
+
+/*
+ * Get the texture that fills are drawn with for the fill style of the resolved graphic context.
+ * For FillTiled it is a copy of the tile, for the stippled fill styles the stipple is colored
+ * with the foreground and, for FillOpaqueStippled, the background color. The texture wraps and
+ * is cached until the values it depends on change. Returns NULL for FillSolid or on failure.
+ */
+GPU_Image* getGCFillImage(GraphicContext* gContext) {
+    if (gContext->fillStyle == FillSolid) return NULL;
+    if (gContext->fillImage != NULL) return gContext->fillImage;
+    Pixmap pixmap = gContext->fillStyle == FillTiled ? gContext->tile : gContext->stipple;
+    GPU_Image* source = GET_PIXMAP_IMAGE(pixmap);
+    if (source == NULL) {
+        LOG("The graphic context has no %s in %s\n",
+            gContext->fillStyle == FillTiled ? "tile" : "stipple", __func__);
+        return NULL;
+    }
+    flushDisplayListForTarget(source->target);
+    GPU_Image* fillImage = GPU_CopyImage(source);
+    if (fillImage == NULL) {
+        LOG("Failed to copy the fill image in %s: %s\n", __func__, GPU_PopErrorCode().details);
+        return NULL;
+    }
+    if (gContext->fillStyle != FillTiled) {
+        GPU_Target* fillTarget = GPU_LoadTarget(fillImage);
+        if (fillTarget == NULL) {
+            LOG("Failed to create the target of the fill image in %s: %s\n", __func__,
+                GPU_PopErrorCode().details);
+            GPU_FreeImage(fillImage);
+            return NULL;
+        }
+        // The set bits of the stipple have an alpha of one.
+        GPU_SetShapeBlendFunction(GPU_FUNC_DST_ALPHA, GPU_FUNC_ZERO,
+                                  GPU_FUNC_DST_ALPHA, GPU_FUNC_ZERO);
+        GPU_RectangleFilled(fillTarget, 0, 0, fillImage->w, fillImage->h,
+                            gContext->foregroundColor);
+        if (gContext->fillStyle == FillOpaqueStippled) {
+            GPU_SetShapeBlendFunction(GPU_FUNC_ONE_MINUS_DST_ALPHA, GPU_FUNC_ONE,
+                                      GPU_FUNC_ONE, GPU_FUNC_ZERO);
+            GPU_RectangleFilled(fillTarget, 0, 0, fillImage->w, fillImage->h,
+                                gContext->backgroundColor);
+        }
+        GPU_SetShapeBlendMode(GPU_BLEND_NORMAL);
+        GPU_Flip(fillTarget);
+        GPU_FreeTarget(fillTarget);
+    }
+    GPU_SetImageFilter(fillImage, GPU_FILTER_NEAREST);
+    GPU_SetWrapMode(fillImage, GPU_WRAP_REPEAT, GPU_WRAP_REPEAT);
+    gContext->fillImage = fillImage;
+    return fillImage;
+}
+
+/*
+ * Get the stipple of the resolved graphic context as a repeat-wrapped texture, whose set bits
+ * are opaque and whose unset bits are transparent. Returns NULL on failure.
+ */
+GPU_Image* getGCStippleImage(GraphicContext* gContext) {
+    GPU_Image* stipple = GET_PIXMAP_IMAGE(gContext->stipple);
+    if (stipple == NULL) {
+        LOG("The graphic context has no stipple in %s\n", __func__);
+        return NULL;
+    }
+    if (stipple->wrap_mode_x != GPU_WRAP_REPEAT || stipple->wrap_mode_y != GPU_WRAP_REPEAT
+        || stipple->filter_mode != GPU_FILTER_NEAREST) {
+        // The graphic context owns its stipple, so it can change how the stipple is sampled.
+        syncRenderThread();
+        GPU_SetImageFilter(stipple, GPU_FILTER_NEAREST);
+        GPU_SetWrapMode(stipple, GPU_WRAP_REPEAT, GPU_WRAP_REPEAT);
+    }
+    return stipple;
+}
@@ -2,7 +2,9 @@
 #define GC_H
 
 #include "X11/Xlib.h"
+#include "SDL.h"
 #include "resourceTypes.h"
+#include "displayList.h"
 
 struct _XGC {
     XExtData *ext_data;	/* hook for extension to hang data */
@@ -34,9 +36,22 @@ typedef struct _GraphicContext {
     char* dashes; // If numDashes is uneven, this has to be treated as concatenated with itself.
     size_t numDashes;
     int arcMode;
+    unsigned long dirtyValues; // The GC values (GC* masks) that changed since they were resolved.
+    SDL_Color foregroundColor; // The resolved foreground color.
+    SDL_Color backgroundColor; // The resolved background color.
+    GPU_Image* fillImage; // The cached texture of the tile or stipple for the fill style.
+    pixman_region16_t* clipRegion; // The clip region relative to the clip origin or NULL.
+    ClipRegion* clip; // The resolved clip region with the clip origin applied.
 } GraphicContext;
 
 #define GET_GC(gc) GET_GC_FROM_XID(((struct _XGC*) (gc))->gid)
 #define GET_GC_FROM_XID(id) ((GraphicContext*) GET_XID_VALUE(id))
+#define MARK_GC_DIRTY(gContext, valueMask) ((gContext)->dirtyValues |= (valueMask))
+
+GraphicContext* getResolvedGC(GC gc);
+GPU_Image* getGCFillImage(GraphicContext* gContext);
+GPU_Image* getGCStippleImage(GraphicContext* gContext);
+void initGCDrawState(DrawState* state, GPU_Target* target, GPU_Image* image,
+                     const GraphicContext* gContext);
 
 #endif /* GC_H */
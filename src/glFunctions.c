@@ -0,0 +1,76 @@
+#include <string.h>
+#include "glFunctions.h"
+#include "util.h"
+
+static GLFunctions functions;
+static Bool functionsLoaded = False;
+
+#define LOAD_GL_FUNCTION(field, type, name) \
+    functions.field = (type) SDL_GL_GetProcAddress(name)
+
+/*
+ * Get the OpenGL functions, loading them with the first call.
+ * This must be called while an OpenGL context of SDL_gpu is current.
+ */
+const GLFunctions* getGLFunctions() {
+    if (functionsLoaded) return &functions;
+    functionsLoaded = True;
+    memset(&functions, 0, sizeof(functions));
+    LOAD_GL_FUNCTION(enable, EnableFunc, "glEnable");
+    LOAD_GL_FUNCTION(disable, EnableFunc, "glDisable");
+    LOAD_GL_FUNCTION(colorMask, ColorMaskFunc, "glColorMask");
+    LOAD_GL_FUNCTION(stencilFunc, StencilFuncFunc, "glStencilFunc");
+    LOAD_GL_FUNCTION(stencilOp, StencilOpFunc, "glStencilOp");
+    LOAD_GL_FUNCTION(stencilMask, StencilMaskFunc, "glStencilMask");
+    LOAD_GL_FUNCTION(getIntegerv, GetIntegervFunc, "glGetIntegerv");
+    LOAD_GL_FUNCTION(bindTexture, BindObjectFunc, "glBindTexture");
+    LOAD_GL_FUNCTION(copyTexSubImage2D, CopyTexSubImage2DFunc, "glCopyTexSubImage2D");
+    LOAD_GL_FUNCTION(readPixels, ReadPixelsFunc, "glReadPixels");
+    LOAD_GL_FUNCTION(genFramebuffers, GenObjectsFunc, "glGenFramebuffers");
+    LOAD_GL_FUNCTION(deleteFramebuffers, DeleteObjectsFunc, "glDeleteFramebuffers");
+    LOAD_GL_FUNCTION(bindFramebuffer, BindObjectFunc, "glBindFramebuffer");
+    LOAD_GL_FUNCTION(framebufferTexture2D, FramebufferTexture2DFunc, "glFramebufferTexture2D");
+    LOAD_GL_FUNCTION(checkFramebufferStatus, CheckFramebufferStatusFunc,
+                     "glCheckFramebufferStatus");
+    LOAD_GL_FUNCTION(genRenderbuffers, GenObjectsFunc, "glGenRenderbuffers");
+    LOAD_GL_FUNCTION(deleteRenderbuffers, DeleteObjectsFunc, "glDeleteRenderbuffers");
+    LOAD_GL_FUNCTION(bindRenderbuffer, BindObjectFunc, "glBindRenderbuffer");
+    LOAD_GL_FUNCTION(renderbufferStorage, RenderbufferStorageFunc, "glRenderbufferStorage");
+    LOAD_GL_FUNCTION(framebufferRenderbuffer, FramebufferRenderbufferFunc,
+                     "glFramebufferRenderbuffer");
+    LOAD_GL_FUNCTION(genBuffers, GenObjectsFunc, "glGenBuffers");
+    LOAD_GL_FUNCTION(deleteBuffers, DeleteObjectsFunc, "glDeleteBuffers");
+    LOAD_GL_FUNCTION(bindBuffer, BindObjectFunc, "glBindBuffer");
+    LOAD_GL_FUNCTION(bufferData, BufferDataFunc, "glBufferData");
+    LOAD_GL_FUNCTION(mapBufferRange, MapBufferRangeFunc, "glMapBufferRange");
+    LOAD_GL_FUNCTION(unmapBuffer, UnmapBufferFunc, "glUnmapBuffer");
+    LOAD_GL_FUNCTION(fenceSync, FenceSyncFunc, "glFenceSync");
+    LOAD_GL_FUNCTION(clientWaitSync, ClientWaitSyncFunc, "glClientWaitSync");
+    LOAD_GL_FUNCTION(deleteSync, DeleteSyncFunc, "glDeleteSync");
+    GPU_Renderer* renderer = GPU_GetCurrentRenderer();
+    if (renderer != NULL && renderer->id.renderer < GPU_RENDERER_GLES_1) {
+        // OpenGL ES does not have logic operations.
+        LOAD_GL_FUNCTION(logicOp, LogicOpFunc, "glLogicOp");
+    }
+    // Pixel buffers and fences are core in OpenGL 3 and OpenGL ES 3.
+    functions.pixelBuffersSupported = renderer != NULL && renderer->id.major_version >= 3
+            && functions.genBuffers != NULL && functions.deleteBuffers != NULL
+            && functions.bindBuffer != NULL && functions.bufferData != NULL
+            && functions.mapBufferRange != NULL && functions.unmapBuffer != NULL
+            && functions.fenceSync != NULL && functions.clientWaitSync != NULL
+            && functions.deleteSync != NULL;
+    LOG("Loaded the OpenGL functions: logic operations %s, asynchronous readbacks %s\n",
+        functions.logicOp != NULL ? "available" : "unavailable",
+        functions.pixelBuffersSupported ? "available" : "unavailable");
+    return &functions;
+}
+
+/*
+ * Forget the loaded functions, they are loaded again for the next OpenGL context.
+ */
+void freeGLFunctions() {
+    memset(&functions, 0, sizeof(functions));
+    functionsLoaded = False;
+}
+
+#undef LOAD_GL_FUNCTION
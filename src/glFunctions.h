@@ -0,0 +1,167 @@
+#ifndef _GL_FUNCTIONS_H_
+#define _GL_FUNCTIONS_H_
+
+#include "X11/Xlib.h"
+#include <stddef.h>
+#include <SDL_gpu.h>
+#ifdef __ANDROID__
+#  include "SDL_opengles2.h"
+#  ifndef APIENTRY
+#    define APIENTRY GL_APIENTRY
+#  endif
+#else
+#  include "SDL_opengl.h"
+#endif
+
+/*
+ * The OpenGL functions that are used directly, next to SDL_gpu. Not all of them are available
+ * on every renderer, so the users must check the functions they need for NULL.
+ */
+
+#ifndef GL_COLOR_LOGIC_OP
+#  define GL_COLOR_LOGIC_OP 0x0BF2
+#endif
+#ifndef GL_STENCIL_TEST
+#  define GL_STENCIL_TEST 0x0B90
+#endif
+#ifndef GL_ALWAYS
+#  define GL_ALWAYS 0x0207
+#endif
+#ifndef GL_EQUAL
+#  define GL_EQUAL 0x0202
+#endif
+#ifndef GL_KEEP
+#  define GL_KEEP 0x1E00
+#endif
+#ifndef GL_REPLACE
+#  define GL_REPLACE 0x1E01
+#endif
+#ifndef GL_INVERT
+#  define GL_INVERT 0x150A
+#endif
+#ifndef GL_FRAMEBUFFER
+#  define GL_FRAMEBUFFER 0x8D40
+#endif
+#ifndef GL_FRAMEBUFFER_BINDING
+#  define GL_FRAMEBUFFER_BINDING 0x8CA6
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE
+#  define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#  define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_RENDERBUFFER
+#  define GL_RENDERBUFFER 0x8D41
+#endif
+#ifndef GL_STENCIL_ATTACHMENT
+#  define GL_STENCIL_ATTACHMENT 0x8D20
+#endif
+#ifndef GL_STENCIL_INDEX8
+#  define GL_STENCIL_INDEX8 0x8D48
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#  define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#  define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#  define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#  define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#  define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#  define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#  define GL_CONDITION_SATISFIED 0x911C
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#  define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_WAIT_FAILED
+#  define GL_WAIT_FAILED 0x911D
+#endif
+/* The OpenGL logic operations are in the same order as the GC functions, starting at GL_CLEAR. */
+#define GL_LOGIC_OP_BASE 0x1500
+
+typedef void* GLSync;
+typedef void (APIENTRY* EnableFunc)(GLenum capability);
+typedef void (APIENTRY* LogicOpFunc)(GLenum opcode);
+typedef void (APIENTRY* ColorMaskFunc)(GLboolean red, GLboolean green, GLboolean blue,
+                                       GLboolean alpha);
+typedef void (APIENTRY* StencilFuncFunc)(GLenum func, GLint ref, GLuint mask);
+typedef void (APIENTRY* StencilOpFunc)(GLenum fail, GLenum zFail, GLenum zPass);
+typedef void (APIENTRY* StencilMaskFunc)(GLuint mask);
+typedef void (APIENTRY* GetIntegervFunc)(GLenum name, GLint* data);
+typedef void (APIENTRY* GenObjectsFunc)(GLsizei count, GLuint* objects);
+typedef void (APIENTRY* DeleteObjectsFunc)(GLsizei count, const GLuint* objects);
+typedef void (APIENTRY* BindObjectFunc)(GLenum target, GLuint object);
+typedef void (APIENTRY* RenderbufferStorageFunc)(GLenum target, GLenum format,
+                                                 GLsizei width, GLsizei height);
+typedef void (APIENTRY* FramebufferRenderbufferFunc)(GLenum target, GLenum attachment,
+                                                     GLenum renderbufferTarget,
+                                                     GLuint renderbuffer);
+typedef void (APIENTRY* FramebufferTexture2DFunc)(GLenum target, GLenum attachment,
+                                                  GLenum textureTarget, GLuint texture,
+                                                  GLint level);
+typedef GLenum (APIENTRY* CheckFramebufferStatusFunc)(GLenum target);
+typedef void (APIENTRY* CopyTexSubImage2DFunc)(GLenum target, GLint level, GLint xoffset,
+                                               GLint yoffset, GLint x, GLint y,
+                                               GLsizei width, GLsizei height);
+typedef void (APIENTRY* ReadPixelsFunc)(GLint x, GLint y, GLsizei width, GLsizei height,
+                                        GLenum format, GLenum type, void* pixels);
+typedef void (APIENTRY* BufferDataFunc)(GLenum target, ptrdiff_t size, const void* data,
+                                        GLenum usage);
+typedef void* (APIENTRY* MapBufferRangeFunc)(GLenum target, ptrdiff_t offset, ptrdiff_t length,
+                                             GLbitfield access);
+typedef GLboolean (APIENTRY* UnmapBufferFunc)(GLenum target);
+typedef GLSync (APIENTRY* FenceSyncFunc)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY* ClientWaitSyncFunc)(GLSync sync, GLbitfield flags, Uint64 timeout);
+typedef void (APIENTRY* DeleteSyncFunc)(GLSync sync);
+
+typedef struct {
+    EnableFunc enable;
+    EnableFunc disable;
+    /* Only available on desktop OpenGL. */
+    LogicOpFunc logicOp;
+    ColorMaskFunc colorMask;
+    StencilFuncFunc stencilFunc;
+    StencilOpFunc stencilOp;
+    StencilMaskFunc stencilMask;
+    GetIntegervFunc getIntegerv;
+    BindObjectFunc bindTexture;
+    CopyTexSubImage2DFunc copyTexSubImage2D;
+    ReadPixelsFunc readPixels;
+    GenObjectsFunc genFramebuffers;
+    DeleteObjectsFunc deleteFramebuffers;
+    BindObjectFunc bindFramebuffer;
+    FramebufferTexture2DFunc framebufferTexture2D;
+    CheckFramebufferStatusFunc checkFramebufferStatus;
+    GenObjectsFunc genRenderbuffers;
+    DeleteObjectsFunc deleteRenderbuffers;
+    BindObjectFunc bindRenderbuffer;
+    RenderbufferStorageFunc renderbufferStorage;
+    FramebufferRenderbufferFunc framebufferRenderbuffer;
+    GenObjectsFunc genBuffers;
+    DeleteObjectsFunc deleteBuffers;
+    BindObjectFunc bindBuffer;
+    BufferDataFunc bufferData;
+    MapBufferRangeFunc mapBufferRange;
+    UnmapBufferFunc unmapBuffer;
+    FenceSyncFunc fenceSync;
+    ClientWaitSyncFunc clientWaitSync;
+    DeleteSyncFunc deleteSync;
+    /* Whether pixel buffers and fences are available (OpenGL 3 and OpenGL ES 3). */
+    Bool pixelBuffersSupported;
+} GLFunctions;
+
+const GLFunctions* getGLFunctions(void);
+void freeGLFunctions(void);
+
+#endif /* _GL_FUNCTIONS_H_ */
@@ -0,0 +1,433 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__) && !defined(__ANDROID__)
+#  include <sys/mman.h>
+#  include <sys/eventfd.h>
+#  define HEADLESS_MODE_SUPPORTED
+#endif
+#include "headless.h"
+#include "window.h"
+#include "pixman.h"
+#include "readback.h"
+#include "util.h"
+
+/*
+ * In the headless mode the top level windows are not shown. They only have a hidden SDL window
+ * to track their geometry and draw into an offscreen image instead, so they don't need an
+ * OpenGL capable window. The content of the root window is composed into a framebuffer in
+ * shared memory, which is exported as a memfd.
+ * After every flush of the display list, the areas of the windows that were drawn on are read
+ * back asynchronously, from the bottom to the top of the stacking order. Once the pixels of an
+ * area arrived, the parts of it that are not covered by a window above are copied into the
+ * framebuffer and the damage fd (an eventfd) is signaled.
+ * The stacking order and geometry of the windows are recorded into every flushed display list,
+ * because the display list might be executed by the render thread while the client changes
+ * the windows and records the next lists. Windows that appear in the recording are damaged
+ * completely.
+ * External tools can map the framebuffer fd and wait for the damage fd to read frames.
+ * The framebuffer can also be exported while the windows are shown, e.g. for the RFB server.
+ */
+
+typedef struct {
+    GPU_Target* target;
+    /* The damaged area in target coordinates. */
+    GPU_Rect rect;
+} DamagedTarget;
+
+/* A readback of a damaged area that is copied into the framebuffer. */
+typedef struct {
+    /* The position of the read area in the framebuffer. */
+    int x;
+    int y;
+    /* The visible part of the read area in framebuffer coordinates. */
+    pixman_region16_t region;
+    /* The performance counter value when the area was first damaged. */
+    Uint64 damageTime;
+} FramebufferCopy;
+
+static Bool headless = False;
+static int framebufferFd = -1;
+static int damageFd = -1;
+static HeadlessFramebufferHeader* framebuffer = NULL;
+static size_t framebufferSize = 0;
+static DamagedTarget damagedTargets[HEADLESS_MAX_DAMAGED_TARGETS];
+static size_t numDamagedTargets = 0;
+/* The performance counter value when the first of the damaged areas was recorded. */
+static Uint64 damageTime = 0;
+static FramebufferDamageListener damageListener = NULL;
+/*
+ * The windows of the display list that is executed. This and the damage are only used by the
+ * thread that executes the display lists.
+ */
+static StackedWindows executedWindows = {NULL, 0, 0};
+
+/*
+ * Create the exported framebuffer with the size of the root window.
+ */
+static Bool createFramebuffer() {
+#ifdef HEADLESS_MODE_SUPPORTED
+    int width = 0, height = 0;
+    GET_WINDOW_DIMS(SCREEN_WINDOW, width, height);
+    size_t stride = (size_t) width * 4;
+    framebufferSize = HEADLESS_FRAMEBUFFER_PIXELS_OFFSET + stride * height;
+    framebufferFd = memfd_create("SDL2X11 framebuffer", MFD_CLOEXEC);
+    if (framebufferFd == -1 || ftruncate(framebufferFd, (off_t) framebufferSize) == -1) {
+        LOG("Failed to create the headless framebuffer: %s\n", strerror(errno));
+        freeHeadlessMode();
+        return False;
+    }
+    framebuffer = mmap(NULL, framebufferSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       framebufferFd, 0);
+    if (framebuffer == MAP_FAILED) {
+        LOG("Failed to map the headless framebuffer: %s\n", strerror(errno));
+        framebuffer = NULL;
+        freeHeadlessMode();
+        return False;
+    }
+    damageFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (damageFd == -1) {
+        LOG("Failed to create the headless damage fd: %s\n", strerror(errno));
+        freeHeadlessMode();
+        return False;
+    }
+    framebuffer->magic = HEADLESS_FRAMEBUFFER_MAGIC;
+    framebuffer->version = HEADLESS_FRAMEBUFFER_VERSION;
+    framebuffer->width = (uint32_t) width;
+    framebuffer->height = (uint32_t) height;
+    framebuffer->stride = (uint32_t) stride;
+    framebuffer->frame = 0;
+    LOG("Exporting the framebuffer: fd %d (%dx%d), damage fd %d\n",
+        framebufferFd, width, height, damageFd);
+    return True;
+#else
+    LOG("Exporting the framebuffer is not supported on this platform\n");
+    return False;
+#endif
+}
+
+static Bool isHeadlessModeRequested() {
+    const char* value = getenv(HEADLESS_ENV_VARIABLE);
+    return value != NULL && strcmp(value, "1") == 0;
+}
+
+/*
+ * Initialize the SDL video subsystem. In the headless mode the offscreen video driver is
+ * preferred, which provides OpenGL contexts without a display server, unless a video driver
+ * was selected explicitly. Returns False if SDL failed to initialize.
+ */
+Bool initHeadlessVideo() {
+    if (isHeadlessModeRequested() && SDL_getenv("SDL_VIDEODRIVER") == NULL) {
+        SDL_setenv("SDL_VIDEODRIVER", HEADLESS_VIDEO_DRIVER, 1);
+        if (SDL_Init(SDL_INIT_VIDEO) == 0) return True;
+        LOG("The %s video driver is not available: %s\n", HEADLESS_VIDEO_DRIVER, SDL_GetError());
+        // An empty driver name lets SDL choose the default driver.
+        SDL_setenv("SDL_VIDEODRIVER", "", 1);
+    }
+    return SDL_Init(SDL_INIT_VIDEO) == 0;
+}
+
+/*
+ * Enable the headless mode if it is requested via the environment.
+ * Returns False if the headless mode was requested but is not available.
+ */
+Bool initHeadlessMode() {
+    if (!isHeadlessModeRequested() || headless) return True;
+    if (!exportFramebuffer()) return False;
+    headless = True;
+    return True;
+}
+
+/*
+ * Start exporting the content of the root window without hiding the windows.
+ */
+Bool exportFramebuffer() {
+    return framebuffer != NULL || createFramebuffer();
+}
+
+Bool isFramebufferExported() {
+    return framebuffer != NULL;
+}
+
+/*
+ * Set a function that is called after every update of the framebuffer with the changed area
+ * and the performance counter value when the area was first damaged. The listener is called
+ * on the thread that executes the display list.
+ */
+void setFramebufferDamageListener(FramebufferDamageListener listener) {
+    damageListener = listener;
+}
+
+Bool isHeadless() {
+    return headless;
+}
+
+int getHeadlessFramebufferFd() {
+    return framebufferFd;
+}
+
+int getHeadlessDamageFd() {
+    return damageFd;
+}
+
+const HeadlessFramebufferHeader* getHeadlessFramebuffer() {
+    return framebuffer;
+}
+
+/*
+ * Make sure that the windows can hold the given number of windows.
+ */
+static Bool reserveStackedWindows(StackedWindows* windows, size_t numWindows) {
+    if (numWindows <= windows->capacity) return True;
+    StackedWindow* array = realloc(windows->windows, numWindows * sizeof(StackedWindow));
+    if (array == NULL) return False;
+    windows->windows = array;
+    windows->capacity = numWindows;
+    return True;
+}
+
+/*
+ * Record the stacking order and geometry of the mapped top level windows for the execution
+ * of a flushed display list. This is called by the client thread.
+ */
+void recordHeadlessWindows(StackedWindows* windows) {
+    Window* children;
+    size_t i, numChildren;
+    windows->numWindows = 0;
+    if (framebuffer == NULL) return;
+    children = GET_CHILDREN(SCREEN_WINDOW);
+    numChildren = GET_WINDOW_STRUCT(SCREEN_WINDOW)->children.length;
+    if (!reserveStackedWindows(windows, numChildren)) {
+        LOG("Out of memory: Failed to record the headless windows!\n");
+        return;
+    }
+    for (i = 0; i < numChildren; i++) {
+        if (!IS_MAPPED_TOP_LEVEL_WINDOW(children[i])) continue;
+        StackedWindow* window = &windows->windows[windows->numWindows++];
+        window->window = children[i];
+        window->target = GET_WINDOW_STRUCT(children[i])->renderTarget;
+        GET_WINDOW_POS(children[i], window->x, window->y);
+        GET_WINDOW_DIMS(children[i], window->width, window->height);
+        window->isInputOnly = IS_INPUT_ONLY(children[i]);
+    }
+}
+
+static Bool isStackedWindowTarget(GPU_Target* target) {
+    size_t i;
+    for (i = 0; i < executedWindows.numWindows; i++) {
+        if (executedWindows.windows[i].target == target) return True;
+    }
+    return False;
+}
+
+/*
+ * Use the windows that were recorded for a display list, called by the thread that executes
+ * the display list before it executes the commands. Windows that were not mapped during
+ * the previous execution are damaged completely.
+ */
+void useHeadlessWindows(const StackedWindows* windows) {
+    size_t i, numOldWindows = executedWindows.numWindows;
+    if (framebuffer == NULL) return;
+    if (!reserveStackedWindows(&executedWindows, numOldWindows + windows->numWindows)) {
+        LOG("Out of memory: Failed to use the headless windows!\n");
+        return;
+    }
+    // Keep the old windows behind the new ones to find the newly mapped windows.
+    memmove(&executedWindows.windows[windows->numWindows], executedWindows.windows,
+            numOldWindows * sizeof(StackedWindow));
+    memcpy(executedWindows.windows, windows->windows,
+           windows->numWindows * sizeof(StackedWindow));
+    executedWindows.numWindows = windows->numWindows;
+    for (i = 0; i < windows->numWindows; i++) {
+        const StackedWindow* window = &windows->windows[i];
+        size_t j;
+        for (j = 0; j < numOldWindows; j++) {
+            if (executedWindows.windows[windows->numWindows + j].target == window->target) break;
+        }
+        if (j == numOldWindows) {
+            GPU_Rect damage = {0, 0, (float) window->width, (float) window->height};
+            addHeadlessDamage(window->target, &damage);
+        }
+    }
+}
+
+void freeHeadlessWindows(StackedWindows* windows) {
+    free(windows->windows);
+    windows->windows = NULL;
+    windows->numWindows = windows->capacity = 0;
+}
+
+/*
+ * Remember that the area of the window target was drawn on and must be copied into the
+ * framebuffer with the next update. Drawings on targets of other drawables are ignored.
+ */
+void addHeadlessDamage(GPU_Target* target, const GPU_Rect* rect) {
+    size_t i;
+    if (framebuffer == NULL || rect->w <= 0 || rect->h <= 0) return;
+    for (i = 0; i < numDamagedTargets; i++) {
+        if (damagedTargets[i].target == target) {
+            GPU_Rect* damage = &damagedTargets[i].rect;
+            float x2 = MAX(damage->x + damage->w, rect->x + rect->w);
+            float y2 = MAX(damage->y + damage->h, rect->y + rect->h);
+            damage->x = MIN(damage->x, rect->x);
+            damage->y = MIN(damage->y, rect->y);
+            damage->w = x2 - damage->x;
+            damage->h = y2 - damage->y;
+            return;
+        }
+    }
+    if (!isStackedWindowTarget(target)) return;
+    if (numDamagedTargets == HEADLESS_MAX_DAMAGED_TARGETS) {
+        updateHeadlessFramebuffer();
+    }
+    if (numDamagedTargets == 0) {
+        damageTime = SDL_GetPerformanceCounter();
+    }
+    damagedTargets[numDamagedTargets].target = target;
+    damagedTargets[numDamagedTargets].rect = *rect;
+    numDamagedTargets++;
+}
+
+static void freeFramebufferCopy(FramebufferCopy* copy) {
+    pixman_region_fini(&copy->region);
+    free(copy);
+}
+
+/*
+ * Copy the visible parts of the read pixels of a damaged area into the framebuffer
+ * and signal the damage fd.
+ */
+static void storeFramebufferCopy(const Uint8* pixels, ptrdiff_t pitch, int width, int height,
+                                 void* data) {
+    FramebufferCopy* copy = data;
+    int numBoxes, i, y;
+    (void) width;
+    (void) height;
+    // The framebuffer might have been freed while the pixels were read.
+    if (pixels == NULL || framebuffer == NULL) {
+        freeFramebufferCopy(copy);
+        return;
+    }
+    pixman_box16_t* boxes = pixman_region_rectangles(&copy->region, &numBoxes);
+    pixman_box16_t* extents = pixman_region_extents(&copy->region);
+    Uint8* destination = (Uint8*) framebuffer + HEADLESS_FRAMEBUFFER_PIXELS_OFFSET;
+    framebuffer->frame++;
+    SDL_MemoryBarrierRelease();
+    for (i = 0; i < numBoxes; i++) {
+        size_t rowSize = (size_t) (boxes[i].x2 - boxes[i].x1) * 4;
+        for (y = boxes[i].y1; y < boxes[i].y2; y++) {
+            memcpy(destination + (size_t) y * framebuffer->stride + (size_t) boxes[i].x1 * 4,
+                   pixels + (y - copy->y) * pitch + (boxes[i].x1 - copy->x) * 4, rowSize);
+        }
+    }
+    framebuffer->damageX = extents->x1;
+    framebuffer->damageY = extents->y1;
+    framebuffer->damageWidth = (uint32_t) (extents->x2 - extents->x1);
+    framebuffer->damageHeight = (uint32_t) (extents->y2 - extents->y1);
+    SDL_MemoryBarrierRelease();
+    framebuffer->frame++;
+    SDL_Rect damage = {extents->x1, extents->y1, extents->x2 - extents->x1,
+                       extents->y2 - extents->y1};
+    if (damageListener != NULL) {
+        damageListener(&damage, copy->damageTime);
+    }
+    uint64_t count = 1;
+    if (write(damageFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        LOG("Failed to signal the headless damage fd: %s\n", strerror(errno));
+    }
+    freeFramebufferCopy(copy);
+}
+
+/*
+ * Start reading back the damaged area of the top level window at the index of the recorded
+ * stacking order. The parts of the area that are not covered by a mapped window above it are
+ * copied into the framebuffer once the pixels are available.
+ */
+static void copyDamage(size_t windowIndex, const GPU_Rect* rect) {
+    const StackedWindow* windows = executedWindows.windows;
+    const StackedWindow* window = &windows[windowIndex];
+    GPU_Target* target = window->target;
+    int windowX = window->x, windowY = window->y;
+    size_t i;
+    int x1 = MAX((int) rect->x, 0), y1 = MAX((int) rect->y, 0);
+    int x2 = MIN((int) (rect->x + rect->w + 0.5f), (int) target->w);
+    int y2 = MIN((int) (rect->y + rect->h + 0.5f), (int) target->h);
+    if (x1 >= x2 || y1 >= y2) return;
+    FramebufferCopy* copy = malloc(sizeof(FramebufferCopy));
+    if (copy == NULL) {
+        LOG("Out of memory: Failed to allocate a headless framebuffer copy!\n");
+        return;
+    }
+    pixman_region_init_rect(&copy->region, windowX + x1, windowY + y1,
+                            (unsigned int) (x2 - x1), (unsigned int) (y2 - y1));
+    pixman_region_intersect_rect(&copy->region, &copy->region, 0, 0,
+                                 framebuffer->width, framebuffer->height);
+    // Windows later in the child list of the root window are stacked above the window.
+    for (i = windowIndex + 1; i < executedWindows.numWindows; i++) {
+        if (windows[i].isInputOnly) continue;
+        pixman_region16_t above;
+        pixman_region_init_rect(&above, windows[i].x, windows[i].y,
+                                windows[i].width, windows[i].height);
+        pixman_region_subtract(&copy->region, &copy->region, &above);
+        pixman_region_fini(&above);
+    }
+    if (!pixman_region_not_empty(&copy->region)) {
+        freeFramebufferCopy(copy);
+        return;
+    }
+    // Only read the part of the area that is visible.
+    pixman_box16_t* extents = pixman_region_extents(&copy->region);
+    copy->x = extents->x1;
+    copy->y = extents->y1;
+    copy->damageTime = damageTime;
+    GPU_Rect readRect = GPU_MakeRect(extents->x1 - windowX, extents->y1 - windowY,
+                                     extents->x2 - extents->x1, extents->y2 - extents->y1);
+    if (!readExecutedPixelsAsync(target, &readRect, storeFramebufferCopy, copy)) {
+        LOG("Failed to read back the damaged area of window %lu\n", window->window);
+        freeFramebufferCopy(copy);
+    }
+}
+
+/*
+ * Start copying all damaged areas into the framebuffer, from the bottom to the top of the
+ * stacking order. This must be called before the damaged window targets are flipped.
+ */
+void updateHeadlessFramebuffer() {
+    size_t i, j;
+    if (framebuffer == NULL) return;
+    // Copy the areas of previous updates whose pixels arrived in the meantime.
+    completeReadbacks(False);
+    if (numDamagedTargets == 0) return;
+    for (i = 0; i < executedWindows.numWindows; i++) {
+        for (j = 0; j < numDamagedTargets; j++) {
+            if (damagedTargets[j].target == executedWindows.windows[i].target) {
+                copyDamage(i, &damagedTargets[j].rect);
+                break;
+            }
+        }
+    }
+    numDamagedTargets = 0;
+}
+
+void freeHeadlessMode() {
+#ifdef HEADLESS_MODE_SUPPORTED
+    if (framebuffer != NULL) {
+        munmap(framebuffer, framebufferSize);
+        framebuffer = NULL;
+    }
+#endif
+    if (framebufferFd != -1) {
+        close(framebufferFd);
+        framebufferFd = -1;
+    }
+    if (damageFd != -1) {
+        close(damageFd);
+        damageFd = -1;
+    }
+    numDamagedTargets = 0;
+    freeHeadlessWindows(&executedWindows);
+    damageListener = NULL;
+    headless = False;
+}
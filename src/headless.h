@@ -0,0 +1,76 @@
+#ifndef _HEADLESS_H_
+#define _HEADLESS_H_
+
+#include <stdint.h>
+#include "X11/Xlib.h"
+#include <SDL_gpu.h>
+
+/* The environment variable that enables the headless mode if it is set to 1. */
+#define HEADLESS_ENV_VARIABLE "SDL2X11_HEADLESS"
+/* The SDL video driver that is preferred in the headless mode. */
+#define HEADLESS_VIDEO_DRIVER "offscreen"
+/* The magic number at the start of the exported framebuffer ("X11F"). */
+#define HEADLESS_FRAMEBUFFER_MAGIC 0x58313146
+#define HEADLESS_FRAMEBUFFER_VERSION 1
+/* The offset of the pixels from the start of the exported framebuffer. */
+#define HEADLESS_FRAMEBUFFER_PIXELS_OFFSET 4096
+/* The maximum number of windows whose damage is tracked between two updates. */
+#define HEADLESS_MAX_DAMAGED_TARGETS 32
+
+/*
+ * The header at the start of the exported framebuffer. The pixels of the root window follow at
+ * HEADLESS_FRAMEBUFFER_PIXELS_OFFSET as rows of R, G, B, A bytes. The frame counter is odd while
+ * the framebuffer is updated, readers should retry if it is odd or changed while they read.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    volatile uint32_t frame;
+    /* The bounds of the area that changed with the last update. */
+    int32_t damageX;
+    int32_t damageY;
+    uint32_t damageWidth;
+    uint32_t damageHeight;
+} HeadlessFramebufferHeader;
+
+/* A mapped top level window, as recorded for the execution of a display list. */
+typedef struct {
+    Window window;
+    GPU_Target* target;
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+    Bool isInputOnly;
+} StackedWindow;
+
+/* The mapped top level windows from the bottom to the top of the stacking order. */
+typedef struct {
+    StackedWindow* windows;
+    size_t numWindows;
+    size_t capacity;
+} StackedWindows;
+
+/* Called after the framebuffer was updated with the changed area in root window coordinates. */
+typedef void (*FramebufferDamageListener)(const SDL_Rect* damage, Uint64 damageTime);
+
+Bool initHeadlessVideo(void);
+Bool initHeadlessMode(void);
+Bool isHeadless(void);
+Bool exportFramebuffer(void);
+Bool isFramebufferExported(void);
+void setFramebufferDamageListener(FramebufferDamageListener listener);
+int getHeadlessFramebufferFd(void);
+int getHeadlessDamageFd(void);
+const HeadlessFramebufferHeader* getHeadlessFramebuffer(void);
+void recordHeadlessWindows(StackedWindows* windows);
+void useHeadlessWindows(const StackedWindows* windows);
+void freeHeadlessWindows(StackedWindows* windows);
+void addHeadlessDamage(GPU_Target* target, const GPU_Rect* rect);
+void updateHeadlessFramebuffer(void);
+void freeHeadlessMode(void);
+
+#endif /* _HEADLESS_H_ */
@@ -1,12 +1,33 @@
 #include "X11/Xlib.h"
+#include "image.h"
 #include "errors.h"
 #include "drawing.h"
 #include "resourceTypes.h"
 #include "window.h"
 #include "display.h"
+#include "gc.h"
+#include "rasterOp.h"
+#include "pixelFormat.h"
+#include "readback.h"
+#include "visual.h"
+#include "imageCache.h"
+#include "renderThread.h"
 
 // Inspired by https://github.com/csulmone/X11/blob/59029dc09211926a5c95ff1dd2b828574fefcde6/libX11-1.5.0/src/ImUtil.c
 
+/*
+ * The scratch image that XPutImage uploads to if it can not write into the destination directly.
+ * Consecutive uploads are packed into rows of the image, so they only have to wait for the
+ * queued blits of earlier uploads once the image is full.
+ */
+static GPU_Image* putScratchImage = NULL;
+static int putScratchX = 0;
+static int putScratchY = 0;
+static int putScratchRowHeight = 0;
+/* The converted pixels that XPutImage uploads. */
+static Uint8* uploadBuffer = NULL;
+static size_t uploadBufferSize = 0;
+
 XImage* XCreateImage(Display* display, Visual* visual, unsigned int depth, int format, int offset,
                      char* data, unsigned int width, unsigned int height, int bitmap_pad,
                      int bytes_per_line) {
@@ -21,6 +42,7 @@ XImage* XCreateImage(Display* display, Visual* visual, unsigned int depth, int f
     image->height = height;
     image->format = format;
     image->data = data;
+    image->xoffset = offset;
     image->byte_order = MSBFirst;
     image->bitmap_unit = 8;
     #if SDL_BYTEORDER == SDL_BIG_ENDIAN
@@ -43,164 +65,395 @@ XImage* XCreateImage(Display* display, Visual* visual, unsigned int depth, int f
             image->bits_per_pixel = 32;
         }
     }
+    image->bitmap_pad = bitmap_pad;
+    if (bytes_per_line == 0) {
+        int pad = bitmap_pad > 0 ? bitmap_pad : 8;
+        int bitsPerLine = format == ZPixmap ? (int) width * image->bits_per_pixel
+                                            : (int) width + offset;
+        image->bytes_per_line = (bitsPerLine + pad - 1) / pad * pad / 8;
+    }
+    if (visual != NULL) {
+        image->red_mask = visual->red_mask;
+        image->green_mask = visual->green_mask;
+        image->blue_mask = visual->blue_mask;
+    } else {
+        image->red_mask = image->green_mask = image->blue_mask = 0;
+    }
+    image->obdata = NULL;
+    initImageFunctions(image);
     return image;
 }
 
-char* getImageDataPointer(XImage* image, unsigned int x, unsigned int y) {
-    char* pointer = image->data;
-    pointer += image->bytes_per_line * y;
-    return pointer + (image->bits_per_pixel / 8) * x;
+/*
+ * Reserve an area of the put scratch image that is not used by queued commands.
+ * Returns NULL if the scratch image could not be created.
+ */
+static GPU_Image* getPutScratchArea(unsigned int width, unsigned int height, GPU_Rect* area) {
+    if (putScratchImage == NULL || putScratchImage->w < width || putScratchImage->h < height) {
+        Uint16 imageWidth = (Uint16) MAX(MAX(width, PUT_SCRATCH_IMAGE_SIZE),
+                                         putScratchImage == NULL ? 0 : putScratchImage->w);
+        Uint16 imageHeight = (Uint16) MAX(MAX(height, PUT_SCRATCH_IMAGE_SIZE),
+                                          putScratchImage == NULL ? 0 : putScratchImage->h);
+        syncRenderThread();
+        GPU_Image* image = GPU_CreateImage(imageWidth, imageHeight, GPU_FORMAT_RGBA);
+        if (image == NULL) {
+            LOG("Failed to create the put scratch image: %s\n", GPU_PopErrorCode().details);
+            return NULL;
+        }
+        // The uploaded pixels replace the pixels of the destination.
+        GPU_SetBlending(image, False);
+        if (putScratchImage != NULL) {
+            queueImageFree(putScratchImage);
+        }
+        putScratchImage = image;
+        putScratchX = putScratchY = putScratchRowHeight = 0;
+    }
+    if (putScratchX + width > putScratchImage->w) {
+        putScratchX = 0;
+        putScratchY += putScratchRowHeight;
+        putScratchRowHeight = 0;
+    }
+    if (putScratchY + height > putScratchImage->h) {
+        // Start over once the queued blits of the earlier uploads have been executed.
+        flushDisplayListForImage(putScratchImage);
+        putScratchX = putScratchY = putScratchRowHeight = 0;
+    }
+    *area = GPU_MakeRect(putScratchX, putScratchY, width, height);
+    putScratchX += width;
+    putScratchRowHeight = MAX(putScratchRowHeight, (int) height);
+    return putScratchImage;
 }
 
-int putPixel(XImage* image, int x, int y, unsigned long pixel) {
-    // https://tronche.com/gui/x/xlib/utilities/XPutPixel.html
-    LOG("%s on %p: %lu (%ld, %ld, %ld)\n", __func__, image, pixel,
-        (pixel >> 24) & 0xFF, (pixel >> 16) & 0xFF, (pixel >> 8) & 0xFF);
-    if (image->data == NULL) {
-        LOG("Invalid argument: Got image with NULL data in XPutPixel\n");
-        return 0;
-    }
-    char* pointer;
-    switch (image->format) {
-        case ZPixmap:
-        case XYBitmap:
-            pointer = getImageDataPointer(image, x, y);
-            if (image->bits_per_pixel == 32) {
-                *((unsigned long*) pointer) = pixel;
-            }
-            break;
-        case XYPixmap:
-            LOG("Warn: Got unimplemented format XYPixmap\n");
-            break;
-        default:
-            LOG("Warn: Got invalid format %d\n", image->format);
-            return 0;
-    }
-    return 1;
+static Uint8* getUploadBuffer(size_t size) {
+    if (size > uploadBufferSize) {
+        Uint8* buffer = realloc(uploadBuffer, size);
+        if (buffer == NULL) return NULL;
+        uploadBuffer = buffer;
+        uploadBufferSize = size;
+    }
+    return uploadBuffer;
 }
 
-unsigned long getPixel(XImage* image, int x, int y) {
-    // https://tronche.com/gui/x/xlib/utilities/XGetPixel.html
-    LOG("%s from %p: x = %d, y = %d\n", __func__, image, x, y);
-    if (image->data == NULL) {
-        LOG("Invalid argument: Got image with NULL data in XGetPixel\n");
-        return 0; // TODO: throw error
-    }
-    char* pointer;
-    switch (image->format) {
-        case ZPixmap:
-        case XYBitmap:
-            pointer = getImageDataPointer(image, x, y);
-//            LOG("%s: bits_per_pixel = %d, value = %x (%d)\n", __func__, image->bits_per_pixel, *pointer & 0xFF, (int) *pointer & 0xFF);
-            if (image->bits_per_pixel == 32) {
-                return *((unsigned long*) pointer);
-            } else if (image->bits_per_pixel == 1) {
-                return 0x000000FF | (*pointer << 12) | (*pointer << 8) | (*pointer << 4);
-            }
-            break;
-        case XYPixmap:
-            LOG("Warn: Got unimplemented format XYPixmap\n");
-            break;
-        default:
-            LOG("Warn: Got invalid format %d\n", image->format);
-    }
-    return 0;
+void freeImageResources() {
+    if (putScratchImage != NULL) {
+        queueImageFree(putScratchImage);
+        putScratchImage = NULL;
+    }
+    free(uploadBuffer);
+    uploadBuffer = NULL;
+    uploadBufferSize = 0;
 }
 
-int destroyImage(XImage* image) {
-    // https://tronche.com/gui/x/xlib/utilities/XDestroyImage.html
-    if (image->data != NULL) {
-        free(image->data);
+static Bool queueUploadBlit(Display* display, GPU_Target* target, GPU_Image* uploadImage,
+                            GPU_Rect* uploadRect, GraphicContext* gContext, int putX, int putY) {
+    DrawState drawState;
+    initGCDrawState(&drawState, target, uploadImage, gContext);
+    if (!queueBlit(&drawState, uploadRect, putX, putY)) {
+        handleOutOfMemory(0, display, 0, 0);
+        return False;
     }
-    free(image);
-    return 1;
+    return True;
+}
+
+/*
+ * Draw an area of the image onto the drawable. Images whose pixels are already in the layout of
+ * the textures are uploaded straight from their data, all others are converted first.
+ * If the image cache is enabled, repeatedly drawn images are blitted from a cached texture.
+ * Returns False and reports an error if the image could not be drawn.
+ */
+Bool putImage(Display* display, Drawable drawable, GC gc, XImage* image, int src_x, int src_y,
+              int dest_x, int dest_y, unsigned int width, unsigned int height) {
+    TYPE_CHECK(drawable, DRAWABLE, display, False);
+    LOG("%s: Drawing %p on %lu\n", __func__, image, drawable);
+    if (IS_TYPE(drawable, WINDOW) && IS_INPUT_ONLY(drawable)) {
+        LOG("BadMatch: Got input only window as the destination in %s!\n", __func__);
+        handleError(0, display, drawable, 0, BadMatch, 0);
+        return False;
+    }
+    if (image->format != XYBitmap && image->format != XYPixmap && image->format != ZPixmap) {
+        LOG("BadValue: Got invalid image format %d in %s!\n", image->format, __func__);
+        handleError(0, display, None, 0, BadValue, 0);
+        return False;
+    }
+    GPU_Target* target;
+    GET_RENDER_TARGET(drawable, target);
+    if (target == NULL) {
+        LOG("BadMatch: Failed to get render target of drawable %lu in %s!\n", drawable, __func__);
+        handleError(0, display, drawable, 0, BadMatch, 0);
+        return False;
+    }
+    GraphicContext* gContext = getResolvedGC(gc);
+    // Pixmaps can be updated in place if the pixels are just replaced.
+    Bool direct = IS_TYPE(drawable, PIXMAP) && gContext->clip == NULL
+                  && IS_COPY_RASTER_OP(gContext->function, gContext->planeMask);
+    // Only the part of the source rectangle inside of the image can be drawn.
+    int x1 = MAX(src_x, 0), y1 = MAX(src_y, 0);
+    int x2 = MIN(src_x + (int) width, image->width), y2 = MIN(src_y + (int) height, image->height);
+    if (direct) {
+        x1 = MAX(x1, src_x - dest_x);
+        y1 = MAX(y1, src_y - dest_y);
+        x2 = MIN(x2, src_x - dest_x + target->image->w);
+        y2 = MIN(y2, src_y - dest_y + target->image->h);
+    }
+    if (x1 >= x2 || y1 >= y2) return True;
+    unsigned int putWidth = (unsigned int) (x2 - x1), putHeight = (unsigned int) (y2 - y1);
+    int putX = dest_x + x1 - src_x, putY = dest_y + y1 - src_y;
+    Uint8* pixels;
+    int pitch;
+    Bool converted = !hasTexturePixelLayout(image);
+    Uint64 hash = 0;
+    Bool cache = False;
+    if (isImageCacheEnabled() && image->data != NULL) {
+        hash = hashImageArea(image, x1, y1, putWidth, putHeight, gContext->foregroundColor,
+                             gContext->backgroundColor);
+        GPU_Image* cachedImage = findCachedImage(hash, putWidth, putHeight, &cache);
+        if (cachedImage != NULL) {
+            GPU_Rect cachedRect = GPU_MakeRect(0, 0, putWidth, putHeight);
+            LOG("%s: Drawing %ux%u pixels from the image cache\n", __func__, putWidth, putHeight);
+            return queueUploadBlit(display, target, cachedImage, &cachedRect, gContext,
+                                   putX, putY);
+        }
+    }
+    if (converted) {
+        pixels = getUploadBuffer((size_t) putWidth * putHeight * 4);
+        if (pixels == NULL) {
+            handleOutOfMemory(0, display, 0, 0);
+            return False;
+        }
+        pitch = (int) putWidth * 4;
+        if (!convertImageToRGBA(image, x1, y1, putWidth, putHeight, gContext->foregroundColor,
+                                gContext->backgroundColor, pixels, (size_t) pitch)) {
+            LOG("BadMatch: Unsupported image with %d bits per pixel in %s!\n",
+                image->bits_per_pixel, __func__);
+            handleError(0, display, None, 0, BadMatch, 0);
+            return False;
+        }
+    } else {
+        pitch = image->bytes_per_line;
+        pixels = (Uint8*) image->data + (size_t) y1 * pitch + (size_t) x1 * 4;
+    }
+    GPU_Rect uploadRect;
+    GPU_Image* uploadImage = NULL;
+    if (cache && (uploadImage = addCachedImage(hash, putWidth, putHeight)) != NULL) {
+        uploadRect = GPU_MakeRect(0, 0, putWidth, putHeight);
+        direct = False;
+    } else if (direct) {
+        // Queued commands that draw on or sample the pixmap must see its previous content.
+        uploadImage = target->image;
+        uploadRect = GPU_MakeRect(putX, putY, putWidth, putHeight);
+    } else {
+        uploadImage = getPutScratchArea(putWidth, putHeight, &uploadRect);
+        if (uploadImage == NULL) {
+            handleOutOfMemory(0, display, 0, 0);
+            return False;
+        }
+    }
+    if (direct) {
+        updateImageBytes(uploadImage, &uploadRect, pixels, pitch);
+    } else {
+        // The render thread might still sample the scratch image or the cached image.
+        syncRenderThread();
+        GPU_UpdateImageBytes(uploadImage, &uploadRect, pixels, pitch);
+    }
+    if (!direct && !queueUploadBlit(display, target, uploadImage, &uploadRect, gContext,
+                                    putX, putY)) {
+        return False;
+    }
+    return True;
 }
 
 int XPutImage(Display* display, Drawable drawable, GC gc, XImage* image, int src_x, int src_y,
                int dest_x, int dest_y, unsigned int width, unsigned int height) {
     // https://tronche.com/gui/x/xlib/graphics/XPutImage.html
     SET_X_SERVER_REQUEST(display, X_PutImage);
-    TYPE_CHECK(drawable, DRAWABLE, display, 0);
-    LOG("%s: Drawing %p on %lu\n", __func__, image, drawable);
-    // TODO: Implement this: Create Uint32* data, Create Texture from data, rendercopy
-//    LOCK_SURFACE(surface);
-//    unsigned int x, y;
-//    if (image->format == XYBitmap && 0) {
-//        for (x = 0; x < width; x++) {
-//            for (y = 0; y < height; y++) {
-//                unsigned long color = gc->background;
-//                if (XGetPixel(image, src_x + x, src_y + y)) {
-//                    color = gc->foreground;
-//                }
-//                putPixel(surface, dest_x + x, dest_y + y, color);
-//            }
-//        }
-//    } else {
-//        for (x = 0; x < width; x++) {
-//            for (y = 0; y < height; y++) {
-//                unsigned long color = XGetPixel(image, src_x + x, src_y + y);
-////                LOG("%s: %lu (%ld, %ld, %ld)\n", __func__, color, (color >> 24) & 0xFF, (color >> 16) & 0xFF, (color >> 8) & 0xFF);
-//                putPixel(surface, dest_x + x, dest_y + y, XGetPixel(image, src_x + x, src_y + y));
-//            }
-//        }
-//    }
-//    UNLOCK_SURFACE(surface);
-    return 1;
+    return putImage(display, drawable, gc, image, src_x, src_y, dest_x, dest_y, width, height);
+}
+
+/* A read of the pixels of a drawable into an image. */
+typedef struct {
+    XImage* image;
+    int x;
+    int y;
+    unsigned long planeMask;
+    /* Whether the readback completed, whether it delivered pixels and whether they fit. */
+    Bool done;
+    Bool received;
+    Bool success;
+    /* Whether the reader stopped waiting for the pixels. */
+    Bool abandoned;
+} ImageRead;
+
+static void storeReadPixels(const Uint8* pixels, ptrdiff_t pitch, int width, int height,
+                            void* data) {
+    ImageRead* read = data;
+    if (read->abandoned) {
+        free(read);
+        return;
+    }
+    read->done = True;
+    read->received = pixels != NULL;
+    read->success = pixels != NULL && convertRGBAToImage(pixels, pitch, (unsigned int) width,
+            (unsigned int) height, read->planeMask, read->image, read->x, read->y);
+}
+
+/*
+ * Read an area of the drawable into the image at the destination position. The area must
+ * lie inside of the drawable, parts of it that are outside of the render target are not
+ * written. Only the requested area is read back and converted directly into the format of
+ * the image. Returns False and reports an error if the pixels could not be read.
+ */
+Bool readDrawableIntoImage(Display* display, Drawable drawable, int x, int y,
+                           unsigned int width, unsigned int height, unsigned long planeMask,
+                           XImage* image, int destX, int destY) {
+    GPU_Target* target;
+    unsigned int drawableWidth = 0, drawableHeight = 0;
+    int offsetX = 0, offsetY = 0;
+    if (IS_TYPE(drawable, WINDOW)) {
+        if (drawable == SCREEN_WINDOW || IS_INPUT_ONLY(drawable)) {
+            LOG("BadMatch: Can not read the pixels of window %lu in %s!\n", drawable, __func__);
+            handleError(0, display, drawable, 0, BadMatch, 0);
+            return False;
+        }
+        GET_WINDOW_DIMS(drawable, drawableWidth, drawableHeight);
+    } else {
+        GPU_Image* pixmapImage = GET_PIXMAP_IMAGE(drawable);
+        drawableWidth = pixmapImage->w;
+        drawableHeight = pixmapImage->h;
+    }
+    if (x < 0 || y < 0 || x + width > drawableWidth || y + height > drawableHeight) {
+        LOG("BadMatch: The area %dx%d+%d+%d is outside of drawable %lu in %s!\n",
+            (int) width, (int) height, x, y, drawable, __func__);
+        handleError(0, display, drawable, 0, BadMatch, 0);
+        return False;
+    }
+    GET_RENDER_TARGET(drawable, target);
+    if (target == NULL) {
+        LOG("BadMatch: Failed to get render target of drawable %lu in %s!\n", drawable, __func__);
+        handleError(0, display, drawable, 0, BadMatch, 0);
+        return False;
+    }
+    if (IS_TYPE(drawable, WINDOW)) {
+        GPU_Rect viewport, clipRect;
+        Bool useClipRect;
+        getRenderTargetView(target, &viewport, &clipRect, &useClipRect);
+        offsetX = (int) viewport.x;
+        offsetY = (int) viewport.y;
+    }
+    // Parts of a child window that are clipped by its parents are not in the render target.
+    int x1 = MAX(x + offsetX, 0), y1 = MAX(y + offsetY, 0);
+    int x2 = MIN(x + offsetX + (int) width, (int) target->w);
+    int y2 = MIN(y + offsetY + (int) height, (int) target->h);
+    if (x1 >= x2 || y1 >= y2) return True;
+    ImageRead* read = malloc(sizeof(ImageRead));
+    if (read == NULL) {
+        handleOutOfMemory(0, display, 0, 0);
+        return False;
+    }
+    read->image = image;
+    read->x = destX + x1 - (x + offsetX);
+    read->y = destY + y1 - (y + offsetY);
+    read->planeMask = planeMask;
+    read->done = read->received = read->success = read->abandoned = False;
+    GPU_Rect rect = GPU_MakeRect(x1, y1, x2 - x1, y2 - y1);
+    if (!readPixelsAsync(target, &rect, storeReadPixels, read)) {
+        LOG("BadImplementation: Failed to read the pixels of drawable %lu in %s!\n",
+            drawable, __func__);
+        free(read);
+        handleError(0, display, drawable, 0, BadImplementation, 0);
+        return False;
+    }
+    // The request returns the pixels, so it has to wait for them. The pixel buffer only keeps
+    // the read from stalling the pipeline: The display list was only flushed if it draws on
+    // the target, and the read is queued behind the flushed commands instead of waiting
+    // for them before it is issued.
+    if (!read->done) {
+        completeReadbacks(True);
+    }
+    if (!read->done || !read->received) {
+        LOG("BadImplementation: The pixels of drawable %lu were not received in %s!\n",
+            drawable, __func__);
+        if (read->done) {
+            free(read);
+        } else {
+            // The pixels might still arrive during a later flush, they are dropped then.
+            read->abandoned = True;
+        }
+        handleError(0, display, drawable, 0, BadImplementation, 0);
+        return False;
+    }
+    Bool success = read->success;
+    free(read);
+    if (!success) {
+        LOG("BadMatch: Failed to convert the pixels of drawable %lu into the image in %s!\n",
+            drawable, __func__);
+        handleError(0, display, drawable, 0, BadMatch, 0);
+        return False;
+    }
+    return True;
 }
 
 XImage* XGetImage(Display* display, Drawable drawable, int x, int y, unsigned int width,
                   unsigned int height, unsigned long plane_mask, int format) {
     // https://tronche.com/gui/x/xlib/graphics/XGetImage.html
     SET_X_SERVER_REQUEST(display, X_GetImage);
+    TYPE_CHECK(drawable, DRAWABLE, display, NULL);
     LOG("%s: From %lu\n", __func__, drawable);
-    if (IS_TYPE(drawable, WINDOW) && drawable == SCREEN_WINDOW) {
-        LOG("XGetImage called with SCREEN_WINDOW as argument!\n");
-        // TODO: Handle error and check INPUTONLY
+    if (format != XYPixmap && format != ZPixmap) {
+        LOG("BadValue: Got invalid image format %d in %s!\n", format, __func__);
+        handleError(0, display, None, 0, BadValue, 0);
         return NULL;
     }
-    // TODO: Figure this out
-    int depth = 8;
-//    if (drawable->type == PIXMAP) {
-//
-//    }
-    int bytes_per_line = (depth / 8) * width;
-    char* data = malloc(sizeof(char) * width * height);
-    if (data == NULL) {
+    unsigned int depth = SDL_SURFACE_DEPTH;
+    size_t numPlanes = 1;
+    if (format == XYPixmap) {
+        // The image only contains the planes of the plane mask.
+        unsigned long planes = plane_mask & 0xFFFFFFFFUL;
+        for (depth = 0; planes != 0; planes &= planes - 1) {
+            depth++;
+        }
+        numPlanes = depth;
+    }
+    XImage* image = XCreateImage(display, getDefaultVisual(0), depth, format, 0, NULL,
+                                 width, height, 32, 0);
+    if (image == NULL) return NULL;
+    image->data = calloc(MAX((size_t) image->bytes_per_line * height * numPlanes, 1), 1);
+    if (image->data == NULL) {
+        free(image);
         handleOutOfMemory(0, display, 0, 0);
         return NULL;
     }
-    // FIXME: The NULL will cause problems.
-    XImage* image = XCreateImage(display, NULL, depth, format, 0, data, width, height,
-                                 (int) NULL, bytes_per_line);
-    if (image == NULL) {
-        free(data);
+    if (!readDrawableIntoImage(display, drawable, x, y, width, height, plane_mask,
+                               image, 0, 0)) {
+        destroyImage(image);
         return NULL;
     }
-    //TODO: Implement: Read from Textur into data and Convert from data to image type
-//    SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGBA8888, GET_SURFACE(drawable)->pixels, GET_SURFACE(drawable)->pitch);
-
-//    unsigned int currX, currY;
-//    // TODO: Worry about XYPixmap
-////    if (format == XYPixmap) {
-//    for (currX = 0; currX < width; currX++) {
-//        for (currY = 0; currY < height; currY++) {
-//            data[currY * width + currX] = plane_mask & getPixel(drawableSurface, x + currX, y + currY);
-//        }
-//    }
     return image;
 }
 
-Status _XInitImageFuncPtrs(XImage *image) {
-    image->f.put_pixel = putPixel;
-    image->f.get_pixel = getPixel;
-    image->f.create_image = XCreateImage;
-    image->f.destroy_image = destroyImage;
-    image->f.add_pixel = NULL; // TODO
-    image->f.sub_image = NULL; // TODO
-    return 1;
-}
-
-Status XInitImage(XImage* image) {
-    // https://tronche.com/gui/x/xlib/graphics/XInitImage.html
-    return _XInitImageFuncPtrs(image);
+XImage* XGetSubImage(Display* display, Drawable drawable, int x, int y, unsigned int width,
+                     unsigned int height, unsigned long plane_mask, int format,
+                     XImage* dest_image, int dest_x, int dest_y) {
+    // https://tronche.com/gui/x/xlib/graphics/XGetSubImage.html
+    SET_X_SERVER_REQUEST(display, X_GetImage);
+    TYPE_CHECK(drawable, DRAWABLE, display, NULL);
+    LOG("%s: From %lu\n", __func__, drawable);
+    if (format != XYPixmap && format != ZPixmap) {
+        LOG("BadValue: Got invalid image format %d in %s!\n", format, __func__);
+        handleError(0, display, None, 0, BadValue, 0);
+        return NULL;
+    }
+    if (dest_x < 0 || dest_y < 0) {
+        LOG("BadValue: Got negative destination position in %s!\n", __func__);
+        handleError(0, display, None, 0, BadValue, 0);
+        return NULL;
+    }
+    // The parts of the area that do not fit into the destination image are not read.
+    width = (unsigned int) MIN((int) width, dest_image->width - dest_x);
+    height = (unsigned int) MIN((int) height, dest_image->height - dest_y);
+    if ((int) width <= 0 || (int) height <= 0) return dest_image;
+    if (!readDrawableIntoImage(display, drawable, x, y, width, height, plane_mask,
+                               dest_image, dest_x, dest_y)) {
+        return NULL;
+    }
+    return dest_image;
 }
@@ -0,0 +1,18 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include "X11/Xlib.h"
+
+/* The minimum size of the scratch image that XPutImage uploads to. */
+#define PUT_SCRATCH_IMAGE_SIZE 1024
+
+Bool putImage(Display* display, Drawable drawable, GC gc, XImage* image, int src_x, int src_y,
+              int dest_x, int dest_y, unsigned int width, unsigned int height);
+Bool readDrawableIntoImage(Display* display, Drawable drawable, int x, int y,
+                           unsigned int width, unsigned int height, unsigned long planeMask,
+                           XImage* image, int destX, int destY);
+void freeImageResources(void);
+void initImageFunctions(XImage* image);
+int destroyImage(XImage* image);
+
+#endif /* _IMAGE_H_ */
@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include "imageCache.h"
+#include "displayList.h"
+#include "util.h"
+#include "renderThread.h"
+
+/*
+ * The image cache keeps textures of the pixels that XPutImage uploaded, so clients that put
+ * the same image over and over again (toolbar icons on every expose, static photo images, ...)
+ * only pay for hashing the pixels and a blit on the GPU. The images are identified by a 64 bit
+ * XXH64 hash of their pixels and format. An image is only cached when it is seen for the second
+ * time, so streamed images that never repeat do not churn through textures. The cached textures
+ * share a byte budget, the least recently used images are evicted first.
+ */
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define ROTATE_LEFT(value, bits) ((value) << (bits) | (value) >> (64 - (bits)))
+
+typedef struct {
+    Uint64 hash;
+    unsigned int width;
+    unsigned int height;
+} ImageKey;
+
+typedef struct ImageCacheEntry {
+    ImageKey key;
+    /* The texture with the pixels or NULL if the image was only seen once. */
+    GPU_Image* image;
+    struct ImageCacheEntry* newer;
+    struct ImageCacheEntry* older;
+    struct ImageCacheEntry* nextInBucket;
+} ImageCacheEntry;
+
+static ImageCacheEntry* buckets[IMAGE_CACHE_BUCKETS] = {NULL};
+static ImageCacheEntry* newestEntry = NULL;
+static ImageCacheEntry* oldestEntry = NULL;
+static size_t numEntries = 0;
+static size_t budget = 0;
+static ImageCacheStatistics statistics;
+
+/*
+ * Initialize the image cache with the byte budget from the environment.
+ * Returns False if the budget is invalid, the cache is disabled in that case.
+ */
+Bool initImageCache() {
+    const char* value = getenv(IMAGE_CACHE_SIZE_ENV_VARIABLE);
+    char* suffix;
+    budget = 0;
+    memset(&statistics, 0, sizeof(statistics));
+    if (value == NULL) return True;
+    unsigned long size = strtoul(value, &suffix, 10);
+    if (suffix == value) {
+        LOG("Invalid image cache size '%s'\n", value);
+        return False;
+    }
+    if (*suffix == 'K' || *suffix == 'k') {
+        size *= 1024;
+        suffix++;
+    } else if (*suffix == 'M' || *suffix == 'm') {
+        size *= 1024 * 1024;
+        suffix++;
+    }
+    if (*suffix != '\0') {
+        LOG("Invalid image cache size '%s'\n", value);
+        return False;
+    }
+    budget = size;
+    if (budget != 0) {
+        LOG("Using an image cache of %lu bytes\n", size);
+    }
+    return True;
+}
+
+Bool isImageCacheEnabled() {
+    return budget != 0;
+}
+
+static Uint64 readUint64(const Uint8* bytes) {
+    Uint64 value;
+    memcpy(&value, bytes, sizeof(value));
+    return SDL_SwapLE64(value);
+}
+
+static Uint32 readUint32(const Uint8* bytes) {
+    Uint32 value;
+    memcpy(&value, bytes, sizeof(value));
+    return SDL_SwapLE32(value);
+}
+
+static Uint64 hashRound(Uint64 accumulator, Uint64 input) {
+    accumulator += input * PRIME64_2;
+    accumulator = ROTATE_LEFT(accumulator, 31);
+    return accumulator * PRIME64_1;
+}
+
+static Uint64 mergeRound(Uint64 hash, Uint64 accumulator) {
+    hash ^= hashRound(0, accumulator);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+/*
+ * Calculate the XXH64 hash of the bytes with the seed.
+ */
+static Uint64 hashBytes(const void* data, size_t length, Uint64 seed) {
+    const Uint8* bytes = data;
+    const Uint8* end = bytes + length;
+    Uint64 hash;
+    if (length >= 32) {
+        Uint64 accumulators[4] = {seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed,
+                                  seed - PRIME64_1};
+        for (; end - bytes >= 32; bytes += 32) {
+            accumulators[0] = hashRound(accumulators[0], readUint64(bytes));
+            accumulators[1] = hashRound(accumulators[1], readUint64(bytes + 8));
+            accumulators[2] = hashRound(accumulators[2], readUint64(bytes + 16));
+            accumulators[3] = hashRound(accumulators[3], readUint64(bytes + 24));
+        }
+        hash = ROTATE_LEFT(accumulators[0], 1) + ROTATE_LEFT(accumulators[1], 7)
+               + ROTATE_LEFT(accumulators[2], 12) + ROTATE_LEFT(accumulators[3], 18);
+        hash = mergeRound(hash, accumulators[0]);
+        hash = mergeRound(hash, accumulators[1]);
+        hash = mergeRound(hash, accumulators[2]);
+        hash = mergeRound(hash, accumulators[3]);
+    } else {
+        hash = seed + PRIME64_5;
+    }
+    hash += length;
+    for (; end - bytes >= 8; bytes += 8) {
+        hash ^= hashRound(0, readUint64(bytes));
+        hash = ROTATE_LEFT(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (end - bytes >= 4) {
+        hash ^= readUint32(bytes) * PRIME64_1;
+        hash = ROTATE_LEFT(hash, 23) * PRIME64_2 + PRIME64_3;
+        bytes += 4;
+    }
+    for (; bytes < end; bytes++) {
+        hash ^= *bytes * PRIME64_5;
+        hash = ROTATE_LEFT(hash, 11) * PRIME64_1;
+    }
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    return hash ^ hash >> 32;
+}
+
+/*
+ * Hash the pixels of an area of the image together with everything that determines how they
+ * are converted: The format of the image and, for XYBitmap images, the colors of the GC.
+ * Only the bytes that hold pixels of the area are hashed, one row after another.
+ */
+Uint64 hashImageArea(const XImage* image, int x, int y, unsigned int width, unsigned int height,
+                     SDL_Color foreground, SDL_Color background) {
+    unsigned int row;
+    int plane, numPlanes = image->format == XYPixmap ? image->depth : 1;
+    size_t bitsPerPixel = image->format == ZPixmap ? (size_t) image->bits_per_pixel : 1;
+    size_t firstBit = (size_t) x * bitsPerPixel;
+    // Swapped bitmap units are hashed whole, so the bits of the area are part of the range.
+    size_t unitBits = 8;
+    if (image->format != ZPixmap) {
+        firstBit += (size_t) image->xoffset;
+        unitBits = (size_t) MAX(image->bitmap_unit, 8);
+    }
+    size_t endBit = firstBit + width * bitsPerPixel;
+    size_t firstByte = firstBit / unitBits * unitBits / 8;
+    size_t endByte = MIN((endBit + unitBits - 1) / unitBits * unitBits / 8,
+                         (size_t) image->bytes_per_line);
+    Uint32 foregroundPixel = 0, backgroundPixel = 0;
+    if (image->format == XYBitmap) {
+        memcpy(&foregroundPixel, &foreground, sizeof(foregroundPixel));
+        memcpy(&backgroundPixel, &background, sizeof(backgroundPixel));
+    }
+    unsigned long description[] = {
+        (unsigned long) image->format, (unsigned long) image->depth, bitsPerPixel,
+        (unsigned long) image->byte_order, (unsigned long) image->bitmap_unit,
+        (unsigned long) image->bitmap_bit_order, image->red_mask, image->green_mask,
+        image->blue_mask, firstBit - firstByte * 8, width, height,
+        foregroundPixel, backgroundPixel,
+    };
+    Uint64 hash = hashBytes(description, sizeof(description), 0);
+    size_t planeSize = (size_t) image->bytes_per_line * image->height;
+    for (plane = 0; plane < numPlanes; plane++) {
+        const Uint8* source = (const Uint8*) image->data + plane * planeSize
+                              + (size_t) y * image->bytes_per_line + firstByte;
+        for (row = 0; row < height; row++, source += image->bytes_per_line) {
+            hash = hashBytes(source, endByte - firstByte, hash);
+        }
+    }
+    return hash;
+}
+
+static size_t getBucket(const ImageKey* key) {
+    return (size_t) (key->hash % IMAGE_CACHE_BUCKETS);
+}
+
+static void unlinkEntry(ImageCacheEntry* entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else newestEntry = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else oldestEntry = entry->newer;
+    entry->newer = entry->older = NULL;
+}
+
+static void linkNewestEntry(ImageCacheEntry* entry) {
+    entry->older = newestEntry;
+    entry->newer = NULL;
+    if (newestEntry != NULL) newestEntry->newer = entry;
+    newestEntry = entry;
+    if (oldestEntry == NULL) oldestEntry = entry;
+}
+
+static void evictOldestEntry() {
+    ImageCacheEntry* entry = oldestEntry;
+    ImageCacheEntry** bucketEntry = &buckets[getBucket(&entry->key)];
+    while (*bucketEntry != entry) {
+        bucketEntry = &(*bucketEntry)->nextInBucket;
+    }
+    *bucketEntry = entry->nextInBucket;
+    unlinkEntry(entry);
+    if (entry->image != NULL) {
+        // Queued blits may still read from the image.
+        queueImageFree(entry->image);
+        statistics.usedBytes -= (size_t) entry->key.width * entry->key.height * 4;
+        statistics.evictions++;
+    }
+    free(entry);
+    numEntries--;
+}
+
+static void logStatistics() {
+    if (statistics.lookups == 0) return;
+    LOG("Image cache: %lu lookups, %.1f%% hits, %lu uploads, %lu evictions, "
+        "%lu images using %lu of %lu bytes\n", statistics.lookups,
+        statistics.hits * 100.0 / statistics.lookups, statistics.uploads, statistics.evictions,
+        (unsigned long) numEntries, (unsigned long) statistics.usedBytes,
+        (unsigned long) budget);
+}
+
+static ImageCacheEntry* findEntry(const ImageKey* key) {
+    ImageCacheEntry* entry;
+    for (entry = buckets[getBucket(key)]; entry != NULL; entry = entry->nextInBucket) {
+        if (entry->key.hash == key->hash && entry->key.width == key->width
+            && entry->key.height == key->height) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Look up the texture of an image with the hash and size. Returns NULL on a miss, shouldCache
+ * is set if the image was seen before and should be added to the cache after it is converted.
+ */
+GPU_Image* findCachedImage(Uint64 hash, unsigned int width, unsigned int height,
+                           Bool* shouldCache) {
+    ImageKey key = {hash, width, height};
+    *shouldCache = False;
+    if (++statistics.lookups % IMAGE_CACHE_STATISTICS_INTERVAL == 0) {
+        logStatistics();
+    }
+    ImageCacheEntry* entry = findEntry(&key);
+    if (entry != NULL) {
+        unlinkEntry(entry);
+        linkNewestEntry(entry);
+        if (entry->image != NULL) {
+            statistics.hits++;
+            return entry->image;
+        }
+        *shouldCache = (size_t) width * height * 4 <= budget / IMAGE_CACHE_MAX_IMAGE_FRACTION;
+        return NULL;
+    }
+    // Remember the image, so it is cached if it is seen again.
+    if (numEntries >= IMAGE_CACHE_MAX_ENTRIES) {
+        evictOldestEntry();
+    }
+    entry = malloc(sizeof(ImageCacheEntry));
+    if (entry == NULL) return NULL;
+    entry->key = key;
+    entry->image = NULL;
+    size_t bucket = getBucket(&key);
+    entry->nextInBucket = buckets[bucket];
+    buckets[bucket] = entry;
+    linkNewestEntry(entry);
+    numEntries++;
+    return NULL;
+}
+
+/*
+ * Create the texture of an image that findCachedImage asked to cache. The caller uploads the
+ * pixels into it. Returns NULL if the texture could not be created.
+ */
+GPU_Image* addCachedImage(Uint64 hash, unsigned int width, unsigned int height) {
+    ImageKey key = {hash, width, height};
+    size_t size = (size_t) width * height * 4;
+    ImageCacheEntry* entry = findEntry(&key);
+    if (entry == NULL || entry->image != NULL) return NULL;
+    // The entry was just looked up, so it is the newest one and evicted last.
+    while (statistics.usedBytes + size > budget && oldestEntry != entry) {
+        evictOldestEntry();
+    }
+    syncRenderThread();
+    entry->image = GPU_CreateImage((Uint16) width, (Uint16) height, GPU_FORMAT_RGBA);
+    if (entry->image == NULL) {
+        LOG("Failed to create a cached image: %s\n", GPU_PopErrorCode().details);
+        return NULL;
+    }
+    // The uploaded pixels replace the pixels of the destination.
+    GPU_SetBlending(entry->image, False);
+    statistics.usedBytes += size;
+    statistics.uploads++;
+    return entry->image;
+}
+
+/*
+ * Get the counters of the image cache, the lookups that were not hits are misses.
+ */
+void getImageCacheStatistics(ImageCacheStatistics* imageCacheStatistics) {
+    *imageCacheStatistics = statistics;
+}
+
+void freeImageCache() {
+    logStatistics();
+    while (oldestEntry != NULL) {
+        evictOldestEntry();
+    }
+    budget = 0;
+}
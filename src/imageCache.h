@@ -0,0 +1,42 @@
+#ifndef _IMAGE_CACHE_H_
+#define _IMAGE_CACHE_H_
+
+#include "X11/Xlib.h"
+#include "SDL.h"
+#include <SDL_gpu.h>
+
+/*
+ * The environment variable with the byte budget of the image cache, optionally with a K or M
+ * suffix. The cache is disabled if it is not set or 0.
+ */
+#define IMAGE_CACHE_SIZE_ENV_VARIABLE "SDL2X11_IMAGE_CACHE_SIZE"
+/* The maximum number of remembered images, including the ones that were only seen once. */
+#define IMAGE_CACHE_MAX_ENTRIES 1024
+/* The number of hash buckets of the image cache. */
+#define IMAGE_CACHE_BUCKETS 512
+/* The fraction of the byte budget that a single cached image may use at most. */
+#define IMAGE_CACHE_MAX_IMAGE_FRACTION 4
+/* The number of lookups after which the cache statistics are logged. */
+#define IMAGE_CACHE_STATISTICS_INTERVAL 1000
+
+/* The counters of the image cache since it was initialized. */
+typedef struct {
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long uploads;
+    unsigned long evictions;
+    /* The bytes of the cached textures. */
+    size_t usedBytes;
+} ImageCacheStatistics;
+
+Bool initImageCache(void);
+Bool isImageCacheEnabled(void);
+Uint64 hashImageArea(const XImage* image, int x, int y, unsigned int width, unsigned int height,
+                     SDL_Color foreground, SDL_Color background);
+GPU_Image* findCachedImage(Uint64 hash, unsigned int width, unsigned int height,
+                           Bool* shouldCache);
+GPU_Image* addCachedImage(Uint64 hash, unsigned int width, unsigned int height);
+void getImageCacheStatistics(ImageCacheStatistics* imageCacheStatistics);
+void freeImageCache(void);
+
+#endif /* _IMAGE_CACHE_H_ */
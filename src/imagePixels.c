@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <string.h>
+#include "X11/Xlib.h"
+#include "SDL.h"
+#include "image.h"
+#include "util.h"
+
+// Inspired by https://github.com/csulmone/X11/blob/59029dc09211926a5c95ff1dd2b828574fefcde6/libX11-1.5.0/src/ImUtil.c
+
+/*
+ * The pixel accessors of XImages. Each image gets the get_pixel and put_pixel functions for
+ * its bits per pixel and byte order when it is created or initialized, so accessing a pixel
+ * is a single indirect call without any format checks. The pixel values that are read are
+ * limited to the depth of the image.
+ */
+
+#define IMAGE_ROW(image, y) ((Uint8*) (image)->data + (size_t) (y) * (image)->bytes_per_line)
+
+/* The values with the lowest n bits set, indexed by n. */
+static const unsigned long lowBits[33] = {
+    0x00000000, 0x00000001, 0x00000003, 0x00000007, 0x0000000F, 0x0000001F, 0x0000003F,
+    0x0000007F, 0x000000FF, 0x000001FF, 0x000003FF, 0x000007FF, 0x00000FFF, 0x00001FFF,
+    0x00003FFF, 0x00007FFF, 0x0000FFFF, 0x0001FFFF, 0x0003FFFF, 0x0007FFFF, 0x000FFFFF,
+    0x001FFFFF, 0x003FFFFF, 0x007FFFFF, 0x00FFFFFF, 0x01FFFFFF, 0x03FFFFFF, 0x07FFFFFF,
+    0x0FFFFFFF, 0x1FFFFFFF, 0x3FFFFFFF, 0x7FFFFFFF, 0xFFFFFFFF,
+};
+
+static unsigned long getPixel32MSB(XImage* image, int x, int y) {
+    const Uint8* pixel = IMAGE_ROW(image, y) + x * 4;
+    return ((unsigned long) pixel[0] << 24 | (unsigned long) pixel[1] << 16
+            | (unsigned long) pixel[2] << 8 | pixel[3]) & lowBits[image->depth];
+}
+
+static int putPixel32MSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixel = IMAGE_ROW(image, y) + x * 4;
+    pixel[0] = (Uint8) (value >> 24);
+    pixel[1] = (Uint8) (value >> 16);
+    pixel[2] = (Uint8) (value >> 8);
+    pixel[3] = (Uint8) value;
+    return 1;
+}
+
+static unsigned long getPixel32LSB(XImage* image, int x, int y) {
+    const Uint8* pixel = IMAGE_ROW(image, y) + x * 4;
+    return ((unsigned long) pixel[3] << 24 | (unsigned long) pixel[2] << 16
+            | (unsigned long) pixel[1] << 8 | pixel[0]) & lowBits[image->depth];
+}
+
+static int putPixel32LSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixel = IMAGE_ROW(image, y) + x * 4;
+    pixel[3] = (Uint8) (value >> 24);
+    pixel[2] = (Uint8) (value >> 16);
+    pixel[1] = (Uint8) (value >> 8);
+    pixel[0] = (Uint8) value;
+    return 1;
+}
+
+static unsigned long getPixel24MSB(XImage* image, int x, int y) {
+    const Uint8* pixel = IMAGE_ROW(image, y) + x * 3;
+    return ((unsigned long) pixel[0] << 16 | (unsigned long) pixel[1] << 8 | pixel[2])
+           & lowBits[image->depth];
+}
+
+static int putPixel24MSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixel = IMAGE_ROW(image, y) + x * 3;
+    pixel[0] = (Uint8) (value >> 16);
+    pixel[1] = (Uint8) (value >> 8);
+    pixel[2] = (Uint8) value;
+    return 1;
+}
+
+static unsigned long getPixel24LSB(XImage* image, int x, int y) {
+    const Uint8* pixel = IMAGE_ROW(image, y) + x * 3;
+    return ((unsigned long) pixel[2] << 16 | (unsigned long) pixel[1] << 8 | pixel[0])
+           & lowBits[image->depth];
+}
+
+static int putPixel24LSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixel = IMAGE_ROW(image, y) + x * 3;
+    pixel[2] = (Uint8) (value >> 16);
+    pixel[1] = (Uint8) (value >> 8);
+    pixel[0] = (Uint8) value;
+    return 1;
+}
+
+static unsigned long getPixel16MSB(XImage* image, int x, int y) {
+    const Uint8* pixel = IMAGE_ROW(image, y) + x * 2;
+    return ((unsigned long) pixel[0] << 8 | pixel[1]) & lowBits[image->depth];
+}
+
+static int putPixel16MSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixel = IMAGE_ROW(image, y) + x * 2;
+    pixel[0] = (Uint8) (value >> 8);
+    pixel[1] = (Uint8) value;
+    return 1;
+}
+
+static unsigned long getPixel16LSB(XImage* image, int x, int y) {
+    const Uint8* pixel = IMAGE_ROW(image, y) + x * 2;
+    return ((unsigned long) pixel[1] << 8 | pixel[0]) & lowBits[image->depth];
+}
+
+static int putPixel16LSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixel = IMAGE_ROW(image, y) + x * 2;
+    pixel[1] = (Uint8) (value >> 8);
+    pixel[0] = (Uint8) value;
+    return 1;
+}
+
+static unsigned long getPixel8(XImage* image, int x, int y) {
+    return IMAGE_ROW(image, y)[x] & lowBits[image->depth];
+}
+
+static int putPixel8(XImage* image, int x, int y, unsigned long value) {
+    IMAGE_ROW(image, y)[x] = (Uint8) value;
+    return 1;
+}
+
+/* The first of two 4 bit pixels is stored in the high nibble if the byte order is MSBFirst. */
+static unsigned long getPixel4MSB(XImage* image, int x, int y) {
+    Uint8 pixels = IMAGE_ROW(image, y)[x / 2];
+    return (unsigned long) (x & 1 ? pixels & 0x0F : pixels >> 4) & lowBits[image->depth];
+}
+
+static int putPixel4MSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixels = &IMAGE_ROW(image, y)[x / 2];
+    *pixels = (Uint8) (x & 1 ? (*pixels & 0xF0) | (value & 0x0F)
+                             : (*pixels & 0x0F) | (value & 0x0F) << 4);
+    return 1;
+}
+
+static unsigned long getPixel4LSB(XImage* image, int x, int y) {
+    Uint8 pixels = IMAGE_ROW(image, y)[x / 2];
+    return (unsigned long) (x & 1 ? pixels >> 4 : pixels & 0x0F) & lowBits[image->depth];
+}
+
+static int putPixel4LSB(XImage* image, int x, int y, unsigned long value) {
+    Uint8* pixels = &IMAGE_ROW(image, y)[x / 2];
+    *pixels = (Uint8) (x & 1 ? (*pixels & 0x0F) | (value & 0x0F) << 4
+                             : (*pixels & 0xF0) | (value & 0x0F));
+    return 1;
+}
+
+/*
+ * Accessors of single bit pixels whose bitmap units do not need to be swapped,
+ * which is the case if the units are bytes or the byte order equals the bit order.
+ */
+static unsigned long getPixel1MSB(XImage* image, int x, int y) {
+    unsigned int bit = (unsigned int) (x + image->xoffset);
+    return (unsigned long) (IMAGE_ROW(image, y)[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+static int putPixel1MSB(XImage* image, int x, int y, unsigned long value) {
+    unsigned int bit = (unsigned int) (x + image->xoffset);
+    Uint8* byte = &IMAGE_ROW(image, y)[bit / 8];
+    *byte = (Uint8) (value & 1 ? *byte | 0x80 >> bit % 8 : *byte & ~(0x80 >> bit % 8));
+    return 1;
+}
+
+static unsigned long getPixel1LSB(XImage* image, int x, int y) {
+    unsigned int bit = (unsigned int) (x + image->xoffset);
+    return (unsigned long) (IMAGE_ROW(image, y)[bit / 8] >> bit % 8) & 1;
+}
+
+static int putPixel1LSB(XImage* image, int x, int y, unsigned long value) {
+    unsigned int bit = (unsigned int) (x + image->xoffset);
+    Uint8* byte = &IMAGE_ROW(image, y)[bit / 8];
+    *byte = (Uint8) (value & 1 ? *byte | 1 << bit % 8 : *byte & ~(1 << bit % 8));
+    return 1;
+}
+
+/*
+ * Get the byte and the mask of a bit of a bitmap row in any bitmap unit and bit order.
+ */
+static Uint8* getBitmapBit(XImage* image, Uint8* row, unsigned int bit, Uint8* mask) {
+    size_t byte = bit / 8;
+    if (image->bitmap_unit > 8 && image->byte_order != image->bitmap_bit_order) {
+        byte ^= (size_t) image->bitmap_unit / 8 - 1;
+    }
+    *mask = (Uint8) (image->bitmap_bit_order == MSBFirst ? 0x80 >> bit % 8 : 1 << bit % 8);
+    return &row[byte];
+}
+
+/*
+ * Accessors of XY images, whose bit planes are stored one after another starting with the most
+ * significant one, in any bitmap unit. They also handle single planes whose units are swapped.
+ */
+static unsigned long getPixelXY(XImage* image, int x, int y) {
+    unsigned long pixel = 0;
+    size_t planeSize = (size_t) image->bytes_per_line * image->height;
+    Uint8* row = IMAGE_ROW(image, y);
+    int plane, numPlanes = image->format == ZPixmap || image->format == XYBitmap ? 1 : image->depth;
+    Uint8 mask;
+    for (plane = 0; plane < numPlanes; plane++, row += planeSize) {
+        Uint8* byte = getBitmapBit(image, row, (unsigned int) (x + image->xoffset), &mask);
+        pixel = pixel << 1 | (*byte & mask ? 1 : 0);
+    }
+    return pixel;
+}
+
+static int putPixelXY(XImage* image, int x, int y, unsigned long value) {
+    size_t planeSize = (size_t) image->bytes_per_line * image->height;
+    Uint8* row = IMAGE_ROW(image, y);
+    int plane, numPlanes = image->format == ZPixmap || image->format == XYBitmap ? 1 : image->depth;
+    Uint8 mask;
+    for (plane = numPlanes - 1; plane >= 0; plane--, row += planeSize) {
+        Uint8* byte = getBitmapBit(image, row, (unsigned int) (x + image->xoffset), &mask);
+        *byte = (Uint8) ((value >> plane) & 1 ? *byte | mask : *byte & ~mask);
+    }
+    return 1;
+}
+
+static unsigned long getPixelUnsupported(XImage* image, int x, int y) {
+    (void) image; (void) x; (void) y;
+    return 0;
+}
+
+static int putPixelUnsupported(XImage* image, int x, int y, unsigned long value) {
+    (void) image; (void) x; (void) y; (void) value;
+    return 0;
+}
+
+int destroyImage(XImage* image) {
+    // https://tronche.com/gui/x/xlib/utilities/XDestroyImage.html
+    if (image->data != NULL) {
+        free(image->data);
+    }
+    free(image);
+    return 1;
+}
+
+static XImage* subImage(XImage* image, int x, int y, unsigned int width, unsigned int height) {
+    // https://tronche.com/gui/x/xlib/utilities/XSubImage.html
+    XImage* sub = malloc(sizeof(XImage));
+    if (sub == NULL) return NULL;
+    *sub = *image;
+    sub->width = (int) width;
+    sub->height = (int) height;
+    sub->xoffset = 0;
+    sub->obdata = NULL;
+    int pad = image->bitmap_pad > 0 ? image->bitmap_pad : 8;
+    int bitsPerLine = image->format == ZPixmap ? (int) width * image->bits_per_pixel : (int) width;
+    sub->bytes_per_line = (bitsPerLine + pad - 1) / pad * pad / 8;
+    size_t numPlanes = image->format == XYPixmap ? (size_t) image->depth : 1;
+    size_t size = (size_t) sub->bytes_per_line * height * numPlanes;
+    sub->data = calloc(MAX(size, 1), 1);
+    if (sub->data == NULL) {
+        free(sub);
+        return NULL;
+    }
+    initImageFunctions(sub);
+    // Pixels outside of the source image stay 0.
+    int x1 = MAX(x, 0), y1 = MAX(y, 0);
+    int x2 = MIN(x + (int) width, image->width), y2 = MIN(y + (int) height, image->height);
+    int row, column;
+    if (x1 >= x2 || y1 >= y2 || image->data == NULL) return sub;
+    if (image->format == ZPixmap && image->bits_per_pixel % 8 == 0) {
+        size_t bytesPerPixel = (size_t) image->bits_per_pixel / 8;
+        for (row = y1; row < y2; row++) {
+            memcpy(IMAGE_ROW(sub, row - y) + (x1 - x) * bytesPerPixel,
+                   IMAGE_ROW(image, row) + x1 * bytesPerPixel, (x2 - x1) * bytesPerPixel);
+        }
+        return sub;
+    }
+    for (row = y1; row < y2; row++) {
+        for (column = x1; column < x2; column++) {
+            sub->f.put_pixel(sub, column - x, row - y, image->f.get_pixel(image, column, row));
+        }
+    }
+    return sub;
+}
+
+static int addPixel(XImage* image, long value) {
+    // https://tronche.com/gui/x/xlib/utilities/XAddPixel.html
+    int x, y;
+    if (value == 0 || image->data == NULL) return 1;
+    if (image->format == ZPixmap && image->bits_per_pixel == 8) {
+        for (y = 0; y < image->height; y++) {
+            Uint8* row = IMAGE_ROW(image, y);
+            for (x = 0; x < image->width; x++) {
+                row[x] = (Uint8) (row[x] + value);
+            }
+        }
+        return 1;
+    }
+    for (y = 0; y < image->height; y++) {
+        for (x = 0; x < image->width; x++) {
+            image->f.put_pixel(image, x, y, image->f.get_pixel(image, x, y) + value);
+        }
+    }
+    return 1;
+}
+
+/*
+ * Install the function pointers of the image that are specialized for its format.
+ */
+void initImageFunctions(XImage* image) {
+    Bool msbFirst = image->byte_order == MSBFirst;
+    image->f.create_image = XCreateImage;
+    image->f.destroy_image = destroyImage;
+    image->f.sub_image = subImage;
+    image->f.add_pixel = addPixel;
+    image->f.get_pixel = getPixelUnsupported;
+    image->f.put_pixel = putPixelUnsupported;
+    if (image->format == ZPixmap && image->bits_per_pixel != 1) {
+        switch (image->bits_per_pixel) {
+            case 32:
+                image->f.get_pixel = msbFirst ? getPixel32MSB : getPixel32LSB;
+                image->f.put_pixel = msbFirst ? putPixel32MSB : putPixel32LSB;
+                break;
+            case 24:
+                image->f.get_pixel = msbFirst ? getPixel24MSB : getPixel24LSB;
+                image->f.put_pixel = msbFirst ? putPixel24MSB : putPixel24LSB;
+                break;
+            case 16:
+                image->f.get_pixel = msbFirst ? getPixel16MSB : getPixel16LSB;
+                image->f.put_pixel = msbFirst ? putPixel16MSB : putPixel16LSB;
+                break;
+            case 8:
+                image->f.get_pixel = getPixel8;
+                image->f.put_pixel = putPixel8;
+                break;
+            case 4:
+                image->f.get_pixel = msbFirst ? getPixel4MSB : getPixel4LSB;
+                image->f.put_pixel = msbFirst ? putPixel4MSB : putPixel4LSB;
+                break;
+            default:
+                LOG("Warn: Got unsupported %d bits per pixel for image %p\n",
+                    image->bits_per_pixel, image);
+                break;
+        }
+        if (image->depth < 1 || image->depth > 32) {
+            image->f.get_pixel = getPixelUnsupported;
+        }
+        return;
+    }
+    if (image->format == XYPixmap && image->depth > 1) {
+        image->f.get_pixel = getPixelXY;
+        image->f.put_pixel = putPixelXY;
+    } else if (image->bitmap_unit > 8 && image->byte_order != image->bitmap_bit_order) {
+        image->f.get_pixel = getPixelXY;
+        image->f.put_pixel = putPixelXY;
+    } else {
+        Bool bitMsbFirst = image->bitmap_bit_order == MSBFirst;
+        image->f.get_pixel = bitMsbFirst ? getPixel1MSB : getPixel1LSB;
+        image->f.put_pixel = bitMsbFirst ? putPixel1MSB : putPixel1LSB;
+    }
+}
+
+Status _XInitImageFuncPtrs(XImage *image) {
+    initImageFunctions(image);
+    return 1;
+}
+
+Status XInitImage(XImage* image) {
+    // https://tronche.com/gui/x/xlib/graphics/XInitImage.html
+    if (image->depth <= 0 || image->depth > 32 || image->bits_per_pixel <= 0
+        || image->bits_per_pixel > 32 || image->bitmap_unit < 0 || image->bitmap_unit > 32
+        || image->bitmap_pad < 0 || image->xoffset < 0 || image->bytes_per_line < 0
+        || image->width < 0 || image->height < 0
+        || (image->format != XYBitmap && image->format != XYPixmap && image->format != ZPixmap)) {
+        LOG("Got invalid image %p in %s\n", image, __func__);
+        return 0;
+    }
+    if (image->bytes_per_line == 0) {
+        int pad = image->bitmap_pad > 0 ? image->bitmap_pad : 8;
+        int bitsPerLine = image->format == ZPixmap ? image->width * image->bits_per_pixel
+                                                   : image->width + image->xoffset;
+        image->bytes_per_line = (bitsPerLine + pad - 1) / pad * pad / 8;
+    }
+    initImageFunctions(image);
+    return 1;
+}
@@ -90,6 +90,23 @@ KeySym XKeycodeToKeysym(Display *display, KeyCode keycode, int index) {
     return NoSymbol;
 }
 
+/*
+ * Find the SDL keycode that produces the keysym, the inverse of XKeycodeToKeysym.
+ */
+SDL_Keycode convertKeySymToKeycode(KeySym keysym) {
+    if (keysym >= XK_space && keysym <= XK_asciitilde) {
+        // SDL uses the lower case character as the keycode of letter keys.
+        return keysym >= XK_A && keysym <= XK_Z ? SDLK_a + (keysym - XK_A) : (SDL_Keycode) keysym;
+    }
+    int i;
+    for (i = 0; i < SDL_KEYCODE_TO_KEYSYM_LENGTH; i++) {
+        if (SDLKeycodeToKeySym[i].keysym == keysym) {
+            return SDLKeycodeToKeySym[i].keycode;
+        }
+    }
+    return SDLK_UNKNOWN;
+}
+
 int XLookupString(XKeyEvent* event_struct, char* buffer_return, int bytes_buffer,
                   KeySym* keysym_return, XComposeStatus *status_in_out) {
     // https://tronche.com/gui/x/xlib/utilities/XLookupString.html
@@ -5,5 +5,6 @@
 #include "window.h"
 
 Window getKeyboardFocus();
+SDL_Keycode convertKeySymToKeycode(KeySym keysym);
 
 #endif /* INPUT_H */
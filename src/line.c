@@ -0,0 +1,307 @@
+#include <math.h>
+#include <stdlib.h>
+#include "line.h"
+#include "util.h"
+
+/*
+ * Lines are tessellated on the CPU into a list of triangles. The line runs through the pixel
+ * centers of its points. Dashed lines are split into one run per dash, which is tessellated
+ * like a solid line, so the cap style is applied to the ends of every dash. The dash pattern
+ * continues across the joints of a polyline.
+ * The segments, joins and caps overlap each other. X draws every pixel of a polyline only once,
+ * which is only visible for GC functions like GXxor and for translucent colors, so the display
+ * list takes care of that when the polyline is drawn.
+ */
+
+typedef struct {
+    float x;
+    float y;
+} Vector;
+
+/*
+ * Make sure that the triangle list has space for at least numPoints additional points.
+ */
+Bool reserveTriangleList(TriangleList* list, size_t numPoints) {
+    if (list->numPoints + numPoints > list->capacity) {
+        size_t capacity = MAX(list->numPoints + numPoints, MAX(64, list->capacity * 2));
+        float* points = realloc(list->points, sizeof(float) * 2 * capacity);
+        if (points == NULL) return False;
+        list->points = points;
+        list->capacity = capacity;
+    }
+    return True;
+}
+
+static Bool addTriangle(TriangleList* list, Vector a, Vector b, Vector c) {
+    if (!reserveTriangleList(list, 3)) return False;
+    float* point = &list->points[list->numPoints * 2];
+    *point++ = a.x; *point++ = a.y;
+    *point++ = b.x; *point++ = b.y;
+    *point++ = c.x; *point   = c.y;
+    list->numPoints += 3;
+    return True;
+}
+
+static Bool addQuad(TriangleList* list, Vector a, Vector b, Vector c, Vector d) {
+    return addTriangle(list, a, b, c) && addTriangle(list, a, c, d);
+}
+
+static Vector makeVector(float x, float y) {
+    Vector vector;
+    vector.x = x;
+    vector.y = y;
+    return vector;
+}
+
+static Vector getDirection(Vector from, Vector to) {
+    float dx = to.x - from.x, dy = to.y - from.y;
+    float length = sqrtf(dx * dx + dy * dy);
+    return makeVector(dx / length, dy / length);
+}
+
+static Bool isSamePoint(Vector point1, Vector point2) {
+    return point1.x == point2.x && point1.y == point2.y;
+}
+
+/*
+ * Add a triangle fan around the center that covers the given sweep of a circle,
+ * starting at the start angle (in radians).
+ */
+static Bool addFan(TriangleList* list, Vector center, float radius, double startAngle,
+                   double sweep) {
+    double segmentsPerCircle = MIN(MAX(radius * 3, 8), 128);
+    size_t i, segments = (size_t) MAX(1, ceil(segmentsPerCircle * fabs(sweep) / (2 * M_PI)));
+    Vector previous = makeVector((float) (center.x + radius * cos(startAngle)),
+                                 (float) (center.y + radius * sin(startAngle)));
+    for (i = 1; i <= segments; i++) {
+        double angle = startAngle + sweep * i / segments;
+        Vector current = makeVector((float) (center.x + radius * cos(angle)),
+                                    (float) (center.y + radius * sin(angle)));
+        if (!addTriangle(list, center, previous, current)) return False;
+        previous = current;
+    }
+    return True;
+}
+
+/*
+ * Add the join between a segment in direction d0 and the following segment in direction d1
+ * at the vertex. The join fills the gap on the outer side of the turn.
+ */
+static Bool addJoin(TriangleList* list, const LineStyle* style, Vector vertex,
+                    Vector d0, Vector d1, float halfWidth) {
+    float cross = d0.x * d1.y - d0.y * d1.x, dot = d0.x * d1.x + d0.y * d1.y;
+    if (fabsf(cross) < 1e-6f && dot > 0) return True;
+    // The normals of the outer side of the turn.
+    float side = cross > 0 ? -1.0f : 1.0f;
+    Vector u0 = makeVector(-d0.y * side, d0.x * side), u1 = makeVector(-d1.y * side, d1.x * side);
+    Vector outer0 = makeVector(vertex.x + u0.x * halfWidth, vertex.y + u0.y * halfWidth);
+    Vector outer1 = makeVector(vertex.x + u1.x * halfWidth, vertex.y + u1.y * halfWidth);
+    if (style->lineWidth > 0 && style->joinStyle == JoinRound) {
+        double startAngle = atan2(u0.y, u0.x);
+        double sweep = atan2(u0.x * u1.y - u0.y * u1.x, u0.x * u1.x + u0.y * u1.y);
+        return addFan(list, vertex, halfWidth, startAngle, sweep);
+    }
+    // Thin lines are mitered, so the pixel at the corner is covered.
+    if (style->lineWidth == 0 || style->joinStyle == JoinMiter) {
+        double angleBetweenLines = M_PI - acos(MAX(-1.0f, MIN(dot, 1.0f)));
+        Vector miter = makeVector(u0.x + u1.x, u0.y + u1.y);
+        float miterLength = sqrtf(miter.x * miter.x + miter.y * miter.y);
+        if (angleBetweenLines >= LINE_MITER_LIMIT_ANGLE * M_PI / 180 && miterLength > 1e-6f) {
+            miter.x /= miterLength;
+            miter.y /= miterLength;
+            // The distance from the vertex to the miter tip.
+            float tipDistance = halfWidth / (miter.x * u0.x + miter.y * u0.y);
+            Vector tip = makeVector(vertex.x + miter.x * tipDistance,
+                                    vertex.y + miter.y * tipDistance);
+            return addTriangle(list, vertex, outer0, tip) && addTriangle(list, vertex, tip, outer1);
+        }
+    }
+    return addTriangle(list, vertex, outer0, outer1);
+}
+
+/*
+ * Tessellate a polyline without dashes. If the run is closed, the last point is joined with the
+ * first one. isPathEnd specifies whether the run ends at the last point of the whole path.
+ */
+static Bool tessellateRun(TriangleList* list, const LineStyle* style, const Vector* points,
+                          size_t numPoints, Bool closed, Bool isPathEnd) {
+    size_t i;
+    if (numPoints < 2) return True;
+    Bool isThin = style->lineWidth == 0;
+    float halfWidth = isThin ? 0.5f : style->lineWidth / 2.0f;
+    float startExtension = 0, endExtension = 0;
+    if (isThin && !closed) {
+        // Thin lines cover the pixels from their start point up to their end point.
+        startExtension = 0.5f;
+        endExtension = isPathEnd && style->capStyle != CapNotLast ? 0.5f : -0.5f;
+    } else if (!closed && style->capStyle == CapProjecting) {
+        startExtension = endExtension = halfWidth;
+    }
+    Vector previousDirection = {0, 0};
+    for (i = 0; i + 1 < numPoints; i++) {
+        Vector direction = getDirection(points[i], points[i + 1]);
+        float start = i == 0 ? startExtension : 0;
+        float end = i + 2 == numPoints ? endExtension : 0;
+        Vector a = makeVector(points[i].x - direction.x * start, points[i].y - direction.y * start);
+        Vector b = makeVector(points[i + 1].x + direction.x * end,
+                              points[i + 1].y + direction.y * end);
+        Vector normal = makeVector(-direction.y * halfWidth, direction.x * halfWidth);
+        if (!addQuad(list, makeVector(a.x + normal.x, a.y + normal.y),
+                     makeVector(b.x + normal.x, b.y + normal.y),
+                     makeVector(b.x - normal.x, b.y - normal.y),
+                     makeVector(a.x - normal.x, a.y - normal.y))) {
+            return False;
+        }
+        if (i > 0 && !addJoin(list, style, points[i], previousDirection, direction, halfWidth)) {
+            return False;
+        }
+        previousDirection = direction;
+    }
+    if (closed) {
+        return addJoin(list, style, points[0], previousDirection,
+                       getDirection(points[0], points[1]), halfWidth);
+    }
+    if (!isThin && style->capStyle == CapRound) {
+        Vector startDirection = getDirection(points[0], points[1]);
+        if (!addFan(list, points[0], halfWidth,
+                    atan2(startDirection.x, -startDirection.y), M_PI)) {
+            return False;
+        }
+        return addFan(list, points[numPoints - 1], halfWidth,
+                      atan2(-previousDirection.x, previousDirection.y), M_PI);
+    }
+    return True;
+}
+
+/*
+ * Tessellate a line that consists of a single point.
+ */
+static Bool tessellatePoint(TriangleList* list, const LineStyle* style, Vector point) {
+    float halfWidth = style->lineWidth / 2.0f;
+    if (style->lineWidth == 0 || style->capStyle == CapProjecting) {
+        halfWidth = MAX(0.5f, halfWidth);
+        return addQuad(list, makeVector(point.x - halfWidth, point.y - halfWidth),
+                       makeVector(point.x + halfWidth, point.y - halfWidth),
+                       makeVector(point.x + halfWidth, point.y + halfWidth),
+                       makeVector(point.x - halfWidth, point.y + halfWidth));
+    }
+    if (style->capStyle == CapRound) {
+        return addFan(list, point, halfWidth, 0, 2 * M_PI);
+    }
+    return True;
+}
+
+static unsigned int getDashLength(const LineStyle* style, size_t index) {
+    return (unsigned char) style->dashes[index % style->numDashes];
+}
+
+/*
+ * Split the path into dashes and tessellate them. The dash position is the distance
+ * into the dash pattern at the start of the path and is advanced by the length of the path.
+ */
+static Bool tessellateDashes(const LineStyle* style, const Vector* path, size_t numPoints,
+                             float* dashPosition, TriangleList* onTriangles,
+                             TriangleList* offTriangles) {
+    // If the number of dashes is uneven, the pattern is concatenated with itself.
+    size_t i, numDashes = style->numDashes % 2 == 0 ? style->numDashes : style->numDashes * 2;
+    unsigned int patternLength = 0;
+    for (i = 0; i < numDashes; i++) {
+        patternLength += getDashLength(style, i);
+    }
+    if (patternLength == 0) return True;
+    float position = fmodf(*dashPosition, patternLength);
+    if (position < 0) position += patternLength;
+    size_t dashIndex = 0;
+    while (position >= getDashLength(style, dashIndex)) {
+        position -= getDashLength(style, dashIndex);
+        dashIndex = (dashIndex + 1) % numDashes;
+    }
+    float remaining = getDashLength(style, dashIndex) - position;
+    // A run contains the start of the dash and at most all points of the path.
+    Vector* run = malloc(sizeof(Vector) * (numPoints + 1));
+    if (run == NULL) return False;
+    size_t runLength = 1;
+    run[0] = path[0];
+    float pathLength = 0;
+    for (i = 0; i + 1 < numPoints; i++) {
+        Vector direction = getDirection(path[i], path[i + 1]);
+        float dx = path[i + 1].x - path[i].x, dy = path[i + 1].y - path[i].y;
+        float segmentLength = sqrtf(dx * dx + dy * dy), distance = 0;
+        pathLength += segmentLength;
+        while (segmentLength - distance > remaining) {
+            distance += remaining;
+            Vector dashEnd = makeVector(path[i].x + direction.x * distance,
+                                        path[i].y + direction.y * distance);
+            if (!isSamePoint(run[runLength - 1], dashEnd)) run[runLength++] = dashEnd;
+            // Even dashes are drawn in the foreground, uneven dashes in the background.
+            TriangleList* list = dashIndex % 2 == 0 ? onTriangles
+                                 : style->lineStyle == LineDoubleDash ? offTriangles : NULL;
+            if (list != NULL && !tessellateRun(list, style, run, runLength, False, False)) {
+                free(run);
+                return False;
+            }
+            dashIndex = (dashIndex + 1) % numDashes;
+            remaining = getDashLength(style, dashIndex);
+            run[0] = dashEnd;
+            runLength = 1;
+        }
+        remaining -= segmentLength - distance;
+        if (!isSamePoint(run[runLength - 1], path[i + 1])) run[runLength++] = path[i + 1];
+    }
+    TriangleList* list = dashIndex % 2 == 0 ? onTriangles
+                         : style->lineStyle == LineDoubleDash ? offTriangles : NULL;
+    Bool success = list == NULL || tessellateRun(list, style, run, runLength, False, True);
+    free(run);
+    *dashPosition += pathLength;
+    return success;
+}
+
+/*
+ * Tessellate the polyline through the points with the line style. The points are interpreted
+ * according to the coordinate mode. If the first and the last point are equal, they are joined.
+ * The triangles of the dashes that are drawn in the foreground are appended to the on triangles,
+ * the ones drawn in the background (for LineDoubleDash) to the off triangles.
+ * The dash position is the distance into the dash pattern at the start of the polyline,
+ * it is advanced by the length of the polyline. Returns False if we ran out of memory.
+ */
+Bool tessellateLines(const LineStyle* style, const XPoint* points, size_t numPoints,
+                     int mode, float* dashPosition, TriangleList* onTriangles,
+                     TriangleList* offTriangles) {
+    size_t i, numPathPoints = 0;
+    if (numPoints == 0) return True;
+    Vector* path = malloc(sizeof(Vector) * numPoints);
+    if (path == NULL) return False;
+    int x = 0, y = 0;
+    for (i = 0; i < numPoints; i++) {
+        if (mode == CoordModePrevious && i > 0) {
+            x += points[i].x;
+            y += points[i].y;
+        } else {
+            x = points[i].x;
+            y = points[i].y;
+        }
+        // The line runs through the pixel centers.
+        Vector point = makeVector(x + 0.5f, y + 0.5f);
+        if (numPathPoints == 0 || !isSamePoint(path[numPathPoints - 1], point)) {
+            path[numPathPoints++] = point;
+        }
+    }
+    Bool success;
+    if (numPathPoints == 1) {
+        success = tessellatePoint(onTriangles, style, path[0]);
+    } else if (style->lineStyle == LineSolid || style->numDashes == 0) {
+        Bool closed = numPathPoints > 2 && isSamePoint(path[0], path[numPathPoints - 1]);
+        success = tessellateRun(onTriangles, style, path, numPathPoints, closed, True);
+    } else {
+        success = tessellateDashes(style, path, numPathPoints, dashPosition,
+                                   onTriangles, offTriangles);
+    }
+    free(path);
+    return success;
+}
+
+void freeTriangleList(TriangleList* list) {
+    free(list->points);
+    list->points = NULL;
+    list->numPoints = list->capacity = 0;
+}
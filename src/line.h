@@ -0,0 +1,32 @@
+#ifndef _LINE_H_
+#define _LINE_H_
+
+#include "X11/Xlib.h"
+
+/* The smallest angle between two lines that is still joined with a miter, as specified by X. */
+#define LINE_MITER_LIMIT_ANGLE 11.0
+
+/* The line attributes of a graphic context. */
+typedef struct {
+    unsigned int lineWidth;
+    int lineStyle;
+    int capStyle;
+    int joinStyle;
+    const char* dashes;
+    size_t numDashes;
+} LineStyle;
+
+/* A growing list of triangles. Every three consecutive points (x, y pairs) form one triangle. */
+typedef struct {
+    float* points;
+    size_t numPoints;
+    size_t capacity;
+} TriangleList;
+
+Bool tessellateLines(const LineStyle* style, const XPoint* points, size_t numPoints,
+                     int mode, float* dashPosition, TriangleList* onTriangles,
+                     TriangleList* offTriangles);
+Bool reserveTriangleList(TriangleList* list, size_t numPoints);
+void freeTriangleList(TriangleList* list);
+
+#endif /* _LINE_H_ */
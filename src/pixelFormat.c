@@ -0,0 +1,980 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pixelFormat.h"
+#include "visual.h"
+#include "util.h"
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#endif
+
+/*
+ * Conversion between the pixels of XImages or client pixel data and the R, G, B, A bytes
+ * of the textures, which have straight alpha.
+ * Pixel values are interpreted with the color masks of the image or, if it has none, in the
+ * layout of the default visual (0xRRGGBBAA). 32 bit pixels with one byte per channel,
+ * 16 bit RGB565 pixels, bitmaps and the alpha premultiplication are converted with SSE2 or
+ * NEON kernels where available, all other formats pixel by pixel. Read back pixels are
+ * written into 32 bit images with the same kernels in reverse.
+ * Every kernel finishes the pixels that the SIMD loop leaves over with a scalar loop, which is
+ * also the reference implementation: If the SIMD kernels are disabled via the environment,
+ * the scalar loops convert all pixels.
+ */
+
+/* Whether the SIMD kernels are used, or only the scalar reference loops. */
+static Bool simdEnabled = True;
+
+/* A color channel of a pixel value. */
+typedef struct {
+    unsigned long mask;
+    int shift;
+    int bits;
+} Channel;
+
+/* The R, G, B and A channels of the pixel values of an image. */
+typedef struct {
+    Channel channels[4];
+} PixelLayout;
+
+/* How the bytes of 32 bit pixels are reordered. */
+typedef struct {
+    /* The source byte of each destination byte or -1 if it is filled with the fill value. */
+    int source[4];
+    Uint8 fillValue;
+    /* Whether the bytes are already in the destination order. */
+    Bool identity;
+#if defined(__SSE2__)
+    __m128i masks[4];
+    __m128i shifts[4];
+    Bool shiftLeft[4];
+    __m128i fill;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    /* The table lookup indices and the fill bytes for two pixels. */
+    uint8x8_t indices;
+    uint8x8_t fill;
+#endif
+} ByteSwizzle;
+
+static void initChannel(Channel* channel, unsigned long mask) {
+    channel->mask = mask;
+    channel->shift = 0;
+    channel->bits = 0;
+    if (mask == 0) return;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        channel->shift++;
+    }
+    while ((mask & 1) != 0) {
+        mask >>= 1;
+        channel->bits++;
+    }
+}
+
+static void getPixelLayout(const XImage* image, PixelLayout* layout) {
+    unsigned long red = image->red_mask, green = image->green_mask, blue = image->blue_mask;
+    unsigned long alpha;
+    if (red == 0 && green == 0 && blue == 0) {
+        Visual* visual = getDefaultVisual(0);
+        red = visual->red_mask;
+        green = visual->green_mask;
+        blue = visual->blue_mask;
+        // A depth of 24 bits has room for the colors of the default layout, but not for alpha.
+        alpha = image->depth >= 24 && image->depth < 32 ? 0 : 0xFFFFFFFFUL & ~(red | green | blue);
+    } else {
+        unsigned long depthMask = image->depth >= 32 ? 0xFFFFFFFFUL : (1UL << image->depth) - 1;
+        alpha = depthMask & ~(red | green | blue);
+    }
+    initChannel(&layout->channels[0], red);
+    initChannel(&layout->channels[1], green);
+    initChannel(&layout->channels[2], blue);
+    initChannel(&layout->channels[3], alpha);
+}
+
+static Uint8 getChannelValue(const Channel* channel, unsigned long pixel, Uint8 missingValue) {
+    if (channel->bits == 0) return missingValue;
+    unsigned long value = (pixel & channel->mask) >> channel->shift;
+    if (channel->bits >= 8) return (Uint8) (value >> (channel->bits - 8));
+    // Replicate the bits of smaller channels, so the full range is covered.
+    unsigned long result = 0;
+    int numBits = 0;
+    while (numBits < 8) {
+        result = result << channel->bits | value;
+        numBits += channel->bits;
+    }
+    return (Uint8) (result >> (numBits - 8));
+}
+
+static void mapPixel(const PixelLayout* layout, unsigned long pixel, Uint8* rgba) {
+    rgba[0] = getChannelValue(&layout->channels[0], pixel, 0);
+    rgba[1] = getChannelValue(&layout->channels[1], pixel, 0);
+    rgba[2] = getChannelValue(&layout->channels[2], pixel, 0);
+    rgba[3] = getChannelValue(&layout->channels[3], pixel, 0xFF);
+}
+
+/*
+ * Read a bit of a bitmap row. The bits are grouped into bitmap units, whose bytes are stored
+ * in the byte order of the image.
+ */
+static int readBit(const XImage* image, const Uint8* row, unsigned int bit) {
+    size_t byte = bit / 8;
+    if (image->bitmap_unit > 8 && image->byte_order != image->bitmap_bit_order) {
+        byte ^= (size_t) image->bitmap_unit / 8 - 1;
+    }
+    if (image->bitmap_bit_order == MSBFirst) {
+        return (row[byte] >> (7 - bit % 8)) & 1;
+    }
+    return (row[byte] >> (bit % 8)) & 1;
+}
+
+static unsigned long readZPixel(const XImage* image, const Uint8* row, unsigned int x) {
+    const Uint8* pixel;
+    switch (image->bits_per_pixel) {
+        case 1:
+            return (unsigned long) readBit(image, row, x);
+        case 4:
+            pixel = &row[x / 2];
+            if ((x % 2 == 0) == (image->byte_order == MSBFirst)) return (unsigned long) *pixel >> 4;
+            return (unsigned long) *pixel & 0x0F;
+        case 8:
+            return row[x];
+        case 16:
+            pixel = &row[x * 2];
+            if (image->byte_order == MSBFirst) return (unsigned long) pixel[0] << 8 | pixel[1];
+            return (unsigned long) pixel[1] << 8 | pixel[0];
+        case 24:
+            pixel = &row[x * 3];
+            if (image->byte_order == MSBFirst) {
+                return (unsigned long) pixel[0] << 16 | (unsigned long) pixel[1] << 8 | pixel[2];
+            }
+            return (unsigned long) pixel[2] << 16 | (unsigned long) pixel[1] << 8 | pixel[0];
+        case 32:
+            pixel = &row[x * 4];
+            if (image->byte_order == MSBFirst) {
+                return (unsigned long) pixel[0] << 24 | (unsigned long) pixel[1] << 16
+                       | (unsigned long) pixel[2] << 8 | pixel[3];
+            }
+            return (unsigned long) pixel[3] << 24 | (unsigned long) pixel[2] << 16
+                   | (unsigned long) pixel[1] << 8 | pixel[0];
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Read a pixel of an XYPixmap image, whose bit planes are stored one after another,
+ * starting with the most significant plane.
+ */
+static unsigned long readXYPixel(const XImage* image, unsigned int x, unsigned int y) {
+    unsigned long pixel = 0;
+    size_t planeSize = (size_t) image->bytes_per_line * image->height;
+    const Uint8* row = (const Uint8*) image->data + (size_t) y * image->bytes_per_line;
+    int plane;
+    for (plane = 0; plane < image->depth; plane++, row += planeSize) {
+        pixel = pixel << 1 | (unsigned long) readBit(image, row, image->xoffset + x);
+    }
+    return pixel;
+}
+
+/*
+ * Prepare the kernels of the byte swizzle whose source bytes are set.
+ */
+static void initSwizzleKernel(ByteSwizzle* swizzle, Uint8 fillValue) {
+    int byte;
+    swizzle->fillValue = fillValue;
+    swizzle->identity = swizzle->source[0] == 0 && swizzle->source[1] == 1
+                        && swizzle->source[2] == 2 && swizzle->source[3] == 3;
+#if defined(__SSE2__)
+    // The pixels are loaded as little endian 32 bit lanes, so byte n is at bit 8 * n.
+    Uint32 fill = 0;
+    for (byte = 0; byte < 4; byte++) {
+        int distance = 8 * (byte - swizzle->source[byte]);
+        if (swizzle->source[byte] < 0) {
+            fill |= (Uint32) fillValue << (8 * byte);
+        }
+        swizzle->masks[byte] = _mm_set1_epi32((int) (0xFFU << (8 * byte)));
+        swizzle->shiftLeft[byte] = distance >= 0;
+        swizzle->shifts[byte] = _mm_cvtsi32_si128(distance >= 0 ? distance : -distance);
+    }
+    swizzle->fill = _mm_set1_epi32((int) fill);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    Uint8 indices[8], fill[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        int source = swizzle->source[i % 4];
+        // Out of range indices are looked up as 0.
+        indices[i] = (Uint8) (source < 0 ? 0xFF : i / 4 * 4 + source);
+        fill[i] = source < 0 ? fillValue : 0;
+    }
+    swizzle->indices = vld1_u8(indices);
+    swizzle->fill = vld1_u8(fill);
+#else
+    (void) byte;
+#endif
+}
+
+/*
+ * Initialize the byte swizzle from 32 bit pixels with one byte per channel in the given byte
+ * order to R, G, B, A bytes, or the reverse if toImage is set.
+ * Returns False if the pixels do not have that layout.
+ */
+static Bool initByteSwizzle(ByteSwizzle* swizzle, int byteOrder, const PixelLayout* layout,
+                            Bool toImage) {
+    int channel, sources[4];
+    for (channel = 0; channel < 4; channel++) {
+        const Channel* layoutChannel = &layout->channels[channel];
+        if (channel == 3 && layoutChannel->bits == 0) {
+            sources[channel] = -1;
+            continue;
+        }
+        if (layoutChannel->bits != 8 || layoutChannel->shift % 8 != 0) return False;
+        int byte = layoutChannel->shift / 8;
+        sources[channel] = byteOrder == MSBFirst ? 3 - byte : byte;
+    }
+    if (!toImage) {
+        memcpy(swizzle->source, sources, sizeof(sources));
+        initSwizzleKernel(swizzle, 0xFF);
+        return True;
+    }
+    // The byte that holds no channel is cleared.
+    memset(swizzle->source, -1, sizeof(swizzle->source));
+    for (channel = 0; channel < 4; channel++) {
+        if (sources[channel] >= 0) {
+            swizzle->source[sources[channel]] = channel;
+        }
+    }
+    initSwizzleKernel(swizzle, 0);
+    return True;
+}
+
+/*
+ * Check if the pixels of the image are already R, G, B, A bytes,
+ * so they can be uploaded without a conversion.
+ */
+Bool hasTexturePixelLayout(const XImage* image) {
+    PixelLayout layout;
+    ByteSwizzle swizzle;
+    if (image->format != ZPixmap || image->bits_per_pixel != 32 || image->data == NULL
+        || image->bytes_per_line % 4 != 0) {
+        return False;
+    }
+    getPixelLayout(image, &layout);
+    return initByteSwizzle(&swizzle, image->byte_order, &layout, False) && swizzle.identity;
+}
+
+static void swizzleRow(const ByteSwizzle* swizzle, const Uint8* source, Uint8* dest,
+                       size_t numPixels) {
+    size_t i = 0;
+    int byte;
+    if (swizzle->identity) {
+        memcpy(dest, source, numPixels * 4);
+        return;
+    }
+#if defined(__SSE2__)
+    for (; simdEnabled && i + 4 <= numPixels; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (source + i * 4));
+        __m128i result = swizzle->fill;
+        for (byte = 0; byte < 4; byte++) {
+            if (swizzle->source[byte] < 0) continue;
+            __m128i shifted = swizzle->shiftLeft[byte] ?
+                    _mm_sll_epi32(pixels, swizzle->shifts[byte]) :
+                    _mm_srl_epi32(pixels, swizzle->shifts[byte]);
+            result = _mm_or_si128(result, _mm_and_si128(shifted, swizzle->masks[byte]));
+        }
+        _mm_storeu_si128((__m128i*) (dest + i * 4), result);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; simdEnabled && i + 4 <= numPixels; i += 4) {
+        uint8x16_t pixels = vld1q_u8(source + i * 4);
+        uint8x8_t low = vorr_u8(vtbl1_u8(vget_low_u8(pixels), swizzle->indices), swizzle->fill);
+        uint8x8_t high = vorr_u8(vtbl1_u8(vget_high_u8(pixels), swizzle->indices), swizzle->fill);
+        vst1q_u8(dest + i * 4, vcombine_u8(low, high));
+    }
+#endif
+    for (; i < numPixels; i++) {
+        for (byte = 0; byte < 4; byte++) {
+            int sourceByte = swizzle->source[byte];
+            dest[i * 4 + byte] = sourceByte < 0 ? swizzle->fillValue : source[i * 4 + sourceByte];
+        }
+    }
+}
+
+/*
+ * Expand a row of a bitmap into R, G, B, A bytes, set bits become the foreground and unset
+ * bits the background color. The bits start at the given bit of the row, the bits of each byte
+ * are ordered with the most significant one first if msbFirst is set.
+ * Whole bytes are expanded with SSE2 or NEON kernels where available.
+ */
+void expandBitmapRow(const Uint8* bits, unsigned int firstBit, unsigned int width,
+                     Bool msbFirst, SDL_Color foreground, SDL_Color background, Uint8* dest) {
+    static const Uint8 msbMasks[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+    static const Uint8 lsbMasks[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+    const Uint8* bitMasks = msbFirst ? msbMasks : lsbMasks;
+    Uint32 foregroundPixel, backgroundPixel;
+    unsigned int i = 0;
+    memcpy(&foregroundPixel, &foreground, 4);
+    memcpy(&backgroundPixel, &background, 4);
+    bits += firstBit / 8;
+    firstBit %= 8;
+    // Expand the bits before the first whole byte one by one.
+    for (; firstBit != 0 && firstBit < 8 && i < width; firstBit++, i++, dest += 4) {
+        memcpy(dest, *bits & bitMasks[firstBit] ? &foregroundPixel : &backgroundPixel, 4);
+    }
+    if (firstBit == 8) {
+        bits++;
+    }
+#if defined(__SSE2__)
+    const __m128i foregroundPixels = _mm_set1_epi32((int) foregroundPixel);
+    const __m128i backgroundPixels = _mm_set1_epi32((int) backgroundPixel);
+    const __m128i lowMasks = _mm_setr_epi32(bitMasks[0], bitMasks[1], bitMasks[2], bitMasks[3]);
+    const __m128i highMasks = _mm_setr_epi32(bitMasks[4], bitMasks[5], bitMasks[6], bitMasks[7]);
+    for (; simdEnabled && i + 8 <= width; i += 8, bits++, dest += 32) {
+        __m128i byte = _mm_set1_epi32(*bits);
+        __m128i low = _mm_cmpeq_epi32(_mm_and_si128(byte, lowMasks), lowMasks);
+        __m128i high = _mm_cmpeq_epi32(_mm_and_si128(byte, highMasks), highMasks);
+        _mm_storeu_si128((__m128i*) dest, _mm_or_si128(_mm_and_si128(low, foregroundPixels),
+                _mm_andnot_si128(low, backgroundPixels)));
+        _mm_storeu_si128((__m128i*) (dest + 16), _mm_or_si128(
+                _mm_and_si128(high, foregroundPixels), _mm_andnot_si128(high, backgroundPixels)));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint32x4_t foregroundPixels = vdupq_n_u32(foregroundPixel);
+    const uint32x4_t backgroundPixels = vdupq_n_u32(backgroundPixel);
+    const Uint32 masks[8] = {bitMasks[0], bitMasks[1], bitMasks[2], bitMasks[3],
+                             bitMasks[4], bitMasks[5], bitMasks[6], bitMasks[7]};
+    const uint32x4_t lowMasks = vld1q_u32(masks);
+    const uint32x4_t highMasks = vld1q_u32(masks + 4);
+    for (; simdEnabled && i + 8 <= width; i += 8, bits++, dest += 32) {
+        uint32x4_t byte = vdupq_n_u32(*bits);
+        vst1q_u8(dest, vreinterpretq_u8_u32(vbslq_u32(vtstq_u32(byte, lowMasks),
+                                                      foregroundPixels, backgroundPixels)));
+        vst1q_u8(dest + 16, vreinterpretq_u8_u32(vbslq_u32(vtstq_u32(byte, highMasks),
+                                                           foregroundPixels, backgroundPixels)));
+    }
+#endif
+    for (firstBit = 0; i < width; i++, dest += 4) {
+        memcpy(dest, *bits & bitMasks[firstBit] ? &foregroundPixel : &backgroundPixel, 4);
+        if (++firstBit == 8) {
+            firstBit = 0;
+            bits++;
+        }
+    }
+}
+
+/*
+ * Check if the 16 bit pixels are RGB565 or, if swapRedBlue is set, BGR565.
+ */
+static Bool isRgb565(const PixelLayout* layout, Bool* swapRedBlue) {
+    const Channel* channels = layout->channels;
+    if (channels[1].bits != 6 || channels[1].shift != 5 || channels[3].bits != 0
+        || channels[0].bits != 5 || channels[2].bits != 5) {
+        return False;
+    }
+    *swapRedBlue = channels[0].shift == 0;
+    return (channels[0].shift == 11 && channels[2].shift == 0)
+           || (channels[0].shift == 0 && channels[2].shift == 11);
+}
+
+static void convertRgb565Row(const Uint8* source, Uint8* dest, size_t numPixels, Bool msbFirst,
+                             Bool swapRedBlue) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i alpha = _mm_set1_epi16((short) 0xFF00);
+    for (; simdEnabled && i + 8 <= numPixels; i += 8) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (source + i * 2));
+        if (msbFirst) {
+            pixels = _mm_or_si128(_mm_slli_epi16(pixels, 8), _mm_srli_epi16(pixels, 8));
+        }
+        __m128i high = _mm_srli_epi16(pixels, 11);
+        __m128i middle = _mm_and_si128(_mm_srli_epi16(pixels, 5), mask6);
+        __m128i low = _mm_and_si128(pixels, mask5);
+        // Replicate the upper bits into the lower bits, so the full range is covered.
+        high = _mm_or_si128(_mm_slli_epi16(high, 3), _mm_srli_epi16(high, 2));
+        middle = _mm_or_si128(_mm_slli_epi16(middle, 2), _mm_srli_epi16(middle, 4));
+        low = _mm_or_si128(_mm_slli_epi16(low, 3), _mm_srli_epi16(low, 2));
+        __m128i redGreen = _mm_or_si128(swapRedBlue ? low : high, _mm_slli_epi16(middle, 8));
+        __m128i blueAlpha = _mm_or_si128(swapRedBlue ? high : low, alpha);
+        _mm_storeu_si128((__m128i*) (dest + i * 4), _mm_unpacklo_epi16(redGreen, blueAlpha));
+        _mm_storeu_si128((__m128i*) (dest + i * 4 + 16), _mm_unpackhi_epi16(redGreen, blueAlpha));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; simdEnabled && i + 8 <= numPixels; i += 8) {
+        uint8x16_t bytes = vld1q_u8(source + i * 2);
+        if (msbFirst) {
+            bytes = vrev16q_u8(bytes);
+        }
+        uint16x8_t pixels = vreinterpretq_u16_u8(bytes);
+        uint8x8_t high = vmovn_u16(vshrq_n_u16(pixels, 11));
+        uint8x8_t middle = vand_u8(vmovn_u16(vshrq_n_u16(pixels, 5)), vdup_n_u8(0x3F));
+        uint8x8_t low = vand_u8(vmovn_u16(pixels), vdup_n_u8(0x1F));
+        high = vorr_u8(vshl_n_u8(high, 3), vshr_n_u8(high, 2));
+        middle = vorr_u8(vshl_n_u8(middle, 2), vshr_n_u8(middle, 4));
+        low = vorr_u8(vshl_n_u8(low, 3), vshr_n_u8(low, 2));
+        uint8x8x4_t rgba;
+        rgba.val[0] = swapRedBlue ? low : high;
+        rgba.val[1] = middle;
+        rgba.val[2] = swapRedBlue ? high : low;
+        rgba.val[3] = vdup_n_u8(0xFF);
+        vst4_u8(dest + i * 4, rgba);
+    }
+#endif
+    for (; i < numPixels; i++) {
+        const Uint8* pixel = &source[i * 2];
+        unsigned int value = msbFirst ? (unsigned int) pixel[0] << 8 | pixel[1]
+                                      : (unsigned int) pixel[1] << 8 | pixel[0];
+        unsigned int high = value >> 11, middle = (value >> 5) & 0x3F, low = value & 0x1F;
+        high = high << 3 | high >> 2;
+        middle = middle << 2 | middle >> 4;
+        low = low << 3 | low >> 2;
+        dest[i * 4] = (Uint8) (swapRedBlue ? low : high);
+        dest[i * 4 + 1] = (Uint8) middle;
+        dest[i * 4 + 2] = (Uint8) (swapRedBlue ? high : low);
+        dest[i * 4 + 3] = 0xFF;
+    }
+}
+
+/*
+ * Convert an area of the image into rows of R, G, B, A bytes with the given pitch.
+ * The 1 bits of XYBitmap images are converted to the foreground and the 0 bits to the
+ * background color. Returns False if the format of the image is not supported.
+ */
+Bool convertImageToRGBA(const XImage* image, int x, int y, unsigned int width,
+                        unsigned int height, SDL_Color foreground, SDL_Color background,
+                        Uint8* pixels, size_t pitch) {
+    unsigned int row, i;
+    PixelLayout layout;
+    ByteSwizzle swizzle;
+    Bool swapRedBlue;
+    if (image->data == NULL || image->bytes_per_line <= 0) return False;
+    if (image->format == XYBitmap) {
+        // Without swapped bitmap units, the bits are in consecutive bytes.
+        Bool consecutiveBits = image->bitmap_unit <= 8
+                               || image->byte_order == image->bitmap_bit_order;
+        for (row = 0; row < height; row++) {
+            const Uint8* source = (const Uint8*) image->data
+                                  + (size_t) (y + row) * image->bytes_per_line;
+            Uint8* dest = pixels + row * pitch;
+            if (consecutiveBits) {
+                expandBitmapRow(source, (unsigned int) (image->xoffset + x), width,
+                                image->bitmap_bit_order == MSBFirst, foreground, background, dest);
+                continue;
+            }
+            for (i = 0; i < width; i++, dest += 4) {
+                memcpy(dest, readBit(image, source, image->xoffset + x + i) ?
+                             &foreground : &background, 4);
+            }
+        }
+        return True;
+    }
+    getPixelLayout(image, &layout);
+    if (image->format == XYPixmap) {
+        for (row = 0; row < height; row++) {
+            for (i = 0; i < width; i++) {
+                mapPixel(&layout, readXYPixel(image, x + i, y + row), pixels + row * pitch + i * 4);
+            }
+        }
+        return True;
+    }
+    if (image->format != ZPixmap) return False;
+    int bitsPerPixel = image->bits_per_pixel;
+    if ((bitsPerPixel != 1 && bitsPerPixel != 4 && bitsPerPixel % 8 != 0) || bitsPerPixel > 32) {
+        return False;
+    }
+    const Uint8* source = (const Uint8*) image->data + (size_t) y * image->bytes_per_line;
+    if (bitsPerPixel == 32 && initByteSwizzle(&swizzle, image->byte_order, &layout, False)) {
+        for (row = 0; row < height; row++, source += image->bytes_per_line) {
+            swizzleRow(&swizzle, source + x * 4, pixels + row * pitch, width);
+        }
+    } else if (bitsPerPixel == 16 && isRgb565(&layout, &swapRedBlue)) {
+        for (row = 0; row < height; row++, source += image->bytes_per_line) {
+            convertRgb565Row(source + x * 2, pixels + row * pitch, width,
+                             image->byte_order == MSBFirst, swapRedBlue);
+        }
+    } else {
+        for (row = 0; row < height; row++, source += image->bytes_per_line) {
+            for (i = 0; i < width; i++) {
+                mapPixel(&layout, readZPixel(image, source, x + i), pixels + row * pitch + i * 4);
+            }
+        }
+    }
+    return True;
+}
+
+static unsigned long getChannelBits(const Channel* channel, Uint8 value) {
+    if (channel->bits == 0) return 0;
+    unsigned long bits = channel->bits >= 8 ? (unsigned long) value << (channel->bits - 8)
+                                            : (unsigned long) value >> (8 - channel->bits);
+    return (bits << channel->shift) & channel->mask;
+}
+
+static unsigned long unmapPixel(const PixelLayout* layout, const Uint8* rgba) {
+    return getChannelBits(&layout->channels[0], rgba[0])
+           | getChannelBits(&layout->channels[1], rgba[1])
+           | getChannelBits(&layout->channels[2], rgba[2])
+           | getChannelBits(&layout->channels[3], rgba[3]);
+}
+
+/*
+ * Write a bit of a bitmap row, see readBit.
+ */
+static void writeBit(const XImage* image, Uint8* row, unsigned int bit, int value) {
+    size_t byte = bit / 8;
+    if (image->bitmap_unit > 8 && image->byte_order != image->bitmap_bit_order) {
+        byte ^= (size_t) image->bitmap_unit / 8 - 1;
+    }
+    Uint8 mask = (Uint8) (image->bitmap_bit_order == MSBFirst ? 0x80 >> (bit % 8)
+                                                               : 0x01 << (bit % 8));
+    row[byte] = (Uint8) (value ? row[byte] | mask : row[byte] & ~mask);
+}
+
+static void writeZPixel(const XImage* image, Uint8* row, unsigned int x, unsigned long pixel) {
+    Uint8* dest;
+    int i, numBytes;
+    switch (image->bits_per_pixel) {
+        case 1:
+            writeBit(image, row, x, (int) (pixel & 1));
+            break;
+        case 4:
+            dest = &row[x / 2];
+            if ((x % 2 == 0) == (image->byte_order == MSBFirst)) {
+                *dest = (Uint8) ((*dest & 0x0F) | (pixel & 0x0F) << 4);
+            } else {
+                *dest = (Uint8) ((*dest & 0xF0) | (pixel & 0x0F));
+            }
+            break;
+        case 8:
+            row[x] = (Uint8) pixel;
+            break;
+        case 16:
+        case 24:
+        case 32:
+            numBytes = image->bits_per_pixel / 8;
+            dest = &row[x * numBytes];
+            for (i = 0; i < numBytes; i++) {
+                dest[i] = (Uint8) (pixel >> 8 * (image->byte_order == MSBFirst ?
+                                                 numBytes - 1 - i : i));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Write a pixel into an XYPixmap image with a plane per bit of its depth, see readXYPixel.
+ */
+static void writeXYPixel(const XImage* image, int depth, unsigned int x, unsigned int y,
+                         unsigned long pixel) {
+    size_t planeSize = (size_t) image->bytes_per_line * image->height;
+    Uint8* row = (Uint8*) image->data + (size_t) y * image->bytes_per_line;
+    int plane;
+    for (plane = depth - 1; plane >= 0; plane--, row += planeSize) {
+        writeBit(image, row, image->xoffset + x, (int) ((pixel >> plane) & 1));
+    }
+}
+
+/*
+ * Collect the bits of the pixel that are selected by the plane mask into the lowest bits.
+ */
+static unsigned long packPlanes(unsigned long pixel, unsigned long planeMask) {
+    unsigned long result = 0;
+    int plane, numPlanes = 0;
+    for (plane = 0; plane < 32; plane++) {
+        if (planeMask & (1UL << plane)) {
+            result |= ((pixel >> plane) & 1) << numPlanes++;
+        }
+    }
+    return result;
+}
+
+/*
+ * Convert rows of R, G, B, A bytes into an area of the image. The pitch may be negative.
+ * ZPixmap pixels only keep the bits of the plane mask. XYPixmap images receive the planes
+ * selected by the plane mask, starting with the most significant one.
+ * Returns False if the format of the image is not supported.
+ */
+Bool convertRGBAToImage(const Uint8* pixels, ptrdiff_t pitch, unsigned int width,
+                        unsigned int height, unsigned long planeMask, XImage* image, int x, int y) {
+    unsigned int row, i;
+    PixelLayout layout;
+    ByteSwizzle swizzle;
+    if (image->data == NULL || image->bytes_per_line <= 0) return False;
+    if (image->format == XYPixmap || image->format == XYBitmap) {
+        // The depth of XY images is the number of their planes, the read pixels are unmapped
+        // in the layout of the 32 bit drawables before the planes are selected.
+        XImage drawableImage = *image;
+        drawableImage.depth = 32;
+        getPixelLayout(&drawableImage, &layout);
+        int depth = image->format == XYBitmap ? 1 : image->depth;
+        for (row = 0; row < height; row++) {
+            const Uint8* source = pixels + (ptrdiff_t) row * pitch;
+            for (i = 0; i < width; i++) {
+                unsigned long pixel = packPlanes(unmapPixel(&layout, source + i * 4), planeMask);
+                writeXYPixel(image, depth, x + i, y + row, pixel);
+            }
+        }
+        return True;
+    }
+    if (image->format != ZPixmap) return False;
+    int bitsPerPixel = image->bits_per_pixel;
+    if ((bitsPerPixel != 1 && bitsPerPixel != 4 && bitsPerPixel % 8 != 0) || bitsPerPixel > 32) {
+        return False;
+    }
+    getPixelLayout(image, &layout);
+    Uint8* dest = (Uint8*) image->data + (size_t) y * image->bytes_per_line;
+    if (bitsPerPixel == 32 && initByteSwizzle(&swizzle, image->byte_order, &layout, True)) {
+        Uint8 maskBytes[4];
+        Bool masked = False;
+        for (i = 0; i < 4; i++) {
+            int shift = image->byte_order == MSBFirst ? 24 - (int) i * 8 : (int) i * 8;
+            maskBytes[i] = (Uint8) (planeMask >> shift);
+            masked = masked || maskBytes[i] != 0xFF;
+        }
+        for (row = 0; row < height; row++, dest += image->bytes_per_line) {
+            Uint8* destPixels = dest + x * 4;
+            swizzleRow(&swizzle, pixels + (ptrdiff_t) row * pitch, destPixels, width);
+            for (i = 0; masked && i < width * 4; i++) {
+                destPixels[i] &= maskBytes[i % 4];
+            }
+        }
+    } else {
+        for (row = 0; row < height; row++, dest += image->bytes_per_line) {
+            const Uint8* source = pixels + (ptrdiff_t) row * pitch;
+            for (i = 0; i < width; i++) {
+                writeZPixel(image, dest, x + i, unmapPixel(&layout, source + i * 4) & planeMask);
+            }
+        }
+    }
+    return True;
+}
+
+/*
+ * Select the conversion kernels from the environment.
+ * Returns False if the selection is invalid, the SIMD kernels are used in that case.
+ */
+Bool initPixelConversion() {
+    const char* value = getenv(PIXEL_CONVERSION_ENV_VARIABLE);
+    simdEnabled = True;
+    if (value == NULL || strcmp(value, "simd") == 0) return True;
+    if (strcmp(value, "scalar") == 0) {
+        LOG("Using the scalar reference pixel conversion\n");
+        simdEnabled = False;
+        return True;
+    }
+    LOG("Unknown pixel conversion '%s'\n", value);
+    return False;
+}
+
+/*
+ * Get the name of the kernels that convert the pixels.
+ */
+const char* getPixelConversionKernels() {
+    return simdEnabled ? PIXEL_FORMAT_SIMD : "scalar";
+}
+
+static Uint8 multiplyAlpha(unsigned int value, unsigned int alpha) {
+    // Exactly value * alpha / 255, rounded.
+    unsigned int product = value * alpha + 128;
+    return (Uint8) ((product + (product >> 8)) >> 8);
+}
+
+/*
+ * Multiply the colors of R, G, B, A bytes with their alpha.
+ */
+static void premultiplyRow(const Uint8* source, Uint8* dest, size_t numPixels) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(128);
+    const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+    for (; simdEnabled && i + 4 <= numPixels; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (source + i * 4));
+        __m128i low = _mm_unpacklo_epi8(pixels, zero);
+        __m128i high = _mm_unpackhi_epi8(pixels, zero);
+        __m128i lowAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(low, 0xFF), 0xFF);
+        __m128i highAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(high, 0xFF), 0xFF);
+        low = _mm_add_epi16(_mm_mullo_epi16(low, lowAlpha), rounding);
+        high = _mm_add_epi16(_mm_mullo_epi16(high, highAlpha), rounding);
+        low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+        high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+        __m128i result = _mm_packus_epi16(low, high);
+        result = _mm_or_si128(_mm_andnot_si128(alphaMask, result),
+                              _mm_and_si128(alphaMask, pixels));
+        _mm_storeu_si128((__m128i*) (dest + i * 4), result);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int channel;
+    for (; simdEnabled && i + 8 <= numPixels; i += 8) {
+        uint8x8x4_t pixels = vld4_u8(source + i * 4);
+        for (channel = 0; channel < 3; channel++) {
+            uint16x8_t product = vmull_u8(pixels.val[channel], pixels.val[3]);
+            pixels.val[channel] = vraddhn_u16(product, vrshrq_n_u16(product, 8));
+        }
+        vst4_u8(dest + i * 4, pixels);
+    }
+#endif
+    for (; i < numPixels; i++) {
+        const Uint8* pixel = &source[i * 4];
+        dest[i * 4] = multiplyAlpha(pixel[0], pixel[3]);
+        dest[i * 4 + 1] = multiplyAlpha(pixel[1], pixel[3]);
+        dest[i * 4 + 2] = multiplyAlpha(pixel[2], pixel[3]);
+        dest[i * 4 + 3] = pixel[3];
+    }
+}
+
+/*
+ * Divide the colors of premultiplied R, G, B, A bytes by their alpha.
+ */
+static void unpremultiplyRow(Uint8* pixels, size_t numPixels) {
+    size_t i;
+    int channel;
+    for (i = 0; i < numPixels; i++, pixels += 4) {
+        unsigned int alpha = pixels[3];
+        if (alpha == 0xFF) continue;
+        for (channel = 0; channel < 3; channel++) {
+            pixels[channel] = (Uint8) (alpha == 0 ? 0 :
+                    MIN(0xFF, (pixels[channel] * 0xFFU + alpha / 2) / alpha));
+        }
+    }
+}
+
+static void convertRgb888Row(const Uint8* source, Uint8* dest, size_t numPixels, Bool msbFirst) {
+    size_t i;
+    for (i = 0; i < numPixels; i++, source += 3, dest += 4) {
+        dest[0] = source[msbFirst ? 0 : 2];
+        dest[1] = source[1];
+        dest[2] = source[msbFirst ? 2 : 0];
+        dest[3] = 0xFF;
+    }
+}
+
+static void packRgb888Row(const Uint8* source, Uint8* dest, size_t numPixels, Bool msbFirst) {
+    size_t i;
+    for (i = 0; i < numPixels; i++, source += 4, dest += 3) {
+        dest[msbFirst ? 0 : 2] = source[0];
+        dest[1] = source[1];
+        dest[msbFirst ? 2 : 0] = source[2];
+    }
+}
+
+/*
+ * Pack R, G, B, A bytes into RGB565 pixels, the lower bits of the colors are dropped.
+ */
+static void packRgb565Row(const Uint8* source, Uint8* dest, size_t numPixels, Bool msbFirst) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i redMask = _mm_set1_epi32(0xF8);
+    const __m128i greenMask = _mm_set1_epi32(0xFC00);
+    const __m128i blueMask = _mm_set1_epi32(0xF80000);
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    for (; simdEnabled && i + 8 <= numPixels; i += 8) {
+        __m128i halves[2];
+        int half;
+        for (half = 0; half < 2; half++) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*) (source + i * 4 + half * 16));
+            __m128i value = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pixels, redMask), 8),
+                    _mm_or_si128(_mm_srli_epi32(_mm_and_si128(pixels, greenMask), 5),
+                                 _mm_srli_epi32(_mm_and_si128(pixels, blueMask), 19)));
+            // Bias the values into the signed range, so they survive the saturating pack.
+            halves[half] = _mm_sub_epi32(value, bias);
+        }
+        __m128i values = _mm_add_epi16(_mm_packs_epi32(halves[0], halves[1]),
+                                       _mm_set1_epi16((short) 0x8000));
+        if (msbFirst) {
+            values = _mm_or_si128(_mm_slli_epi16(values, 8), _mm_srli_epi16(values, 8));
+        }
+        _mm_storeu_si128((__m128i*) (dest + i * 2), values);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; simdEnabled && i + 8 <= numPixels; i += 8) {
+        uint8x8x4_t pixels = vld4_u8(source + i * 4);
+        uint16x8_t values = vshll_n_u8(vand_u8(pixels.val[0], vdup_n_u8(0xF8)), 8);
+        values = vorrq_u16(values, vshll_n_u8(vand_u8(pixels.val[1], vdup_n_u8(0xFC)), 3));
+        values = vorrq_u16(values, vmovl_u8(vshr_n_u8(pixels.val[2], 3)));
+        uint8x16_t bytes = vreinterpretq_u8_u16(values);
+        if (msbFirst) {
+            bytes = vrev16q_u8(bytes);
+        }
+        vst1q_u8(dest + i * 2, bytes);
+    }
+#endif
+    for (; i < numPixels; i++) {
+        const Uint8* pixel = &source[i * 4];
+        unsigned int value = (pixel[0] & 0xF8U) << 8 | (pixel[1] & 0xFCU) << 3 | pixel[2] >> 3;
+        dest[i * 2] = (Uint8) (msbFirst ? value >> 8 : value);
+        dest[i * 2 + 1] = (Uint8) (msbFirst ? value : value >> 8);
+    }
+}
+
+/*
+ * Get the layout of the 32 bit values of ARGB8888 and ABGR8888 pixels.
+ */
+static void getFormatLayout(PixelFormatType type, PixelLayout* layout) {
+    initChannel(&layout->channels[0], type == PIXEL_FORMAT_ARGB8888 ? 0x00FF0000 : 0x000000FF);
+    initChannel(&layout->channels[1], 0x0000FF00);
+    initChannel(&layout->channels[2], type == PIXEL_FORMAT_ARGB8888 ? 0x000000FF : 0x00FF0000);
+    initChannel(&layout->channels[3], 0xFF000000);
+}
+
+/* The last color that was looked up in a palette, neighbouring pixels often have the same. */
+typedef struct {
+    Uint32 color;
+    int index;
+} PaletteLookup;
+
+/*
+ * Get the index of the palette color that is closest to the R, G, B, A bytes.
+ */
+static int findPaletteColor(const ClientPixelFormat* format, const Uint8* rgba,
+                            PaletteLookup* lookup) {
+    int i, bestIndex = 0;
+    long bestDistance = -1;
+    Uint32 color;
+    memcpy(&color, rgba, 4);
+    if (lookup->index >= 0 && lookup->color == color) return lookup->index;
+    for (i = 0; i < format->numColors; i++) {
+        const SDL_Color* color = &format->palette[i];
+        long red = color->r - rgba[0], green = color->g - rgba[1];
+        long blue = color->b - rgba[2], alpha = color->a - rgba[3];
+        long distance = red * red + green * green + blue * blue + alpha * alpha;
+        if (bestDistance < 0 || distance < bestDistance) {
+            bestDistance = distance;
+            bestIndex = i;
+            if (distance == 0) break;
+        }
+    }
+    lookup->color = color;
+    lookup->index = bestIndex;
+    return bestIndex;
+}
+
+/*
+ * Prepare the conversion of pixels in the format. Returns False if the format is not supported.
+ */
+static Bool initFormatConversion(const ClientPixelFormat* format, Bool toPixels,
+                                 ByteSwizzle* swizzle, Uint32* palette) {
+    PixelLayout layout;
+    int i;
+    switch (format->type) {
+        case PIXEL_FORMAT_ARGB8888:
+        case PIXEL_FORMAT_ABGR8888:
+            getFormatLayout(format->type, &layout);
+            return initByteSwizzle(swizzle, format->byteOrder, &layout, toPixels);
+        case PIXEL_FORMAT_RGB888:
+        case PIXEL_FORMAT_RGB565:
+            return True;
+        case PIXEL_FORMAT_INDEXED8:
+            if (format->palette == NULL || format->numColors < 1 || format->numColors > 256) {
+                return False;
+            }
+            // Indices without a palette color are opaque black.
+            for (i = 0; i < 256; i++) {
+                SDL_Color color = {0x00, 0x00, 0x00, 0xFF};
+                memcpy(&palette[i], i < format->numColors ? &format->palette[i] : &color, 4);
+            }
+            return True;
+        case PIXEL_FORMAT_BITMAP:
+            return format->palette != NULL && format->numColors == 2;
+        default:
+            return False;
+    }
+}
+
+/*
+ * Convert rows of client pixels in the format into rows of R, G, B, A bytes.
+ * Returns False if the format is not supported.
+ */
+Bool convertPixelsToRGBA(const ClientPixelFormat* format, const Uint8* source, size_t sourcePitch,
+                         unsigned int width, unsigned int height, Uint8* dest, size_t destPitch) {
+    unsigned int row, i;
+    ByteSwizzle swizzle;
+    Uint32 palette[256];
+    Bool msbFirst = format->byteOrder == MSBFirst;
+    if (!initFormatConversion(format, False, &swizzle, palette)) return False;
+    for (row = 0; row < height; row++, source += sourcePitch, dest += destPitch) {
+        switch (format->type) {
+            case PIXEL_FORMAT_ARGB8888:
+            case PIXEL_FORMAT_ABGR8888:
+                swizzleRow(&swizzle, source, dest, width);
+                break;
+            case PIXEL_FORMAT_RGB888:
+                convertRgb888Row(source, dest, width, msbFirst);
+                break;
+            case PIXEL_FORMAT_RGB565:
+                convertRgb565Row(source, dest, width, msbFirst, False);
+                break;
+            case PIXEL_FORMAT_INDEXED8:
+                for (i = 0; i < width; i++) {
+                    memcpy(dest + i * 4, &palette[source[i]], 4);
+                }
+                break;
+            case PIXEL_FORMAT_BITMAP:
+                expandBitmapRow(source, 0, width, msbFirst, format->palette[1],
+                                format->palette[0], dest);
+                break;
+        }
+        if (format->premultiplied) {
+            unpremultiplyRow(dest, width);
+        }
+    }
+    return True;
+}
+
+/*
+ * Convert rows of R, G, B, A bytes into rows of client pixels in the format.
+ * Indexed pixels and bitmaps receive the closest color of their palette.
+ * Returns False if the format is not supported.
+ */
+Bool convertRGBAToPixels(const ClientPixelFormat* format, const Uint8* source, size_t sourcePitch,
+                         unsigned int width, unsigned int height, Uint8* dest, size_t destPitch) {
+    unsigned int row, i, j;
+    ByteSwizzle swizzle;
+    Uint32 palette[256];
+    Uint8 premultiplied[PIXEL_CONVERSION_CHUNK_SIZE * 4];
+    PaletteLookup lookup = {0, -1};
+    Bool msbFirst = format->byteOrder == MSBFirst;
+    if (!initFormatConversion(format, True, &swizzle, palette)) return False;
+    for (row = 0; row < height; row++, source += sourcePitch, dest += destPitch) {
+        unsigned int numPixels;
+        for (i = 0; i < width; i += numPixels) {
+            const Uint8* pixels = source + i * 4;
+            numPixels = MIN(width - i, PIXEL_CONVERSION_CHUNK_SIZE);
+            if (format->premultiplied) {
+                premultiplyRow(pixels, premultiplied, numPixels);
+                pixels = premultiplied;
+            }
+            switch (format->type) {
+                case PIXEL_FORMAT_ARGB8888:
+                case PIXEL_FORMAT_ABGR8888:
+                    swizzleRow(&swizzle, pixels, dest + i * 4, numPixels);
+                    break;
+                case PIXEL_FORMAT_RGB888:
+                    packRgb888Row(pixels, dest + i * 3, numPixels, msbFirst);
+                    break;
+                case PIXEL_FORMAT_RGB565:
+                    packRgb565Row(pixels, dest + i * 2, numPixels, msbFirst);
+                    break;
+                case PIXEL_FORMAT_INDEXED8:
+                    for (j = 0; j < numPixels; j++) {
+                        dest[i + j] = (Uint8) findPaletteColor(format, pixels + j * 4, &lookup);
+                    }
+                    break;
+                case PIXEL_FORMAT_BITMAP:
+                    // The chunk size is a multiple of 8, so the chunks start at whole bytes.
+                    for (j = 0; j < numPixels; j++) {
+                        unsigned int bit = i + j;
+                        Uint8 mask = (Uint8) (msbFirst ? 0x80 >> bit % 8 : 0x01 << bit % 8);
+                        if (findPaletteColor(format, pixels + j * 4, &lookup) == 1) {
+                            dest[bit / 8] |= mask;
+                        } else {
+                            dest[bit / 8] &= (Uint8) ~mask;
+                        }
+                    }
+                    break;
+            }
+        }
+    }
+    return True;
+}
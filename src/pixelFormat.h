@@ -0,0 +1,63 @@
+#ifndef _PIXEL_FORMAT_H_
+#define _PIXEL_FORMAT_H_
+
+#include <stddef.h>
+#include "X11/Xlib.h"
+#include "SDL.h"
+
+#if defined(__SSE2__)
+#  define PIXEL_FORMAT_SIMD "SSE2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define PIXEL_FORMAT_SIMD "NEON"
+#else
+#  define PIXEL_FORMAT_SIMD "scalar"
+#endif
+
+/* The environment variable that selects the conversion kernels: simd (the default) or scalar. */
+#define PIXEL_CONVERSION_ENV_VARIABLE "SDL2X11_PIXEL_CONVERSION"
+/* The number of pixels that are premultiplied at once, a multiple of 8. */
+#define PIXEL_CONVERSION_CHUNK_SIZE 256
+
+/* The formats of client pixel data. */
+typedef enum {
+    /* 32 bit 0xAARRGGBB values. */
+    PIXEL_FORMAT_ARGB8888,
+    /* 32 bit 0xAABBGGRR values. */
+    PIXEL_FORMAT_ABGR8888,
+    /* 24 bit 0xRRGGBB values, the pixels are opaque. */
+    PIXEL_FORMAT_RGB888,
+    /* 16 bit values with 5 red, 6 green and 5 blue bits, the pixels are opaque. */
+    PIXEL_FORMAT_RGB565,
+    /* 8 bit indices into the palette. */
+    PIXEL_FORMAT_INDEXED8,
+    /* 1 bit per pixel, set bits are the second and unset bits the first palette color. */
+    PIXEL_FORMAT_BITMAP,
+} PixelFormatType;
+
+typedef struct {
+    PixelFormatType type;
+    /* The byte order of the values or the bit order of bitmaps, LSBFirst or MSBFirst. */
+    int byteOrder;
+    /* Whether the colors are premultiplied with the alpha. */
+    Bool premultiplied;
+    /* The colors of indexed pixels and bitmaps. */
+    const SDL_Color* palette;
+    int numColors;
+} ClientPixelFormat;
+
+Bool initPixelConversion(void);
+const char* getPixelConversionKernels(void);
+Bool hasTexturePixelLayout(const XImage* image);
+void expandBitmapRow(const Uint8* bits, unsigned int firstBit, unsigned int width,
+                     Bool msbFirst, SDL_Color foreground, SDL_Color background, Uint8* dest);
+Bool convertImageToRGBA(const XImage* image, int x, int y, unsigned int width,
+                        unsigned int height, SDL_Color foreground, SDL_Color background,
+                        Uint8* pixels, size_t pitch);
+Bool convertRGBAToImage(const Uint8* pixels, ptrdiff_t pitch, unsigned int width,
+                        unsigned int height, unsigned long planeMask, XImage* image, int x, int y);
+Bool convertPixelsToRGBA(const ClientPixelFormat* format, const Uint8* source, size_t sourcePitch,
+                         unsigned int width, unsigned int height, Uint8* dest, size_t destPitch);
+Bool convertRGBAToPixels(const ClientPixelFormat* format, const Uint8* source, size_t sourcePitch,
+                         unsigned int width, unsigned int height, Uint8* dest, size_t destPitch);
+
+#endif /* _PIXEL_FORMAT_H_ */
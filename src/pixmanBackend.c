@@ -0,0 +1,597 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pixmanBackend.h"
+#include "rasterOp.h"
+#include "colors.h"
+#include "util.h"
+#include "pixman.h"
+
+/*
+ * The pixman backend draws the batches of the display list on the CPU. It is selected by setting
+ * the render backend environment variable to "pixman". Pixmaps are kept on the CPU as pixman
+ * images from their creation on: Drawing on them and XPutImage only change the CPU copy, which
+ * is uploaded when a GPU consumer needs it, i.e. when SDL_gpu samples or reads the pixmap.
+ * GC functions and plane masks are applied by a CPU rasterizer. Other images, like the offscreen
+ * content of windows and scratch images, are read from the GPU when a flush first uses them and
+ * are written back at the end of the flush. Batches that draw on window framebuffers, copy
+ * from their own target or have tinted textures are drawn by SDL_gpu, which gets the images
+ * uploaded first. The images still have an SDL_gpu texture, so an OpenGL context is required.
+ * Pixman uses premultiplied alpha, so the colors of transparent pixels are lost.
+ */
+
+#if SDL_BYTEORDER != SDL_BIG_ENDIAN
+/* The pixman format with the same byte order as the RGBA images of SDL_gpu. */
+#  define SOFTWARE_IMAGE_FORMAT PIXMAN_a8b8g8r8
+#else
+#  define SOFTWARE_IMAGE_FORMAT PIXMAN_r8g8b8a8
+#endif
+
+typedef struct {
+    GPU_Image* image;
+    pixman_image_t* pixmanImage;
+    /* The premultiplied RGBA bytes of the image. */
+    Uint8* pixels;
+    /* Whether the pixels were changed and must be written back to the GPU. */
+    Bool dirty;
+    /* The bounds of the changed pixels. */
+    int dirtyX1, dirtyY1, dirtyX2, dirtyY2;
+    /* Whether the image is kept on the CPU across flushes, which is the case for pixmaps. */
+    Bool resident;
+} SoftwareImage;
+
+static Array softwareImages = {NULL, 0, 0};
+/* The buffer for the straight alpha pixels that are uploaded. */
+static Uint8* uploadBuffer = NULL;
+static size_t uploadBufferSize = 0;
+
+static SoftwareImage* findSoftwareImage(GPU_Image* image, size_t* index) {
+    size_t i;
+    for (i = 0; i < softwareImages.length; i++) {
+        SoftwareImage* softwareImage = softwareImages.array[i];
+        if (softwareImage->image == image) {
+            if (index != NULL) *index = i;
+            return softwareImage;
+        }
+    }
+    return NULL;
+}
+
+static Uint8 premultiply(Uint8 value, Uint8 alpha) {
+    return (Uint8) ((value * alpha + 127) / 255);
+}
+
+static Uint8 unpremultiply(Uint8 value, Uint8 alpha) {
+    if (alpha == 0 || alpha == 255) return value;
+    return (Uint8) MIN(255, (value * 255 + alpha / 2) / alpha);
+}
+
+static void markDirty(SoftwareImage* softwareImage, int x1, int y1, int x2, int y2) {
+    x1 = MAX(x1, 0);
+    y1 = MAX(y1, 0);
+    x2 = MIN(x2, softwareImage->image->w);
+    y2 = MIN(y2, softwareImage->image->h);
+    if (x1 >= x2 || y1 >= y2) return;
+    if (!softwareImage->dirty) {
+        softwareImage->dirty = True;
+        softwareImage->dirtyX1 = x1;
+        softwareImage->dirtyY1 = y1;
+        softwareImage->dirtyX2 = x2;
+        softwareImage->dirtyY2 = y2;
+        return;
+    }
+    softwareImage->dirtyX1 = MIN(softwareImage->dirtyX1, x1);
+    softwareImage->dirtyY1 = MIN(softwareImage->dirtyY1, y1);
+    softwareImage->dirtyX2 = MAX(softwareImage->dirtyX2, x2);
+    softwareImage->dirtyY2 = MAX(softwareImage->dirtyY2, y2);
+}
+
+/*
+ * Create the CPU copy of the image. The pixels are read from the GPU if requested,
+ * otherwise they are transparent.
+ */
+static SoftwareImage* createSoftwareImage(GPU_Image* image, Bool readPixels, Bool resident) {
+    SDL_Surface* surface = NULL;
+    if (readPixels) {
+        surface = GPU_CopySurfaceFromImage(image);
+        if (surface == NULL) {
+            LOG("Failed to read the image in %s: %s\n", __func__, GPU_PopErrorCode().details);
+            return NULL;
+        }
+    }
+    SoftwareImage* softwareImage = malloc(sizeof(SoftwareImage));
+    Uint8* pixels = calloc((size_t) image->w * image->h, 4);
+    if (softwareImage == NULL || pixels == NULL || !insertArray(&softwareImages, softwareImage)) {
+        LOG("Out of memory: Failed to allocate the software image in %s!\n", __func__);
+        free(softwareImage);
+        free(pixels);
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+    int x, y;
+    for (y = 0; surface != NULL && y < image->h; y++) {
+        Uint8* row = (Uint8*) surface->pixels + y * surface->pitch;
+        Uint8* pixel = &pixels[y * image->w * 4];
+        for (x = 0; x < image->w; x++, pixel += 4) {
+            Uint32 value = 0;
+            memcpy(&value, row + x * surface->format->BytesPerPixel,
+                   surface->format->BytesPerPixel);
+            SDL_GetRGBA(value, surface->format, &pixel[0], &pixel[1], &pixel[2], &pixel[3]);
+            pixel[0] = premultiply(pixel[0], pixel[3]);
+            pixel[1] = premultiply(pixel[1], pixel[3]);
+            pixel[2] = premultiply(pixel[2], pixel[3]);
+        }
+    }
+    SDL_FreeSurface(surface);
+    softwareImage->image = image;
+    softwareImage->pixels = pixels;
+    softwareImage->dirty = False;
+    softwareImage->resident = resident;
+    softwareImage->pixmanImage = pixman_image_create_bits(
+            SOFTWARE_IMAGE_FORMAT, image->w, image->h, (uint32_t*) pixels, image->w * 4);
+    if (softwareImage->pixmanImage == NULL) {
+        LOG("Failed to create the pixman image in %s!\n", __func__);
+        removeArray(&softwareImages, softwareImages.length - 1, False);
+        free(pixels);
+        free(softwareImage);
+        return NULL;
+    }
+    return softwareImage;
+}
+
+/*
+ * Get the CPU copy of the image. Images that are not kept on the CPU are read from the GPU
+ * the first time they are requested.
+ */
+static SoftwareImage* getSoftwareImage(GPU_Image* image) {
+    SoftwareImage* softwareImage = findSoftwareImage(image, NULL);
+    if (softwareImage != NULL) return softwareImage;
+    return createSoftwareImage(image, True, False);
+}
+
+/*
+ * Write the changed pixels of the CPU copy to the GPU.
+ */
+static void uploadSoftwareImage(SoftwareImage* softwareImage) {
+    if (!softwareImage->dirty) return;
+    int width = softwareImage->dirtyX2 - softwareImage->dirtyX1;
+    int height = softwareImage->dirtyY2 - softwareImage->dirtyY1;
+    size_t rowSize = (size_t) width * 4, size = rowSize * height, i;
+    int y;
+    if (size > uploadBufferSize) {
+        Uint8* buffer = realloc(uploadBuffer, size);
+        if (buffer == NULL) {
+            LOG("Out of memory: Failed to allocate the upload buffer in %s!\n", __func__);
+            return;
+        }
+        uploadBuffer = buffer;
+        uploadBufferSize = size;
+    }
+    for (y = 0; y < height; y++) {
+        const Uint8* source = softwareImage->pixels + ((size_t) (softwareImage->dirtyY1 + y)
+                * softwareImage->image->w + softwareImage->dirtyX1) * 4;
+        Uint8* destination = uploadBuffer + y * rowSize;
+        for (i = 0; i < rowSize; i += 4) {
+            Uint8 alpha = source[i + 3];
+            destination[i] = unpremultiply(source[i], alpha);
+            destination[i + 1] = unpremultiply(source[i + 1], alpha);
+            destination[i + 2] = unpremultiply(source[i + 2], alpha);
+            destination[i + 3] = alpha;
+        }
+    }
+    GPU_Rect rect = GPU_MakeRect(softwareImage->dirtyX1, softwareImage->dirtyY1, width, height);
+    GPU_UpdateImageBytes(softwareImage->image, &rect, uploadBuffer, (int) rowSize);
+    softwareImage->dirty = False;
+}
+
+static void freeSoftwareImage(size_t index) {
+    SoftwareImage* softwareImage = removeArray(&softwareImages, index, False);
+    pixman_image_unref(softwareImage->pixmanImage);
+    free(softwareImage->pixels);
+    free(softwareImage);
+}
+
+/*
+ * Keep the new image on the CPU until a GPU consumer needs it.
+ */
+static Bool createImage(GPU_Image* image) {
+    return createSoftwareImage(image, False, True) != NULL;
+}
+
+static void uploadImage(GPU_Image* image) {
+    SoftwareImage* softwareImage = findSoftwareImage(image, NULL);
+    if (softwareImage != NULL) {
+        uploadSoftwareImage(softwareImage);
+    }
+}
+
+static void releaseImage(GPU_Image* image) {
+    size_t index;
+    SoftwareImage* softwareImage = findSoftwareImage(image, &index);
+    if (softwareImage == NULL) return;
+    uploadSoftwareImage(softwareImage);
+    freeSoftwareImage(index);
+}
+
+/*
+ * Replace the pixels in the rectangle of an image that is kept on the CPU with the RGBA pixels.
+ */
+static Bool updateImage(GPU_Image* image, const GPU_Rect* rect, const Uint8* pixels, int pitch) {
+    size_t index;
+    SoftwareImage* softwareImage = findSoftwareImage(image, &index);
+    int x, y;
+    if (softwareImage == NULL) return False;
+    if (!softwareImage->resident) {
+        releaseImage(image);
+        return False;
+    }
+    int x1 = rect != NULL ? (int) rect->x : 0, y1 = rect != NULL ? (int) rect->y : 0;
+    int width = rect != NULL ? (int) rect->w : image->w;
+    int height = rect != NULL ? (int) rect->h : image->h;
+    for (y = 0; y < height; y++) {
+        const Uint8* source = pixels + (size_t) y * pitch;
+        Uint8* destination = softwareImage->pixels + ((size_t) (y1 + y) * image->w + x1) * 4;
+        for (x = 0; x < width; x++, source += 4, destination += 4) {
+            destination[0] = premultiply(source[0], source[3]);
+            destination[1] = premultiply(source[1], source[3]);
+            destination[2] = premultiply(source[2], source[3]);
+            destination[3] = source[3];
+        }
+    }
+    markDirty(softwareImage, x1, y1, x1 + width, y1 + height);
+    return True;
+}
+
+static void freeImage(GPU_Image* image) {
+    size_t index;
+    if (findSoftwareImage(image, &index) != NULL) {
+        freeSoftwareImage(index);
+    }
+}
+
+static void releaseAllImages(Bool keepCreated) {
+    size_t i = 0;
+    while (i < softwareImages.length) {
+        SoftwareImage* softwareImage = softwareImages.array[i];
+        if (keepCreated && softwareImage->resident) {
+            i++;
+            continue;
+        }
+        uploadSoftwareImage(softwareImage);
+        freeSoftwareImage(i);
+    }
+    if (softwareImages.length == 0) {
+        freeArray(&softwareImages);
+        free(uploadBuffer);
+        uploadBuffer = NULL;
+        uploadBufferSize = 0;
+    }
+}
+
+/*
+ * Get the region of the target image that the draw state may draw on.
+ */
+static void initClipRegion(pixman_region16_t* region, const DrawState* state) {
+    pixman_region_init_rect(region, 0, 0, state->target->image->w, state->target->image->h);
+    if (state->useClipRect) {
+        pixman_region_intersect_rect(region, region, (int) state->clipRect.x,
+                                     (int) state->clipRect.y, (unsigned int) state->clipRect.w,
+                                     (unsigned int) state->clipRect.h);
+    }
+    if (state->clip != NULL) {
+        pixman_region16_t clipRegion;
+        pixman_region_init(&clipRegion);
+        pixman_region_copy(&clipRegion, (pixman_region16_t*) &state->clip->region);
+        pixman_region_translate(&clipRegion, (int) state->viewport.x, (int) state->viewport.y);
+        pixman_region_intersect(region, region, &clipRegion);
+        pixman_region_fini(&clipRegion);
+    }
+}
+
+/*
+ * Calculate the affine transformation from the pixels of the triangle with the corners x and y
+ * on the target to the pixels of its texture. Returns False if the triangle is degenerated.
+ */
+static Bool getTextureTransform(const float* vertices[3], const GPU_Image* image,
+                                const double x[3], const double y[3],
+                                struct pixman_f_transform* transform) {
+    double u[3], v[3];
+    int i;
+    for (i = 0; i < 3; i++) {
+        u[i] = vertices[i][2] * image->texture_w;
+        v[i] = vertices[i][3] * image->texture_h;
+    }
+    double determinant = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (determinant == 0) return False;
+    double du1 = u[1] - u[0], du2 = u[2] - u[0], dv1 = v[1] - v[0], dv2 = v[2] - v[0];
+    transform->m[0][0] = (du1 * (y[2] - y[0]) - du2 * (y[1] - y[0])) / determinant;
+    transform->m[0][1] = (du2 * (x[1] - x[0]) - du1 * (x[2] - x[0])) / determinant;
+    transform->m[0][2] = u[0] - transform->m[0][0] * x[0] - transform->m[0][1] * y[0];
+    transform->m[1][0] = (dv1 * (y[2] - y[0]) - dv2 * (y[1] - y[0])) / determinant;
+    transform->m[1][1] = (dv2 * (x[1] - x[0]) - dv1 * (x[2] - x[0])) / determinant;
+    transform->m[1][2] = v[0] - transform->m[1][0] * x[0] - transform->m[1][1] * y[0];
+    transform->m[2][0] = 0;
+    transform->m[2][1] = 0;
+    transform->m[2][2] = 1;
+    return True;
+}
+
+static Bool isSameColor(const float* color1, const float* color2) {
+    return color1[0] == color2[0] && color1[1] == color2[1]
+           && color1[2] == color2[2] && color1[3] == color2[3];
+}
+
+static void fillTriangles(pixman_image_t* target, const float* color,
+                          const pixman_triangle_t* triangles, int numTriangles) {
+    if (numTriangles == 0) return;
+    // Pixman colors are premultiplied.
+    pixman_color_t pixmanColor;
+    pixmanColor.red = (uint16_t) (color[0] * color[3] * 0xFFFF);
+    pixmanColor.green = (uint16_t) (color[1] * color[3] * 0xFFFF);
+    pixmanColor.blue = (uint16_t) (color[2] * color[3] * 0xFFFF);
+    pixmanColor.alpha = (uint16_t) (color[3] * 0xFFFF);
+    pixman_image_t* source = pixman_image_create_solid_fill(&pixmanColor);
+    if (source == NULL) return;
+    pixman_composite_triangles(PIXMAN_OP_OVER, source, target, PIXMAN_a1, 0, 0, 0, 0,
+                               numTriangles, triangles);
+    pixman_image_unref(source);
+}
+
+/* Convert premultiplied RGBA bytes to a pixel value. */
+static unsigned long bytesToPixel(const Uint8* bytes) {
+    Uint8 alpha = bytes[3];
+    return (unsigned long) unpremultiply(bytes[0], alpha) << RED_SHIFT
+           | (unsigned long) unpremultiply(bytes[1], alpha) << GREEN_SHIFT
+           | (unsigned long) unpremultiply(bytes[2], alpha) << BLUE_SHIFT
+           | (unsigned long) alpha << ALPHA_SHIFT;
+}
+
+/* Convert a pixel value to premultiplied RGBA bytes. */
+static void pixelToBytes(unsigned long pixel, Uint8* bytes) {
+    Uint8 alpha = GET_ALPHA_FROM_COLOR(pixel);
+    bytes[0] = premultiply(GET_RED_FROM_COLOR(pixel), alpha);
+    bytes[1] = premultiply(GET_GREEN_FROM_COLOR(pixel), alpha);
+    bytes[2] = premultiply(GET_BLUE_FROM_COLOR(pixel), alpha);
+    bytes[3] = alpha;
+}
+
+/* An edge of a triangle as the edge function a * x + b * y + c. */
+typedef struct {
+    double a, b, c;
+    /* Whether pixels exactly on the edge belong to the triangle. */
+    Bool includesEdge;
+} TriangleEdge;
+
+static void initTriangleEdge(TriangleEdge* edge, double x1, double y1, double x2, double y2) {
+    edge->a = y1 - y2;
+    edge->b = x2 - x1;
+    edge->c = x1 * y2 - x2 * y1;
+    // Two triangles that share the edge walk it in opposite directions,
+    // so the pixels on it are drawn by exactly one of them.
+    edge->includesEdge = edge->a > 0 || (edge->a == 0 && edge->b > 0);
+}
+
+static Bool isInsideTriangleEdge(const TriangleEdge* edge, double x, double y) {
+    double value = edge->a * x + edge->b * y + edge->c;
+    return value > 0 || (value == 0 && edge->includesEdge);
+}
+
+/*
+ * Draw a triangle with the GC function and plane mask of the draw state on the CPU. Every pixel
+ * whose center is in the triangle is drawn once, either with the color or with the nearest
+ * pixel of the texture, using the transformation from the target to the texture pixels.
+ */
+static void rasterizeTriangle(SoftwareImage* target, const DrawState* state,
+                              pixman_region16_t* clipRegion, double x[3], double y[3],
+                              const float* color, SoftwareImage* texture,
+                              const struct pixman_f_transform* transform) {
+    TriangleEdge edges[3];
+    unsigned long colorPixel = 0, backgroundPixel = 0;
+    int numBoxes, i;
+    if ((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) < 0) {
+        double temp = x[1];
+        x[1] = x[2];
+        x[2] = temp;
+        temp = y[1];
+        y[1] = y[2];
+        y[2] = temp;
+    }
+    for (i = 0; i < 3; i++) {
+        initTriangleEdge(&edges[i], x[i], y[i], x[(i + 1) % 3], y[(i + 1) % 3]);
+    }
+    if (texture == NULL || state->plane != 0) {
+        colorPixel = (unsigned long) (color[0] * 255 + 0.5f) << RED_SHIFT
+                     | (unsigned long) (color[1] * 255 + 0.5f) << GREEN_SHIFT
+                     | (unsigned long) (color[2] * 255 + 0.5f) << BLUE_SHIFT
+                     | (unsigned long) (color[3] * 255 + 0.5f) << ALPHA_SHIFT;
+    }
+    if (state->plane != 0) {
+        backgroundPixel = (unsigned long) state->planeBackground.r << RED_SHIFT
+                          | (unsigned long) state->planeBackground.g << GREEN_SHIFT
+                          | (unsigned long) state->planeBackground.b << BLUE_SHIFT
+                          | (unsigned long) state->planeBackground.a << ALPHA_SHIFT;
+    }
+    int minX = (int) floor(MIN(x[0], MIN(x[1], x[2])));
+    int minY = (int) floor(MIN(y[0], MIN(y[1], y[2])));
+    int maxX = (int) ceil(MAX(x[0], MAX(x[1], x[2])));
+    int maxY = (int) ceil(MAX(y[0], MAX(y[1], y[2])));
+    const pixman_box16_t* boxes = pixman_region_rectangles(clipRegion, &numBoxes);
+    for (i = 0; i < numBoxes; i++) {
+        int x1 = MAX(minX, boxes[i].x1), x2 = MIN(maxX, boxes[i].x2);
+        int y1 = MAX(minY, boxes[i].y1), y2 = MIN(maxY, boxes[i].y2);
+        int pixelX, pixelY;
+        if (x1 >= x2 || y1 >= y2) continue;
+        for (pixelY = y1; pixelY < y2; pixelY++) {
+            double centerY = pixelY + 0.5;
+            Uint8* pixel = target->pixels + ((size_t) pixelY * target->image->w + x1) * 4;
+            for (pixelX = x1; pixelX < x2; pixelX++, pixel += 4) {
+                double centerX = pixelX + 0.5;
+                if (!isInsideTriangleEdge(&edges[0], centerX, centerY)
+                    || !isInsideTriangleEdge(&edges[1], centerX, centerY)
+                    || !isInsideTriangleEdge(&edges[2], centerX, centerY)) {
+                    continue;
+                }
+                unsigned long source = colorPixel;
+                if (texture != NULL) {
+                    int textureX = (int) floor(transform->m[0][0] * centerX
+                            + transform->m[0][1] * centerY + transform->m[0][2]);
+                    int textureY = (int) floor(transform->m[1][0] * centerX
+                            + transform->m[1][1] * centerY + transform->m[1][2]);
+                    int width = texture->image->w, height = texture->image->h;
+                    if (state->image->wrap_mode_x == GPU_WRAP_REPEAT) {
+                        textureX = ((textureX % width) + width) % width;
+                        textureY = ((textureY % height) + height) % height;
+                    } else if (textureX < 0 || textureX >= width
+                               || textureY < 0 || textureY >= height) {
+                        continue;
+                    }
+                    source = bytesToPixel(
+                            &texture->pixels[((size_t) textureY * width + textureX) * 4]);
+                    // Like the plane shader, the plane bit selects between the plane colors.
+                    if (state->plane != 0 && (source & state->plane) != 0) {
+                        source = colorPixel;
+                    } else if (state->plane != 0) {
+                        if (state->planeBackgroundMode == PLANE_BACKGROUND_TRANSPARENT) continue;
+                        source = backgroundPixel;
+                    }
+                }
+                pixelToBytes(applyRasterOp(state->function, state->planeMask, source,
+                                           bytesToPixel(pixel)), pixel);
+            }
+        }
+        markDirty(target, x1, y1, x2, y2);
+    }
+}
+
+static Bool drawBatch(const DrawState* state, const float* vertices, size_t numVertices,
+                      const unsigned short* indices, size_t numIndices) {
+    (void) numVertices;
+    GPU_Image* targetImage = state->target->image;
+    if (targetImage == NULL || state->image == targetImage) {
+        return False;
+    }
+    if (IS_NOOP_RASTER_OP(state->function, state->planeMask)) return True;
+    if (state->image != NULL && state->plane == 0) {
+        SDL_Color color = state->image->color;
+        // Tinted textures are not supported.
+        if (color.r != 255 || color.g != 255 || color.b != 255 || color.a != 255) return False;
+    }
+    SoftwareImage* target = getSoftwareImage(targetImage);
+    SoftwareImage* texture = state->image != NULL ? getSoftwareImage(state->image) : NULL;
+    if (target == NULL || (state->image != NULL && texture == NULL)) return False;
+    // Plane draws select the color per pixel, which only the CPU rasterizer does.
+    Bool isCopy = IS_COPY_RASTER_OP(state->function, state->planeMask) && state->plane == 0;
+    pixman_triangle_t* triangles = malloc(sizeof(pixman_triangle_t) * (numIndices / 3));
+    pixman_region16_t clipRegion;
+    initClipRegion(&clipRegion, state);
+    if (triangles == NULL
+        || (isCopy && !pixman_image_set_clip_region(target->pixmanImage, &clipRegion))) {
+        pixman_region_fini(&clipRegion);
+        free(triangles);
+        return False;
+    }
+    size_t floatsPerVertex = state->image != NULL ? 8 : 6;
+    // The viewport maps the coordinates of the target onto its pixels.
+    double scaleX = state->viewport.w / state->target->w;
+    double scaleY = state->viewport.h / state->target->h;
+    if (texture != NULL && isCopy) {
+        pixman_image_set_filter(texture->pixmanImage, PIXMAN_FILTER_NEAREST, NULL, 0);
+        pixman_image_set_repeat(texture->pixmanImage, state->image->wrap_mode_x == GPU_WRAP_REPEAT
+                                                      ? PIXMAN_REPEAT_NORMAL : PIXMAN_REPEAT_NONE);
+    }
+    const float* runColor = NULL;
+    int numTriangles = 0;
+    double minX = targetImage->w, minY = targetImage->h, maxX = 0, maxY = 0;
+    size_t i;
+    for (i = 0; i + 2 < numIndices; i += 3) {
+        const float* triangleVertices[3];
+        double x[3], y[3];
+        struct pixman_f_transform fTransform;
+        pixman_triangle_t* triangle = &triangles[numTriangles];
+        int j;
+        for (j = 0; j < 3; j++) {
+            triangleVertices[j] = &vertices[indices[i + j] * floatsPerVertex];
+            x[j] = state->viewport.x + triangleVertices[j][0] * scaleX;
+            y[j] = state->viewport.y + triangleVertices[j][1] * scaleY;
+            minX = MIN(minX, x[j]);
+            minY = MIN(minY, y[j]);
+            maxX = MAX(maxX, x[j]);
+            maxY = MAX(maxY, y[j]);
+        }
+        if (texture != NULL
+            && !getTextureTransform(triangleVertices, state->image, x, y, &fTransform)) {
+            continue;
+        }
+        const float* color = &triangleVertices[0][floatsPerVertex - 4];
+        if (!isCopy) {
+            rasterizeTriangle(target, state, &clipRegion, x, y, color, texture, &fTransform);
+            continue;
+        }
+        triangle->p1.x = pixman_double_to_fixed(x[0]);
+        triangle->p1.y = pixman_double_to_fixed(y[0]);
+        triangle->p2.x = pixman_double_to_fixed(x[1]);
+        triangle->p2.y = pixman_double_to_fixed(y[1]);
+        triangle->p3.x = pixman_double_to_fixed(x[2]);
+        triangle->p3.y = pixman_double_to_fixed(y[2]);
+        if (texture != NULL) {
+            pixman_transform_t transform;
+            if (!pixman_transform_from_pixman_f_transform(&transform, &fTransform)) continue;
+            pixman_image_set_transform(texture->pixmanImage, &transform);
+            pixman_composite_triangles(PIXMAN_OP_OVER, texture->pixmanImage,
+                                       target->pixmanImage, PIXMAN_a1, 0, 0, 0, 0, 1, triangle);
+            continue;
+        }
+        if (runColor != NULL && !isSameColor(runColor, color)) {
+            fillTriangles(target->pixmanImage, runColor, triangles, numTriangles);
+            triangles[0] = *triangle;
+            numTriangles = 0;
+        }
+        runColor = color;
+        numTriangles++;
+    }
+    if (runColor != NULL) {
+        fillTriangles(target->pixmanImage, runColor, triangles, numTriangles);
+    }
+    if (texture != NULL && isCopy) {
+        pixman_image_set_transform(texture->pixmanImage, NULL);
+        pixman_image_set_repeat(texture->pixmanImage, PIXMAN_REPEAT_NONE);
+    }
+    if (isCopy) {
+        pixman_image_set_clip_region(target->pixmanImage, NULL);
+        const pixman_box16_t* extents = pixman_region_extents(&clipRegion);
+        markDirty(target, MAX(extents->x1, (int) floor(minX)), MAX(extents->y1, (int) floor(minY)),
+                  MIN(extents->x2, (int) ceil(maxX)), MIN(extents->y2, (int) ceil(maxY)));
+    }
+    pixman_region_fini(&clipRegion);
+    free(triangles);
+    return True;
+}
+
+static const RenderBackend pixmanBackend = {
+        "pixman",
+        drawBatch,
+        createImage,
+        uploadImage,
+        releaseImage,
+        updateImage,
+        freeImage,
+        releaseAllImages,
+};
+
+/*
+ * Get the render backend that was selected via the environment,
+ * or NULL if everything is drawn by SDL_gpu.
+ */
+const RenderBackend* getRenderBackend() {
+    static Bool initialized = False;
+    static const RenderBackend* backend = NULL;
+    if (!initialized) {
+        initialized = True;
+        const char* name = getenv(RENDER_BACKEND_ENV_VARIABLE);
+        if (name != NULL && strcmp(name, pixmanBackend.name) == 0) {
+            backend = &pixmanBackend;
+        }
+        LOG("Using the %s render backend\n", backend != NULL ? backend->name : "SDL_gpu");
+    }
+    return backend;
+}
@@ -0,0 +1,40 @@
+#ifndef _PIXMAN_BACKEND_H_
+#define _PIXMAN_BACKEND_H_
+
+#include "X11/Xlib.h"
+#include <SDL_gpu.h>
+#include "displayList.h"
+
+/* The environment variable that selects the render backend ("gpu" or "pixman"). */
+#define RENDER_BACKEND_ENV_VARIABLE "SDL2X11_RENDER_BACKEND"
+
+/* A backend that can execute draw batches instead of SDL_gpu. */
+typedef struct {
+    const char* name;
+    /* Draw the triangles of a batch. Returns False if the backend can not draw the batch. */
+    Bool (*drawBatch)(const DrawState* state, const float* vertices, size_t numVertices,
+                      const unsigned short* indices, size_t numIndices);
+    /* Keep the new, transparent image in the backend. Returns False if it is drawn by SDL_gpu. */
+    Bool (*createImage)(GPU_Image* image);
+    /* Make the drawings of the backend on the image visible to SDL_gpu. */
+    void (*uploadImage)(GPU_Image* image);
+    /* Make the drawings of the backend on the image visible to SDL_gpu and forget the image. */
+    void (*releaseImage)(GPU_Image* image);
+    /*
+     * Replace the pixels in the rectangle of the image (or all pixels if it is NULL) with the
+     * RGBA pixels. Returns False if the image is not kept by the backend, then SDL_gpu must
+     * update it.
+     */
+    Bool (*updateImage)(GPU_Image* image, const GPU_Rect* rect, const Uint8* pixels, int pitch);
+    /* Forget the image without making the drawings visible, because it is freed. */
+    void (*freeImage)(GPU_Image* image);
+    /*
+     * Release all images, called at the end of every display list flush. Images that were
+     * created by the backend stay with it, unless keepCreated is False.
+     */
+    void (*releaseAllImages)(Bool keepCreated);
+} RenderBackend;
+
+const RenderBackend* getRenderBackend(void);
+
+#endif /* _PIXMAN_BACKEND_H_ */
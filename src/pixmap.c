@@ -1,8 +1,13 @@
+#include <stdlib.h>
 #include "X11/Xlib.h"
 #include "drawing.h"
 #include "errors.h"
 #include "resourceTypes.h"
 #include "display.h"
+#include "colors.h"
+#include "pixelFormat.h"
+#include "renderThread.h"
+#include "pixmanBackend.h"
 
 Pixmap XCreatePixmap(Display* display, Drawable drawable, unsigned int width, unsigned int height,
                      unsigned int depth) {
@@ -27,6 +32,7 @@ Pixmap XCreatePixmap(Display* display, Drawable drawable, unsigned int width, un
         return None;
     }
     LOG("%s: addr= %lu, w = %d, h = %d\n", __func__, pixmap, width, height);
+    syncRenderThread();
     GPU_Image* image = GPU_CreateImage((Uint16) width, (Uint16) height, GPU_FORMAT_RGBA);
     if (image == NULL) {
         LOG("GPU_CreateImage failed in XCreatePixmap: %s\n", GPU_PopErrorCode().details);
@@ -42,6 +48,10 @@ Pixmap XCreatePixmap(Display* display, Drawable drawable, unsigned int width, un
         return None;
     }
     LOG("gpu target is %p\n", image->target);
+    // The pixmap is only uploaded when SDL_gpu needs it if the render backend draws it.
+    if (getRenderBackend() != NULL) {
+        getRenderBackend()->createImage(image);
+    }
     SET_XID_TYPE(pixmap, PIXMAP);
     SET_XID_VALUE(pixmap, image);
     return pixmap;
@@ -53,50 +63,62 @@ int XFreePixmap(Display* display, Pixmap pixmap) {
     TYPE_CHECK(pixmap, PIXMAP, display, 0);
     GPU_Image* image = GET_PIXMAP_IMAGE(pixmap);
     FREE_XID(pixmap);
-    if (image->target != NULL) {
-        LOG("%s, %d\n", __func__, __LINE__);
-        GPU_FreeTarget(image->target);
-        image->target = NULL;
-    }
-    LOG("%s, %d\n", __func__, __LINE__);
-    GPU_FreeImage(image);
+    // Drawing requests before the free might still use the pixmap.
+    queueImageFree(image);
     return 1;
 }
 
-Pixmap XCreateBitmapFromData(Display* display, Drawable d, _Xconst char* data,
-                             unsigned int width, unsigned int height) {
-    // https://tronche.com/gui/x/xlib/utilities/XCreateBitmapFromData.html
-    SET_X_SERVER_REQUEST(display, X_CreatePixmap);
-    XID pixmap = ALLOC_XID();
-    if (pixmap == None) {
-        LOG("Out of memory: Could not allocate XID in %s!\n", __func__);
-        handleOutOfMemory(0, display, 0, 0);
-        return None;
-    }
-    SDL_Surface* surface = SDL_CreateRGBSurfaceFrom((void *) data, width, height, 1,
-                                                    (int) ceilf(width / 8.0f), 0, 0, 0, 1);
-    if (surface == NULL) {
-        FREE_XID(pixmap);
-        LOG("SDL_CreateRGBSurfaceFrom failed in %s: %s\n", __func__, SDL_GetError());
-        handleOutOfMemory(0, display, 0, 0);
-        return None;
-    }
-    GPU_Image* image = GPU_CopyImageFromSurface(surface);
-    SDL_FreeSurface(surface);
-    if (image == NULL) {
-        LOG("GPU_CreateImage failed in %s: %s\n", __func__, GPU_PopErrorCode().details);
-        FREE_XID(pixmap);
+static SDL_Color pixelToColor(unsigned long pixel) {
+    SDL_Color color;
+    color.r = GET_RED_FROM_COLOR(pixel);
+    color.g = GET_GREEN_FROM_COLOR(pixel);
+    color.b = GET_BLUE_FROM_COLOR(pixel);
+    color.a = GET_ALPHA_FROM_COLOR(pixel);
+    return color;
+}
+
+/*
+ * Create a pixmap from the bitmap data in the XBM format: Rows padded to whole bytes with the
+ * least significant bit of each byte first. The set bits are filled with the foreground
+ * and the others with the background color.
+ */
+static Pixmap createPixmapFromBitmap(Display* display, Drawable drawable, const char* data,
+                                     unsigned int width, unsigned int height,
+                                     SDL_Color foreground, SDL_Color background,
+                                     unsigned int depth) {
+    unsigned int row;
+    Pixmap pixmap = XCreatePixmap(display, drawable, width, height, depth);
+    if (pixmap == None) return None;
+    size_t pitch = (size_t) width * 4;
+    Uint8* pixels = malloc(pitch * height);
+    if (pixels == NULL) {
+        LOG("Out of memory: Failed to allocate the pixels in %s!\n", __func__);
+        XFreePixmap(display, pixmap);
         handleOutOfMemory(0, display, 0, 0);
         return None;
     }
-    if (GPU_LoadTarget(image) == NULL) {
-        LOG("GPU_LoadTarget failed in %s: %s\n", __func__, GPU_PopErrorCode().details);
-        FREE_XID(pixmap);
-        GPU_FreeImage(image);
-        handleOutOfMemory(0, display, 0, 0);
-        return None;
+    size_t bytesPerLine = (width + 7) / 8;
+    for (row = 0; row < height; row++) {
+        expandBitmapRow((const Uint8*) data + row * bytesPerLine, 0, width, False,
+                        foreground, background, pixels + row * pitch);
     }
-    SET_XID_TYPE(pixmap, PIXMAP);
-    SET_XID_VALUE(pixmap, image);
+    updateImageBytes(GET_PIXMAP_IMAGE(pixmap), NULL, pixels, (int) pitch);
+    free(pixels);
     return pixmap;
 }
+
+Pixmap XCreateBitmapFromData(Display* display, Drawable d, _Xconst char* data,
+                             unsigned int width, unsigned int height) {
+    // https://tronche.com/gui/x/xlib/utilities/XCreateBitmapFromData.html
+    SDL_Color setBit = {0xFF, 0xFF, 0xFF, 0xFF};
+    SDL_Color unsetBit = {0x00, 0x00, 0x00, 0x00};
+    return createPixmapFromBitmap(display, d, data, width, height, setBit, unsetBit, 1);
+}
+
+Pixmap XCreatePixmapFromBitmapData(Display* display, Drawable d, char* data, unsigned int width,
+                                   unsigned int height, unsigned long fg, unsigned long bg,
+                                   unsigned int depth) {
+    // https://tronche.com/gui/x/xlib/utilities/XCreatePixmapFromBitmapData.html
+    return createPixmapFromBitmap(display, d, data, width, height,
+                                  pixelToColor(fg), pixelToColor(bg), depth);
+}
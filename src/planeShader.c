@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include "planeShader.h"
+#include "colors.h"
+#include "util.h"
+#include "renderThread.h"
+
+/*
+ * The plane shader draws a textured batch in two colors: Every pixel of the texture that has the
+ * selected bit plane set is drawn in the vertex color (the foreground), all other pixels are
+ * drawn in the background color or discarded. This allows XCopyPlane to be executed as a single
+ * draw instead of reading back the source.
+ * The color shader draws a textured batch with inverted or white colors, which the blend
+ * functions of the GC functions need on OpenGL ES. It can also invert the colors of the
+ * plane shader.
+ * The raster op shader applies a GC function and plane mask bit by bit. It reads the pixels of
+ * the destination from a copy of the drawn area and computes the source like the other shaders,
+ * from the vertex color, the texture or a plane of the texture.
+ */
+
+static const char* vertexShaderSource =
+        "attribute vec2 gpu_Vertex;\n"
+        "attribute vec2 gpu_TexCoord;\n"
+        "attribute vec4 gpu_Color;\n"
+        "uniform mat4 gpu_ModelViewProjectionMatrix;\n"
+        "varying vec4 color;\n"
+        "varying vec2 texCoord;\n"
+        "void main(void) {\n"
+        "    color = gpu_Color;\n"
+        "    texCoord = gpu_TexCoord;\n"
+        "    gl_Position = gpu_ModelViewProjectionMatrix * vec4(gpu_Vertex, 0.0, 1.0);\n"
+        "}\n";
+
+/* Applies the color mode (0: unchanged, 1: inverted, 2: white) to the drawn color. */
+static const char* colorModeSource =
+        "uniform float colorMode;\n"
+        "vec4 applyColorMode(vec4 value) {\n"
+        "    if (colorMode > 1.5) return vec4(1.0);\n"
+        "    if (colorMode > 0.5) return vec4(vec3(1.0) - value.rgb, 1.0);\n"
+        "    return value;\n"
+        "}\n";
+
+static const char* planeFragmentShaderSource =
+        "varying vec4 color;\n"
+        "varying vec2 texCoord;\n"
+        "uniform sampler2D tex;\n"
+        "uniform vec4 planeChannel;\n"
+        "uniform float planeBit;\n"
+        "uniform vec4 background;\n"
+        "uniform float transparentBackground;\n"
+        "void main(void) {\n"
+        "    float value = floor(dot(texture2D(tex, texCoord), planeChannel) * 255.0 + 0.5);\n"
+        "    if (mod(floor(value / planeBit), 2.0) >= 1.0) {\n"
+        "        gl_FragColor = applyColorMode(color);\n"
+        "    } else if (transparentBackground > 0.5) {\n"
+        "        discard;\n"
+        "    } else {\n"
+        "        gl_FragColor = applyColorMode(background);\n"
+        "    }\n"
+        "}\n";
+
+static const char* colorFragmentShaderSource =
+        "varying vec4 color;\n"
+        "varying vec2 texCoord;\n"
+        "uniform sampler2D tex;\n"
+        "void main(void) {\n"
+        "    gl_FragColor = applyColorMode(texture2D(tex, texCoord) * color);\n"
+        "}\n";
+
+static const char* rasterOpFragmentShaderSource =
+        // The destination is addressed with window coordinates, which need more than 10 bits.
+        "#if defined(GL_ES) && defined(GL_FRAGMENT_PRECISION_HIGH)\n"
+        "precision highp float;\n"
+        "#endif\n"
+        "varying vec4 color;\n"
+        "varying vec2 texCoord;\n"
+        "uniform sampler2D tex;\n"
+        "uniform sampler2D destination;\n"
+        "uniform vec2 destinationOrigin;\n"
+        "uniform vec2 destinationSize;\n"
+        "uniform vec4 functionTable;\n"
+        "uniform vec4 planeMask;\n"
+        "uniform float sourceMode;\n"
+        "uniform vec4 planeChannel;\n"
+        "uniform float planeBit;\n"
+        "uniform vec4 background;\n"
+        "uniform float transparentBackground;\n"
+        // The function table has the result for the source and destination bits 11, 10, 01, 00.
+        "float applyFunction(float source, float dest, float mask) {\n"
+        "    float result = 0.0;\n"
+        "    float bit = 1.0;\n"
+        "    for (int i = 0; i < 8; i++) {\n"
+        "        float s = mod(floor(source / bit), 2.0);\n"
+        "        float d = mod(floor(dest / bit), 2.0);\n"
+        "        float m = mod(floor(mask / bit), 2.0);\n"
+        "        float r = dot(functionTable, vec4(s * d, s * (1.0 - d), (1.0 - s) * d,\n"
+        "                                          (1.0 - s) * (1.0 - d)));\n"
+        "        result += mix(d, r, m) * bit;\n"
+        "        bit *= 2.0;\n"
+        "    }\n"
+        "    return result;\n"
+        "}\n"
+        "void main(void) {\n"
+        "    vec4 source = color;\n"
+        "    if (sourceMode > 1.5) {\n"
+        "        float value = floor(dot(texture2D(tex, texCoord), planeChannel) * 255.0 + 0.5);\n"
+        "        if (mod(floor(value / planeBit), 2.0) < 1.0) {\n"
+        "            if (transparentBackground > 0.5) discard;\n"
+        "            source = background;\n"
+        "        }\n"
+        "    } else if (sourceMode > 0.5) {\n"
+        "        source = texture2D(tex, texCoord) * color;\n"
+        "    }\n"
+        "    vec4 s = floor(source * 255.0 + 0.5);\n"
+        "    vec4 d = floor(texture2D(destination, (gl_FragCoord.xy - destinationOrigin)\n"
+        "                                          / destinationSize) * 255.0 + 0.5);\n"
+        "    gl_FragColor = vec4(applyFunction(s.r, d.r, planeMask.r),\n"
+        "                        applyFunction(s.g, d.g, planeMask.g),\n"
+        "                        applyFunction(s.b, d.b, planeMask.b),\n"
+        "                        applyFunction(s.a, d.a, planeMask.a)) / 255.0;\n"
+        "}\n";
+
+typedef struct {
+    const char* name;
+    const char* fragmentShaderSource;
+    Bool loaded;
+    Bool failed;
+    Uint32 program;
+    GPU_ShaderBlock block;
+    int colorModeLocation;
+} ShaderProgram;
+
+static ShaderProgram planeProgram = {"plane shader", NULL, False, False, 0, {0}, -1};
+static ShaderProgram colorProgram = {"color shader", NULL, False, False, 0, {0}, -1};
+static ShaderProgram rasterOpProgram = {"raster op shader", NULL, False, False, 0, {0}, -1};
+static int planeChannelLocation = -1;
+static int planeBitLocation = -1;
+static int backgroundLocation = -1;
+static int transparentBackgroundLocation = -1;
+/* The uniforms of the raster op shader. */
+static struct {
+    int destination;
+    int destinationOrigin;
+    int destinationSize;
+    int functionTable;
+    int planeMask;
+    int sourceMode;
+    int planeChannel;
+    int planeBit;
+    int background;
+    int transparentBackground;
+} rasterOpLocations;
+/* Whether the plane shader is active and whether the color shader was activated. */
+static Bool planeShaderActive = False;
+static Bool colorShaderActive = False;
+
+/*
+ * Compile one of the shaders for the shader language of the current renderer.
+ * The sources are written in GLSL 1.00 / 1.10 and are adapted to newer versions with defines.
+ */
+static Uint32 compileShader(const char* name, GPU_ShaderEnum type, const char* source) {
+    GPU_Renderer* renderer = GPU_GetCurrentRenderer();
+    int version = renderer->min_shader_version;
+    Bool isES = renderer->shader_language == GPU_LANGUAGE_GLSLES;
+    Bool isModern = version >= (isES ? 300 : 130);
+    char header[256];
+    snprintf(header, sizeof(header), "#version %d%s\n%s%s", version,
+             isES && isModern ? " es" : "", isES ? "precision mediump float;\n" : "",
+             !isModern ? "" : type == GPU_VERTEX_SHADER ?
+                              "#define attribute in\n#define varying out\n" :
+                              "#define varying in\n#define texture2D texture\n"
+                              "out vec4 fragColor;\n#define gl_FragColor fragColor\n");
+    const char* functions = type == GPU_FRAGMENT_SHADER ? colorModeSource : "";
+    size_t length = strlen(header) + strlen(functions) + strlen(source) + 1;
+    char* fullSource = malloc(sizeof(char) * length);
+    if (fullSource == NULL) return 0;
+    strcpy(fullSource, header);
+    strcat(fullSource, functions);
+    strcat(fullSource, source);
+    Uint32 shader = GPU_CompileShader(type, fullSource);
+    free(fullSource);
+    if (shader == 0) {
+        LOG("Failed to compile the %s: %s\n", name, GPU_GetShaderMessage());
+    }
+    return shader;
+}
+
+static Bool loadProgram(ShaderProgram* program, const char* fragmentShaderSource) {
+    if (program->loaded || program->failed) return program->loaded;
+    if (GPU_GetCurrentRenderer() == NULL) return False;
+    program->failed = True;
+    Uint32 vertexShader = compileShader(program->name, GPU_VERTEX_SHADER, vertexShaderSource);
+    if (vertexShader == 0) return False;
+    Uint32 fragmentShader = compileShader(program->name, GPU_FRAGMENT_SHADER,
+                                          fragmentShaderSource);
+    if (fragmentShader == 0) {
+        GPU_FreeShader(vertexShader);
+        return False;
+    }
+    program->program = GPU_LinkShaders(vertexShader, fragmentShader);
+    GPU_FreeShader(vertexShader);
+    GPU_FreeShader(fragmentShader);
+    if (program->program == 0) {
+        LOG("Failed to link the %s: %s\n", program->name, GPU_GetShaderMessage());
+        return False;
+    }
+    program->block = GPU_LoadShaderBlock(program->program, "gpu_Vertex", "gpu_TexCoord",
+                                         "gpu_Color", "gpu_ModelViewProjectionMatrix");
+    program->colorModeLocation = GPU_GetUniformLocation(program->program, "colorMode");
+    program->failed = False;
+    program->loaded = True;
+    return True;
+}
+
+static Bool loadShader() {
+    if (planeProgram.loaded || planeProgram.failed) return planeProgram.loaded;
+    if (!loadProgram(&planeProgram, planeFragmentShaderSource)) return False;
+    planeChannelLocation = GPU_GetUniformLocation(planeProgram.program, "planeChannel");
+    planeBitLocation = GPU_GetUniformLocation(planeProgram.program, "planeBit");
+    backgroundLocation = GPU_GetUniformLocation(planeProgram.program, "background");
+    transparentBackgroundLocation = GPU_GetUniformLocation(planeProgram.program,
+                                                           "transparentBackground");
+    return True;
+}
+
+static void freeProgram(ShaderProgram* program) {
+    if (program->loaded) {
+        GPU_FreeShaderProgram(program->program);
+        program->program = 0;
+        program->loaded = False;
+    }
+    program->failed = False;
+}
+
+static Bool loadRasterOpShader() {
+    if (rasterOpProgram.loaded || rasterOpProgram.failed) return rasterOpProgram.loaded;
+    if (!loadProgram(&rasterOpProgram, rasterOpFragmentShaderSource)) return False;
+    Uint32 program = rasterOpProgram.program;
+    rasterOpLocations.destination = GPU_GetUniformLocation(program, "destination");
+    rasterOpLocations.destinationOrigin = GPU_GetUniformLocation(program, "destinationOrigin");
+    rasterOpLocations.destinationSize = GPU_GetUniformLocation(program, "destinationSize");
+    rasterOpLocations.functionTable = GPU_GetUniformLocation(program, "functionTable");
+    rasterOpLocations.planeMask = GPU_GetUniformLocation(program, "planeMask");
+    rasterOpLocations.sourceMode = GPU_GetUniformLocation(program, "sourceMode");
+    rasterOpLocations.planeChannel = GPU_GetUniformLocation(program, "planeChannel");
+    rasterOpLocations.planeBit = GPU_GetUniformLocation(program, "planeBit");
+    rasterOpLocations.background = GPU_GetUniformLocation(program, "background");
+    rasterOpLocations.transparentBackground = GPU_GetUniformLocation(program,
+                                                                     "transparentBackground");
+    return True;
+}
+
+/*
+ * Get the color channel that holds the plane bit and the value of the bit in the channel.
+ */
+static void getPlaneChannel(unsigned long plane, float planeChannel[4], float* planeBit) {
+    int bit = 0;
+    while (bit < 31 && !(plane & (1UL << bit))) bit++;
+    int shifts[4] = {RED_SHIFT, GREEN_SHIFT, BLUE_SHIFT, ALPHA_SHIFT};
+    int channel;
+    for (channel = 0; channel < 4; channel++) {
+        planeChannel[channel] = 0;
+    }
+    for (channel = 0; channel < 4; channel++) {
+        if (bit >= shifts[channel] && bit < shifts[channel] + 8) break;
+    }
+    planeChannel[channel] = 1;
+    *planeBit = (float) (1 << (bit - shifts[channel]));
+}
+
+/*
+ * Check if the plane shader can be used by the current renderer.
+ */
+Bool isPlaneShaderAvailable() {
+    if (!planeProgram.loaded && !planeProgram.failed) {
+        // The shader is compiled by the client thread, which needs the OpenGL context.
+        syncRenderThread();
+    }
+    return loadShader();
+}
+
+/*
+ * Activate the plane shader for the following textured draws.
+ * The plane must have exactly one bit set. Returns False if the shader is not available.
+ */
+Bool beginPlaneShader(unsigned long plane, SDL_Color background, PlaneBackgroundMode mode) {
+    if (!loadShader()) return False;
+    float planeChannel[4], planeBit;
+    getPlaneChannel(plane, planeChannel, &planeBit);
+    float backgroundColor[4] = {background.r / 255.0f, background.g / 255.0f,
+                                background.b / 255.0f, background.a / 255.0f};
+    GPU_ActivateShaderProgram(planeProgram.program, &planeProgram.block);
+    GPU_SetUniformf(planeProgram.colorModeLocation, (float) SHADER_COLOR_UNCHANGED);
+    GPU_SetUniformfv(planeChannelLocation, 4, 1, planeChannel);
+    GPU_SetUniformf(planeBitLocation, planeBit);
+    GPU_SetUniformfv(backgroundLocation, 4, 1, backgroundColor);
+    GPU_SetUniformf(transparentBackgroundLocation,
+                    mode == PLANE_BACKGROUND_TRANSPARENT ? 1.0f : 0.0f);
+    planeShaderActive = True;
+    return True;
+}
+
+/*
+ * Restore the default shaders of the renderer.
+ */
+void endPlaneShader() {
+    planeShaderActive = False;
+    GPU_DeactivateShaderProgram();
+}
+
+/*
+ * Draw the following textured draws in the color mode. If the plane shader is active, its
+ * colors are changed, otherwise the color shader is activated.
+ * Returns False if the shader is not available.
+ */
+Bool beginColorShader(ShaderColorMode mode) {
+    if (planeShaderActive) {
+        GPU_SetUniformf(planeProgram.colorModeLocation, (float) mode);
+        return True;
+    }
+    if (!loadProgram(&colorProgram, colorFragmentShaderSource)) return False;
+    GPU_ActivateShaderProgram(colorProgram.program, &colorProgram.block);
+    GPU_SetUniformf(colorProgram.colorModeLocation, (float) mode);
+    colorShaderActive = True;
+    return True;
+}
+
+/*
+ * Stop drawing in the color mode of beginColorShader.
+ */
+void endColorShader() {
+    if (colorShaderActive) {
+        colorShaderActive = False;
+        GPU_DeactivateShaderProgram();
+    } else if (planeShaderActive) {
+        GPU_SetUniformf(planeProgram.colorModeLocation, (float) SHADER_COLOR_UNCHANGED);
+    }
+}
+
+/*
+ * Activate the raster op shader for the following draws, which are combined with the copy of the
+ * destination with the GC function and plane mask. The origin is the position of the copy in the
+ * framebuffer of the target. The source is the vertex color, or the texture times the vertex
+ * color if the draws are textured. If the plane is not 0, the source is selected by the plane
+ * of the texture like in the plane shader.
+ * Blending must be disabled while the shader is active.
+ * Returns False if the shader is not available.
+ */
+Bool beginRasterOpShader(int function, unsigned long planeMask, GPU_Image* destination,
+                         float originX, float originY, Bool textured, unsigned long plane,
+                         SDL_Color background, PlaneBackgroundMode mode) {
+    if (!loadRasterOpShader()) return False;
+    float functionTable[4] = {(float) (function & 0x1), (float) ((function >> 1) & 0x1),
+                              (float) ((function >> 2) & 0x1), (float) ((function >> 3) & 0x1)};
+    // The alpha channel is not part of the pixel value, so it is only written by GXcopy.
+    float planeMaskChannels[4] = {
+            GET_RED_FROM_COLOR(planeMask), GET_GREEN_FROM_COLOR(planeMask),
+            GET_BLUE_FROM_COLOR(planeMask),
+            function == GXcopy ? GET_ALPHA_FROM_COLOR(planeMask) : 0,
+    };
+    float origin[2] = {originX, originY};
+    float size[2] = {destination->texture_w, destination->texture_h};
+    float planeChannel[4] = {0, 0, 0, 0}, planeBit = 1;
+    float backgroundColor[4] = {background.r / 255.0f, background.g / 255.0f,
+                                background.b / 255.0f, background.a / 255.0f};
+    if (plane != 0) {
+        getPlaneChannel(plane, planeChannel, &planeBit);
+    }
+    GPU_ActivateShaderProgram(rasterOpProgram.program, &rasterOpProgram.block);
+    GPU_SetUniformf(rasterOpProgram.colorModeLocation, (float) SHADER_COLOR_UNCHANGED);
+    GPU_SetShaderImage(destination, rasterOpLocations.destination, 1);
+    GPU_SetUniformfv(rasterOpLocations.destinationOrigin, 2, 1, origin);
+    GPU_SetUniformfv(rasterOpLocations.destinationSize, 2, 1, size);
+    GPU_SetUniformfv(rasterOpLocations.functionTable, 4, 1, functionTable);
+    GPU_SetUniformfv(rasterOpLocations.planeMask, 4, 1, planeMaskChannels);
+    GPU_SetUniformf(rasterOpLocations.sourceMode, plane != 0 ? 2.0f : textured ? 1.0f : 0.0f);
+    GPU_SetUniformfv(rasterOpLocations.planeChannel, 4, 1, planeChannel);
+    GPU_SetUniformf(rasterOpLocations.planeBit, planeBit);
+    GPU_SetUniformfv(rasterOpLocations.background, 4, 1, backgroundColor);
+    GPU_SetUniformf(rasterOpLocations.transparentBackground,
+                    mode == PLANE_BACKGROUND_TRANSPARENT ? 1.0f : 0.0f);
+    return True;
+}
+
+/*
+ * Unbind the destination copy and restore the default shaders of the renderer.
+ */
+void endRasterOpShader() {
+    GPU_SetShaderImage(NULL, rasterOpLocations.destination, 1);
+    GPU_DeactivateShaderProgram();
+}
+
+void freePlaneShader() {
+    freeProgram(&planeProgram);
+    freeProgram(&colorProgram);
+    freeProgram(&rasterOpProgram);
+}
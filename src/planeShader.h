@@ -0,0 +1,36 @@
+#ifndef _PLANE_SHADER_H_
+#define _PLANE_SHADER_H_
+
+#include "X11/Xlib.h"
+#include "SDL.h"
+#include <SDL_gpu.h>
+
+/* How the pixels of the source with a cleared plane bit are drawn by the plane shader. */
+typedef enum {
+    /* The cleared pixels are drawn in the background color, like XCopyPlane does. */
+    PLANE_BACKGROUND_OPAQUE,
+    /* The cleared pixels are not drawn, like a stippled fill. */
+    PLANE_BACKGROUND_TRANSPARENT,
+} PlaneBackgroundMode;
+
+/* How the colors of textured draws are changed by the shaders. */
+typedef enum {
+    SHADER_COLOR_UNCHANGED,
+    /* The colors are inverted and opaque. */
+    SHADER_COLOR_INVERTED,
+    /* Every drawn pixel is opaque white. */
+    SHADER_COLOR_WHITE,
+} ShaderColorMode;
+
+Bool isPlaneShaderAvailable(void);
+Bool beginPlaneShader(unsigned long plane, SDL_Color background, PlaneBackgroundMode mode);
+void endPlaneShader(void);
+Bool beginColorShader(ShaderColorMode mode);
+void endColorShader(void);
+Bool beginRasterOpShader(int function, unsigned long planeMask, GPU_Image* destination,
+                         float originX, float originY, Bool textured, unsigned long plane,
+                         SDL_Color background, PlaneBackgroundMode mode);
+void endRasterOpShader(void);
+void freePlaneShader(void);
+
+#endif /* _PLANE_SHADER_H_ */
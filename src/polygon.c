@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include "polygon.h"
+#include "util.h"
+
+/*
+ * Polygons are tessellated on the CPU into a list of triangles.
+ * Convex polygons are drawn as a triangle fan. All other polygons are cut into horizontal slabs
+ * at the y coordinate of every vertex and every edge intersection, so that no edges cross
+ * inside of a slab. Within a slab the edges are sorted from left to right and the spans
+ * between them that are inside of the polygon according to the fill rule become trapezoids.
+ * The same decomposition merges overlapping triangles, like the ones of wide lines,
+ * into trapezoids that don't overlap.
+ */
+
+typedef struct {
+    float x;
+    float y;
+} PolygonPoint;
+
+typedef struct {
+    /* The upper and the lower end of the edge. */
+    PolygonPoint top;
+    PolygonPoint bottom;
+    /* 1 if the edge points downwards in the path of the polygon, -1 otherwise. */
+    int direction;
+    /* The x coordinate of the edge in the middle of the current slab. */
+    float middleX;
+} PolygonEdge;
+
+static Bool addTriangle(TriangleList* list, float x1, float y1, float x2, float y2,
+                        float x3, float y3) {
+    if (!reserveTriangleList(list, 3)) return False;
+    float* point = &list->points[list->numPoints * 2];
+    *point++ = x1; *point++ = y1;
+    *point++ = x2; *point++ = y2;
+    *point++ = x3; *point   = y3;
+    list->numPoints += 3;
+    return True;
+}
+
+static float getEdgeX(const PolygonEdge* edge, float y) {
+    return edge->top.x + (edge->bottom.x - edge->top.x) * (y - edge->top.y)
+                         / (edge->bottom.y - edge->top.y);
+}
+
+static int compareFloats(const void* value1, const void* value2) {
+    float a = *(const float*) value1, b = *(const float*) value2;
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static int compareEdgeTops(const void* edge1, const void* edge2) {
+    return compareFloats(&((const PolygonEdge*) edge1)->top.y, &((const PolygonEdge*) edge2)->top.y);
+}
+
+static int compareEdgeMiddles(const void* edge1, const void* edge2) {
+    return compareFloats(&(*(PolygonEdge* const*) edge1)->middleX,
+                         &(*(PolygonEdge* const*) edge2)->middleX);
+}
+
+/*
+ * Get the y coordinate where the two edges cross each other.
+ * Returns False if they don't cross within the vertical range of both edges.
+ */
+static Bool getIntersectionY(const PolygonEdge* edge1, const PolygonEdge* edge2, float* y) {
+    float top = MAX(edge1->top.y, edge2->top.y), bottom = MIN(edge1->bottom.y, edge2->bottom.y);
+    if (top >= bottom) return False;
+    float distanceTop = getEdgeX(edge1, top) - getEdgeX(edge2, top);
+    float distanceBottom = getEdgeX(edge1, bottom) - getEdgeX(edge2, bottom);
+    if ((distanceTop < 0) == (distanceBottom < 0) || distanceTop == 0 || distanceBottom == 0) {
+        return False;
+    }
+    *y = top + (bottom - top) * distanceTop / (distanceTop - distanceBottom);
+    return True;
+}
+
+static Bool tessellateConvexPolygon(const PolygonPoint* path, size_t numPoints,
+                                    TriangleList* triangles) {
+    size_t i;
+    if (!reserveTriangleList(triangles, (numPoints - 2) * 3)) return False;
+    for (i = 2; i < numPoints; i++) {
+        addTriangle(triangles, path[0].x, path[0].y, path[i - 1].x, path[i - 1].y,
+                    path[i].x, path[i].y);
+    }
+    return True;
+}
+
+/*
+ * Get 1 if the triangle is oriented clockwise on the screen, -1 if it is counterclockwise
+ * and 0 if it is degenerated.
+ */
+static int getTriangleOrientation(const PolygonPoint* points) {
+    float cross = (points[1].x - points[0].x) * (points[2].y - points[0].y)
+                  - (points[2].x - points[0].x) * (points[1].y - points[0].y);
+    return cross > 0 ? 1 : cross < 0 ? -1 : 0;
+}
+
+/*
+ * Tessellate the path with the slab decomposition. The path consists of closed contours of
+ * contourLength points each. Contours of three points are oriented the same way, so that the
+ * union of the triangles is filled with the NonZero rule. If the path is not complex,
+ * its edges can't cross each other and the intersection search is skipped.
+ */
+static Bool tessellateSlabs(const PolygonPoint* path, size_t numPoints, size_t contourLength,
+                            Bool complex, int fillRule, TriangleList* triangles) {
+    size_t i, j, numEdges = 0, numStops = 0, stopCapacity = numPoints;
+    int orientation = 1;
+    PolygonEdge* edges = malloc(sizeof(PolygonEdge) * numPoints);
+    PolygonEdge** activeEdges = malloc(sizeof(PolygonEdge*) * numPoints);
+    float* stops = malloc(sizeof(float) * stopCapacity);
+    Bool success = edges != NULL && activeEdges != NULL && stops != NULL;
+    for (i = 0; i < numPoints && success; i++) {
+        size_t contourStart = i - i % contourLength;
+        if (i == contourStart && contourLength == 3) {
+            orientation = getTriangleOrientation(&path[i]);
+        }
+        PolygonPoint start = path[i];
+        PolygonPoint end = path[i + 1 == contourStart + contourLength ? contourStart : i + 1];
+        stops[numStops++] = start.y;
+        // Horizontal edges and degenerated triangles don't contribute to the spans.
+        if (start.y == end.y || orientation == 0) continue;
+        PolygonEdge* edge = &edges[numEdges++];
+        edge->direction = (start.y < end.y ? 1 : -1) * orientation;
+        edge->top = start.y < end.y ? start : end;
+        edge->bottom = start.y < end.y ? end : start;
+    }
+    if (success) {
+        qsort(edges, numEdges, sizeof(PolygonEdge), compareEdgeTops);
+    }
+    for (i = 0; i < numEdges && complex && success; i++) {
+        // The edges are sorted by their top, so no later edge can reach this one.
+        for (j = i + 1; j < numEdges && edges[j].top.y < edges[i].bottom.y; j++) {
+            float y;
+            if (!getIntersectionY(&edges[i], &edges[j], &y)) continue;
+            if (numStops == stopCapacity) {
+                stopCapacity *= 2;
+                float* newStops = realloc(stops, sizeof(float) * stopCapacity);
+                if (newStops == NULL) {
+                    success = False;
+                    break;
+                }
+                stops = newStops;
+            }
+            stops[numStops++] = y;
+        }
+    }
+    if (success) {
+        qsort(stops, numStops, sizeof(float), compareFloats);
+    }
+    size_t nextEdge = 0, numActiveEdges = 0;
+    for (i = 0; i + 1 < numStops && success; i++) {
+        float top = stops[i], bottom = stops[i + 1];
+        if (top == bottom) continue;
+        float middle = (top + bottom) / 2;
+        // Update the edges that span the slab.
+        for (j = 0; j < numActiveEdges;) {
+            if (activeEdges[j]->bottom.y <= top) {
+                activeEdges[j] = activeEdges[--numActiveEdges];
+            } else {
+                j++;
+            }
+        }
+        while (nextEdge < numEdges && edges[nextEdge].top.y <= top) {
+            if (edges[nextEdge].bottom.y > top) {
+                activeEdges[numActiveEdges++] = &edges[nextEdge];
+            }
+            nextEdge++;
+        }
+        for (j = 0; j < numActiveEdges; j++) {
+            activeEdges[j]->middleX = getEdgeX(activeEdges[j], middle);
+        }
+        qsort(activeEdges, numActiveEdges, sizeof(PolygonEdge*), compareEdgeMiddles);
+        int winding = 0;
+        PolygonEdge* spanStart = NULL;
+        for (j = 0; j < numActiveEdges && success; j++) {
+            winding += activeEdges[j]->direction;
+            Bool inside = fillRule == EvenOddRule ? (winding & 1) != 0 : winding != 0;
+            if (inside && spanStart == NULL) {
+                spanStart = activeEdges[j];
+            } else if (!inside && spanStart != NULL) {
+                float leftTop = getEdgeX(spanStart, top), leftBottom = getEdgeX(spanStart, bottom);
+                float rightTop = getEdgeX(activeEdges[j], top);
+                float rightBottom = getEdgeX(activeEdges[j], bottom);
+                spanStart = NULL;
+                // Coinciding edges, like the shared edges of merged triangles, have no span.
+                if (leftTop == rightTop && leftBottom == rightBottom) continue;
+                success = addTriangle(triangles, leftTop, top, rightTop, top,
+                                      rightBottom, bottom)
+                          && addTriangle(triangles, leftTop, top, rightBottom, bottom,
+                                         leftBottom, bottom);
+            }
+        }
+    }
+    free(edges);
+    free(activeEdges);
+    free(stops);
+    return success;
+}
+
+/*
+ * Tessellate the polygon into the triangle list. The points are interpreted according to
+ * the coordinate mode. The shape is the hint of the client: Convex polygons are tessellated
+ * as a fan, Nonconvex polygons are assumed to not intersect themselves.
+ * Returns False if we ran out of memory.
+ */
+Bool tessellatePolygon(const XPoint* points, size_t numPoints, int shape, int mode,
+                       int fillRule, TriangleList* triangles) {
+    size_t i, numPathPoints = 0;
+    if (numPoints < 3) return True;
+    PolygonPoint* path = malloc(sizeof(PolygonPoint) * numPoints);
+    if (path == NULL) return False;
+    int x = 0, y = 0;
+    for (i = 0; i < numPoints; i++) {
+        if (mode == CoordModePrevious && i > 0) {
+            x += points[i].x;
+            y += points[i].y;
+        } else {
+            x = points[i].x;
+            y = points[i].y;
+        }
+        if (numPathPoints > 0 && path[numPathPoints - 1].x == x
+            && path[numPathPoints - 1].y == y) {
+            continue;
+        }
+        path[numPathPoints].x = (float) x;
+        path[numPathPoints].y = (float) y;
+        numPathPoints++;
+    }
+    // The polygon is closed implicitly.
+    if (numPathPoints > 1 && path[0].x == path[numPathPoints - 1].x
+        && path[0].y == path[numPathPoints - 1].y) {
+        numPathPoints--;
+    }
+    Bool success = True;
+    if (numPathPoints >= 3) {
+        if (shape == Convex) {
+            success = tessellateConvexPolygon(path, numPathPoints, triangles);
+        } else {
+            success = tessellateSlabs(path, numPathPoints, numPathPoints, shape == Complex,
+                                      fillRule, triangles);
+        }
+    }
+    free(path);
+    return success;
+}
+
+/*
+ * Replace the triangles of the list, starting at the first point, with triangles that cover
+ * the same area without overlapping each other, so that every pixel is drawn only once.
+ * Returns False if we ran out of memory.
+ */
+Bool mergeTriangles(TriangleList* triangles, size_t firstPoint) {
+    size_t i, numPoints = triangles->numPoints - firstPoint;
+    if (numPoints <= 3) return True;
+    PolygonPoint* path = malloc(sizeof(PolygonPoint) * numPoints);
+    if (path == NULL) return False;
+    for (i = 0; i < numPoints; i++) {
+        path[i].x = triangles->points[(firstPoint + i) * 2];
+        path[i].y = triangles->points[(firstPoint + i) * 2 + 1];
+    }
+    triangles->numPoints = firstPoint;
+    Bool success = tessellateSlabs(path, numPoints, 3, True, WindingRule, triangles);
+    free(path);
+    return success;
+}
@@ -0,0 +1,11 @@
+#ifndef _POLYGON_H_
+#define _POLYGON_H_
+
+#include "X11/Xlib.h"
+#include "line.h"
+
+Bool tessellatePolygon(const XPoint* points, size_t numPoints, int shape, int mode,
+                       int fillRule, TriangleList* triangles);
+Bool mergeTriangles(TriangleList* triangles, size_t firstPoint);
+
+#endif /* _POLYGON_H_ */
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <string.h>
+#include "presentScheduler.h"
+#include "util.h"
+
+/*
+ * The present scheduler decides when the windows that were drawn on are presented.
+ * In the immediate mode every flush of the display list presents the windows right away.
+ * In the vsync and adaptive modes a window is presented at most once per refresh of its
+ * display: A present that is requested too early is deferred until it is due and all requests
+ * in between are merged into it, so no frames are rendered that would never be visible.
+ * The swaps are synchronized to the vertical blank via the swap interval. If the driver does
+ * not support that (e.g. the dummy driver), the deadlines of the deferred presents act as a
+ * timer with the refresh rate of the display, which the event loop waits for.
+ * The scheduler is only used by the thread that owns the OpenGL context.
+ */
+
+typedef struct {
+    GPU_Target* target;
+    /* The refresh interval of the display of the window in performance counter ticks. */
+    Uint64 refreshInterval;
+    /* The performance counter value after the last present or 0 if it was never presented. */
+    Uint64 lastPresent;
+    /* The performance counter value at which the deferred present is due or 0. */
+    Uint64 deadline;
+    /* Whether the driver synchronizes the swaps of the window to the vertical blank. */
+    Bool hardwareVsync;
+} PresentedWindow;
+
+static PresentMode presentMode = PRESENT_IMMEDIATE;
+static Array presentedWindows = {NULL, 0, 0};
+/* The number of windows with a deferred present, read by the client thread at any time. */
+static SDL_atomic_t numDeferredPresents;
+/* The number of frames per frame time in milliseconds since the histogram was last logged. */
+static Uint32 frameTimeHistogram[PRESENT_HISTOGRAM_BUCKETS];
+static unsigned long numHistogramFrames = 0;
+static unsigned long numDeferred = 0;
+static unsigned long numMerged = 0;
+
+/*
+ * Initialize the present scheduler with the present mode from the environment.
+ * Returns False if the present mode is invalid, windows are presented immediately in that case.
+ */
+Bool initPresentScheduler() {
+    const char* value = getenv(PRESENT_MODE_ENV_VARIABLE);
+    presentMode = PRESENT_IMMEDIATE;
+    SDL_AtomicSet(&numDeferredPresents, 0);
+    if (value == NULL || strcmp(value, "immediate") == 0) return True;
+    if (strcmp(value, "vsync") == 0) {
+        presentMode = PRESENT_VSYNC;
+    } else if (strcmp(value, "adaptive") == 0) {
+        presentMode = PRESENT_ADAPTIVE;
+    } else {
+        LOG("Unknown present mode '%s'\n", value);
+        return False;
+    }
+    if (!initArray(&presentedWindows, 4)) {
+        LOG("Failed to allocate the presented windows\n");
+        presentMode = PRESENT_IMMEDIATE;
+        return False;
+    }
+    memset(frameTimeHistogram, 0, sizeof(frameTimeHistogram));
+    numHistogramFrames = numDeferred = numMerged = 0;
+    LOG("Using the %s present mode\n", value);
+    return True;
+}
+
+PresentMode getPresentMode() {
+    return presentMode;
+}
+
+static void logFrameTimeHistogram() {
+    size_t i;
+    Uint32 maxCount = 1;
+    char bar[PRESENT_HISTOGRAM_BAR_WIDTH + 1];
+    if (numHistogramFrames == 0) return;
+    for (i = 0; i < PRESENT_HISTOGRAM_BUCKETS; i++) {
+        maxCount = MAX(maxCount, frameTimeHistogram[i]);
+    }
+    LOG("Frame times of the last %lu presents (%lu deferred, %lu merged requests):\n",
+        numHistogramFrames, numDeferred, numMerged);
+    for (i = 0; i < PRESENT_HISTOGRAM_BUCKETS; i++) {
+        if (frameTimeHistogram[i] == 0) continue;
+        size_t barLength = frameTimeHistogram[i] * PRESENT_HISTOGRAM_BAR_WIDTH / maxCount;
+        memset(bar, '#', barLength);
+        bar[barLength] = '\0';
+        LOG("  %s%2lu ms: %6u %s\n", i == PRESENT_HISTOGRAM_BUCKETS - 1 ? ">=" : "  ",
+            (unsigned long) i, frameTimeHistogram[i], bar);
+    }
+    memset(frameTimeHistogram, 0, sizeof(frameTimeHistogram));
+    numHistogramFrames = numDeferred = numMerged = 0;
+}
+
+static void recordFrameTime(Uint64 frameTime) {
+    Uint64 milliseconds = frameTime * 1000 / SDL_GetPerformanceFrequency();
+    frameTimeHistogram[MIN(milliseconds, PRESENT_HISTOGRAM_BUCKETS - 1)]++;
+    if (++numHistogramFrames == PRESENT_HISTOGRAM_INTERVAL) {
+        logFrameTimeHistogram();
+    }
+}
+
+/*
+ * Synchronize the swaps of the current window to the vertical blank.
+ * Returns False if the driver does not support a swap interval.
+ */
+static Bool enableVsync() {
+    // Adaptive vsync swaps immediately instead of waiting a whole refresh if a frame is late.
+    if (presentMode == PRESENT_ADAPTIVE && SDL_GL_SetSwapInterval(-1) == 0) return True;
+    if (SDL_GL_SetSwapInterval(1) == 0) return True;
+    LOG("Failed to enable vsync, pacing the presents with a timer: %s\n", SDL_GetError());
+    return False;
+}
+
+static Uint64 getRefreshInterval(GPU_Target* target) {
+    SDL_DisplayMode mode;
+    int refreshRate = PRESENT_DEFAULT_REFRESH_RATE;
+    SDL_Window* window = SDL_GetWindowFromID(target->context->windowID);
+    if (window != NULL && SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) {
+        refreshRate = mode.refresh_rate;
+    }
+    return SDL_GetPerformanceFrequency() / refreshRate;
+}
+
+static PresentedWindow* getPresentedWindow(GPU_Target* target) {
+    size_t i;
+    for (i = 0; i < presentedWindows.length; i++) {
+        PresentedWindow* window = presentedWindows.array[i];
+        if (window->target == target) return window;
+    }
+    PresentedWindow* window = malloc(sizeof(PresentedWindow));
+    if (window == NULL) return NULL;
+    if (!insertArray(&presentedWindows, window)) {
+        free(window);
+        return NULL;
+    }
+    window->target = target;
+    window->refreshInterval = getRefreshInterval(target);
+    window->lastPresent = 0;
+    window->deadline = 0;
+    window->hardwareVsync = False;
+    return window;
+}
+
+static void presentWindow(PresentedWindow* window) {
+    GPU_Flip(window->target);
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (window->lastPresent == 0) {
+        // SDL_gpu sets the swap interval when it creates the window target,
+        // so it is changed after the first swap, while the window is current.
+        window->hardwareVsync = enableVsync();
+    } else {
+        recordFrameTime(now - window->lastPresent);
+    }
+    window->lastPresent = now;
+    if (window->deadline != 0) {
+        window->deadline = 0;
+        SDL_AtomicAdd(&numDeferredPresents, -1);
+    }
+}
+
+/*
+ * Get the earliest time at which the window can be presented again.
+ */
+static Uint64 getPresentDeadline(const PresentedWindow* window, Uint64 now) {
+    Uint64 interval = window->refreshInterval;
+    if (window->lastPresent == 0) return now;
+    if (window->hardwareVsync) {
+        // The last present returned close to the last vertical blank. Swap a bit before
+        // the next one, the driver waits for it.
+        return window->lastPresent + interval - interval / 4;
+    }
+    Uint64 elapsed = now - window->lastPresent;
+    if (elapsed < interval) return window->lastPresent + interval;
+    if (presentMode == PRESENT_ADAPTIVE) return now;
+    // Emulate the vertical blank by keeping the presents on the grid of the refresh interval.
+    return window->lastPresent + (elapsed + interval - 1) / interval * interval;
+}
+
+/*
+ * Present the target that was drawn on. Window targets are presented according to the present
+ * mode, possibly during a later call to presentScheduledFrames. Image targets are always
+ * flushed immediately.
+ */
+void schedulePresent(GPU_Target* target) {
+    if (presentMode == PRESENT_IMMEDIATE || target->image != NULL || target->context == NULL) {
+        GPU_Flip(target);
+        return;
+    }
+    PresentedWindow* window = getPresentedWindow(target);
+    if (window == NULL) {
+        LOG("Failed to schedule the present of a window, presenting immediately\n");
+        GPU_Flip(target);
+        return;
+    }
+    if (window->deadline != 0) {
+        // The new content is shown with the deferred present.
+        numMerged++;
+        return;
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 deadline = getPresentDeadline(window, now);
+    if (deadline <= now) {
+        presentWindow(window);
+        return;
+    }
+    window->deadline = deadline;
+    numDeferred++;
+    SDL_AtomicAdd(&numDeferredPresents, 1);
+}
+
+/*
+ * Execute the deferred presents that are due, or all of them if force is True.
+ */
+void presentScheduledFrames(Bool force) {
+    size_t i;
+    if (SDL_AtomicGet(&numDeferredPresents) == 0) return;
+    Uint64 now = SDL_GetPerformanceCounter();
+    for (i = 0; i < presentedWindows.length; i++) {
+        PresentedWindow* window = presentedWindows.array[i];
+        if (window->deadline != 0 && (force || window->deadline <= now)) {
+            presentWindow(window);
+        }
+    }
+}
+
+/*
+ * Check if a present is deferred. This can be called by the client thread at any time,
+ * but the result is only reliable after synchronizing with the render thread.
+ */
+Bool hasDeferredPresents() {
+    return SDL_AtomicGet(&numDeferredPresents) != 0;
+}
+
+/*
+ * Get the number of milliseconds until the next deferred present is due
+ * or -1 if no present is deferred.
+ */
+int getPresentTimeout() {
+    size_t i;
+    Uint64 deadline = 0;
+    if (SDL_AtomicGet(&numDeferredPresents) == 0) return -1;
+    for (i = 0; i < presentedWindows.length; i++) {
+        PresentedWindow* window = presentedWindows.array[i];
+        if (window->deadline != 0 && (deadline == 0 || window->deadline < deadline)) {
+            deadline = window->deadline;
+        }
+    }
+    if (deadline == 0) return -1;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (deadline <= now) return 0;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    return (int) (((deadline - now) * 1000 + frequency - 1) / frequency);
+}
+
+/*
+ * Forget the scheduling state of the window target.
+ * This must be called before the target is freed.
+ */
+void forgetPresentTarget(GPU_Target* target) {
+    size_t i;
+    for (i = 0; i < presentedWindows.length; i++) {
+        PresentedWindow* window = presentedWindows.array[i];
+        if (window->target == target) {
+            if (window->deadline != 0) {
+                SDL_AtomicAdd(&numDeferredPresents, -1);
+            }
+            free(removeArray(&presentedWindows, i, True));
+            return;
+        }
+    }
+}
+
+void freePresentScheduler() {
+    size_t i;
+    logFrameTimeHistogram();
+    for (i = 0; i < presentedWindows.length; i++) {
+        free(presentedWindows.array[i]);
+    }
+    freeArray(&presentedWindows);
+    SDL_AtomicSet(&numDeferredPresents, 0);
+    presentMode = PRESENT_IMMEDIATE;
+}
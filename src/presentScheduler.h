@@ -0,0 +1,37 @@
+#ifndef _PRESENT_SCHEDULER_H_
+#define _PRESENT_SCHEDULER_H_
+
+#include "X11/Xlib.h"
+#include "SDL.h"
+#include <SDL_gpu.h>
+
+/* The environment variable that selects the present mode: immediate, vsync or adaptive. */
+#define PRESENT_MODE_ENV_VARIABLE "SDL2X11_PRESENT_MODE"
+/* The refresh rate that is assumed if the refresh rate of a display is unknown. */
+#define PRESENT_DEFAULT_REFRESH_RATE 60
+/* The number of one millisecond buckets of the frame time histogram, the last one is open. */
+#define PRESENT_HISTOGRAM_BUCKETS 34
+/* The number of presents after which the frame time histogram is logged. */
+#define PRESENT_HISTOGRAM_INTERVAL 600
+/* The length of the bar of the largest bucket in the logged histogram. */
+#define PRESENT_HISTOGRAM_BAR_WIDTH 40
+
+typedef enum {
+    /* Present every window whenever the display list is flushed. */
+    PRESENT_IMMEDIATE,
+    /* Present at most once per refresh, aligned to the vertical blank. */
+    PRESENT_VSYNC,
+    /* Like PRESENT_VSYNC, but present immediately if the window was idle or a frame is late. */
+    PRESENT_ADAPTIVE,
+} PresentMode;
+
+Bool initPresentScheduler(void);
+PresentMode getPresentMode(void);
+void schedulePresent(GPU_Target* target);
+void presentScheduledFrames(Bool force);
+Bool hasDeferredPresents(void);
+int getPresentTimeout(void);
+void forgetPresentTarget(GPU_Target* target);
+void freePresentScheduler(void);
+
+#endif /* _PRESENT_SCHEDULER_H_ */
@@ -0,0 +1,317 @@
+#include "rasterOp.h"
+#include "colors.h"
+#include "util.h"
+#include "glFunctions.h"
+#include "planeShader.h"
+#include "readback.h"
+
+/*
+ * The GC functions are executed with OpenGL logic operations if they are available, and plane
+ * masks that enable or disable whole color channels are applied with the color mask.
+ * OpenGL ES does not have logic operations and the color mask can not select single planes.
+ * In these cases the area of the batch is copied from the target into the destination image
+ * and the raster op shader combines the source with it bit by bit. Because the destination is
+ * copied once per batch, the display list does not let the commands of such batches overlap.
+ * If the raster op shader is not available, the functions are approximated with blend
+ * functions, which are exact if every color channel of the source and destination is either
+ * fully on or fully off, and channels with some of their planes enabled are written
+ * completely. This is logged.
+ * The pixman render backend applies GC functions and plane masks bit by bit.
+ */
+
+typedef enum {
+    SOURCE_COLOR,
+    INVERTED_COLOR,
+    WHITE_COLOR,
+} RasterOpColor;
+
+typedef struct {
+    GPU_BlendFuncEnum sourceFactor;
+    GPU_BlendFuncEnum destinationFactor;
+    RasterOpColor color;
+} BlendRasterOp;
+
+static const BlendRasterOp blendRasterOps[] = {
+        /* GXclear */        {GPU_FUNC_ZERO,          GPU_FUNC_ZERO,          SOURCE_COLOR},
+        /* GXand */          {GPU_FUNC_ZERO,          GPU_FUNC_SRC_COLOR,     SOURCE_COLOR},
+        /* GXandReverse */   {GPU_FUNC_ONE_MINUS_DST, GPU_FUNC_ZERO,          SOURCE_COLOR},
+        /* GXcopy */         {GPU_FUNC_ONE,           GPU_FUNC_ZERO,          SOURCE_COLOR},
+        /* GXandInverted */  {GPU_FUNC_ZERO,          GPU_FUNC_ONE_MINUS_SRC, SOURCE_COLOR},
+        /* GXnoop */         {GPU_FUNC_ZERO,          GPU_FUNC_ONE,           SOURCE_COLOR},
+        /* GXxor */          {GPU_FUNC_ONE_MINUS_DST, GPU_FUNC_ONE_MINUS_SRC, SOURCE_COLOR},
+        /* GXor */           {GPU_FUNC_ONE,           GPU_FUNC_ONE_MINUS_SRC, SOURCE_COLOR},
+        /* GXnor */          {GPU_FUNC_ONE_MINUS_DST, GPU_FUNC_ZERO,          INVERTED_COLOR},
+        /* GXequiv */        {GPU_FUNC_ONE_MINUS_DST, GPU_FUNC_ONE_MINUS_SRC, INVERTED_COLOR},
+        /* GXinvert */       {GPU_FUNC_ONE_MINUS_DST, GPU_FUNC_ZERO,          WHITE_COLOR},
+        // Can not be expressed with blending, approximated by GXcopy.
+        /* GXorReverse */    {GPU_FUNC_ONE,           GPU_FUNC_ZERO,          SOURCE_COLOR},
+        /* GXcopyInverted */ {GPU_FUNC_ONE,           GPU_FUNC_ZERO,          INVERTED_COLOR},
+        /* GXorInverted */   {GPU_FUNC_ONE,           GPU_FUNC_ONE_MINUS_SRC, INVERTED_COLOR},
+        // Can not be expressed with blending, approximated by GXinvert.
+        /* GXnand */         {GPU_FUNC_ONE_MINUS_DST, GPU_FUNC_ZERO,          WHITE_COLOR},
+        /* GXset */          {GPU_FUNC_ONE,           GPU_FUNC_ZERO,          WHITE_COLOR},
+};
+
+/* The blend state of the image that is restored in endRasterOp. */
+static GPU_bool savedUseBlending;
+static GPU_BlendMode savedBlendMode;
+/* Whether the color shader draws the inverted source of the current raster operation. */
+static Bool isColorShader = False;
+/* The last plane mask that was reported to be applied per color channel. */
+static unsigned long reportedPlaneMask = PLANE_MASK_ALL_PLANES;
+/* The last GC function that was reported to be approximated with blend functions. */
+static int reportedBlendFunction = GXcopy;
+/* The copy of the destination that the raster op shader reads. */
+static GPU_Image* destinationImage = NULL;
+
+static void setVertexColors(float* vertices, size_t numVertices, size_t floatsPerVertex,
+                            RasterOpColor mode) {
+    size_t i, j;
+    for (i = 0; i < numVertices; i++) {
+        // The color is stored in the last four components of the vertex.
+        float* color = &vertices[i * floatsPerVertex + floatsPerVertex - 4];
+        for (j = 0; j < 3; j++) {
+            color[j] = mode == WHITE_COLOR ? 1.0f : 1.0f - color[j];
+        }
+        color[3] = 1.0f;
+    }
+}
+
+/*
+ * Check if the color mask can apply the plane mask exactly,
+ * i.e. if every color channel has either all or none of its planes enabled.
+ */
+static Bool isChannelPlaneMask(unsigned long planeMask) {
+    Uint8 channels[3] = {GET_RED_FROM_COLOR(planeMask), GET_GREEN_FROM_COLOR(planeMask),
+                         GET_BLUE_FROM_COLOR(planeMask)};
+    int i;
+    for (i = 0; i < 3; i++) {
+        if (channels[i] != 0 && channels[i] != 0xFF) return False;
+    }
+    return True;
+}
+
+/*
+ * Check if the draws with the GC function and plane mask read the destination in the raster op
+ * shader. This can be called by the client thread while it records the draws.
+ */
+Bool isDestinationRasterOp(int function, unsigned long planeMask) {
+    if (IS_COPY_RASTER_OP(function, planeMask)) return False;
+    if (!isChannelPlaneMask(planeMask)) return True;
+    GPU_Renderer* renderer = GPU_GetCurrentRenderer();
+    return function != GXcopy && renderer != NULL
+           && renderer->id.renderer >= GPU_RENDERER_GLES_1;
+}
+
+/*
+ * Get the destination image with at least the given size.
+ */
+static GPU_Image* getDestinationImage(Uint16 width, Uint16 height) {
+    if (destinationImage != NULL && destinationImage->w >= width
+        && destinationImage->h >= height) {
+        return destinationImage;
+    }
+    GPU_Image* image = GPU_CreateImage(
+            MAX(width, destinationImage == NULL ? 0 : destinationImage->w),
+            MAX(height, destinationImage == NULL ? 0 : destinationImage->h), GPU_FORMAT_RGBA);
+    if (image == NULL) {
+        LOG("Failed to create the raster op destination image: %s\n",
+            GPU_PopErrorCode().details);
+        return NULL;
+    }
+    GPU_SetImageFilter(image, GPU_FILTER_NEAREST);
+    if (destinationImage != NULL) {
+        GPU_FreeImage(destinationImage);
+    }
+    destinationImage = image;
+    return destinationImage;
+}
+
+/*
+ * Prepare drawing a batch with a GC function or plane mask that needs the raster op shader.
+ * The area in target coordinates that the batch draws on is copied into the destination image.
+ * The current viewport and clip rectangle of the target must be set. Returns False if the
+ * shader or the copy are not available, in which case endDestinationRasterOp must not be called.
+ */
+Bool beginDestinationRasterOp(GPU_Target* target, const GPU_Rect* area, int function,
+                              unsigned long planeMask, GPU_Image* image, unsigned long plane,
+                              SDL_Color background, PlaneBackgroundMode mode) {
+    const GLFunctions* gl = getGLFunctions();
+    if (gl->bindFramebuffer == NULL || gl->genFramebuffers == NULL
+        || gl->framebufferTexture2D == NULL || gl->checkFramebufferStatus == NULL
+        || gl->bindTexture == NULL || gl->copyTexSubImage2D == NULL) {
+        return False;
+    }
+    float x1 = MAX(area->x, 0), y1 = MAX(area->y, 0);
+    float x2 = MIN(area->x + area->w, target->w), y2 = MIN(area->y + area->h, target->h);
+    if (target->use_clip_rect) {
+        x1 = MAX(x1, target->clip_rect.x);
+        y1 = MAX(y1, target->clip_rect.y);
+        x2 = MIN(x2, target->clip_rect.x + target->clip_rect.w);
+        y2 = MIN(y2, target->clip_rect.y + target->clip_rect.h);
+    }
+    // Include all pixels that the batch touches partially.
+    GLint x = (GLint) x1, y = (GLint) y1;
+    GLsizei width = (GLsizei) (x2 + 0.999f) - x, height = (GLsizei) (y2 + 0.999f) - y;
+    if (width <= 0 || height <= 0) {
+        width = height = 1;
+    }
+    GPU_FlushBlitBuffer();
+    GPU_Image* destination = getDestinationImage((Uint16) width, (Uint16) height);
+    if (destination == NULL) return False;
+    // Window framebuffers are stored bottom up.
+    if (target->image == NULL) {
+        y = (GLint) target->h - y - height;
+    }
+    if (!bindTargetFramebuffer(target)) {
+        GPU_ResetRendererState();
+        return False;
+    }
+    gl->bindTexture(GL_TEXTURE_2D, (GLuint) GPU_GetTextureHandle(destination));
+    gl->copyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, width, height);
+    // Let SDL_gpu restore the OpenGL state it expects.
+    GPU_ResetRendererState();
+    if (!beginRasterOpShader(function, planeMask, destination, (float) x, (float) y,
+                             image != NULL, plane, background, mode)) {
+        return False;
+    }
+    // The shader computes the final pixels.
+    if (image != NULL) {
+        savedUseBlending = image->use_blending;
+        GPU_SetBlending(image, False);
+    } else {
+        GPU_SetShapeBlending(False);
+    }
+    return True;
+}
+
+/*
+ * Restore the normal drawing state after drawing with beginDestinationRasterOp.
+ */
+void endDestinationRasterOp(GPU_Image* image) {
+    GPU_FlushBlitBuffer();
+    endRasterOpShader();
+    if (image != NULL) {
+        GPU_SetBlending(image, savedUseBlending);
+    } else {
+        GPU_SetShapeBlending(True);
+    }
+}
+
+/*
+ * Prepare drawing the vertices with the given GC function and plane mask.
+ * The colors of the vertices may be changed. Returns False if nothing needs to be prepared,
+ * in which case endRasterOp must not be called.
+ */
+Bool beginRasterOp(int function, unsigned long planeMask, GPU_Image* image,
+                   float* vertices, size_t numVertices, size_t floatsPerVertex) {
+    if (IS_COPY_RASTER_OP(function, planeMask)) return False;
+    const GLFunctions* gl = getGLFunctions();
+    GPU_FlushBlitBuffer();
+    if (!isChannelPlaneMask(planeMask) && planeMask != reportedPlaneMask) {
+        LOG("The raster op shader is not available: Channels of plane mask 0x%08lx with some "
+            "of their planes enabled are written completely\n", planeMask & PLANE_MASK_ALL_PLANES);
+        reportedPlaneMask = planeMask;
+    }
+    if (gl->colorMask != NULL) {
+        // Channels are only written if any of their planes are enabled. The alpha channel
+        // is not part of the pixel value, so it is only written by GXcopy.
+        gl->colorMask((GLboolean) (GET_RED_FROM_COLOR(planeMask) != 0),
+                      (GLboolean) (GET_GREEN_FROM_COLOR(planeMask) != 0),
+                      (GLboolean) (GET_BLUE_FROM_COLOR(planeMask) != 0),
+                      (GLboolean) (function == GXcopy && GET_ALPHA_FROM_COLOR(planeMask) != 0));
+    }
+    if (function == GXcopy) return True;
+    if (gl->logicOp != NULL && gl->enable != NULL) {
+        gl->enable(GL_COLOR_LOGIC_OP);
+        gl->logicOp((GLenum) (GL_LOGIC_OP_BASE + function));
+        return True;
+    }
+    if (function != reportedBlendFunction) {
+        LOG("The raster op shader is not available: GC function %d is approximated with blend "
+            "functions\n", function);
+        reportedBlendFunction = function;
+    }
+    const BlendRasterOp* blendOp = &blendRasterOps[function];
+    if (blendOp->color != SOURCE_COLOR && image == NULL) {
+        setVertexColors(vertices, numVertices, floatsPerVertex, blendOp->color);
+    } else if (blendOp->color != SOURCE_COLOR) {
+        isColorShader = beginColorShader(blendOp->color == WHITE_COLOR
+                                         ? SHADER_COLOR_WHITE : SHADER_COLOR_INVERTED);
+        if (!isColorShader) {
+            LOG("The color shader is not available, GC function %d draws the source "
+                "without inverting it\n", function);
+        }
+    }
+    if (image != NULL) {
+        savedUseBlending = image->use_blending;
+        savedBlendMode = image->blend_mode;
+        GPU_SetBlending(image, True);
+        GPU_SetBlendFunction(image, blendOp->sourceFactor, blendOp->destinationFactor,
+                             GPU_FUNC_ZERO, GPU_FUNC_ONE);
+        GPU_SetBlendEquation(image, GPU_EQ_ADD, GPU_EQ_ADD);
+    } else {
+        GPU_SetShapeBlending(True);
+        GPU_SetShapeBlendFunction(blendOp->sourceFactor, blendOp->destinationFactor,
+                                  GPU_FUNC_ZERO, GPU_FUNC_ONE);
+        GPU_SetShapeBlendEquation(GPU_EQ_ADD, GPU_EQ_ADD);
+    }
+    return True;
+}
+
+/*
+ * Restore the normal drawing state after drawing with a GC function and plane mask.
+ */
+void endRasterOp(int function, unsigned long planeMask, GPU_Image* image) {
+    const GLFunctions* gl = getGLFunctions();
+    (void) planeMask;
+    GPU_FlushBlitBuffer();
+    if (gl->colorMask != NULL) {
+        gl->colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+    if (function == GXcopy) return;
+    if (gl->logicOp != NULL && gl->disable != NULL) {
+        gl->disable(GL_COLOR_LOGIC_OP);
+        return;
+    }
+    if (isColorShader) {
+        endColorShader();
+        isColorShader = False;
+    }
+    if (image != NULL) {
+        GPU_SetBlending(image, savedUseBlending);
+        GPU_SetBlendFunction(image, savedBlendMode.source_color, savedBlendMode.dest_color,
+                             savedBlendMode.source_alpha, savedBlendMode.dest_alpha);
+        GPU_SetBlendEquation(image, savedBlendMode.color_equation, savedBlendMode.alpha_equation);
+    } else {
+        GPU_SetShapeBlendMode(GPU_BLEND_NORMAL);
+    }
+}
+
+/*
+ * Apply the GC function and plane mask to a pixel on the CPU. Like on the GPU, the alpha channel
+ * is not part of the pixel value, so it is only written by GXcopy.
+ */
+unsigned long applyRasterOp(int function, unsigned long planeMask, unsigned long source,
+                            unsigned long destination) {
+    unsigned long mask = planeMask & PLANE_MASK_ALL_PLANES;
+    unsigned long value = 0;
+    if (function != GXcopy) {
+        mask &= ~(0xFFUL << ALPHA_SHIFT);
+    }
+    // Every bit of the function is the result for one combination of source and destination bit.
+    if (function & 0x1) value |= source & destination;
+    if (function & 0x2) value |= source & ~destination;
+    if (function & 0x4) value |= ~source & destination;
+    if (function & 0x8) value |= ~source & ~destination;
+    return ((value & mask) | (destination & ~mask)) & PLANE_MASK_ALL_PLANES;
+}
+
+void freeRasterOp() {
+    if (destinationImage != NULL) {
+        GPU_FreeImage(destinationImage);
+        destinationImage = NULL;
+    }
+    reportedPlaneMask = PLANE_MASK_ALL_PLANES;
+    reportedBlendFunction = GXcopy;
+}
@@ -0,0 +1,28 @@
+#ifndef _RASTER_OP_H_
+#define _RASTER_OP_H_
+
+#include "X11/Xlib.h"
+#include <SDL_gpu.h>
+#include "planeShader.h"
+
+/* The plane mask bits that are used by the pixel format of the drawables. */
+#define PLANE_MASK_ALL_PLANES 0xFFFFFFFFUL
+
+#define IS_NOOP_RASTER_OP(function, planeMask) \
+    ((function) == GXnoop || ((planeMask) & PLANE_MASK_ALL_PLANES) == 0)
+#define IS_COPY_RASTER_OP(function, planeMask) \
+    ((function) == GXcopy && ((planeMask) & PLANE_MASK_ALL_PLANES) == PLANE_MASK_ALL_PLANES)
+
+Bool isDestinationRasterOp(int function, unsigned long planeMask);
+Bool beginDestinationRasterOp(GPU_Target* target, const GPU_Rect* area, int function,
+                              unsigned long planeMask, GPU_Image* image, unsigned long plane,
+                              SDL_Color background, PlaneBackgroundMode mode);
+void endDestinationRasterOp(GPU_Image* image);
+Bool beginRasterOp(int function, unsigned long planeMask, GPU_Image* image,
+                   float* vertices, size_t numVertices, size_t floatsPerVertex);
+void endRasterOp(int function, unsigned long planeMask, GPU_Image* image);
+unsigned long applyRasterOp(int function, unsigned long planeMask, unsigned long source,
+                            unsigned long destination);
+void freeRasterOp(void);
+
+#endif /* _RASTER_OP_H_ */
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+#include "readback.h"
+#include "drawing.h"
+#include "displayList.h"
+#include "util.h"
+#include "glFunctions.h"
+
+/*
+ * Reading pixels back from the GPU with glReadPixels stalls until all drawing on the target has
+ * finished. On OpenGL (ES) 3 the pixels are instead read into a pixel buffer object, which
+ * returns immediately, and a fence is inserted after the read. The pixel buffer is mapped once
+ * the fence has signaled, which is checked whenever the display list is flushed.
+ * The pixel buffers are kept after their readback completed and reused by later readbacks,
+ * so repeated reads of similar sizes do not allocate buffer storage on the GPU.
+ * On older renderers the pixels are read synchronously and the callback is called immediately.
+ */
+
+/*
+ * The time in nanoseconds after which a readback that is waited for is logged as slow.
+ * The wait continues until the fence signals or waiting on it fails.
+ */
+#define READBACK_WAIT_TIMEOUT 1000000000ull
+
+/* A pixel buffer that receives the pixels of readbacks. */
+typedef struct {
+    GLuint buffer;
+    /* The size of the storage of the buffer in bytes. */
+    size_t size;
+} StagingBuffer;
+
+typedef struct {
+    StagingBuffer staging;
+    GLSync fence;
+    int width;
+    int height;
+    Bool bottomUp;
+    ReadbackCallback callback;
+    void* data;
+} PendingReadback;
+
+static PendingReadback pendingReadbacks[MAX_PENDING_READBACKS];
+static size_t numPendingReadbacks = 0;
+/* The staging buffers that are not used by a pending readback. */
+static StagingBuffer stagingBuffers[MAX_PENDING_READBACKS];
+static size_t numStagingBuffers = 0;
+/* A framebuffer to read from the textures of images. */
+static GLuint readFramebuffer = 0;
+static Uint8* readBuffer = NULL;
+static size_t readBufferSize = 0;
+
+/*
+ * Check that the functions to read pixels are available.
+ */
+static Bool hasReadFunctions(const GLFunctions* gl) {
+    return gl->bindFramebuffer != NULL && gl->genFramebuffers != NULL
+           && gl->framebufferTexture2D != NULL && gl->checkFramebufferStatus != NULL
+           && gl->readPixels != NULL;
+}
+
+/*
+ * Bind the framebuffer that contains the pixels of the target for reading. Call
+ * GPU_ResetRendererState afterwards, so SDL_gpu binds the framebuffers it expects again.
+ */
+Bool bindTargetFramebuffer(GPU_Target* target) {
+    const GLFunctions* gl = getGLFunctions();
+    if (target->image == NULL) {
+        makeRenderTargetCurrent(target, target->context->windowID);
+        gl->bindFramebuffer(GL_FRAMEBUFFER, 0);
+        return True;
+    }
+    if (readFramebuffer == 0) {
+        gl->genFramebuffers(1, &readFramebuffer);
+    }
+    gl->bindFramebuffer(GL_FRAMEBUFFER, readFramebuffer);
+    gl->framebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         (GLuint) GPU_GetTextureHandle(target->image), 0);
+    if (gl->checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOG("The framebuffer of the image %p is incomplete\n", target->image);
+        return False;
+    }
+    return True;
+}
+
+/*
+ * Get a staging buffer with room for size bytes and bind it as the pixel pack buffer.
+ */
+static StagingBuffer acquireStagingBuffer(const GLFunctions* gl, size_t size) {
+    StagingBuffer staging = {0, 0};
+    if (numStagingBuffers > 0) {
+        staging = stagingBuffers[--numStagingBuffers];
+    } else {
+        gl->genBuffers(1, &staging.buffer);
+    }
+    gl->bindBuffer(GL_PIXEL_PACK_BUFFER, staging.buffer);
+    if (staging.size < size) {
+        gl->bufferData(GL_PIXEL_PACK_BUFFER, (ptrdiff_t) size, NULL, GL_STREAM_READ);
+        staging.size = size;
+    }
+    return staging;
+}
+
+static void callCallback(const PendingReadback* readback, const Uint8* pixels) {
+    ptrdiff_t pitch = (ptrdiff_t) readback->width * 4;
+    if (pixels != NULL && readback->bottomUp) {
+        pixels += (readback->height - 1) * pitch;
+        pitch = -pitch;
+    }
+    readback->callback(pixels, pitch, readback->width, readback->height, readback->data);
+}
+
+/*
+ * Read the pixels of the area of the target and call the callback with them. The area is in
+ * target coordinates and must lie inside of the target. If asynchronous readbacks are
+ * supported, the callback is called once the pixels are available during a later flush of
+ * the display list, otherwise it is called before this returns.
+ * Returns False if the readback could not be started, the callback is not called in that case.
+ */
+Bool readPixelsAsync(GPU_Target* target, const GPU_Rect* rect, ReadbackCallback callback,
+                     void* data) {
+    flushDisplayListForTarget(target);
+    return readExecutedPixelsAsync(target, rect, callback, data);
+}
+
+/*
+ * Like readPixelsAsync, but reads the pixels of the commands that were executed so far without
+ * flushing the display list. This must be called on the thread that executes the display list.
+ */
+Bool readExecutedPixelsAsync(GPU_Target* target, const GPU_Rect* rect,
+                             ReadbackCallback callback, void* data) {
+    PendingReadback readback;
+    readback.staging.buffer = 0;
+    readback.staging.size = 0;
+    readback.fence = NULL;
+    readback.width = (int) rect->w;
+    readback.height = (int) rect->h;
+    // Window framebuffers are stored bottom up.
+    readback.bottomUp = target->image == NULL;
+    readback.callback = callback;
+    readback.data = data;
+    GLint y = (GLint) (readback.bottomUp ? target->h - rect->y - rect->h : rect->y);
+    size_t size = (size_t) readback.width * readback.height * 4;
+    if (readback.width <= 0 || readback.height <= 0) return False;
+    const GLFunctions* gl = getGLFunctions();
+    if (!hasReadFunctions(gl)) {
+        LOG("Failed to load the OpenGL functions in %s: %s\n", __func__, SDL_GetError());
+        return False;
+    }
+    if (gl->pixelBuffersSupported && numPendingReadbacks == MAX_PENDING_READBACKS) {
+        completeReadbacks(True);
+    }
+    GPU_FlushBlitBuffer();
+    if (!bindTargetFramebuffer(target)) {
+        GPU_ResetRendererState();
+        return False;
+    }
+    Bool success = True;
+    if (gl->pixelBuffersSupported) {
+        readback.staging = acquireStagingBuffer(gl, size);
+        gl->readPixels((GLint) rect->x, y, readback.width, readback.height, GL_RGBA,
+                       GL_UNSIGNED_BYTE, NULL);
+        gl->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = gl->fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pendingReadbacks[numPendingReadbacks++] = readback;
+    } else {
+        if (size > readBufferSize) {
+            Uint8* buffer = realloc(readBuffer, size);
+            if (buffer == NULL) {
+                LOG("Out of memory: Failed to grow the readback buffer!\n");
+                success = False;
+            } else {
+                readBuffer = buffer;
+                readBufferSize = size;
+            }
+        }
+        if (success) {
+            gl->readPixels((GLint) rect->x, y, readback.width, readback.height, GL_RGBA,
+                           GL_UNSIGNED_BYTE, readBuffer);
+        }
+    }
+    // Let SDL_gpu restore the OpenGL state it expects.
+    GPU_ResetRendererState();
+    if (success && !gl->pixelBuffersSupported) {
+        callCallback(&readback, readBuffer);
+    }
+    return success;
+}
+
+Bool hasPendingReadbacks() {
+    return numPendingReadbacks > 0;
+}
+
+/*
+ * Call the callbacks of the pending readbacks whose pixels are available.
+ * If wait is True, this waits until all pending readbacks are complete. A readback whose fence
+ * can not be waited for fails, its callback is called without pixels.
+ */
+void completeReadbacks(Bool wait) {
+    size_t i, numCompleted = 0;
+    if (numPendingReadbacks == 0 || GPU_GetContextTarget() == NULL) return;
+    const GLFunctions* gl = getGLFunctions();
+    for (i = 0; i < numPendingReadbacks; i++) {
+        PendingReadback* readback = &pendingReadbacks[i];
+        GLenum status = gl->clientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                           wait ? READBACK_WAIT_TIMEOUT : 0);
+        while (wait && status == GL_TIMEOUT_EXPIRED) {
+            LOG("Still waiting for a %dx%d readback\n", readback->width, readback->height);
+            status = gl->clientWaitSync(readback->fence, 0, READBACK_WAIT_TIMEOUT);
+        }
+        if (status == GL_TIMEOUT_EXPIRED) break;
+        gl->deleteSync(readback->fence);
+        const Uint8* pixels = NULL;
+        gl->bindBuffer(GL_PIXEL_PACK_BUFFER, readback->staging.buffer);
+        if (status == GL_WAIT_FAILED) {
+            LOG("Failed to wait for the fence of a readback\n");
+        } else {
+            pixels = gl->mapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                    (ptrdiff_t) readback->width * readback->height * 4, GL_MAP_READ_BIT);
+            if (pixels == NULL) {
+                LOG("Failed to map the pixel buffer of a readback\n");
+            }
+        }
+        callCallback(readback, pixels);
+        if (pixels != NULL) {
+            gl->unmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        gl->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        stagingBuffers[numStagingBuffers++] = readback->staging;
+        numCompleted++;
+    }
+    numPendingReadbacks -= numCompleted;
+    memmove(pendingReadbacks, pendingReadbacks + numCompleted,
+            numPendingReadbacks * sizeof(PendingReadback));
+}
+
+void freeReadbacks() {
+    size_t i;
+    completeReadbacks(True);
+    const GLFunctions* gl = getGLFunctions();
+    for (i = 0; i < numPendingReadbacks; i++) {
+        LOG("A readback did not complete, dropping it\n");
+        callCallback(&pendingReadbacks[i], NULL);
+        gl->deleteSync(pendingReadbacks[i].fence);
+        gl->deleteBuffers(1, &pendingReadbacks[i].staging.buffer);
+    }
+    numPendingReadbacks = 0;
+    for (i = 0; i < numStagingBuffers; i++) {
+        gl->deleteBuffers(1, &stagingBuffers[i].buffer);
+    }
+    numStagingBuffers = 0;
+    if (readFramebuffer != 0 && gl->deleteFramebuffers != NULL) {
+        gl->deleteFramebuffers(1, &readFramebuffer);
+        readFramebuffer = 0;
+    }
+    free(readBuffer);
+    readBuffer = NULL;
+    readBufferSize = 0;
+}
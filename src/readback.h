@@ -0,0 +1,28 @@
+#ifndef _READBACK_H_
+#define _READBACK_H_
+
+#include <stddef.h>
+#include "X11/Xlib.h"
+#include <SDL_gpu.h>
+
+/* The maximum number of readbacks that can be in flight at the same time. */
+#define MAX_PENDING_READBACKS 8
+
+/*
+ * Called with the read pixels as rows of R, G, B, A bytes. The first row is the top row of the
+ * area, the pitch is negative if the rows are stored bottom up. Pixels is NULL if the readback
+ * failed. The pixels are only valid during the call.
+ */
+typedef void (*ReadbackCallback)(const Uint8* pixels, ptrdiff_t pitch, int width, int height,
+                                 void* data);
+
+Bool bindTargetFramebuffer(GPU_Target* target);
+Bool readPixelsAsync(GPU_Target* target, const GPU_Rect* rect, ReadbackCallback callback,
+                     void* data);
+Bool readExecutedPixelsAsync(GPU_Target* target, const GPU_Rect* rect,
+                             ReadbackCallback callback, void* data);
+Bool hasPendingReadbacks(void);
+void completeReadbacks(Bool wait);
+void freeReadbacks(void);
+
+#endif /* _READBACK_H_ */
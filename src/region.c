@@ -5,6 +5,7 @@
 #include "pixman.h"
 #include "drawing.h"
 #include "resourceTypes.h"
+#include "errors.h"
 
 typedef struct pixman_region16* pRegion;
 #define GET_REGION(pixmanRegion) ((Region) (void*) pixmanRegion)
@@ -79,9 +80,20 @@ int XUnionRectWithRegion(XRectangle *rectangle, Region src_region, Region dest_r
 
 int XSetRegion(Display* display, GC gc, Region region) {
     // https://tronche.com/gui/x/xlib/utilities/regions/XSetRegion.html
-    pixman_box16_t* extends = pixman_region_extents(GET_P_REGION(region));
-    int width  = abs(extends->x2 - extends->x1);
-    int height = abs(extends->y2 - extends->y1);
-    // TODO: Implement (https://opensource.apple.com/source/X11/X11-0.40.2/xc/lib/X11/Region.c.auto.html)
-    return 1;
+    int numRects, i;
+    pixman_box16_t* boxes = pixman_region_rectangles(GET_P_REGION(region), &numRects);
+    XRectangle* rectangles = numRects > 0 ? malloc(sizeof(XRectangle) * numRects) : NULL;
+    if (numRects > 0 && rectangles == NULL) {
+        handleOutOfMemory(0, display, 0, 0);
+        return 0;
+    }
+    for (i = 0; i < numRects; i++) {
+        rectangles[i].x = boxes[i].x1;
+        rectangles[i].y = boxes[i].y1;
+        rectangles[i].width = (unsigned short) (boxes[i].x2 - boxes[i].x1);
+        rectangles[i].height = (unsigned short) (boxes[i].y2 - boxes[i].y1);
+    }
+    int result = XSetClipRectangles(display, gc, 0, 0, rectangles, numRects, YXBanded);
+    free(rectangles);
+    return result;
 }
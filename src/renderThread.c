@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include "renderThread.h"
+#include "util.h"
+
+/*
+ * In the opt-in render thread mode the display list is executed by a dedicated thread,
+ * so the client can continue with its own work while the driver rasterizes the frame.
+ * SDL_gpu is not thread safe, so only one thread uses it at a time: The OpenGL context is
+ * handed to the render thread when a job is submitted and taken back by the client thread at
+ * the next synchronization point: XSync, readbacks such as XGetImage, direct uploads into
+ * textures and the creation of GPU resources. Other requests are only recorded into the
+ * display list and run concurrently with the render thread. Images are freed by the thread that
+ * executes the display list, so freeing them does not wait.
+ * The jobs are passed through a lock-free single producer, single consumer ring buffer. Up to
+ * RENDER_QUEUE_SIZE jobs can be in flight, so the client can record the next frames while the
+ * render thread draws the previous ones. The finish functions of executed jobs are called when
+ * the client submits a job or synchronizes, the client only waits if the queue is full.
+ */
+
+typedef struct {
+    /* Called on the render thread with the OpenGL context. */
+    RenderJobFunc execute;
+    /* Called on the client thread once the job was executed, may be NULL. */
+    RenderJobFunc finish;
+    void* data;
+} RenderJob;
+
+static Bool enabled = False;
+static SDL_Thread* renderThread = NULL;
+static RenderJob queue[RENDER_QUEUE_SIZE];
+/* The number of submitted jobs, only written by the client thread. */
+static SDL_atomic_t queueHead;
+/* The number of executed jobs, only written by the render thread. */
+static SDL_atomic_t queueTail;
+/* The number of executed jobs when the render thread last released the context. */
+static SDL_atomic_t releasedTail;
+static SDL_atomic_t stopRequested;
+static SDL_sem* jobsAvailable = NULL;
+static SDL_sem* contextReleased = NULL;
+/* Posted by the render thread after every executed job. */
+static SDL_sem* jobExecuted = NULL;
+static SDL_threadID renderThreadId = 0;
+/* The window and OpenGL context that are handed between the threads. */
+static SDL_Window* contextWindow = NULL;
+static SDL_GLContext context = NULL;
+/* The following are only accessed by the client thread. */
+static Bool clientOwnsContext = True;
+static int numFinishedJobs = 0;
+
+static int renderThreadMain(void* data) {
+    (void) data;
+    while (True) {
+        SDL_SemWait(jobsAvailable);
+        if (SDL_AtomicGet(&stopRequested)) break;
+        int tail = SDL_AtomicGet(&queueTail);
+        if (tail == SDL_AtomicGet(&queueHead)) continue;
+        SDL_MemoryBarrierAcquire();
+        SDL_GL_MakeCurrent(contextWindow, context);
+        while (tail != SDL_AtomicGet(&queueHead)) {
+            SDL_MemoryBarrierAcquire();
+            RenderJob* job = &queue[(unsigned int) tail % RENDER_QUEUE_SIZE];
+            job->execute(job->data);
+            SDL_MemoryBarrierRelease();
+            SDL_AtomicSet(&queueTail, ++tail);
+            SDL_SemPost(jobExecuted);
+        }
+        // SDL_gpu might have switched to the context of another window.
+        contextWindow = SDL_GL_GetCurrentWindow();
+        context = SDL_GL_GetCurrentContext();
+        SDL_GL_MakeCurrent(contextWindow, NULL);
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&releasedTail, tail);
+        SDL_SemPost(contextReleased);
+    }
+    return 0;
+}
+
+/*
+ * Start the render thread if it is enabled via the environment.
+ * Returns False if the render thread should be used but could not be started.
+ */
+Bool initRenderThread() {
+    const char* value = getenv(RENDER_THREAD_ENV_VARIABLE);
+    if (value == NULL || strcmp(value, "1") != 0 || enabled) return True;
+    SDL_AtomicSet(&queueHead, 0);
+    SDL_AtomicSet(&queueTail, 0);
+    SDL_AtomicSet(&releasedTail, 0);
+    SDL_AtomicSet(&stopRequested, 0);
+    numFinishedJobs = 0;
+    clientOwnsContext = True;
+    jobsAvailable = SDL_CreateSemaphore(0);
+    contextReleased = SDL_CreateSemaphore(0);
+    jobExecuted = SDL_CreateSemaphore(0);
+    if (jobsAvailable == NULL || contextReleased == NULL || jobExecuted == NULL) {
+        LOG("Failed to create the render thread semaphores: %s\n", SDL_GetError());
+        stopRenderThread();
+        return False;
+    }
+    renderThread = SDL_CreateThread(renderThreadMain, "X11 render thread", NULL);
+    if (renderThread == NULL) {
+        LOG("Failed to start the render thread: %s\n", SDL_GetError());
+        stopRenderThread();
+        return False;
+    }
+    renderThreadId = SDL_GetThreadID(renderThread);
+    LOG("Started the render thread\n");
+    enabled = True;
+    return True;
+}
+
+Bool isRenderThreadEnabled() {
+    return enabled;
+}
+
+/*
+ * Check if the caller runs on the render thread.
+ */
+Bool isRenderThread() {
+    return enabled && SDL_ThreadID() == renderThreadId;
+}
+
+/*
+ * Check if submitted jobs were not executed by the render thread yet.
+ */
+Bool isRenderThreadBusy() {
+    return enabled && SDL_AtomicGet(&queueTail) != SDL_AtomicGet(&queueHead);
+}
+
+/*
+ * Call the finish functions of all jobs that the render thread has executed.
+ */
+static void finishExecutedJobs() {
+    int tail = SDL_AtomicGet(&queueTail);
+    SDL_MemoryBarrierAcquire();
+    while (numFinishedJobs != tail) {
+        RenderJob* job = &queue[(unsigned int) numFinishedJobs % RENDER_QUEUE_SIZE];
+        if (job->finish != NULL) {
+            job->finish(job->data);
+        }
+        numFinishedJobs++;
+    }
+}
+
+/*
+ * Queue a job for the render thread. The job gets the OpenGL context when it is executed.
+ * The finish function is called on the client thread once the job was executed, during a later
+ * submit or at the next synchronization point. If RENDER_QUEUE_SIZE jobs are not finished yet,
+ * this waits until the render thread has executed the oldest one.
+ * Returns False if the render thread is not enabled, the caller must execute the job itself.
+ */
+Bool submitRenderJob(RenderJobFunc execute, RenderJobFunc finish, void* data) {
+    if (!enabled) return False;
+    int head = SDL_AtomicGet(&queueHead);
+    finishExecutedJobs();
+    while (head - numFinishedJobs == RENDER_QUEUE_SIZE) {
+        SDL_SemWait(jobExecuted);
+        finishExecutedJobs();
+    }
+    if (clientOwnsContext) {
+        contextWindow = SDL_GL_GetCurrentWindow();
+        context = SDL_GL_GetCurrentContext();
+        SDL_GL_MakeCurrent(contextWindow, NULL);
+        clientOwnsContext = False;
+    }
+    RenderJob* job = &queue[(unsigned int) head % RENDER_QUEUE_SIZE];
+    job->execute = execute;
+    job->finish = finish;
+    job->data = data;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queueHead, head + 1);
+    SDL_SemPost(jobsAvailable);
+    return True;
+}
+
+/*
+ * Wait until the render thread executed all queued jobs and take the OpenGL context back.
+ * This must be called by the client thread before it uses SDL_gpu.
+ */
+void syncRenderThread() {
+    if (clientOwnsContext) return;
+    int head = SDL_AtomicGet(&queueHead);
+    while (SDL_AtomicGet(&releasedTail) != head) {
+        SDL_SemWait(contextReleased);
+    }
+    SDL_MemoryBarrierAcquire();
+    SDL_GL_MakeCurrent(contextWindow, context);
+    clientOwnsContext = True;
+    // Nobody waits for the jobs that were executed since the last submit anymore.
+    while (SDL_SemTryWait(jobExecuted) == 0);
+    finishExecutedJobs();
+}
+
+void stopRenderThread() {
+    if (renderThread != NULL) {
+        syncRenderThread();
+        SDL_AtomicSet(&stopRequested, 1);
+        SDL_SemPost(jobsAvailable);
+        SDL_WaitThread(renderThread, NULL);
+        renderThread = NULL;
+    }
+    if (jobsAvailable != NULL) {
+        SDL_DestroySemaphore(jobsAvailable);
+        jobsAvailable = NULL;
+    }
+    if (contextReleased != NULL) {
+        SDL_DestroySemaphore(contextReleased);
+        contextReleased = NULL;
+    }
+    if (jobExecuted != NULL) {
+        SDL_DestroySemaphore(jobExecuted);
+        jobExecuted = NULL;
+    }
+    enabled = False;
+}
@@ -0,0 +1,23 @@
+#ifndef _RENDER_THREAD_H_
+#define _RENDER_THREAD_H_
+
+#include "X11/Xlib.h"
+#include "SDL.h"
+
+/* The environment variable that enables the render thread if it is set to 1. */
+#define RENDER_THREAD_ENV_VARIABLE "SDL2X11_RENDER_THREAD"
+/* The maximum number of render jobs that can be in flight on the render thread. */
+#define RENDER_QUEUE_SIZE 8
+
+/* A function of a render job that is called with the data of the job. */
+typedef void (*RenderJobFunc)(void* data);
+
+Bool initRenderThread(void);
+Bool isRenderThreadEnabled(void);
+Bool isRenderThread(void);
+Bool isRenderThreadBusy(void);
+Bool submitRenderJob(RenderJobFunc execute, RenderJobFunc finish, void* data);
+void syncRenderThread(void);
+void stopRenderThread(void);
+
+#endif /* _RENDER_THREAD_H_ */
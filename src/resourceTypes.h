@@ -2,7 +2,7 @@
 #define _RESOURCE_TYPES_H_
 
 typedef enum {WINDOW = 1, DRAWABLE = 2, PIXMAP = 3,
-    GRAPHICS_CONTEXT = 4, FONT = 5, CURSOR = 6} XResourceType;
+    GRAPHICS_CONTEXT = 4, FONT = 5, CURSOR = 6, SHM_SEGMENT = 7} XResourceType;
 
 typedef struct {
     XResourceType type;
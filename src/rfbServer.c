@@ -0,0 +1,1236 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__) && !defined(__ANDROID__)
+#  include <poll.h>
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <sys/eventfd.h>
+#  include <sys/socket.h>
+#  include <zlib.h>
+#  define RFB_SERVER_SUPPORTED
+#endif
+#include "X11/keysym.h"
+#include "rfbServer.h"
+#include "headless.h"
+#include "events.h"
+#include "input.h"
+#include "window.h"
+#include "util.h"
+
+/*
+ * An optional RFB (VNC) server on the loopback interface, which allows to view and control the
+ * emulated display remotely. It serves the exported framebuffer of the headless mode to one
+ * viewer at a time. The server thread is woken by the damage listener of the framebuffer and
+ * sends the changed area, encoded as Raw, ZRLE or Tight (without JPEG), once the viewer
+ * requested an update.
+ * Pointer and key events of the viewer are pushed into the SDL event queue and converted into
+ * SDL input events on the client thread, so they take the same path as local input.
+ */
+
+typedef enum {
+    REMOTE_POINTER_MOTION,
+    REMOTE_POINTER_BUTTON,
+    REMOTE_KEY,
+} RemoteInputType;
+
+typedef struct {
+    RemoteInputType type;
+    /* The pointer position in root window coordinates. */
+    int x;
+    int y;
+    /* The SDL button of a button event. */
+    Uint8 button;
+    Bool pressed;
+    KeySym keysym;
+} RemoteInputEvent;
+
+static Window getTopLevelWindowAt(int x, int y, int* localX, int* localY) {
+    Window* children = GET_CHILDREN(SCREEN_WINDOW);
+    size_t i = GET_WINDOW_STRUCT(SCREEN_WINDOW)->children.length;
+    while (i-- > 0) {
+        if (!IS_MAPPED_TOP_LEVEL_WINDOW(children[i])) continue;
+        int windowX = 0, windowY = 0, width = 0, height = 0;
+        GET_WINDOW_POS(children[i], windowX, windowY);
+        GET_WINDOW_DIMS(children[i], width, height);
+        if (x >= windowX && y >= windowY && x < windowX + width && y < windowY + height) {
+            *localX = x - windowX;
+            *localY = y - windowY;
+            return children[i];
+        }
+    }
+    return None;
+}
+
+static Uint16 getModifierOfKeySym(KeySym keysym) {
+    switch (keysym) {
+        case XK_Shift_L: return KMOD_LSHIFT;
+        case XK_Shift_R: return KMOD_RSHIFT;
+        case XK_Control_L: return KMOD_LCTRL;
+        case XK_Control_R: return KMOD_RCTRL;
+        case XK_Alt_L: return KMOD_LALT;
+        case XK_Alt_R: return KMOD_RALT;
+        case XK_Super_L: return KMOD_LGUI;
+        case XK_Super_R: return KMOD_RGUI;
+        default: return KMOD_NONE;
+    }
+}
+
+/*
+ * Replace the remote input event with the SDL input event for the window under the remote
+ * pointer. This must be called on the client thread.
+ * Returns False if there is no window under the remote pointer.
+ */
+Bool convertRemoteInputEvent(SDL_Event* event) {
+    static int pointerX = 0, pointerY = 0;
+    static Uint32 buttonState = 0;
+    static Uint16 modifiers = KMOD_NONE;
+    RemoteInputEvent input = *((RemoteInputEvent*) event->user.data1);
+    free(event->user.data1);
+    Uint32 timestamp = event->user.timestamp;
+    if (input.type == REMOTE_POINTER_BUTTON) {
+        if (input.pressed) {
+            buttonState |= SDL_BUTTON(input.button);
+        } else {
+            buttonState &= ~SDL_BUTTON(input.button);
+        }
+    } else if (input.type == REMOTE_KEY) {
+        Uint16 modifier = getModifierOfKeySym(input.keysym);
+        modifiers = input.pressed ? modifiers | modifier : modifiers & ~modifier;
+        SDL_SetModState((SDL_Keymod) modifiers);
+    }
+    if (input.type != REMOTE_KEY) {
+        pointerX = input.x;
+        pointerY = input.y;
+    }
+    int x, y;
+    Window window = getTopLevelWindowAt(pointerX, pointerY, &x, &y);
+    if (window == None) return False;
+    Uint32 windowId = SDL_GetWindowID(GET_WINDOW_STRUCT(window)->sdlWindow);
+    SDL_zerop(event);
+    switch (input.type) {
+        case REMOTE_POINTER_MOTION:
+            event->type = SDL_MOUSEMOTION;
+            event->motion.timestamp = timestamp;
+            event->motion.windowID = windowId;
+            event->motion.state = buttonState;
+            event->motion.x = x;
+            event->motion.y = y;
+            break;
+        case REMOTE_POINTER_BUTTON:
+            event->type = input.pressed ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            event->button.timestamp = timestamp;
+            event->button.windowID = windowId;
+            event->button.button = input.button;
+            event->button.state = input.pressed ? SDL_PRESSED : SDL_RELEASED;
+            event->button.clicks = 1;
+            event->button.x = x;
+            event->button.y = y;
+            break;
+        case REMOTE_KEY:
+            event->type = input.pressed ? SDL_KEYDOWN : SDL_KEYUP;
+            event->key.timestamp = timestamp;
+            event->key.windowID = windowId;
+            event->key.state = input.pressed ? SDL_PRESSED : SDL_RELEASED;
+            event->key.keysym.sym = convertKeySymToKeycode(input.keysym);
+            event->key.keysym.scancode = SDL_GetScancodeFromKey(event->key.keysym.sym);
+            event->key.keysym.mod = modifiers;
+            break;
+    }
+    return True;
+}
+
+#ifdef RFB_SERVER_SUPPORTED
+
+#define RFB_PROTOCOL_VERSION "RFB 003.008\n"
+#define RFB_PROTOCOL_VERSION_LENGTH 12
+#define RFB_SERVER_NAME "SDL2X11Emulation"
+#define RFB_SECURITY_NONE 1
+#define RFB_ENCODING_RAW 0
+#define RFB_ENCODING_TIGHT 7
+#define RFB_ENCODING_ZRLE 16
+#define RFB_ZRLE_TILE_SIZE 64
+#define RFB_ZRLE_MAX_PALETTE_SIZE 16
+/* Tight rectangles must not be wider than this, the area limits the size of the zlib blocks. */
+#define RFB_TIGHT_MAX_RECT_WIDTH 2048
+#define RFB_TIGHT_MAX_RECT_AREA 65536
+#define RFB_TIGHT_MAX_PALETTE_SIZE 256
+/* The size of the hash table that collects the palette of a Tight rectangle, a power of two. */
+#define RFB_TIGHT_PALETTE_HASH_SIZE 1024
+/* Tight data that is smaller than this is sent uncompressed. */
+#define RFB_TIGHT_MIN_TO_COMPRESS 12
+#define RFB_TIGHT_FILL 0x80
+#define RFB_TIGHT_EXPLICIT_FILTER 0x40
+#define RFB_TIGHT_FILTER_PALETTE 1
+/* The zlib streams of Tight for the different kinds of data. */
+#define RFB_TIGHT_STREAM_FULL_COLOR 0
+#define RFB_TIGHT_STREAM_MONO 1
+#define RFB_TIGHT_STREAM_INDEXED 2
+#define RFB_TIGHT_NUM_STREAMS 3
+/* A viewer that does not complete a message in this time is disconnected. */
+#define RFB_RECEIVE_TIMEOUT_SECONDS 5
+
+#define RFB_SET_PIXEL_FORMAT 0
+#define RFB_SET_ENCODINGS 2
+#define RFB_FRAMEBUFFER_UPDATE_REQUEST 3
+#define RFB_KEY_EVENT 4
+#define RFB_POINTER_EVENT 5
+#define RFB_CLIENT_CUT_TEXT 6
+#define RFB_FRAMEBUFFER_UPDATE 0
+
+typedef struct {
+    Uint8 bitsPerPixel;
+    Uint8 depth;
+    Bool bigEndian;
+    Bool trueColor;
+    Uint16 redMax;
+    Uint16 greenMax;
+    Uint16 blueMax;
+    Uint8 redShift;
+    Uint8 greenShift;
+    Uint8 blueShift;
+} PixelFormat;
+
+typedef struct {
+    Uint8* data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    int socket;
+    PixelFormat format;
+    size_t bytesPerPixel;
+    /* The size of a compressed pixel of ZRLE and the shift of its value in a pixel. */
+    size_t cPixelSize;
+    int cPixelShift;
+    int encoding;
+    Bool updateRequested;
+    Bool hasDamage;
+    SDL_Rect damage;
+    /* The performance counter value when the damage was first recorded. */
+    Uint64 damageTime;
+    Uint8 buttonMask;
+    int pointerX;
+    int pointerY;
+    /* ZRLE uses one zlib stream for the whole connection. */
+    Bool zlibInitialized;
+    z_stream zlib;
+    /* Tight uses one zlib stream per kind of data for the whole connection. */
+    Bool tightInitialized;
+    z_stream tightStreams[RFB_TIGHT_NUM_STREAMS];
+    /* Whether Tight pixels are sent as three bytes of red, green and blue. */
+    Bool tightPixels24;
+} RfbClient;
+
+static Uint32 remoteInputEventType = (Uint32) -1;
+static const PixelFormat SERVER_PIXEL_FORMAT = {32, 24, False, True, 255, 255, 255, 0, 8, 16};
+
+static SDL_Thread* serverThread = NULL;
+static int listenSocket = -1;
+/* An eventfd to wake the server thread when the framebuffer changed or the server stops. */
+static int wakeFd = -1;
+static SDL_atomic_t stopRequested;
+static SDL_mutex* damageLock = NULL;
+static Bool hasPendingDamage = False;
+static SDL_Rect pendingDamage;
+static Uint64 pendingDamageTime = 0;
+/* The following are only accessed by the server thread. */
+static Buffer output = {NULL, 0, 0};
+static Buffer zrleData = {NULL, 0, 0};
+static Buffer tightData = {NULL, 0, 0};
+static Buffer compressedData = {NULL, 0, 0};
+static Uint32* pixels = NULL;
+static size_t pixelsCapacity = 0;
+static struct {
+    Uint64 updates;
+    Uint64 pixels;
+    Uint64 bytes;
+    Uint64 encodeTicks;
+    Uint64 latencyTicks;
+    Uint64 maxLatencyTicks;
+} statistics;
+
+static Uint8* appendToBuffer(Buffer* buffer, size_t size) {
+    if (buffer->length + size > buffer->capacity) {
+        size_t capacity = MAX(buffer->capacity * 2, buffer->length + size);
+        Uint8* data = realloc(buffer->data, capacity);
+        if (data == NULL) {
+            LOG("Out of memory: Failed to grow the RFB buffer to %lu bytes!\n",
+                (unsigned long) capacity);
+            return NULL;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    Uint8* result = buffer->data + buffer->length;
+    buffer->length += size;
+    return result;
+}
+
+static void writeU16(Uint8* data, Uint16 value) {
+    data[0] = (Uint8) (value >> 8);
+    data[1] = (Uint8) value;
+}
+
+static void writeU32(Uint8* data, Uint32 value) {
+    data[0] = (Uint8) (value >> 24);
+    data[1] = (Uint8) (value >> 16);
+    data[2] = (Uint8) (value >> 8);
+    data[3] = (Uint8) value;
+}
+
+static Uint16 readU16(const Uint8* data) {
+    return (Uint16) (data[0] << 8 | data[1]);
+}
+
+static Uint32 readU32(const Uint8* data) {
+    return (Uint32) data[0] << 24 | (Uint32) data[1] << 16 | (Uint32) data[2] << 8 | data[3];
+}
+
+/*
+ * Write the lowest size bytes of the value in the byte order of the pixel format.
+ */
+static void writePixelValue(Uint8* data, Uint32 value, size_t size, Bool bigEndian) {
+    size_t i;
+    for (i = 0; i < size; i++) {
+        data[bigEndian ? size - 1 - i : i] = (Uint8) (value >> (8 * i));
+    }
+}
+
+static void writePixelFormat(Uint8* data, const PixelFormat* format) {
+    memset(data, 0, 16);
+    data[0] = format->bitsPerPixel;
+    data[1] = format->depth;
+    data[2] = (Uint8) format->bigEndian;
+    data[3] = (Uint8) format->trueColor;
+    writeU16(data + 4, format->redMax);
+    writeU16(data + 6, format->greenMax);
+    writeU16(data + 8, format->blueMax);
+    data[10] = format->redShift;
+    data[11] = format->greenShift;
+    data[12] = format->blueShift;
+}
+
+static Bool setPixelFormat(RfbClient* client, const Uint8* data) {
+    PixelFormat format;
+    format.bitsPerPixel = data[0];
+    format.depth = data[1];
+    format.bigEndian = data[2] != 0;
+    format.trueColor = data[3] != 0;
+    format.redMax = readU16(data + 4);
+    format.greenMax = readU16(data + 6);
+    format.blueMax = readU16(data + 8);
+    format.redShift = data[10];
+    format.greenShift = data[11];
+    format.blueShift = data[12];
+    if (!format.trueColor || (format.bitsPerPixel != 8 && format.bitsPerPixel != 16
+                              && format.bitsPerPixel != 32)) {
+        LOG("The RFB viewer requested an unsupported pixel format (%d bpp, true color %d)\n",
+            format.bitsPerPixel, format.trueColor);
+        return False;
+    }
+    client->format = format;
+    client->bytesPerPixel = format.bitsPerPixel / 8;
+    client->cPixelSize = client->bytesPerPixel;
+    client->cPixelShift = 0;
+    client->tightPixels24 = format.bitsPerPixel == 32 && format.depth == 24
+                            && format.redMax == 255 && format.greenMax == 255
+                            && format.blueMax == 255;
+    if (format.bitsPerPixel == 32 && format.depth <= 24) {
+        // A compressed pixel omits the byte that is not used by any color channel.
+        Uint32 usedBits = (Uint32) format.redMax << format.redShift
+                          | (Uint32) format.greenMax << format.greenShift
+                          | (Uint32) format.blueMax << format.blueShift;
+        if ((usedBits & 0xFF000000) == 0) {
+            client->cPixelSize = 3;
+        } else if ((usedBits & 0x000000FF) == 0) {
+            client->cPixelSize = 3;
+            client->cPixelShift = 8;
+        }
+    }
+    return True;
+}
+
+static Bool sendAll(int socket, const void* data, size_t size) {
+    const Uint8* bytes = data;
+    while (size > 0) {
+        ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            LOG("Failed to send to the RFB viewer: %s\n", strerror(errno));
+            return False;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return True;
+}
+
+static Bool receiveAll(int socket, void* data, size_t size) {
+    Uint8* bytes = data;
+    while (size > 0) {
+        ssize_t received = recv(socket, bytes, size, 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) continue;
+            return False;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return True;
+}
+
+static void addDamage(RfbClient* client, const SDL_Rect* rect, Uint64 damageTime) {
+    const HeadlessFramebufferHeader* framebuffer = getHeadlessFramebuffer();
+    SDL_Rect screen = {0, 0, (int) framebuffer->width, (int) framebuffer->height};
+    SDL_Rect damage;
+    if (!SDL_IntersectRect(rect, &screen, &damage)) return;
+    if (client->hasDamage) {
+        SDL_UnionRect(&client->damage, &damage, &client->damage);
+        client->damageTime = MIN(client->damageTime, damageTime);
+    } else {
+        client->damage = damage;
+        client->damageTime = damageTime;
+        client->hasDamage = True;
+    }
+}
+
+/*
+ * Called on the thread that executes the display list after the framebuffer was updated.
+ */
+static void onFramebufferDamage(const SDL_Rect* damage, Uint64 damageTime) {
+    SDL_LockMutex(damageLock);
+    if (hasPendingDamage) {
+        SDL_UnionRect(&pendingDamage, damage, &pendingDamage);
+    } else {
+        pendingDamage = *damage;
+        pendingDamageTime = damageTime;
+        hasPendingDamage = True;
+    }
+    SDL_UnlockMutex(damageLock);
+    uint64_t count = 1;
+    if (write(wakeFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        LOG("Failed to wake the RFB server: %s\n", strerror(errno));
+    }
+}
+
+static void pushRemoteInputEvent(const RemoteInputEvent* input) {
+    RemoteInputEvent* copy = malloc(sizeof(RemoteInputEvent));
+    if (copy == NULL) {
+        LOG("Out of memory: Failed to allocate a remote input event!\n");
+        return;
+    }
+    *copy = *input;
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = remoteInputEventType;
+    event.user.timestamp = SDL_GetTicks();
+    event.user.code = REMOTE_INPUT_EVENT_CODE;
+    event.user.data1 = copy;
+    if (SDL_PushEvent(&event) != 1) {
+        LOG("Failed to push a remote input event: %s\n", SDL_GetError());
+        free(copy);
+    }
+}
+
+static void handlePointerEvent(RfbClient* client, Uint8 buttonMask, int x, int y) {
+    static const Uint8 BUTTONS[] = {
+            SDL_BUTTON_LEFT, SDL_BUTTON_MIDDLE, SDL_BUTTON_RIGHT,
+            // The wheel buttons become Button4 and Button5.
+            SDL_BUTTON_X1, SDL_BUTTON_X2,
+    };
+    RemoteInputEvent input;
+    size_t i;
+    input.x = x;
+    input.y = y;
+    if (x != client->pointerX || y != client->pointerY) {
+        input.type = REMOTE_POINTER_MOTION;
+        pushRemoteInputEvent(&input);
+        client->pointerX = x;
+        client->pointerY = y;
+    }
+    for (i = 0; i < sizeof(BUTTONS) / sizeof(BUTTONS[0]); i++) {
+        if (((buttonMask ^ client->buttonMask) & (1 << i)) == 0) continue;
+        input.type = REMOTE_POINTER_BUTTON;
+        input.button = BUTTONS[i];
+        input.pressed = (buttonMask & (1 << i)) != 0;
+        pushRemoteInputEvent(&input);
+    }
+    client->buttonMask = buttonMask;
+}
+
+/*
+ * Convert the pixels of the rectangle of the framebuffer into the pixel format of the viewer.
+ * A rectangle that is read while the framebuffer is updated may contain parts of two frames,
+ * but the damage of the update will cause the rectangle to be sent again.
+ */
+static Bool readFramebufferPixels(const RfbClient* client, const SDL_Rect* rect) {
+    const HeadlessFramebufferHeader* framebuffer = getHeadlessFramebuffer();
+    size_t size = (size_t) rect->w * rect->h;
+    int x, y;
+    if (size > pixelsCapacity) {
+        Uint32* buffer = realloc(pixels, size * sizeof(Uint32));
+        if (buffer == NULL) {
+            LOG("Out of memory: Failed to grow the RFB pixel buffer!\n");
+            return False;
+        }
+        pixels = buffer;
+        pixelsCapacity = size;
+    }
+    SDL_MemoryBarrierAcquire();
+    const Uint8* framebufferPixels = (const Uint8*) framebuffer + HEADLESS_FRAMEBUFFER_PIXELS_OFFSET;
+    const PixelFormat* format = &client->format;
+    Uint32* pixel = pixels;
+    for (y = rect->y; y < rect->y + rect->h; y++) {
+        const Uint8* rgba = framebufferPixels + (size_t) y * framebuffer->stride + rect->x * 4;
+        for (x = 0; x < rect->w; x++, rgba += 4) {
+            *pixel++ = (Uint32) (rgba[0] * format->redMax + 127) / 255 << format->redShift
+                       | (Uint32) (rgba[1] * format->greenMax + 127) / 255 << format->greenShift
+                       | (Uint32) (rgba[2] * format->blueMax + 127) / 255 << format->blueShift;
+        }
+    }
+    return True;
+}
+
+/*
+ * Compress the data with the zlib stream and append the result to the destination buffer.
+ */
+static Bool compressIntoBuffer(z_stream* zlib, const Buffer* data, Buffer* destination) {
+    zlib->next_in = data->data;
+    zlib->avail_in = (uInt) data->length;
+    do {
+        size_t chunkSize = deflateBound(zlib, zlib->avail_in) + 64;
+        Uint8* chunk = appendToBuffer(destination, chunkSize);
+        if (chunk == NULL) return False;
+        zlib->next_out = chunk;
+        zlib->avail_out = (uInt) chunkSize;
+        if (deflate(zlib, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+            LOG("Failed to compress the RFB data: %s\n", zlib->msg);
+            return False;
+        }
+        destination->length -= zlib->avail_out;
+    } while (zlib->avail_out == 0);
+    return True;
+}
+
+static Bool appendRectangleHeader(const SDL_Rect* rect, Sint32 encoding) {
+    Uint8* header = appendToBuffer(&output, 12);
+    if (header == NULL) return False;
+    writeU16(header, (Uint16) rect->x);
+    writeU16(header + 2, (Uint16) rect->y);
+    writeU16(header + 4, (Uint16) rect->w);
+    writeU16(header + 6, (Uint16) rect->h);
+    writeU32(header + 8, (Uint32) encoding);
+    return True;
+}
+
+static Bool encodeRaw(const RfbClient* client, const SDL_Rect* rect) {
+    size_t i, count = (size_t) rect->w * rect->h;
+    Uint8* data = appendToBuffer(&output, count * client->bytesPerPixel);
+    if (data == NULL) return False;
+    for (i = 0; i < count; i++, data += client->bytesPerPixel) {
+        writePixelValue(data, pixels[i], client->bytesPerPixel, client->format.bigEndian);
+    }
+    return True;
+}
+
+static Bool appendCPixel(const RfbClient* client, Uint32 pixel) {
+    Uint8* data = appendToBuffer(&zrleData, client->cPixelSize);
+    if (data == NULL) return False;
+    writePixelValue(data, pixel >> client->cPixelShift, client->cPixelSize,
+                    client->format.bigEndian);
+    return True;
+}
+
+/*
+ * Encode one ZRLE tile as a solid color, a packed palette, plain RLE or raw pixels,
+ * whichever is the smallest.
+ */
+static Bool encodeZrleTile(const RfbClient* client, const Uint32* tile, int stride,
+                           int width, int height) {
+    Uint32 palette[RFB_ZRLE_MAX_PALETTE_SIZE];
+    size_t paletteSize = 0, numRuns = 0, runBytes = 0, runLength = 0, i;
+    int x, y;
+    Uint32 previous = tile[0];
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            Uint32 pixel = tile[y * stride + x];
+            if (pixel != previous || runLength == 0) {
+                if (runLength > 0) {
+                    runBytes += (runLength - 1) / 255 + 1;
+                }
+                numRuns++;
+                runLength = 0;
+                previous = pixel;
+            }
+            runLength++;
+            if (paletteSize > RFB_ZRLE_MAX_PALETTE_SIZE) continue;
+            for (i = 0; i < paletteSize && palette[i] != pixel; i++);
+            if (i == paletteSize) {
+                if (paletteSize < RFB_ZRLE_MAX_PALETTE_SIZE) {
+                    palette[i] = pixel;
+                }
+                paletteSize++;
+            }
+        }
+    }
+    runBytes += (runLength - 1) / 255 + 1;
+    Uint8* data;
+    if (paletteSize == 1) {
+        if ((data = appendToBuffer(&zrleData, 1)) == NULL) return False;
+        *data = 1;
+        return appendCPixel(client, palette[0]);
+    }
+    size_t rawSize = (size_t) width * height * client->cPixelSize;
+    size_t rleSize = numRuns * client->cPixelSize + runBytes;
+    if (paletteSize <= RFB_ZRLE_MAX_PALETTE_SIZE) {
+        int bits = paletteSize == 2 ? 1 : paletteSize <= 4 ? 2 : 4;
+        size_t rowSize = ((size_t) width * bits + 7) / 8;
+        if (paletteSize * client->cPixelSize + rowSize * height <= MIN(rawSize, rleSize)) {
+            if ((data = appendToBuffer(&zrleData, 1)) == NULL) return False;
+            *data = (Uint8) paletteSize;
+            for (i = 0; i < paletteSize; i++) {
+                if (!appendCPixel(client, palette[i])) return False;
+            }
+            if ((data = appendToBuffer(&zrleData, rowSize * height)) == NULL) return False;
+            memset(data, 0, rowSize * height);
+            for (y = 0; y < height; y++, data += rowSize) {
+                for (x = 0; x < width; x++) {
+                    Uint32 pixel = tile[y * stride + x];
+                    for (i = 0; palette[i] != pixel; i++);
+                    int bit = x * bits;
+                    data[bit / 8] |= (Uint8) (i << (8 - bits - bit % 8));
+                }
+            }
+            return True;
+        }
+    }
+    if (rleSize < rawSize) {
+        if ((data = appendToBuffer(&zrleData, 1)) == NULL) return False;
+        *data = 128;
+        runLength = 0;
+        previous = tile[0];
+        for (y = 0; y <= height; y++) {
+            for (x = 0; x < width; x++) {
+                Uint32 pixel = y < height ? tile[y * stride + x] : ~previous;
+                if (pixel == previous) {
+                    runLength++;
+                    continue;
+                }
+                if (!appendCPixel(client, previous)) return False;
+                if ((data = appendToBuffer(&zrleData, (runLength - 1) / 255 + 1)) == NULL) {
+                    return False;
+                }
+                // The run length minus one is encoded as a sequence of 255 and the remainder.
+                for (runLength--; runLength >= 255; runLength -= 255) {
+                    *data++ = 255;
+                }
+                *data = (Uint8) runLength;
+                previous = pixel;
+                runLength = 1;
+                if (y == height) break;
+            }
+        }
+        return True;
+    }
+    if ((data = appendToBuffer(&zrleData, 1)) == NULL) return False;
+    *data = 0;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            if (!appendCPixel(client, tile[y * stride + x])) return False;
+        }
+    }
+    return True;
+}
+
+static Bool encodeZrle(RfbClient* client, const SDL_Rect* rect) {
+    int x, y;
+    zrleData.length = 0;
+    for (y = 0; y < rect->h; y += RFB_ZRLE_TILE_SIZE) {
+        for (x = 0; x < rect->w; x += RFB_ZRLE_TILE_SIZE) {
+            if (!encodeZrleTile(client, &pixels[y * rect->w + x], rect->w,
+                                MIN(RFB_ZRLE_TILE_SIZE, rect->w - x),
+                                MIN(RFB_ZRLE_TILE_SIZE, rect->h - y))) {
+                return False;
+            }
+        }
+    }
+    size_t lengthOffset = output.length;
+    if (appendToBuffer(&output, 4) == NULL) return False;
+    if (!compressIntoBuffer(&client->zlib, &zrleData, &output)) return False;
+    writeU32(output.data + lengthOffset, (Uint32) (output.length - lengthOffset - 4));
+    return True;
+}
+
+/*
+ * Write a Tight pixel, which omits the unused byte of 24 bit colors.
+ */
+static void writeTightPixel(const RfbClient* client, Uint8* data, Uint32 pixel) {
+    if (client->tightPixels24) {
+        data[0] = (Uint8) (pixel >> client->format.redShift);
+        data[1] = (Uint8) (pixel >> client->format.greenShift);
+        data[2] = (Uint8) (pixel >> client->format.blueShift);
+    } else {
+        writePixelValue(data, pixel, client->bytesPerPixel, client->format.bigEndian);
+    }
+}
+
+/*
+ * Append the Tight data of a rectangle, compressed with the zlib stream unless it is tiny.
+ * The length of the compressed data is prefixed in the compact representation of Tight.
+ */
+static Bool appendTightData(RfbClient* client, int stream) {
+    if (tightData.length < RFB_TIGHT_MIN_TO_COMPRESS) {
+        Uint8* data = appendToBuffer(&output, tightData.length);
+        if (data == NULL) return False;
+        memcpy(data, tightData.data, tightData.length);
+        return True;
+    }
+    compressedData.length = 0;
+    if (!compressIntoBuffer(&client->tightStreams[stream], &tightData, &compressedData)) {
+        return False;
+    }
+    size_t length = compressedData.length;
+    size_t lengthSize = length < 0x80 ? 1 : length < 0x4000 ? 2 : 3;
+    Uint8* data = appendToBuffer(&output, lengthSize + length);
+    if (data == NULL) return False;
+    // Seven bits per byte, the high bit marks that another byte follows.
+    data[0] = (Uint8) ((length & 0x7F) | (lengthSize > 1 ? 0x80 : 0));
+    if (lengthSize > 1) {
+        data[1] = (Uint8) (((length >> 7) & 0x7F) | (lengthSize > 2 ? 0x80 : 0));
+    }
+    if (lengthSize > 2) {
+        data[2] = (Uint8) (length >> 14);
+    }
+    memcpy(data + lengthSize, compressedData.data, length);
+    return True;
+}
+
+/*
+ * Collect the colors of the rectangle into the palette. Returns the number of colors, or
+ * RFB_TIGHT_MAX_PALETTE_SIZE + 1 if there are more than fit into the palette. The hash table
+ * maps the colors to their palette index plus one.
+ */
+static size_t collectTightPalette(const Uint32* rectPixels, int stride, int width, int height,
+                                  Uint32* palette, Uint32* hashColors, Uint16* hashIndices) {
+    size_t paletteSize = 0;
+    int x, y;
+    memset(hashIndices, 0, RFB_TIGHT_PALETTE_HASH_SIZE * sizeof(Uint16));
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            Uint32 pixel = rectPixels[y * stride + x];
+            size_t slot = (pixel * 2654435761u) >> 22 & (RFB_TIGHT_PALETTE_HASH_SIZE - 1);
+            while (hashIndices[slot] != 0 && hashColors[slot] != pixel) {
+                slot = (slot + 1) & (RFB_TIGHT_PALETTE_HASH_SIZE - 1);
+            }
+            if (hashIndices[slot] != 0) continue;
+            if (paletteSize == RFB_TIGHT_MAX_PALETTE_SIZE) return paletteSize + 1;
+            palette[paletteSize++] = pixel;
+            hashColors[slot] = pixel;
+            hashIndices[slot] = (Uint16) paletteSize;
+        }
+    }
+    return paletteSize;
+}
+
+static Uint16 findTightPaletteIndex(Uint32 pixel, const Uint32* hashColors,
+                                    const Uint16* hashIndices) {
+    size_t slot = (pixel * 2654435761u) >> 22 & (RFB_TIGHT_PALETTE_HASH_SIZE - 1);
+    while (hashColors[slot] != pixel || hashIndices[slot] == 0) {
+        slot = (slot + 1) & (RFB_TIGHT_PALETTE_HASH_SIZE - 1);
+    }
+    return (Uint16) (hashIndices[slot] - 1);
+}
+
+/*
+ * Encode one Tight rectangle as a fill, with a palette of two colors as a bitmap, with a
+ * palette of up to 256 colors as indices, or as full color pixels.
+ */
+static Bool encodeTightRect(RfbClient* client, const Uint32* rectPixels, int stride,
+                            int width, int height) {
+    Uint32 palette[RFB_TIGHT_MAX_PALETTE_SIZE];
+    Uint32 hashColors[RFB_TIGHT_PALETTE_HASH_SIZE];
+    Uint16 hashIndices[RFB_TIGHT_PALETTE_HASH_SIZE];
+    size_t pixelSize = client->tightPixels24 ? 3 : client->bytesPerPixel, i;
+    size_t count = (size_t) width * height;
+    int x, y;
+    size_t paletteSize = collectTightPalette(rectPixels, stride, width, height,
+                                             palette, hashColors, hashIndices);
+    Uint8* data;
+    if (paletteSize == 1) {
+        if ((data = appendToBuffer(&output, 1 + pixelSize)) == NULL) return False;
+        data[0] = RFB_TIGHT_FILL;
+        writeTightPixel(client, data + 1, palette[0]);
+        return True;
+    }
+    tightData.length = 0;
+    // A palette only pays off if the indices are much smaller than the pixels.
+    if (paletteSize == 2 || (paletteSize <= RFB_TIGHT_MAX_PALETTE_SIZE
+                             && paletteSize * 4 <= count && pixelSize > 1)) {
+        int stream = paletteSize == 2 ? RFB_TIGHT_STREAM_MONO : RFB_TIGHT_STREAM_INDEXED;
+        if ((data = appendToBuffer(&output, 3 + paletteSize * pixelSize)) == NULL) return False;
+        data[0] = (Uint8) (stream << 4 | RFB_TIGHT_EXPLICIT_FILTER);
+        data[1] = RFB_TIGHT_FILTER_PALETTE;
+        data[2] = (Uint8) (paletteSize - 1);
+        for (i = 0; i < paletteSize; i++) {
+            writeTightPixel(client, data + 3 + i * pixelSize, palette[i]);
+        }
+        if (paletteSize == 2) {
+            // One bit per pixel, the rows are padded to whole bytes.
+            size_t rowSize = ((size_t) width + 7) / 8;
+            if ((data = appendToBuffer(&tightData, rowSize * height)) == NULL) return False;
+            memset(data, 0, rowSize * height);
+            for (y = 0; y < height; y++, data += rowSize) {
+                for (x = 0; x < width; x++) {
+                    if (rectPixels[y * stride + x] == palette[1]) {
+                        data[x / 8] |= (Uint8) (0x80 >> (x % 8));
+                    }
+                }
+            }
+        } else {
+            if ((data = appendToBuffer(&tightData, count)) == NULL) return False;
+            for (y = 0; y < height; y++) {
+                for (x = 0; x < width; x++) {
+                    *data++ = (Uint8) findTightPaletteIndex(rectPixels[y * stride + x],
+                                                            hashColors, hashIndices);
+                }
+            }
+        }
+        return appendTightData(client, stream);
+    }
+    if ((data = appendToBuffer(&output, 1)) == NULL) return False;
+    data[0] = RFB_TIGHT_STREAM_FULL_COLOR << 4;
+    if ((data = appendToBuffer(&tightData, count * pixelSize)) == NULL) return False;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++, data += pixelSize) {
+            writeTightPixel(client, data, rectPixels[y * stride + x]);
+        }
+    }
+    return appendTightData(client, RFB_TIGHT_STREAM_FULL_COLOR);
+}
+
+/*
+ * Encode the rectangle as Tight rectangles that respect the size limits of Tight.
+ * Returns the number of rectangles, or 0 on failure.
+ */
+static size_t encodeTight(RfbClient* client, const SDL_Rect* rect) {
+    int width = MIN(rect->w, RFB_TIGHT_MAX_RECT_WIDTH);
+    int height = MAX(1, MIN(rect->h, RFB_TIGHT_MAX_RECT_AREA / width));
+    size_t numRects = 0;
+    int x, y;
+    for (y = 0; y < rect->h; y += height) {
+        for (x = 0; x < rect->w; x += width) {
+            SDL_Rect part = {rect->x + x, rect->y + y, MIN(width, rect->w - x),
+                             MIN(height, rect->h - y)};
+            if (!appendRectangleHeader(&part, RFB_ENCODING_TIGHT)
+                || !encodeTightRect(client, &pixels[y * rect->w + x], rect->w,
+                                    part.w, part.h)) {
+                return 0;
+            }
+            numRects++;
+        }
+    }
+    return numRects;
+}
+
+static void logStatistics() {
+    if (statistics.updates == 0) return;
+    double frequency = (double) SDL_GetPerformanceFrequency();
+    LOG("RFB: %lu updates, encoding %.1f Mpixel/s at %.2f bytes/pixel, "
+        "damage to wire latency %.2f ms average, %.2f ms max\n",
+        (unsigned long) statistics.updates,
+        statistics.encodeTicks == 0 ? 0.0 :
+        statistics.pixels / (statistics.encodeTicks / frequency) / 1000000.0,
+        (double) statistics.bytes / statistics.pixels,
+        statistics.latencyTicks * 1000.0 / frequency / statistics.updates,
+        statistics.maxLatencyTicks * 1000.0 / frequency);
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+static Bool sendFramebufferUpdate(RfbClient* client) {
+    SDL_Rect rect = client->damage;
+    Uint64 start = SDL_GetPerformanceCounter();
+    client->hasDamage = False;
+    client->updateRequested = False;
+    if (!readFramebufferPixels(client, &rect)) return False;
+    output.length = 0;
+    Uint8* header = appendToBuffer(&output, 4);
+    if (header == NULL) return False;
+    header[0] = RFB_FRAMEBUFFER_UPDATE;
+    header[1] = 0;
+    size_t numRects = 1;
+    if (client->encoding == RFB_ENCODING_TIGHT) {
+        numRects = encodeTight(client, &rect);
+        if (numRects == 0) return False;
+    } else if (!appendRectangleHeader(&rect, client->encoding)
+               || !(client->encoding == RFB_ENCODING_ZRLE ? encodeZrle(client, &rect)
+                                                          : encodeRaw(client, &rect))) {
+        return False;
+    }
+    // The output buffer might have been moved while encoding.
+    writeU16(output.data + 2, (Uint16) numRects);
+    Uint64 encoded = SDL_GetPerformanceCounter();
+    if (!sendAll(client->socket, output.data, output.length)) return False;
+    Uint64 latency = SDL_GetPerformanceCounter() - client->damageTime;
+    statistics.updates++;
+    statistics.pixels += (Uint64) rect.w * rect.h;
+    statistics.bytes += output.length;
+    statistics.encodeTicks += encoded - start;
+    statistics.latencyTicks += latency;
+    statistics.maxLatencyTicks = MAX(statistics.maxLatencyTicks, latency);
+    if (statistics.updates == RFB_STATISTICS_INTERVAL) {
+        logStatistics();
+    }
+    return True;
+}
+
+static void freeTightStreams(RfbClient* client, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        deflateEnd(&client->tightStreams[i]);
+    }
+    client->tightInitialized = False;
+}
+
+static Bool initTightStreams(RfbClient* client) {
+    size_t i;
+    for (i = 0; i < RFB_TIGHT_NUM_STREAMS; i++) {
+        memset(&client->tightStreams[i], 0, sizeof(z_stream));
+        // The viewer is local, so the speed is more important than the ratio.
+        if (deflateInit(&client->tightStreams[i], Z_BEST_SPEED) != Z_OK) {
+            LOG("Failed to initialize zlib for Tight: %s\n", client->tightStreams[i].msg);
+            freeTightStreams(client, i);
+            return False;
+        }
+    }
+    client->tightInitialized = True;
+    return True;
+}
+
+static Bool setEncodings(RfbClient* client, size_t count) {
+    Uint8 data[4];
+    Bool chosen = False;
+    for (; count > 0; count--) {
+        if (!receiveAll(client->socket, data, sizeof(data))) return False;
+        Sint32 encoding = (Sint32) readU32(data);
+        // The encodings are sorted by the preference of the viewer.
+        if (chosen || (encoding != RFB_ENCODING_RAW && encoding != RFB_ENCODING_ZRLE
+                       && encoding != RFB_ENCODING_TIGHT)) {
+            continue;
+        }
+        chosen = True;
+        if (encoding == RFB_ENCODING_ZRLE && !client->zlibInitialized) {
+            memset(&client->zlib, 0, sizeof(z_stream));
+            // The viewer is local, so the speed is more important than the ratio.
+            if (deflateInit(&client->zlib, Z_BEST_SPEED) != Z_OK) {
+                LOG("Failed to initialize zlib for ZRLE: %s\n", client->zlib.msg);
+                continue;
+            }
+            client->zlibInitialized = True;
+        }
+        if (encoding == RFB_ENCODING_TIGHT && !client->tightInitialized) {
+            if (!initTightStreams(client)) continue;
+        }
+        client->encoding = encoding;
+    }
+    if (!chosen) {
+        client->encoding = RFB_ENCODING_RAW;
+    }
+    LOG("RFB viewer uses the %s encoding\n", client->encoding == RFB_ENCODING_ZRLE ? "ZRLE"
+        : client->encoding == RFB_ENCODING_TIGHT ? "Tight" : "Raw");
+    return True;
+}
+
+/*
+ * Receive and handle one message of the viewer. Returns False if the viewer must be disconnected.
+ */
+static Bool handleClientMessage(RfbClient* client) {
+    Uint8 data[20];
+    if (!receiveAll(client->socket, data, 1)) return False;
+    switch (data[0]) {
+        case RFB_SET_PIXEL_FORMAT:
+            if (!receiveAll(client->socket, data, 19)) return False;
+            return setPixelFormat(client, data + 3);
+        case RFB_SET_ENCODINGS:
+            if (!receiveAll(client->socket, data, 3)) return False;
+            return setEncodings(client, readU16(data + 1));
+        case RFB_FRAMEBUFFER_UPDATE_REQUEST:
+            if (!receiveAll(client->socket, data, 9)) return False;
+            if (!data[0]) {
+                SDL_Rect rect = {readU16(data + 1), readU16(data + 3),
+                                 readU16(data + 5), readU16(data + 7)};
+                addDamage(client, &rect, SDL_GetPerformanceCounter());
+            }
+            client->updateRequested = True;
+            return True;
+        case RFB_KEY_EVENT: {
+            if (!receiveAll(client->socket, data, 7)) return False;
+            RemoteInputEvent input;
+            input.type = REMOTE_KEY;
+            input.pressed = data[0] != 0;
+            input.keysym = readU32(data + 3);
+            pushRemoteInputEvent(&input);
+            return True;
+        }
+        case RFB_POINTER_EVENT:
+            if (!receiveAll(client->socket, data, 5)) return False;
+            handlePointerEvent(client, data[0], readU16(data + 1), readU16(data + 3));
+            return True;
+        case RFB_CLIENT_CUT_TEXT: {
+            if (!receiveAll(client->socket, data, 7)) return False;
+            Uint32 length = readU32(data + 3);
+            while (length > 0) {
+                size_t size = MIN(length, sizeof(data));
+                if (!receiveAll(client->socket, data, size)) return False;
+                length -= size;
+            }
+            return True;
+        }
+        default:
+            LOG("Got unknown message %d from the RFB viewer\n", data[0]);
+            return False;
+    }
+}
+
+static Bool performHandshake(RfbClient* client) {
+    const HeadlessFramebufferHeader* framebuffer = getHeadlessFramebuffer();
+    char version[RFB_PROTOCOL_VERSION_LENGTH + 1];
+    Uint8 data[24 + sizeof(RFB_SERVER_NAME) - 1];
+    if (!sendAll(client->socket, RFB_PROTOCOL_VERSION, RFB_PROTOCOL_VERSION_LENGTH)
+        || !receiveAll(client->socket, version, RFB_PROTOCOL_VERSION_LENGTH)) return False;
+    version[RFB_PROTOCOL_VERSION_LENGTH] = '\0';
+    if (strncmp(version, "RFB 003.", 8) != 0) {
+        LOG("The RFB viewer uses an unsupported protocol: %s\n", version);
+        return False;
+    }
+    int minorVersion = atoi(version + 8);
+    if (minorVersion < 7) {
+        // In version 3.3 the server decides the security type.
+        writeU32(data, RFB_SECURITY_NONE);
+        if (!sendAll(client->socket, data, 4)) return False;
+    } else {
+        data[0] = 1;
+        data[1] = RFB_SECURITY_NONE;
+        if (!sendAll(client->socket, data, 2) || !receiveAll(client->socket, data, 1)) {
+            return False;
+        }
+        if (data[0] != RFB_SECURITY_NONE) {
+            LOG("The RFB viewer chose the unsupported security type %d\n", data[0]);
+            return False;
+        }
+        if (minorVersion >= 8) {
+            writeU32(data, 0);
+            if (!sendAll(client->socket, data, 4)) return False;
+        }
+    }
+    // The shared flag is ignored, there is only one viewer at a time.
+    if (!receiveAll(client->socket, data, 1)) return False;
+    writeU16(data, (Uint16) framebuffer->width);
+    writeU16(data + 2, (Uint16) framebuffer->height);
+    writePixelFormat(data + 4, &SERVER_PIXEL_FORMAT);
+    writeU32(data + 20, sizeof(RFB_SERVER_NAME) - 1);
+    memcpy(data + 24, RFB_SERVER_NAME, sizeof(RFB_SERVER_NAME) - 1);
+    if (!sendAll(client->socket, data, sizeof(data))) return False;
+    writePixelFormat(data, &SERVER_PIXEL_FORMAT);
+    return setPixelFormat(client, data);
+}
+
+static void disconnectClient(RfbClient* client) {
+    LOG("RFB viewer disconnected\n");
+    close(client->socket);
+    client->socket = -1;
+    if (client->zlibInitialized) {
+        deflateEnd(&client->zlib);
+        client->zlibInitialized = False;
+    }
+    if (client->tightInitialized) {
+        freeTightStreams(client, RFB_TIGHT_NUM_STREAMS);
+    }
+    logStatistics();
+}
+
+static void acceptClient(RfbClient* client) {
+    int clientSocket = accept(listenSocket, NULL, NULL);
+    if (clientSocket == -1) {
+        LOG("Failed to accept an RFB viewer: %s\n", strerror(errno));
+        return;
+    }
+    if (client->socket != -1) {
+        LOG("Rejecting an RFB viewer, only one viewer is supported\n");
+        close(clientSocket);
+        return;
+    }
+    int noDelay = 1;
+    struct timeval timeout = {RFB_RECEIVE_TIMEOUT_SECONDS, 0};
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    memset(client, 0, sizeof(RfbClient));
+    client->socket = clientSocket;
+    client->encoding = RFB_ENCODING_RAW;
+    if (!performHandshake(client)) {
+        LOG("The handshake with the RFB viewer failed\n");
+        close(clientSocket);
+        client->socket = -1;
+        return;
+    }
+    LOG("RFB viewer connected\n");
+    const HeadlessFramebufferHeader* framebuffer = getHeadlessFramebuffer();
+    SDL_Rect screen = {0, 0, (int) framebuffer->width, (int) framebuffer->height};
+    addDamage(client, &screen, SDL_GetPerformanceCounter());
+}
+
+static int rfbServerMain(void* data) {
+    RfbClient client;
+    (void) data;
+    client.socket = -1;
+    while (!SDL_AtomicGet(&stopRequested)) {
+        struct pollfd fds[3] = {
+                {listenSocket, POLLIN, 0},
+                {wakeFd, POLLIN, 0},
+                {client.socket, POLLIN, 0},
+        };
+        if (poll(fds, 3, -1) == -1) {
+            if (errno == EINTR) continue;
+            LOG("Polling in the RFB server failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            if (read(wakeFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                LOG("Failed to read the RFB server wake fd: %s\n", strerror(errno));
+            }
+            SDL_LockMutex(damageLock);
+            if (hasPendingDamage && client.socket != -1) {
+                addDamage(&client, &pendingDamage, pendingDamageTime);
+            }
+            hasPendingDamage = False;
+            SDL_UnlockMutex(damageLock);
+        }
+        if (fds[0].revents & POLLIN) {
+            acceptClient(&client);
+        }
+        if (client.socket == -1) continue;
+        if (fds[2].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!handleClientMessage(&client)) {
+                disconnectClient(&client);
+                continue;
+            }
+        }
+        if (client.updateRequested && client.hasDamage && !sendFramebufferUpdate(&client)) {
+            disconnectClient(&client);
+        }
+    }
+    if (client.socket != -1) {
+        disconnectClient(&client);
+    }
+    return 0;
+}
+
+#endif /* RFB_SERVER_SUPPORTED */
+
+/*
+ * Start the RFB server on the loopback interface if a port is given via the environment.
+ * Returns False if the server was requested but could not be started.
+ */
+Bool initRfbServer() {
+    const char* value = getenv(RFB_PORT_ENV_VARIABLE);
+    if (value == NULL) return True;
+#ifdef RFB_SERVER_SUPPORTED
+    if (serverThread != NULL) return True;
+    char* end;
+    long port = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || port <= 0 || port > 65535) {
+        LOG("Invalid RFB server port '%s'\n", value);
+        return False;
+    }
+    if (!exportFramebuffer()) return False;
+    if (remoteInputEventType == (Uint32) -1) {
+        remoteInputEventType = SDL_RegisterEvents(1);
+        if (remoteInputEventType == (Uint32) -1) {
+            LOG("Failed to register the remote input event\n");
+            return False;
+        }
+    }
+    SDL_AtomicSet(&stopRequested, 0);
+    hasPendingDamage = False;
+    damageLock = SDL_CreateMutex();
+    if (damageLock == NULL) {
+        LOG("Failed to create the RFB damage lock: %s\n", SDL_GetError());
+        stopRfbServer();
+        return False;
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (wakeFd == -1 || listenSocket == -1) {
+        LOG("Failed to create the RFB server socket: %s\n", strerror(errno));
+        stopRfbServer();
+        return False;
+    }
+    int reuseAddress = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t) port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenSocket, (struct sockaddr*) &address, sizeof(address)) == -1
+        || listen(listenSocket, 1) == -1) {
+        LOG("Failed to listen on the RFB server port %ld: %s\n", port, strerror(errno));
+        stopRfbServer();
+        return False;
+    }
+    setFramebufferDamageListener(onFramebufferDamage);
+    serverThread = SDL_CreateThread(rfbServerMain, "X11 RFB server", NULL);
+    if (serverThread == NULL) {
+        LOG("Failed to start the RFB server thread: %s\n", SDL_GetError());
+        stopRfbServer();
+        return False;
+    }
+    LOG("RFB server listening on 127.0.0.1:%ld\n", port);
+    return True;
+#else
+    LOG("The RFB server is not supported on this platform\n");
+    return False;
+#endif
+}
+
+void stopRfbServer() {
+#ifdef RFB_SERVER_SUPPORTED
+    if (serverThread != NULL) {
+        setFramebufferDamageListener(NULL);
+        SDL_AtomicSet(&stopRequested, 1);
+        uint64_t count = 1;
+        if (write(wakeFd, &count, sizeof(count)) == -1) {
+            LOG("Failed to wake the RFB server: %s\n", strerror(errno));
+        }
+        SDL_WaitThread(serverThread, NULL);
+        serverThread = NULL;
+    }
+    if (listenSocket != -1) {
+        close(listenSocket);
+        listenSocket = -1;
+    }
+    if (wakeFd != -1) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+    if (damageLock != NULL) {
+        SDL_DestroyMutex(damageLock);
+        damageLock = NULL;
+    }
+    free(output.data);
+    memset(&output, 0, sizeof(output));
+    free(zrleData.data);
+    memset(&zrleData, 0, sizeof(zrleData));
+    free(tightData.data);
+    memset(&tightData, 0, sizeof(tightData));
+    free(compressedData.data);
+    memset(&compressedData, 0, sizeof(compressedData));
+    free(pixels);
+    pixels = NULL;
+    pixelsCapacity = 0;
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef _RFB_SERVER_H_
+#define _RFB_SERVER_H_
+
+#include "X11/Xlib.h"
+#include "SDL.h"
+
+/* The environment variable with the loopback port of the RFB (VNC) server, e.g. 5900. */
+#define RFB_PORT_ENV_VARIABLE "SDL2X11_RFB_PORT"
+/* The number of framebuffer updates after which the encoding statistics are logged. */
+#define RFB_STATISTICS_INTERVAL 100
+
+Bool initRfbServer(void);
+Bool convertRemoteInputEvent(SDL_Event* event);
+void stopRfbServer(void);
+
+#endif /* _RFB_SERVER_H_ */
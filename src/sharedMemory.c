@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#ifndef __ANDROID__
+#  include <sys/shm.h>
+#endif
+#include "X11/extensions/shmproto.h"
+#include "sharedMemory.h"
+#include "image.h"
+#include "errors.h"
+#include "events.h"
+#include "display.h"
+#include "resourceTypes.h"
+#include "visual.h"
+#include "util.h"
+
+/*
+ * The MIT-SHM extension. The emulated server runs in the process of the client, so a segment
+ * is used at the address the client mapped it at. XShmPutImage uploads the pixels straight from
+ * the segment if they are in the layout of the textures, and XShmGetImage converts the read
+ * back pixels directly into it. Both have finished with the segment when they return, so the
+ * completion event is sent right away.
+ * Shared pixmaps are not supported, because the textures of pixmaps can not alias the memory
+ * of a segment.
+ */
+
+/* The value of a shared memory segment resource. */
+typedef struct {
+    char* address;
+    /* Whether the segment was attached by the emulation and has to be detached again. */
+    Bool attached;
+} SharedSegment;
+
+Bool XShmQueryExtension(Display* display) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    (void) display;
+    return True;
+}
+
+int XShmGetEventBase(Display* display) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    (void) display;
+    return SHM_EVENT_BASE;
+}
+
+Bool XShmQueryVersion(Display* display, int* majorVersion, int* minorVersion,
+                      Bool* sharedPixmaps) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    SET_X_SERVER_REQUEST(display, SHM_MAJOR_OPCODE);
+    *majorVersion = SHM_MAJOR_VERSION;
+    *minorVersion = SHM_MINOR_VERSION;
+    *sharedPixmaps = False;
+    return True;
+}
+
+int XShmPixmapFormat(Display* display) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    (void) display;
+    // Shared pixmaps are not supported.
+    return 0;
+}
+
+Bool XShmAttach(Display* display, XShmSegmentInfo* shminfo) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    SET_X_SERVER_REQUEST(display, SHM_MAJOR_OPCODE);
+    SharedSegment* segment = malloc(sizeof(SharedSegment));
+    if (segment == NULL) {
+        handleOutOfMemory(0, display, 0, X_ShmAttach);
+        return False;
+    }
+    segment->address = shminfo->shmaddr;
+    segment->attached = False;
+    if (segment->address == NULL) {
+#ifndef __ANDROID__
+        void* address = shmat(shminfo->shmid, NULL, shminfo->readOnly ? SHM_RDONLY : 0);
+        if (address != (void*) -1) {
+            segment->address = address;
+            segment->attached = True;
+        }
+#endif
+        if (segment->address == NULL) {
+            LOG("BadAccess: Failed to attach the shared memory segment %d in %s!\n",
+                shminfo->shmid, __func__);
+            free(segment);
+            handleError(0, display, None, 0, BadAccess, X_ShmAttach);
+            return False;
+        }
+    }
+    XID segmentId = ALLOC_XID();
+    if (segmentId == None) {
+        LOG("Out of memory: Could not allocate XID in %s!\n", __func__);
+#ifndef __ANDROID__
+        if (segment->attached) {
+            shmdt(segment->address);
+        }
+#endif
+        free(segment);
+        handleOutOfMemory(0, display, 0, X_ShmAttach);
+        return False;
+    }
+    SET_XID_TYPE(segmentId, SHM_SEGMENT);
+    SET_XID_VALUE(segmentId, segment);
+    shminfo->shmseg = segmentId;
+    return True;
+}
+
+Bool XShmDetach(Display* display, XShmSegmentInfo* shminfo) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    SET_X_SERVER_REQUEST(display, SHM_MAJOR_OPCODE);
+    TYPE_CHECK(shminfo->shmseg, SHM_SEGMENT, display, False);
+    SharedSegment* segment = GET_XID_VALUE(shminfo->shmseg);
+#ifndef __ANDROID__
+    if (segment->attached) {
+        shmdt(segment->address);
+    }
+#endif
+    free(segment);
+    FREE_XID(shminfo->shmseg);
+    shminfo->shmseg = None;
+    return True;
+}
+
+/*
+ * Get the segment info of an image that was created by XShmCreateImage.
+ * Returns NULL and reports an error if the image is not in an attached segment.
+ */
+static XShmSegmentInfo* getImageSegment(Display* display, XImage* image, unsigned char request) {
+    XShmSegmentInfo* shminfo = (XShmSegmentInfo*) image->obdata;
+    if (shminfo == NULL) {
+        LOG("Got image %p that was not created by XShmCreateImage in request %d\n",
+            image, request);
+        return NULL;
+    }
+    if (!IS_TYPE(shminfo->shmseg, SHM_SEGMENT)) {
+        LOG("BadShmSeg: Got image %p with an unattached segment in request %d!\n",
+            image, request);
+        handleError(0, display, shminfo->shmseg, 0, SHM_ERROR_BASE + BadShmSeg, request);
+        return NULL;
+    }
+    return shminfo;
+}
+
+static int destroySharedImage(XImage* image) {
+    // The data belongs to the shared memory segment of the client.
+    free(image);
+    return 1;
+}
+
+XImage* XShmCreateImage(Display* display, Visual* visual, unsigned int depth, int format,
+                        char* data, XShmSegmentInfo* shminfo, unsigned int width,
+                        unsigned int height) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    XImage* image = XCreateImage(display, visual, depth, format, 0, data, width, height, 32, 0);
+    if (image == NULL) return NULL;
+    image->obdata = (char*) shminfo;
+    image->f.destroy_image = destroySharedImage;
+    return image;
+}
+
+Bool XShmPutImage(Display* display, Drawable d, GC gc, XImage* image, int src_x, int src_y,
+                  int dst_x, int dst_y, unsigned int src_width, unsigned int src_height,
+                  Bool send_event) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    SET_X_SERVER_REQUEST(display, SHM_MAJOR_OPCODE);
+    XShmSegmentInfo* shminfo = getImageSegment(display, image, X_ShmPutImage);
+    if (shminfo == NULL) return False;
+    if (!putImage(display, d, gc, image, src_x, src_y, dst_x, dst_y, src_width, src_height)) {
+        return False;
+    }
+    if (send_event) {
+        // Extension events are allocated with the size of any event.
+        XShmCompletionEvent* event = malloc(sizeof(XEvent));
+        if (event == NULL) {
+            handleOutOfMemory(0, display, 0, X_ShmPutImage);
+            return False;
+        }
+        event->type = SHM_EVENT_BASE + ShmCompletion;
+        event->send_event = False;
+        event->display = display;
+        event->drawable = d;
+        event->major_code = SHM_MAJOR_OPCODE;
+        event->minor_code = X_ShmPutImage;
+        event->shmseg = shminfo->shmseg;
+        event->offset = (unsigned long) (image->data - shminfo->shmaddr);
+        if (!enqueueEvent(display, d, event)) {
+            free(event);
+        }
+    }
+    return True;
+}
+
+Bool XShmGetImage(Display* display, Drawable d, XImage* image, int x, int y,
+                  unsigned long plane_mask) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    SET_X_SERVER_REQUEST(display, SHM_MAJOR_OPCODE);
+    TYPE_CHECK(d, DRAWABLE, display, False);
+    if (getImageSegment(display, image, X_ShmGetImage) == NULL) return False;
+    if (image->format != XYPixmap && image->format != ZPixmap) {
+        LOG("BadValue: Got invalid image format %d in %s!\n", image->format, __func__);
+        handleError(0, display, None, 0, BadValue, X_ShmGetImage);
+        return False;
+    }
+    return readDrawableIntoImage(display, d, x, y, (unsigned int) image->width,
+                                 (unsigned int) image->height, plane_mask, image, 0, 0);
+}
+
+Pixmap XShmCreatePixmap(Display* display, Drawable d, char* data, XShmSegmentInfo* shminfo,
+                        unsigned int width, unsigned int height, unsigned int depth) {
+    // https://www.x.org/releases/current/doc/xextproto/shm.html
+    SET_X_SERVER_REQUEST(display, SHM_MAJOR_OPCODE);
+    TYPE_CHECK(shminfo->shmseg, SHM_SEGMENT, display, None);
+    // The pixmap can not share the memory of the segment, so it gets a copy of its content.
+    LOG("Warn: %s creates a pixmap that does not follow changes of the segment\n", __func__);
+    Pixmap pixmap = XCreatePixmap(display, d, width, height, depth);
+    if (pixmap == None) return None;
+    XImage* image = XCreateImage(display, getDefaultVisual(0), depth, ZPixmap, 0, data,
+                                 width, height, 32, 0);
+    GC gc = XCreateGC(display, pixmap, 0, NULL);
+    if (image == NULL || gc == NULL) {
+        free(image);
+        if (gc != NULL) {
+            XFreeGC(display, gc);
+        }
+        XFreePixmap(display, pixmap);
+        return None;
+    }
+    Bool success = putImage(display, pixmap, gc, image, 0, 0, 0, 0, width, height);
+    free(image);
+    XFreeGC(display, gc);
+    if (!success) {
+        XFreePixmap(display, pixmap);
+        return None;
+    }
+    return pixmap;
+}
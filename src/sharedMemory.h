@@ -0,0 +1,14 @@
+#ifndef _SHARED_MEMORY_H_
+#define _SHARED_MEMORY_H_
+
+#include "X11/Xlib.h"
+#include "X11/extensions/XShm.h"
+
+/* The major opcode of the requests of the MIT-SHM extension, the first extension opcode. */
+#define SHM_MAJOR_OPCODE 128
+/* The first event code of the MIT-SHM extension. */
+#define SHM_EVENT_BASE 64
+/* The first error code of the MIT-SHM extension. */
+#define SHM_ERROR_BASE FirstExtensionError
+
+#endif /* _SHARED_MEMORY_H_ */
@@ -5,6 +5,9 @@
 #include "atoms.h"
 #include "events.h"
 #include "display.h"
+#include "headless.h"
+#include "presentScheduler.h"
+#include "pixelFormat.h"
 
 // TODO: Cover cases where top-level window is re-parented and window is converted to top-level window
 
@@ -130,6 +133,31 @@ int XSetTransientForHint(Display* display, Window window, Window prop_window) {
     return 1;
 }
 
+/*
+ * Get the target of the offscreen content of a top level window in the headless mode.
+ * The window keeps drawing into the content that it had while it was unmapped.
+ * Returns NULL on failure.
+ */
+static GPU_Target* getOffscreenWindowTarget(WindowStruct* windowStruct) {
+    Bool isNewContent = windowStruct->unmappedContent == NULL;
+    // The render thread must not use the GPU while the target is created.
+    flushDisplayList();
+    if (isNewContent) {
+        windowStruct->unmappedContent = GPU_CreateImage((Uint16) windowStruct->w,
+                                                        (Uint16) windowStruct->h,
+                                                        GPU_FORMAT_RGBA);
+        if (windowStruct->unmappedContent == NULL) return NULL;
+    }
+    if (windowStruct->renderTarget == NULL) {
+        windowStruct->renderTarget = GPU_LoadTarget(windowStruct->unmappedContent);
+        if (windowStruct->renderTarget == NULL) return NULL;
+    }
+    if (isNewContent) {
+        GPU_Clear(windowStruct->renderTarget);
+    }
+    return windowStruct->renderTarget;
+}
+
 int XMapWindow(Display* display, Window window) {
     // https://tronche.com/gui/x/xlib/window/XMapWindow.html
     SET_X_SERVER_REQUEST(display, X_MapWindow);
@@ -143,7 +171,9 @@ int XMapWindow(Display* display, Window window) {
         if (IS_MAPPED_TOP_LEVEL_WINDOW(window)) { return 1; }
         LOG("Mapping Window %lu\n", window);
         WindowStruct* windowStruct = GET_WINDOW_STRUCT(window);
-        Uint32 flags = SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN;
+        // In the headless mode the content of the window is only exported through the framebuffer,
+        // the hidden window only tracks its geometry and is never drawn on.
+        Uint32 flags = isHeadless() ? SDL_WINDOW_HIDDEN : SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN;
         if (windowStruct->borderWidth == 0) {
             flags |= SDL_WINDOW_BORDERLESS;
         }
@@ -156,29 +186,43 @@ int XMapWindow(Display* display, Window window) {
             return 0;
         }
         registerWindowMapping(window, SDL_GetWindowID(sdlWindow));
-        GPU_Target* renderTarget = GPU_CreateTargetFromWindow(SDL_GetWindowID(sdlWindow));
-        if (renderTarget == NULL) {
-            LOG("GPU_CreateTargetFromWindow failed in XMapWindow: %s\n",
-                GPU_PopErrorCode().details);
-            handleError(0, display, None, 0, BadMatch, 0);
-            return 0;
-        }
-        if (windowStruct->unmappedContent != NULL) {
+        GPU_Target* renderTarget;
+        if (isHeadless()) {
+            renderTarget = getOffscreenWindowTarget(windowStruct);
+            if (renderTarget == NULL) {
+                LOG("Failed to create the offscreen target of window %lu in XMapWindow: %s\n",
+                    window, GPU_PopErrorCode().details);
+                handleError(0, display, None, 0, BadMatch, 0);
+                return 0;
+            }
+        } else {
+            flushDisplayList();
+            renderTarget = GPU_CreateTargetFromWindow(SDL_GetWindowID(sdlWindow));
+            if (renderTarget == NULL) {
+                LOG("GPU_CreateTargetFromWindow failed in XMapWindow: %s\n",
+                    GPU_PopErrorCode().details);
+                handleError(0, display, None, 0, BadMatch, 0);
+                return 0;
+            }
+            if (windowStruct->unmappedContent != NULL) {
+                if (windowStruct->renderTarget != NULL) {
+                    GPU_Flip(windowStruct->renderTarget);
+                }
+                LOG("BLITTING in %s\n", __func__);
+                int x, y;
+                GET_WINDOW_POS(window, x, y);
+                GPU_Blit(windowStruct->unmappedContent, NULL, renderTarget,
+                         x + windowStruct->w / 2, y + windowStruct->h / 2);
+            }
             if (windowStruct->renderTarget != NULL) {
-                GPU_Flip(windowStruct->renderTarget);
+                freeClipStencil(windowStruct->renderTarget);
+                forgetPresentTarget(windowStruct->renderTarget);
+                GPU_FreeTarget(windowStruct->renderTarget);
+            }
+            if (windowStruct->unmappedContent != NULL) {
+                GPU_FreeImage(windowStruct->unmappedContent);
+                windowStruct->unmappedContent = NULL;
             }
-            LOG("BLITTING in %s\n", __func__);
-            int x, y;
-            GET_WINDOW_POS(window, x, y);
-            GPU_Blit(windowStruct->unmappedContent, NULL, renderTarget,
-                     x + windowStruct->w / 2, y + windowStruct->h / 2);
-        }
-        if (windowStruct->renderTarget != NULL) {
-            GPU_FreeTarget(windowStruct->renderTarget);
-        }
-        if (windowStruct->unmappedContent != NULL) {
-            GPU_FreeImage(windowStruct->unmappedContent);
-            windowStruct->unmappedContent = NULL;
         }
         windowStruct->renderTarget = renderTarget;
         windowStruct->sdlWindow = sdlWindow;
@@ -223,7 +267,10 @@ int XUnmapWindow(Display* display, Window window) {
     }
     WindowStruct* windowStruct = GET_WINDOW_STRUCT(window);
     if (windowStruct->mapState == UnMapped) return 1;
+    flushDisplayList();
     if (windowStruct->renderTarget != NULL) {
+        freeClipStencil(windowStruct->renderTarget);
+        forgetPresentTarget(windowStruct->renderTarget);
         GPU_FreeTarget(windowStruct->renderTarget);
         windowStruct->renderTarget = NULL;
     }
@@ -416,6 +463,37 @@ Bool XTranslateCoordinates(Display* display, Window sourceWindow, Window destina
     return True;
 }
 
+/*
+ * Create a surface from the pixels of a _NET_WM_ICON property, which are stored as
+ * straight alpha ARGB values in the lower 32 bits of each long.
+ */
+static SDL_Surface* createIconSurface(const unsigned long* pixels, unsigned long width,
+                                      unsigned long height) {
+    static const ClientPixelFormat iconFormat = {
+        PIXEL_FORMAT_ARGB8888, SDL_BYTEORDER == SDL_BIG_ENDIAN ? MSBFirst : LSBFirst,
+        False, NULL, 0
+    };
+    unsigned long x, y;
+    SDL_Surface* icon = SDL_CreateRGBSurfaceWithFormat(0, (int) width, (int) height,
+                                                       SDL_SURFACE_DEPTH, SDL_PIXELFORMAT_RGBA32);
+    Uint32* row = malloc(width * sizeof(Uint32));
+    if (icon == NULL || row == NULL) {
+        LOG("Failed to create the window icon: %s\n", SDL_GetError());
+        SDL_FreeSurface(icon);
+        free(row);
+        return NULL;
+    }
+    for (y = 0; y < height; y++, pixels += width) {
+        for (x = 0; x < width; x++) {
+            row[x] = (Uint32) pixels[x];
+        }
+        convertPixelsToRGBA(&iconFormat, (const Uint8*) row, 0, (unsigned int) width, 1,
+                            (Uint8*) icon->pixels + y * icon->pitch, (size_t) icon->pitch);
+    }
+    free(row);
+    return icon;
+}
+
 int XChangeProperty(Display* display, Window window, Atom property, Atom type, int format,
                      int mode, _Xconst unsigned char* data, int numberOfElements) {
     // https://tronche.com/gui/x/xlib/window-information/XChangeProperty.html
@@ -542,14 +620,13 @@ int XChangeProperty(Display* display, Window window, Atom property, Atom type, i
             w = pixelData[0];
             h = pixelData[1];
             if (w > icons[bestIcon][0] || h > icons[bestIcon][1]) {
-                bestIcon = i;
+                bestIcon = i - 1;
             }
             pixelData += 2 + w * h;
         } while (i < 20 && pixelData < ((unsigned long*) data) + numberOfElements);
         w = icons[bestIcon][0];
         h = icons[bestIcon][1];
-        SDL_Surface* icon = SDL_CreateRGBSurfaceFrom(&icons[bestIcon][2], (int) w, (int) h, 32, w * (32 / 8),
-                                                     0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+        SDL_Surface* icon = createIconSurface(&icons[bestIcon][2], w, h);
         if (windowStruct->icon != NULL) {
             SDL_FreeSurface(windowStruct->icon);
         }
@@ -671,7 +748,8 @@ Status XGetWindowAttributes(Display* display, Window window,
         Uint32 flags = SDL_GetWindowFlags(sdlWindow);
         if (HAS_VALUE(flags, SDL_WINDOW_MINIMIZED)) {
             window_attributes_return->map_state = IsUnviewable;
-        } else if (HAS_VALUE(flags, SDL_WINDOW_HIDDEN)) {
+        } else if (HAS_VALUE(flags, SDL_WINDOW_HIDDEN) && !isHeadless()) {
+            // In the headless mode, mapped windows are always hidden.
             window_attributes_return->map_state = IsUnmapped;
         } else {
             window_attributes_return->map_state = IsViewable;
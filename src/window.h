@@ -22,7 +22,10 @@ typedef struct {
     Window parent;
     /* List of children */
     Array children;
-    /* This is the drawing target of the window and its children while it is unmapped. Might be NULL.*/
+    /*
+     * This is the drawing target of the window and its children while it is unmapped, and of
+     * a mapped top level window in the headless mode. Might be NULL.
+     */
     GPU_Image* unmappedContent;
     /* 
      * This is the SDL Window handler to the real window of this window.
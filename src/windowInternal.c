@@ -5,6 +5,7 @@
 #include "drawing.h"
 #include "events.h"
 #include "display.h"
+#include "presentScheduler.h"
 
 Window SCREEN_WINDOW = None;
 
@@ -66,6 +67,7 @@ Bool initScreenWindow(Display* display) {
 }
 
 void destroyScreenWindow(Display* display) {
+    flushDisplayList();
     if (SCREEN_WINDOW != None) {
         size_t i;
         Window* children = GET_CHILDREN(SCREEN_WINDOW);
@@ -73,6 +75,8 @@ void destroyScreenWindow(Display* display) {
         for (i = 0; i < windowStruct->children.length; i++) {
             destroyWindow(display, children[i], False);
         }
+        freeClipStencil(windowStruct->renderTarget);
+        forgetPresentTarget(windowStruct->renderTarget);
         GPU_FreeTarget(windowStruct->renderTarget);
         windowStruct->renderTarget = NULL;
         SDL_DestroyWindow(windowStruct->sdlWindow);
@@ -182,7 +186,10 @@ void destroyWindow(Display* display, Window window, Bool freeParentData) {
     if (windowStruct->icon != NULL) {
         SDL_FreeSurface(windowStruct->icon);
     }
+    flushDisplayList();
     if (windowStruct->renderTarget != NULL) {
+        freeClipStencil(windowStruct->renderTarget);
+        forgetPresentTarget(windowStruct->renderTarget);
         GPU_FreeTarget(windowStruct->renderTarget);
     }
     if (windowStruct->unmappedContent != NULL) {
@@ -235,6 +242,7 @@ Bool resizeWindowSurface(Window window) {
     WindowStruct* windowStruct = GET_WINDOW_STRUCT(window);
     GPU_Image* oldContent = windowStruct->unmappedContent;
     if (oldContent != NULL) {
+        flushDisplayList();
         GPU_Image* newContent = GPU_CreateImage((Uint16) windowStruct->w, (Uint16) windowStruct->h, oldContent->format);
         if (newContent == NULL) {
             LOG("Failed to resize the window surface: Failed to create new window surface!\n");
@@ -251,7 +259,10 @@ Bool resizeWindowSurface(Window window) {
         LOG("Resizing surface of window %lu\n", window);
         LOG("BLITTING in %s\n", __func__);
         GPU_Blit(oldContent, NULL, newTarget, oldContent->w / 2, oldContent->h / 2);
-        if (windowStruct->renderTarget != NULL) GPU_FreeTarget(windowStruct->renderTarget);
+        if (windowStruct->renderTarget != NULL) {
+            freeClipStencil(windowStruct->renderTarget);
+            GPU_FreeTarget(windowStruct->renderTarget);
+        }
         GPU_FreeImage(oldContent);
         windowStruct->unmappedContent = newContent;
         windowStruct->renderTarget = newTarget;
@@ -262,6 +273,7 @@ Bool resizeWindowSurface(Window window) {
 Bool mergeWindowDrawables(Window parent, Window child) {
     WindowStruct* childWindowStruct = GET_WINDOW_STRUCT(child);
     if (childWindowStruct->unmappedContent == NULL) { return True; }
+    flushDisplayList();
     LOG("getWindowRenderTarget of window %lu in %s.\n", parent, __func__);
     GPU_Target* parentTarget = getWindowRenderTarget(parent);
     if (parentTarget == NULL) return false;
@@ -272,6 +284,7 @@ Bool mergeWindowDrawables(Window parent, Window child) {
     GPU_Blit(childWindowStruct->unmappedContent, NULL, parentTarget,
              childWindowStruct->x + childWindowStruct->w / 2, childWindowStruct->y + childWindowStruct->h / 2);
     if (childWindowStruct->renderTarget != NULL) {
+        freeClipStencil(childWindowStruct->renderTarget);
         GPU_FreeTarget(childWindowStruct->renderTarget);
         childWindowStruct->renderTarget = NULL;
     }
@@ -0,0 +1,191 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "X11/XWDFile.h"
+#include "xwd.h"
+#include "readback.h"
+#include "drawing.h"
+#include "errors.h"
+#include "input.h"
+#include "window.h"
+#include "windowInternal.h"
+#include "util.h"
+#include "renderThread.h"
+
+/*
+ * Dumps of windows and pixmaps in the XWD format of xwd(1), which can be viewed with xwud(1)
+ * or converted by most image tools. The pixels are written as 32 bit TrueColor pixels in the
+ * layout of the default visual. The pixels are read back asynchronously, so the dump file is
+ * written during a later flush of the display list.
+ */
+
+/* Values in XWD files are stored most significant byte first. */
+#define XWD_VALUE(value) SDL_SwapBE32((Uint32) (value))
+
+typedef struct {
+    Drawable drawable;
+    int x;
+    int y;
+    unsigned int borderWidth;
+    /* The performance counter value when the dump was requested. */
+    Uint64 startTime;
+    char fileName[];
+} XwdDump;
+
+static void writeXwdDump(const Uint8* pixels, ptrdiff_t pitch, int width, int height,
+                         void* data) {
+    XwdDump* dump = data;
+    Uint64 readTime = SDL_GetPerformanceCounter();
+    char name[32];
+    int y;
+    if (pixels == NULL) {
+        LOG("Failed to read the pixels of drawable %lu for the XWD dump\n", dump->drawable);
+        free(dump);
+        return;
+    }
+    FILE* file = fopen(dump->fileName, "wb");
+    if (file == NULL) {
+        LOG("Failed to open the XWD dump file %s: %s\n", dump->fileName, strerror(errno));
+        free(dump);
+        return;
+    }
+    snprintf(name, sizeof(name), "0x%lx", dump->drawable);
+    size_t nameSize = strlen(name) + 1;
+    XWDFileHeader header;
+    header.header_size = XWD_VALUE(sz_XWDheader + nameSize);
+    header.file_version = XWD_VALUE(XWD_FILE_VERSION);
+    header.pixmap_format = XWD_VALUE(ZPixmap);
+    header.pixmap_depth = XWD_VALUE(32);
+    header.pixmap_width = XWD_VALUE(width);
+    header.pixmap_height = XWD_VALUE(height);
+    header.xoffset = XWD_VALUE(0);
+    header.byte_order = XWD_VALUE(MSBFirst);
+    header.bitmap_unit = XWD_VALUE(32);
+    header.bitmap_bit_order = XWD_VALUE(MSBFirst);
+    header.bitmap_pad = XWD_VALUE(32);
+    header.bits_per_pixel = XWD_VALUE(32);
+    header.bytes_per_line = XWD_VALUE(width * 4);
+    header.visual_class = XWD_VALUE(TrueColor);
+    // The read pixels are R, G, B, A bytes, so they are RGBA pixels in MSBFirst order.
+    header.red_mask = XWD_VALUE(0xFF000000);
+    header.green_mask = XWD_VALUE(0x00FF0000);
+    header.blue_mask = XWD_VALUE(0x0000FF00);
+    header.bits_per_rgb = XWD_VALUE(8);
+    header.colormap_entries = XWD_VALUE(256);
+    header.ncolors = XWD_VALUE(0);
+    header.window_width = XWD_VALUE(width);
+    header.window_height = XWD_VALUE(height);
+    header.window_x = XWD_VALUE(dump->x);
+    header.window_y = XWD_VALUE(dump->y);
+    header.window_bdrwidth = XWD_VALUE(dump->borderWidth);
+    Bool success = fwrite(&header, sz_XWDheader, 1, file) == 1
+                   && fwrite(name, nameSize, 1, file) == 1;
+    for (y = 0; y < height && success; y++) {
+        success = fwrite(pixels + y * pitch, (size_t) width * 4, 1, file) == 1;
+    }
+    if (fclose(file) != 0) {
+        success = False;
+    }
+    if (success) {
+        double frequency = (double) SDL_GetPerformanceFrequency();
+        LOG("Dumped drawable %lu (%dx%d) to %s in %.2f ms, the readback took %.2f ms\n",
+            dump->drawable, width, height, dump->fileName,
+            (SDL_GetPerformanceCounter() - dump->startTime) * 1000.0 / frequency,
+            (readTime - dump->startTime) * 1000.0 / frequency);
+    } else {
+        LOG("Failed to write the XWD dump file %s: %s\n", dump->fileName, strerror(errno));
+    }
+    free(dump);
+}
+
+/*
+ * Write the content of the window or pixmap into an XWD file. The file is written once the
+ * pixels have been read back, at the latest when the display is closed.
+ * Returns False if the dump could not be started.
+ */
+Bool dumpDrawableToXwd(Display* display, Drawable drawable, const char* fileName) {
+    TYPE_CHECK(drawable, DRAWABLE, display, False);
+    GPU_Target* target;
+    GPU_Rect rect = {0, 0, 0, 0};
+    XwdDump* dump = malloc(sizeof(XwdDump) + strlen(fileName) + 1);
+    if (dump == NULL) {
+        handleOutOfMemory(0, display, 0, 0);
+        return False;
+    }
+    dump->drawable = drawable;
+    dump->x = dump->y = 0;
+    dump->borderWidth = 0;
+    dump->startTime = SDL_GetPerformanceCounter();
+    strcpy(dump->fileName, fileName);
+    if (IS_TYPE(drawable, WINDOW)) {
+        target = drawable == SCREEN_WINDOW ? NULL : getWindowRenderTarget(drawable);
+        if (target != NULL) {
+            rect.x = target->viewport.x;
+            rect.y = target->viewport.y;
+            GET_WINDOW_DIMS(drawable, rect.w, rect.h);
+            GET_WINDOW_POS(drawable, dump->x, dump->y);
+            dump->borderWidth = GET_WINDOW_STRUCT(drawable)->borderWidth;
+        }
+    } else {
+        GPU_Image* image = GET_PIXMAP_IMAGE(drawable);
+        syncRenderThread();
+        target = GPU_LoadTarget(image);
+        rect.w = image->w;
+        rect.h = image->h;
+    }
+    if (target == NULL) {
+        LOG("Failed to get the render target of drawable %lu for the XWD dump\n", drawable);
+        free(dump);
+        return False;
+    }
+    // Only the part of the drawable inside of the target can be read.
+    if (rect.x < 0) {
+        rect.w += rect.x;
+        rect.x = 0;
+    }
+    if (rect.y < 0) {
+        rect.h += rect.y;
+        rect.y = 0;
+    }
+    rect.w = MIN(rect.w, target->w - rect.x);
+    rect.h = MIN(rect.h, target->h - rect.y);
+    if (!readPixelsAsync(target, &rect, writeXwdDump, dump)) {
+        LOG("Failed to read the pixels of drawable %lu for the XWD dump\n", drawable);
+        free(dump);
+        return False;
+    }
+    return True;
+}
+
+/*
+ * Dump the window of the key event if the key is the dump key from the environment.
+ * Returns True if the event was for the dump key and should not be passed to the client.
+ */
+Bool handleXwdDumpKey(Display* display, const SDL_Event* event) {
+    static Bool initialized = False;
+    static SDL_Keycode dumpKey = SDLK_UNKNOWN;
+    static unsigned int numDumps = 0;
+    if (!initialized) {
+        initialized = True;
+        const char* keyName = getenv(XWD_DUMP_KEY_ENV_VARIABLE);
+        if (keyName != NULL) {
+            KeySym keysym = XStringToKeysym(keyName);
+            dumpKey = keysym == NoSymbol ? SDLK_UNKNOWN : convertKeySymToKeycode(keysym);
+            if (dumpKey == SDLK_UNKNOWN) {
+                LOG("Unknown XWD dump key '%s'\n", keyName);
+            }
+        }
+    }
+    if (dumpKey == SDLK_UNKNOWN || event->key.keysym.sym != dumpKey) return False;
+    if (event->type != SDL_KEYDOWN || event->key.repeat) return True;
+    Window window = getWindowFromId(event->key.windowID);
+    if (window == None) return True;
+    const char* directory = getenv(XWD_DUMP_DIRECTORY_ENV_VARIABLE);
+    char fileName[1024];
+    snprintf(fileName, sizeof(fileName), "%s/window-%lu-%u.xwd",
+             directory != NULL ? directory : ".", window, numDumps++);
+    LOG("Dumping window %lu to %s\n", window, fileName);
+    dumpDrawableToXwd(display, window, fileName);
+    return True;
+}
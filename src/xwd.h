@@ -0,0 +1,15 @@
+#ifndef _XWD_H_
+#define _XWD_H_
+
+#include "X11/Xlib.h"
+#include "SDL.h"
+
+/* The environment variable with the name of the key that dumps the focused window, e.g. F12. */
+#define XWD_DUMP_KEY_ENV_VARIABLE "SDL2X11_XWD_DUMP_KEY"
+/* The environment variable with the directory of the dumps of the key, defaults to ".". */
+#define XWD_DUMP_DIRECTORY_ENV_VARIABLE "SDL2X11_XWD_DUMP_DIR"
+
+Bool dumpDrawableToXwd(Display* display, Drawable drawable, const char* fileName);
+Bool handleXwdDumpKey(Display* display, const SDL_Event* event);
+
+#endif /* _XWD_H_ */
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+
+/*
+ * Checks that fills are clipped to a single clip rectangle, to several clip rectangles,
+ * to a region and to a clip mask, each with a clip origin, and that a clip is reused
+ * correctly by several draws.
+ */
+
+#define TEST_SIZE 24
+#define MASK_SIZE 8
+#define FOREGROUND_PIXEL 0x96F00FFFUL
+#define SECOND_FOREGROUND_PIXEL 0x0A0B0CFFUL
+#define DESTINATION_PIXEL 0x3C5AA5FFUL
+
+static const char maskBits[MASK_SIZE] = {
+        0x0F, 0x33, 0x55, 0x00, (char) 0xFF, (char) 0x81, 0x18, 0x7E,
+};
+static XRectangle clipRectangles[] = {{0, 0, 5, 5}, {10, 2, 4, 12}, {3, 15, 12, 3}};
+
+typedef struct {
+    const XRectangle* rectangles;
+    size_t numRectangles;
+    Bool isMask;
+    int originX;
+    int originY;
+} Clip;
+
+static Bool isInClip(const Clip* clip, int x, int y) {
+    size_t i;
+    x -= clip->originX;
+    y -= clip->originY;
+    if (clip->isMask) {
+        return x >= 0 && x < MASK_SIZE && y >= 0 && y < MASK_SIZE && (maskBits[y] >> x) & 1;
+    }
+    for (i = 0; i < clip->numRectangles; i++) {
+        const XRectangle* rect = &clip->rectangles[i];
+        if (x >= rect->x && x < rect->x + rect->width
+            && y >= rect->y && y < rect->y + rect->height) {
+            return True;
+        }
+    }
+    return False;
+}
+
+static unsigned long getClippedPixel(int x, int y, void* data) {
+    return isInClip(data, x, y) ? FOREGROUND_PIXEL : DESTINATION_PIXEL;
+}
+
+/* The second fill only covers the right half of the pixmap. */
+static unsigned long getTwiceClippedPixel(int x, int y, void* data) {
+    if (x >= TEST_SIZE / 2 && isInClip(data, x, y)) return SECOND_FOREGROUND_PIXEL;
+    return getClippedPixel(x, y, data);
+}
+
+/*
+ * Fill the whole pixmap through the clip of the GC and check every pixel. A second fill
+ * of another color over the right half of the pixmap must use the same clip.
+ */
+static void checkClip(Display* display, GC gc, Clip* clip, const char* check) {
+    XRectangle all = {0, 0, TEST_SIZE, TEST_SIZE};
+    Pixmap pixmap = createTestPixmap(display, TEST_SIZE, TEST_SIZE, DESTINATION_PIXEL);
+    XSetForeground(display, gc, FOREGROUND_PIXEL);
+    XFillRectangle(display, pixmap, gc, 0, 0, TEST_SIZE, TEST_SIZE);
+    expectPixels(display, pixmap, &all, getClippedPixel, clip, check);
+    XSetForeground(display, gc, SECOND_FOREGROUND_PIXEL);
+    XFillRectangle(display, pixmap, gc, TEST_SIZE / 2, 0, TEST_SIZE / 2, TEST_SIZE);
+    expectPixels(display, pixmap, &all, getTwiceClippedPixel, clip, check);
+    XFreePixmap(display, pixmap);
+}
+
+int main(void) {
+    size_t numRectangles = sizeof(clipRectangles) / sizeof(clipRectangles[0]), i;
+    Display* display = openTestDisplay();
+    Window root = DefaultRootWindow(display);
+    GC gc = XCreateGC(display, root, 0, NULL);
+    Clip clip = {clipRectangles, 1, False, 2, 3};
+    XSetClipRectangles(display, gc, 2, 3, clipRectangles, 1, Unsorted);
+    checkClip(display, gc, &clip, "single clip rectangle");
+    clip.numRectangles = numRectangles;
+    clip.originX = 1;
+    clip.originY = 1;
+    XSetClipRectangles(display, gc, 1, 1, clipRectangles, (int) numRectangles, Unsorted);
+    checkClip(display, gc, &clip, "several clip rectangles");
+    Region region = XCreateRegion();
+    for (i = 0; i < numRectangles; i++) {
+        XUnionRectWithRegion(&clipRectangles[i], region, region);
+    }
+    XSetClipOrigin(display, gc, 0, 0);
+    XSetRegion(display, gc, region);
+    XDestroyRegion(region);
+    clip.originX = clip.originY = 0;
+    checkClip(display, gc, &clip, "clip region");
+    XSetClipOrigin(display, gc, 2, -1);
+    clip.originX = 2;
+    clip.originY = -1;
+    checkClip(display, gc, &clip, "moved clip region");
+    Pixmap mask = XCreateBitmapFromData(display, root, maskBits, MASK_SIZE, MASK_SIZE);
+    XSetClipMask(display, gc, mask);
+    XSetClipOrigin(display, gc, 5, 4);
+    Clip maskClip = {NULL, 0, True, 5, 4};
+    checkClip(display, gc, &maskClip, "clip mask");
+    XSetClipMask(display, gc, None);
+    XFreePixmap(display, mask);
+    XFreeGC(display, gc);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All clip checks passed\n");
+    return EXIT_SUCCESS;
+}
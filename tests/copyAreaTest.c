@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Checks XCopyArea within a pixmap and a window, where the source and destination overlap
+ * in every direction, and between different drawables.
+ */
+
+#define TEST_SIZE 32
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define BACKGROUND_PIXEL 0x102030FFUL
+
+typedef struct {
+    int offsetX;
+    int offsetY;
+    XRectangle area;
+} CopiedPattern;
+
+static unsigned long getPatternPixel(int x, int y, void* data) {
+    (void) data;
+    return ((unsigned long) (x * 8) << 24) | ((unsigned long) (y * 8) << 16)
+           | ((unsigned long) ((x + y) * 4) << 8) | 0xFFUL;
+}
+
+/* The pattern moved by the offset inside the area and the unmoved pattern outside of it. */
+static unsigned long getCopiedPatternPixel(int x, int y, void* data) {
+    const CopiedPattern* copy = data;
+    if (x >= copy->area.x && x < copy->area.x + copy->area.width
+        && y >= copy->area.y && y < copy->area.y + copy->area.height) {
+        return getPatternPixel(x - copy->offsetX, y - copy->offsetY, NULL);
+    }
+    return getPatternPixel(x, y, NULL);
+}
+
+/* The copy of the whole drawable by the offset, the area is the destination of the copy. */
+static CopiedPattern getCopiedPattern(int offsetX, int offsetY) {
+    CopiedPattern copy = {offsetX, offsetY, {
+            (short) MAX(offsetX, 0), (short) MAX(offsetY, 0),
+            (unsigned short) (TEST_SIZE - abs(offsetX)),
+            (unsigned short) (TEST_SIZE - abs(offsetY))}};
+    return copy;
+}
+
+static void checkOverlappingCopy(Display* display, Drawable drawable, GC gc, int offsetX,
+                                 int offsetY, const char* check) {
+    XRectangle all = {0, 0, TEST_SIZE, TEST_SIZE};
+    CopiedPattern copy = getCopiedPattern(offsetX, offsetY);
+    Pixmap pattern = createPatternPixmap(display, TEST_SIZE, TEST_SIZE, getPatternPixel, NULL);
+    XCopyArea(display, pattern, drawable, gc, 0, 0, TEST_SIZE, TEST_SIZE, 0, 0);
+    XFreePixmap(display, pattern);
+    XCopyArea(display, drawable, drawable, gc, copy.area.x - offsetX, copy.area.y - offsetY,
+              copy.area.width, copy.area.height, copy.area.x, copy.area.y);
+    expectPixels(display, drawable, &all, getCopiedPatternPixel, &copy, check);
+}
+
+int main(void) {
+    const int offsets[][2] = {{0, -4}, {0, 4}, {-5, 0}, {5, 0}, {3, 7}, {-7, -3}};
+    XRectangle all = {0, 0, TEST_SIZE, TEST_SIZE};
+    char check[64];
+    size_t i;
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, TEST_SIZE, TEST_SIZE);
+    Pixmap pixmap = createTestPixmap(display, TEST_SIZE, TEST_SIZE, BACKGROUND_PIXEL);
+    GC gc = XCreateGC(display, pixmap, 0, NULL);
+    XSetGraphicsExposures(display, gc, False);
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        snprintf(check, sizeof(check), "pixmap copy by %d,%d", offsets[i][0], offsets[i][1]);
+        checkOverlappingCopy(display, pixmap, gc, offsets[i][0], offsets[i][1], check);
+        snprintf(check, sizeof(check), "window copy by %d,%d", offsets[i][0], offsets[i][1]);
+        checkOverlappingCopy(display, window, gc, offsets[i][0], offsets[i][1], check);
+    }
+    // Copy the window back into a pixmap, the content of the last check must survive.
+    CopiedPattern copy = getCopiedPattern(offsets[i - 1][0], offsets[i - 1][1]);
+    XCopyArea(display, window, pixmap, gc, 0, 0, TEST_SIZE, TEST_SIZE, 0, 0);
+    expectPixels(display, pixmap, &all, getCopiedPatternPixel, &copy, "window to pixmap copy");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All area copy checks passed\n");
+    return EXIT_SUCCESS;
+}
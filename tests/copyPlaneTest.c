@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Checks XCopyPlane from a bitmap and from single planes of a full depth pixmap into a full
+ * depth pixmap, with the GC foreground and background, with a clip rectangle and with GXxor.
+ */
+
+#define TEST_SIZE 16
+#define BITMAP_SIZE 8
+#define FOREGROUND_PIXEL 0x96F00FFFUL
+#define BACKGROUND_PIXEL 0x112233FFUL
+#define DESTINATION_PIXEL 0x3C5AA5FFUL
+#define XOR(pixel) ((((pixel) ^ DESTINATION_PIXEL) & 0xFFFFFF00UL) | 0xFFUL)
+
+static const char bitmapBits[BITMAP_SIZE] = {
+        0x0F, 0x33, 0x55, 0x00, (char) 0xFF, (char) 0x81, 0x18, 0x7E,
+};
+
+typedef struct {
+    int function;
+    unsigned long plane;
+    /* The destination area, the source is copied from its origin. */
+    XRectangle area;
+    /* The clip rectangle, or a width of 0 if the copy is not clipped. */
+    XRectangle clip;
+} PlaneCopy;
+
+static unsigned long getPatternPixel(int x, int y, void* data) {
+    (void) data;
+    return ((unsigned long) (x * 8) << 24) | ((unsigned long) (y * 8) << 16)
+           | ((unsigned long) ((x + y) * 4) << 8) | 0xFFUL;
+}
+
+static Bool isInRectangle(const XRectangle* rect, int x, int y) {
+    return x >= rect->x && x < rect->x + rect->width && y >= rect->y && y < rect->y + rect->height;
+}
+
+static unsigned long getCopiedPixel(int x, int y, void* data) {
+    const PlaneCopy* copy = data;
+    if (!isInRectangle(&copy->area, x, y)
+        || (copy->clip.width != 0 && !isInRectangle(&copy->clip, x, y))) {
+        return DESTINATION_PIXEL;
+    }
+    int sourceX = x - copy->area.x, sourceY = y - copy->area.y;
+    Bool isSet = copy->plane == 1 ? (bitmapBits[sourceY] >> sourceX) & 1
+                                  : (getPatternPixel(sourceX, sourceY, NULL) & copy->plane) != 0;
+    unsigned long pixel = isSet ? FOREGROUND_PIXEL : BACKGROUND_PIXEL;
+    return copy->function == GXxor ? XOR(pixel) : pixel;
+}
+
+static void checkCopyPlane(Display* display, Drawable source, PlaneCopy* copy,
+                           const char* check) {
+    XRectangle all = {0, 0, TEST_SIZE, TEST_SIZE};
+    Pixmap pixmap = createTestPixmap(display, TEST_SIZE, TEST_SIZE, DESTINATION_PIXEL);
+    XGCValues values;
+    values.function = copy->function;
+    values.foreground = FOREGROUND_PIXEL;
+    values.background = BACKGROUND_PIXEL;
+    values.graphics_exposures = False;
+    GC gc = XCreateGC(display, pixmap,
+                      GCFunction | GCForeground | GCBackground | GCGraphicsExposures, &values);
+    if (copy->clip.width != 0) {
+        XSetClipRectangles(display, gc, 0, 0, &copy->clip, 1, Unsorted);
+    }
+    XCopyPlane(display, source, pixmap, gc, 0, 0, copy->area.width, copy->area.height,
+               copy->area.x, copy->area.y, copy->plane);
+    expectPixels(display, pixmap, &all, getCopiedPixel, copy, check);
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+}
+
+int main(void) {
+    Display* display = openTestDisplay();
+    Window root = DefaultRootWindow(display);
+    Pixmap bitmap = XCreateBitmapFromData(display, root, bitmapBits, BITMAP_SIZE, BITMAP_SIZE);
+    Pixmap pattern = createPatternPixmap(display, TEST_SIZE, TEST_SIZE, getPatternPixel, NULL);
+    PlaneCopy bitmapCopy = {GXcopy, 1, {3, 5, BITMAP_SIZE, BITMAP_SIZE}, {0, 0, 0, 0}};
+    checkCopyPlane(display, bitmap, &bitmapCopy, "plane of a bitmap");
+    PlaneCopy clippedCopy = {GXcopy, 1, {3, 5, BITMAP_SIZE, BITMAP_SIZE}, {5, 4, 4, 5}};
+    checkCopyPlane(display, bitmap, &clippedCopy, "clipped plane of a bitmap");
+    PlaneCopy xorCopy = {GXxor, 1, {3, 5, BITMAP_SIZE, BITMAP_SIZE}, {0, 0, 0, 0}};
+    checkCopyPlane(display, bitmap, &xorCopy, "plane of a bitmap with GXxor");
+    PlaneCopy redCopy = {GXcopy, 1UL << 27, {2, 1, 12, 12}, {0, 0, 0, 0}};
+    checkCopyPlane(display, pattern, &redCopy, "red plane of a pixmap");
+    PlaneCopy blueCopy = {GXcopy, 1UL << 10, {2, 1, 12, 12}, {0, 0, 0, 0}};
+    checkCopyPlane(display, pattern, &blueCopy, "blue plane of a pixmap");
+    XFreePixmap(display, pattern);
+    XFreePixmap(display, bitmap);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All plane copy checks passed\n");
+    return EXIT_SUCCESS;
+}
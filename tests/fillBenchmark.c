@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Measures the fill rate of XFillRectangle with every fill style, for small rectangles like
+ * the backgrounds of widgets and for large ones like the background of a canvas.
+ */
+
+#define BENCHMARK_WIDTH 1024
+#define BENCHMARK_HEIGHT 768
+#define BENCHMARK_PIXELS (BENCHMARK_WIDTH * BENCHMARK_HEIGHT * 20)
+
+static const char stippleBits[] = {0x55, (char) 0xAA, 0x55, (char) 0xAA};
+
+static unsigned long getTilePixel(int x, int y, void* data) {
+    (void) data;
+    return ((unsigned long) (x * 16) << 24) | ((unsigned long) (y * 16) << 16) | 0xFFUL;
+}
+
+/*
+ * Fill rectangles of the size all over the window and return the filled megapixels per second.
+ */
+static double benchmarkFill(Display* display, Window window, GC gc, unsigned int size) {
+    int i, numRectangles = BENCHMARK_PIXELS / (int) (size * size);
+    XSync(display, False);
+    double startTime = getSeconds();
+    for (i = 0; i < numRectangles; i++) {
+        XFillRectangle(display, window, gc, (i * 37) % (BENCHMARK_WIDTH - (int) size),
+                       (i * 53) % (BENCHMARK_HEIGHT - (int) size), size, size);
+    }
+    XSync(display, False);
+    return (double) numRectangles * size * size / (getSeconds() - startTime) / 1e6;
+}
+
+int main(void) {
+    const int fillStyles[] = {FillSolid, FillTiled, FillStippled, FillOpaqueStippled};
+    const char* fillStyleNames[] = {"solid", "tiled", "stippled", "opaque stippled"};
+    const unsigned int sizes[] = {16, 256};
+    size_t i, j;
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    Pixmap tile = createPatternPixmap(display, 16, 16, getTilePixel, NULL);
+    Pixmap stipple = XCreateBitmapFromData(display, window, stippleBits, 8, 4);
+    XGCValues values;
+    values.foreground = 0x96F00FFFUL;
+    values.background = 0x112233FFUL;
+    values.tile = tile;
+    values.stipple = stipple;
+    GC gc = XCreateGC(display, window, GCForeground | GCBackground | GCTile | GCStipple, &values);
+    printf("%d pixels per measurement\n", BENCHMARK_PIXELS);
+    for (i = 0; i < sizeof(fillStyles) / sizeof(fillStyles[0]); i++) {
+        XSetFillStyle(display, gc, fillStyles[i]);
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            printf("%-15s %3ux%-3u %8.0f Mpixel/s\n", fillStyleNames[i], sizes[j], sizes[j],
+                   benchmarkFill(display, window, gc, sizes[j]));
+        }
+    }
+    XFreeGC(display, gc);
+    XFreePixmap(display, tile);
+    XFreePixmap(display, stipple);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
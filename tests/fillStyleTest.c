@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Checks tiled, stippled and opaque stippled fills, with the tile-stipple origin of the GC,
+ * that a stippled fill with GXxor leaves the pixels of unset stipple bits untouched and that
+ * a new tile replaces the cached texture of the GC.
+ */
+
+#define TEST_SIZE 24
+#define TILE_SIZE 4
+#define STIPPLE_SIZE 8
+#define FOREGROUND_PIXEL 0x96F00FFFUL
+#define BACKGROUND_PIXEL 0x112233FFUL
+#define DESTINATION_PIXEL 0x3C5AA5FFUL
+#define XOR_PIXEL (((FOREGROUND_PIXEL ^ DESTINATION_PIXEL) & 0xFFFFFF00UL) | 0xFFUL)
+
+static const char stippleBits[STIPPLE_SIZE] = {
+        0x0F, 0x33, 0x55, 0x00, (char) 0xFF, (char) 0x81, 0x18, 0x7E,
+};
+/* The filled rectangle, it covers the tile and stipple several times. */
+static const XRectangle fillArea = {3, 5, 17, 13};
+
+typedef struct {
+    int fillStyle;
+    int function;
+    int originX;
+    int originY;
+    unsigned long tileSalt;
+} FillCheck;
+
+static unsigned long getTilePixel(int x, int y, void* data) {
+    unsigned long salt = data != NULL ? *(unsigned long*) data : 0;
+    return ((((unsigned long) (x * 60) << 24) | ((unsigned long) (y * 60) << 16)) ^ salt)
+           | 0xFFUL;
+}
+
+static Bool isStippleBitSet(int x, int y) {
+    return (stippleBits[y % STIPPLE_SIZE] >> (x % STIPPLE_SIZE)) & 1;
+}
+
+static unsigned long getFilledPixel(int x, int y, void* data) {
+    const FillCheck* fill = data;
+    if (x < fillArea.x || x >= fillArea.x + fillArea.width
+        || y < fillArea.y || y >= fillArea.y + fillArea.height) {
+        return DESTINATION_PIXEL;
+    }
+    // The origin is placed at a multiple of the pattern size left of and above the area.
+    int patternX = x - fill->originX + TEST_SIZE, patternY = y - fill->originY + TEST_SIZE;
+    switch (fill->fillStyle) {
+    case FillTiled:
+        return getTilePixel(patternX % TILE_SIZE, patternY % TILE_SIZE, (void*) &fill->tileSalt);
+    case FillStippled:
+        if (!isStippleBitSet(patternX, patternY)) return DESTINATION_PIXEL;
+        return fill->function == GXxor ? XOR_PIXEL : FOREGROUND_PIXEL;
+    default:
+        return isStippleBitSet(patternX, patternY) ? FOREGROUND_PIXEL : BACKGROUND_PIXEL;
+    }
+}
+
+static void checkFill(Display* display, GC gc, FillCheck* fill, const char* check) {
+    XRectangle all = {0, 0, TEST_SIZE, TEST_SIZE};
+    Pixmap pixmap = createTestPixmap(display, TEST_SIZE, TEST_SIZE, DESTINATION_PIXEL);
+    XSetFillStyle(display, gc, fill->fillStyle);
+    XSetFunction(display, gc, fill->function);
+    XSetTSOrigin(display, gc, fill->originX, fill->originY);
+    XFillRectangle(display, pixmap, gc, fillArea.x, fillArea.y, fillArea.width,
+                   fillArea.height);
+    expectPixels(display, pixmap, &all, getFilledPixel, fill, check);
+    XFreePixmap(display, pixmap);
+}
+
+int main(void) {
+    const int origins[][2] = {{0, 0}, {1, 2}, {-3, 7}};
+    const int fillStyles[] = {FillTiled, FillStippled, FillOpaqueStippled};
+    const char* fillStyleNames[] = {"tiled", "stippled", "opaque stippled"};
+    unsigned long salt = 0x5A5A5A00UL;
+    char check[64];
+    size_t i, j;
+    Display* display = openTestDisplay();
+    Window root = DefaultRootWindow(display);
+    Pixmap tile = createPatternPixmap(display, TILE_SIZE, TILE_SIZE, getTilePixel, NULL);
+    Pixmap stipple = XCreateBitmapFromData(display, root, stippleBits, STIPPLE_SIZE,
+                                           STIPPLE_SIZE);
+    XGCValues values;
+    values.foreground = FOREGROUND_PIXEL;
+    values.background = BACKGROUND_PIXEL;
+    values.tile = tile;
+    values.stipple = stipple;
+    GC gc = XCreateGC(display, root, GCForeground | GCBackground | GCTile | GCStipple, &values);
+    for (i = 0; i < sizeof(fillStyles) / sizeof(fillStyles[0]); i++) {
+        for (j = 0; j < sizeof(origins) / sizeof(origins[0]); j++) {
+            FillCheck fill = {fillStyles[i], GXcopy, origins[j][0], origins[j][1], 0};
+            snprintf(check, sizeof(check), "%s fill with origin %d,%d", fillStyleNames[i],
+                     origins[j][0], origins[j][1]);
+            checkFill(display, gc, &fill, check);
+        }
+    }
+    FillCheck xorFill = {FillStippled, GXxor, 1, 2, 0};
+    checkFill(display, gc, &xorFill, "stippled fill with GXxor");
+    // The GC must not keep drawing the texture of the previous tile.
+    Pixmap saltedTile = createPatternPixmap(display, TILE_SIZE, TILE_SIZE, getTilePixel, &salt);
+    XSetTile(display, gc, saltedTile);
+    FillCheck saltedFill = {FillTiled, GXcopy, 1, 2, salt};
+    checkFill(display, gc, &saltedFill, "tiled fill after changing the tile");
+    XFreeGC(display, gc);
+    XFreePixmap(display, saltedTile);
+    XFreePixmap(display, tile);
+    XFreePixmap(display, stipple);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All fill style checks passed\n");
+    return EXIT_SUCCESS;
+}
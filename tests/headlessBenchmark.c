@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "xlibTest.h"
+#include "headless.h"
+
+/*
+ * Measures the throughput of full-frame updates of the exported headless framebuffer. A window
+ * that covers the whole root window is filled with another color for every frame and flushed.
+ * The framebuffer updates are counted with the damage listener, which also measures the time
+ * from the first damage of an area until it arrived in the framebuffer, and with the damage fd,
+ * like an external reader would.
+ */
+
+#define BENCHMARK_FRAMES 300
+
+static unsigned int numUpdates = 0;
+static double updatedPixels = 0;
+static double latency = 0;
+
+static void onFramebufferDamage(const SDL_Rect* damage, Uint64 damageTime) {
+    numUpdates++;
+    updatedPixels += (double) damage->w * damage->h;
+    latency += (double) (SDL_GetPerformanceCounter() - damageTime)
+               / (double) SDL_GetPerformanceFrequency();
+}
+
+/* Read the number of damage notifications that were signaled since the last read. */
+static uint64_t readDamageNotifications(void) {
+    uint64_t count = 0;
+    if (read(getHeadlessDamageFd(), &count, sizeof(count)) != sizeof(count)) return 0;
+    return count;
+}
+
+int main(void) {
+    int frame;
+    Display* display = openTestDisplay();
+    if (getHeadlessFramebuffer() == NULL) {
+        printf("SKIP: The framebuffer is not exported\n");
+        return TEST_SKIPPED;
+    }
+    unsigned int width = (unsigned int) DisplayWidth(display, 0);
+    unsigned int height = (unsigned int) DisplayHeight(display, 0);
+    Window window = createTestWindow(display, width, height);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    XSync(display, False);
+    setFramebufferDamageListener(onFramebufferDamage);
+    readDamageNotifications();
+    numUpdates = 0;
+    updatedPixels = latency = 0;
+    double startTime = getSeconds();
+    for (frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+        XSetForeground(display, gc, ((unsigned long) frame * 2654435761u) | 0xFFUL);
+        XFillRectangle(display, window, gc, 0, 0, width, height);
+        XFlush(display);
+    }
+    XSync(display, False);
+    double seconds = getSeconds() - startTime;
+    setFramebufferDamageListener(NULL);
+    printf("%ux%u framebuffer, %d frames\n", width, height, BENCHMARK_FRAMES);
+    printf("client %7.1f frames/s, framebuffer %7.1f updates/s, %7.1f Mpixel/s\n",
+           BENCHMARK_FRAMES / seconds, numUpdates / seconds, updatedPixels / seconds / 1e6);
+    printf("%llu damage notifications, %7.3f ms from damage to framebuffer\n",
+           (unsigned long long) readDamageNotifications(),
+           numUpdates > 0 ? latency * 1000.0 / numUpdates : 0.0);
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
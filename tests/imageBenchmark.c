@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+
+/*
+ * Measures the throughput of XPutImage for the common client image layouts, once into a pixmap,
+ * which is updated in place, and once into a window, which uploads through the scratch image.
+ * Set the image cache size environment variable to measure repeated puts from the cache.
+ * XGetImage is measured for the same layouts, which it converts the read pixels into.
+ * Finally, the creation of pixmaps from bitmap data is measured, which expands the bits.
+ */
+
+#define BENCHMARK_WIDTH 1024
+#define BENCHMARK_HEIGHT 768
+#define BENCHMARK_REPETITIONS 20
+
+typedef struct {
+    const char* name;
+    int format;
+    unsigned int depth;
+} ImageLayout;
+
+static const ImageLayout layouts[] = {
+        {"ZPixmap 32 bpp", ZPixmap, 24},
+        {"ZPixmap 16 bpp", ZPixmap, 16},
+        {"ZPixmap 8 bpp", ZPixmap, 8},
+        {"XYBitmap", XYBitmap, 1},
+};
+
+static XImage* createBenchmarkImage(Display* display, const ImageLayout* layout) {
+    XImage* image = XCreateImage(display, DefaultVisual(display, 0), layout->depth,
+                                 layout->format, 0, NULL, BENCHMARK_WIDTH, BENCHMARK_HEIGHT,
+                                 32, 0);
+    size_t i, size;
+    if (image == NULL) return NULL;
+    size = (size_t) image->bytes_per_line * BENCHMARK_HEIGHT;
+    image->data = malloc(size);
+    if (image->data == NULL) {
+        XDestroyImage(image);
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        image->data[i] = (char) rand();
+    }
+    return image;
+}
+
+static double getMegapixelsPerSecond(double startTime, double endTime) {
+    return (double) BENCHMARK_REPETITIONS * BENCHMARK_WIDTH * BENCHMARK_HEIGHT
+           / (endTime - startTime) / 1e6;
+}
+
+/*
+ * Put the image repeatedly on the drawable and wait until all puts were executed.
+ */
+static double benchmarkPutImage(Display* display, Drawable drawable, GC gc, XImage* image) {
+    int repetition;
+    double startTime = getSeconds();
+    for (repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+        XPutImage(display, drawable, gc, image, 0, 0, 0, 0, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    }
+    XSync(display, False);
+    return getMegapixelsPerSecond(startTime, getSeconds());
+}
+
+/*
+ * Read the drawable repeatedly into the image with XGetSubImage.
+ */
+static double benchmarkGetImage(Display* display, Drawable drawable, XImage* image) {
+    int repetition;
+    // A bitmap receives a single plane.
+    unsigned long planeMask = image->format == XYBitmap ? 1 : AllPlanes;
+    int format = image->format == XYBitmap ? XYPixmap : image->format;
+    double startTime = getSeconds();
+    for (repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+        XGetSubImage(display, drawable, 0, 0, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, planeMask,
+                     format, image, 0, 0);
+    }
+    return getMegapixelsPerSecond(startTime, getSeconds());
+}
+
+/*
+ * Create pixmaps from random bitmap data repeatedly.
+ */
+static double benchmarkBitmapPixmaps(Display* display, Drawable drawable) {
+    size_t i, size = (size_t) (BENCHMARK_WIDTH + 7) / 8 * BENCHMARK_HEIGHT;
+    char* data = malloc(size);
+    int repetition;
+    if (data == NULL) return 0;
+    for (i = 0; i < size; i++) {
+        data[i] = (char) rand();
+    }
+    double startTime = getSeconds();
+    for (repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+        Pixmap pixmap = XCreatePixmapFromBitmapData(
+                display, drawable, data, BENCHMARK_WIDTH, BENCHMARK_HEIGHT,
+                BlackPixel(display, 0), WhitePixel(display, 0),
+                (unsigned int) DefaultDepth(display, 0));
+        XFreePixmap(display, pixmap);
+    }
+    XSync(display, False);
+    double endTime = getSeconds();
+    free(data);
+    return getMegapixelsPerSecond(startTime, endTime);
+}
+
+int main(void) {
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    Pixmap pixmap = createTestPixmap(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    size_t i;
+    printf("%dx%d pixels, %d repetitions\n", BENCHMARK_WIDTH, BENCHMARK_HEIGHT,
+           BENCHMARK_REPETITIONS);
+    for (i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        XImage* image = createBenchmarkImage(display, &layouts[i]);
+        if (image == NULL) {
+            fprintf(stderr, "Failed to create the %s image\n", layouts[i].name);
+            return EXIT_FAILURE;
+        }
+        printf("XPutImage %-14s pixmap %6.0f Mpixel/s, window %6.0f Mpixel/s\n",
+               layouts[i].name, benchmarkPutImage(display, pixmap, gc, image),
+               benchmarkPutImage(display, window, gc, image));
+        printf("XGetImage %-14s pixmap %6.0f Mpixel/s, window %6.0f Mpixel/s\n",
+               layouts[i].name, benchmarkGetImage(display, pixmap, image),
+               benchmarkGetImage(display, window, image));
+        XDestroyImage(image);
+    }
+    printf("XCreatePixmapFromBitmapData %6.0f Mpixel/s\n",
+           benchmarkBitmapPixmaps(display, window));
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
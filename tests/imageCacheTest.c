@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+#include "imageCache.h"
+
+/*
+ * Checks the image cache of XPutImage: an image is cached when it is put for the second time
+ * and blitted from the cache afterwards, images with other pixels or another area miss and
+ * the least recently used images are evicted once the byte budget is used. Every put must
+ * draw the pixels of the image, no matter whether it was a hit or a miss.
+ */
+
+#define IMAGE_SIZE 8
+/* The budget holds four of the images. */
+#define CACHE_SIZE "1K"
+
+typedef struct {
+    XImage* image;
+    int x;
+    int y;
+} PutImage;
+
+static unsigned long getPatternPixel(int x, int y, int seed) {
+    return ((unsigned long) ((x * 29 + seed * 53) & 0xFF) << 24)
+           | ((unsigned long) ((y * 31 + seed * 17) & 0xFF) << 16)
+           | ((unsigned long) (((x ^ y) * 8 + seed) & 0xFF) << 8) | 0xFFUL;
+}
+
+static unsigned long getPutPixel(int x, int y, void* data) {
+    const PutImage* put = data;
+    return XGetPixel(put->image, x - put->x, y - put->y);
+}
+
+static XImage* createPatternImage(Display* display, int seed) {
+    XImage* image = XCreateImage(display, DefaultVisual(display, 0),
+                                 (unsigned int) DefaultDepth(display, 0), ZPixmap, 0, NULL,
+                                 IMAGE_SIZE, IMAGE_SIZE, 32, 0);
+    int x, y;
+    if (image == NULL
+        || (image->data = malloc((size_t) image->bytes_per_line * IMAGE_SIZE)) == NULL) {
+        printf("SKIP: Failed to create the pattern image\n");
+        exit(TEST_SKIPPED);
+    }
+    for (y = 0; y < IMAGE_SIZE; y++) {
+        for (x = 0; x < IMAGE_SIZE; x++) {
+            XPutPixel(image, x, y, getPatternPixel(x, y, seed));
+        }
+    }
+    return image;
+}
+
+/*
+ * Put the image and check the drawn pixels and how the lookup changed the cache statistics.
+ */
+static void putAndCheck(Display* display, Window window, GC gc, XImage* image, int x, int y,
+                        unsigned long hits, unsigned long uploads, const char* check) {
+    char message[96];
+    ImageCacheStatistics before, after;
+    PutImage put = {image, x, y};
+    XRectangle area = {(short) x, (short) y, IMAGE_SIZE, IMAGE_SIZE};
+    getImageCacheStatistics(&before);
+    XPutImage(display, window, gc, image, 0, 0, x, y, IMAGE_SIZE, IMAGE_SIZE);
+    XSync(display, False);
+    getImageCacheStatistics(&after);
+    if (after.lookups - before.lookups != 1 || after.hits - before.hits != hits
+        || after.uploads - before.uploads != uploads) {
+        snprintf(message, sizeof(message), "Got %lu lookups, %lu hits and %lu uploads instead of "
+                 "1, %lu and %lu", after.lookups - before.lookups, after.hits - before.hits,
+                 after.uploads - before.uploads, hits, uploads);
+        reportTestFailure(check, message);
+    }
+    expectPixels(display, window, &area, getPutPixel, &put, check);
+}
+
+int main(void) {
+    int i;
+    XImage* images[5];
+    ImageCacheStatistics statistics;
+    setenv(IMAGE_CACHE_SIZE_ENV_VARIABLE, CACHE_SIZE, 1);
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, IMAGE_SIZE * 8, IMAGE_SIZE * 2);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    if (!isImageCacheEnabled()) {
+        printf("SKIP: The image cache is not enabled\n");
+        return TEST_SKIPPED;
+    }
+    for (i = 0; i < 5; i++) {
+        images[i] = createPatternImage(display, i);
+    }
+    putAndCheck(display, window, gc, images[0], 0, 0, 0, 0, "first put");
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE, 0, 0, 1, "second put");
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE * 2, 0, 1, 0, "cache hit");
+
+    // Changing a single pixel must not draw the cached pixels.
+    XPutPixel(images[0], 3, 5, 0x123456FFUL);
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE * 3, 0, 0, 0, "changed pixel");
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE * 4, 0, 0, 1, "changed pixel again");
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE * 5, 0, 1, 0, "changed pixel hit");
+
+    // Fill the budget, then use the changed image again, so it is not the oldest one anymore.
+    for (i = 1; i < 3; i++) {
+        putAndCheck(display, window, gc, images[i], IMAGE_SIZE * (i - 1), IMAGE_SIZE, 0, 0,
+                    "other image");
+        putAndCheck(display, window, gc, images[i], IMAGE_SIZE * (i - 1), IMAGE_SIZE, 0, 1,
+                    "other image again");
+    }
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE * 6, 0, 1, 0, "recently used hit");
+    // Two more cached images evict the original image and then the first other image.
+    for (i = 3; i < 5; i++) {
+        putAndCheck(display, window, gc, images[i], IMAGE_SIZE * (i - 1), IMAGE_SIZE, 0, 0,
+                    "evicting image");
+        putAndCheck(display, window, gc, images[i], IMAGE_SIZE * (i - 1), IMAGE_SIZE, 0, 1,
+                    "evicting image again");
+    }
+    getImageCacheStatistics(&statistics);
+    if (statistics.evictions != 2 || statistics.usedBytes != 4 * IMAGE_SIZE * IMAGE_SIZE * 4) {
+        reportTestFailure("eviction", "The cache does not hold the four most recent images");
+    }
+    putAndCheck(display, window, gc, images[0], IMAGE_SIZE * 7, 0, 1, 0, "not evicted hit");
+    putAndCheck(display, window, gc, images[1], IMAGE_SIZE * 4, IMAGE_SIZE, 0, 0,
+                "evicted image miss");
+
+    for (i = 0; i < 5; i++) {
+        XDestroyImage(images[i]);
+    }
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All image cache checks passed\n");
+    return EXIT_SUCCESS;
+}
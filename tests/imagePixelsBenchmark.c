@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+
+/*
+ * Measures the throughput of the XImage pixel accessors for every supported format, like the
+ * per pixel loops of the photo image code of Tk, and of XAddPixel and XSubImage.
+ */
+
+#define IMAGE_SIZE 512
+#define BENCHMARK_PASSES 8
+
+/* The sum of the pixels that were read, so the reads can not be optimized away. */
+static volatile unsigned long pixelSum = 0;
+
+typedef struct {
+    const char* name;
+    int format;
+    int depth;
+    int bitsPerPixel;
+    int byteOrder;
+} ImageFormat;
+
+static const ImageFormat formats[] = {
+        {"bitmap", XYBitmap, 1, 1, MSBFirst},
+        {"XYPixmap depth 8", XYPixmap, 8, 1, MSBFirst},
+        {"4 bpp", ZPixmap, 4, 4, MSBFirst},
+        {"8 bpp", ZPixmap, 8, 8, MSBFirst},
+        {"16 bpp MSBFirst", ZPixmap, 16, 16, MSBFirst},
+        {"16 bpp LSBFirst", ZPixmap, 16, 16, LSBFirst},
+        {"24 bpp MSBFirst", ZPixmap, 24, 24, MSBFirst},
+        {"24 bpp LSBFirst", ZPixmap, 24, 24, LSBFirst},
+        {"32 bpp MSBFirst", ZPixmap, 24, 32, MSBFirst},
+        {"32 bpp LSBFirst", ZPixmap, 24, 32, LSBFirst},
+};
+
+static XImage* createImage(const ImageFormat* format) {
+    XImage* image = XCreateImage(NULL, NULL, (unsigned int) format->depth, format->format, 0,
+                                 NULL, IMAGE_SIZE, IMAGE_SIZE, 32, 0);
+    if (image == NULL) return NULL;
+    image->bits_per_pixel = format->bitsPerPixel;
+    image->byte_order = format->byteOrder;
+    image->bitmap_bit_order = format->byteOrder;
+    image->bytes_per_line = 0;
+    size_t numPlanes = format->format == XYPixmap ? (size_t) format->depth : 1;
+    if (XInitImage(image)) {
+        image->data = calloc((size_t) image->bytes_per_line * IMAGE_SIZE * numPlanes, 1);
+    }
+    if (image->data == NULL) {
+        XDestroyImage(image);
+        return NULL;
+    }
+    return image;
+}
+
+int main(void) {
+    size_t i;
+    int pass, x, y;
+    double pixels = (double) IMAGE_SIZE * IMAGE_SIZE * BENCHMARK_PASSES;
+    printf("%dx%d images, %d passes, Mpixel/s\n", IMAGE_SIZE, IMAGE_SIZE, BENCHMARK_PASSES);
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        XImage* image = createImage(&formats[i]);
+        if (image == NULL) {
+            fprintf(stderr, "Failed to create the %s image\n", formats[i].name);
+            return EXIT_FAILURE;
+        }
+        double startTime = getSeconds();
+        for (pass = 0; pass < BENCHMARK_PASSES; pass++) {
+            for (y = 0; y < IMAGE_SIZE; y++) {
+                for (x = 0; x < IMAGE_SIZE; x++) {
+                    XPutPixel(image, x, y, (unsigned long) (x * y + pass));
+                }
+            }
+        }
+        double putTime = getSeconds() - startTime;
+        startTime = getSeconds();
+        for (pass = 0; pass < BENCHMARK_PASSES; pass++) {
+            for (y = 0; y < IMAGE_SIZE; y++) {
+                for (x = 0; x < IMAGE_SIZE; x++) {
+                    pixelSum += XGetPixel(image, x, y);
+                }
+            }
+        }
+        double getTime = getSeconds() - startTime;
+        startTime = getSeconds();
+        for (pass = 0; pass < BENCHMARK_PASSES; pass++) {
+            XAddPixel(image, 1);
+        }
+        double addTime = getSeconds() - startTime;
+        startTime = getSeconds();
+        for (pass = 0; pass < BENCHMARK_PASSES; pass++) {
+            XImage* sub = XSubImage(image, 1, 1, IMAGE_SIZE - 1, IMAGE_SIZE - 1);
+            if (sub == NULL) {
+                fprintf(stderr, "Failed to create a sub image of the %s image\n",
+                        formats[i].name);
+                return EXIT_FAILURE;
+            }
+            XDestroyImage(sub);
+        }
+        double subTime = getSeconds() - startTime;
+        printf("%-16s put %8.1f, get %8.1f, XAddPixel %8.1f, XSubImage %8.1f\n",
+               formats[i].name, pixels / putTime / 1e6, pixels / getTime / 1e6,
+               pixels / addTime / 1e6, pixels / subTime / 1e6);
+        XDestroyImage(image);
+    }
+    return EXIT_SUCCESS;
+}
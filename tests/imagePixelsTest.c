@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+
+/*
+ * Checks the pixel accessors of XImages for every supported bits per pixel and byte order:
+ * the pixels that are put must be read back limited to the depth and must be stored in the
+ * layout of the format, sub images must copy the pixels and XAddPixel must add to every pixel.
+ * The accessors do not need a display, so this test never needs to be skipped.
+ */
+
+#define TEST_WIDTH 37
+#define TEST_HEIGHT 5
+
+typedef struct {
+    const char* name;
+    int format;
+    int depth;
+    int bitsPerPixel;
+    int byteOrder;
+} ImageFormat;
+
+static const ImageFormat formats[] = {
+        {"bitmap MSBFirst", XYBitmap, 1, 1, MSBFirst},
+        {"bitmap LSBFirst", XYBitmap, 1, 1, LSBFirst},
+        {"XYPixmap depth 8", XYPixmap, 8, 1, MSBFirst},
+        {"4 bpp MSBFirst", ZPixmap, 4, 4, MSBFirst},
+        {"4 bpp LSBFirst", ZPixmap, 4, 4, LSBFirst},
+        {"8 bpp", ZPixmap, 8, 8, MSBFirst},
+        {"16 bpp MSBFirst", ZPixmap, 16, 16, MSBFirst},
+        {"16 bpp LSBFirst", ZPixmap, 16, 16, LSBFirst},
+        {"15 bit 16 bpp", ZPixmap, 15, 16, LSBFirst},
+        {"24 bpp MSBFirst", ZPixmap, 24, 24, MSBFirst},
+        {"24 bpp LSBFirst", ZPixmap, 24, 24, LSBFirst},
+        {"32 bpp MSBFirst", ZPixmap, 32, 32, MSBFirst},
+        {"32 bpp LSBFirst", ZPixmap, 32, 32, LSBFirst},
+        {"24 bit 32 bpp", ZPixmap, 24, 32, MSBFirst},
+};
+
+static unsigned long getDepthMask(int depth) {
+    return depth >= 32 ? 0xFFFFFFFFUL : (1UL << depth) - 1;
+}
+
+static unsigned long getPatternPixel(int x, int y) {
+    return ((unsigned long) x * 0x9E3779B1UL + (unsigned long) y * 0x85EBCA77UL) & 0xFFFFFFFFUL;
+}
+
+static XImage* createImage(const ImageFormat* format, int width, int height) {
+    XImage* image = XCreateImage(NULL, NULL, (unsigned int) format->depth, format->format, 0,
+                                 NULL, (unsigned int) width, (unsigned int) height, 32, 0);
+    if (image == NULL) return NULL;
+    image->bits_per_pixel = format->bitsPerPixel;
+    image->byte_order = format->byteOrder;
+    image->bitmap_bit_order = format->byteOrder;
+    image->bytes_per_line = 0;
+    size_t numPlanes = format->format == XYPixmap ? (size_t) format->depth : 1;
+    if (XInitImage(image)) {
+        image->data = calloc((size_t) image->bytes_per_line * height * numPlanes, 1);
+    }
+    if (image->data == NULL) {
+        XDestroyImage(image);
+        return NULL;
+    }
+    return image;
+}
+
+static void expectImagePixels(XImage* image, unsigned long add, const char* check) {
+    char message[80];
+    int x, y;
+    for (y = 0; y < image->height; y++) {
+        for (x = 0; x < image->width; x++) {
+            unsigned long expected = (getPatternPixel(x, y) + add) & getDepthMask(image->depth);
+            unsigned long pixel = XGetPixel(image, x, y);
+            if (pixel != expected) {
+                snprintf(message, sizeof(message), "Pixel %d,%d is 0x%08lx instead of 0x%08lx",
+                         x, y, pixel, expected);
+                reportTestFailure(check, message);
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Check that the pixel at 1,0 with the value 0x12345679 is stored in the layout of the format.
+ */
+static void checkPixelLayout(const ImageFormat* format, const char* check) {
+    const unsigned char* data;
+    XImage* image = createImage(format, 4, 1);
+    if (image == NULL) {
+        reportTestFailure(check, "Failed to create the image");
+        return;
+    }
+    XPutPixel(image, 1, 0, 0x12345679UL);
+    data = (const unsigned char*) image->data;
+    unsigned long stored = 0;
+    int byte, bytesPerPixel = format->bitsPerPixel / 8;
+    if (format->format == ZPixmap && bytesPerPixel > 0) {
+        for (byte = 0; byte < bytesPerPixel; byte++) {
+            int shift = format->byteOrder == MSBFirst ? bytesPerPixel - 1 - byte : byte;
+            stored |= (unsigned long) data[bytesPerPixel + byte] << (8 * shift);
+        }
+        if (stored != (0x12345679UL & (bytesPerPixel == 4 ? 0xFFFFFFFFUL
+                                                          : (1UL << 8 * bytesPerPixel) - 1))) {
+            reportTestFailure(check, "The pixel is not stored in the byte order of the image");
+        }
+    } else if (format->bitsPerPixel == 4) {
+        if (data[0] != (format->byteOrder == MSBFirst ? 0x09 : 0x90)) {
+            reportTestFailure(check, "The pixel is not stored in the nibble order of the image");
+        }
+    } else if (format->format == XYBitmap) {
+        if (data[0] != (format->byteOrder == MSBFirst ? 0x40 : 0x02)) {
+            reportTestFailure(check, "The pixel is not stored in the bit order of the image");
+        }
+    }
+    XDestroyImage(image);
+}
+
+static void checkFormat(const ImageFormat* format) {
+    char check[80];
+    int x, y;
+    XImage* image = createImage(format, TEST_WIDTH, TEST_HEIGHT);
+    if (image == NULL) {
+        reportTestFailure(format->name, "Failed to create the image");
+        return;
+    }
+    for (y = 0; y < TEST_HEIGHT; y++) {
+        for (x = 0; x < TEST_WIDTH; x++) {
+            XPutPixel(image, x, y, getPatternPixel(x, y));
+        }
+    }
+    snprintf(check, sizeof(check), "%s put and get", format->name);
+    expectImagePixels(image, 0, check);
+    snprintf(check, sizeof(check), "%s layout", format->name);
+    checkPixelLayout(format, check);
+
+    // The sub image reaches over the right and the bottom edge, those pixels must be 0.
+    snprintf(check, sizeof(check), "%s XSubImage", format->name);
+    XImage* sub = XSubImage(image, 3, 2, TEST_WIDTH - 1, TEST_HEIGHT);
+    if (sub == NULL) {
+        reportTestFailure(check, "Failed to create the sub image");
+    } else {
+        if (sub->width != TEST_WIDTH - 1 || sub->height != TEST_HEIGHT
+            || sub->depth != image->depth || sub->bits_per_pixel != image->bits_per_pixel) {
+            reportTestFailure(check, "The sub image has the wrong size or format");
+        }
+        for (y = 0; y < sub->height; y++) {
+            for (x = 0; x < sub->width; x++) {
+                Bool inside = x + 3 < TEST_WIDTH && y + 2 < TEST_HEIGHT;
+                unsigned long expected = inside ? getPatternPixel(x + 3, y + 2)
+                                                  & getDepthMask(image->depth) : 0;
+                if (XGetPixel(sub, x, y) != expected) {
+                    reportTestFailure(check, "A pixel of the sub image differs");
+                    y = sub->height;
+                    break;
+                }
+            }
+        }
+        XDestroyImage(sub);
+    }
+
+    snprintf(check, sizeof(check), "%s XAddPixel", format->name);
+    XAddPixel(image, 3);
+    expectImagePixels(image, 3, check);
+    XDestroyImage(image);
+}
+
+int main(void) {
+    size_t i;
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        checkFormat(&formats[i]);
+    }
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All XImage pixel checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Measures the throughput of long polylines, like the plots of a chart, for several line
+ * widths. With GXcopy the overlapping segments are drawn in one pass, with GXxor every
+ * polyline must draw each of its pixels only once.
+ */
+
+#define BENCHMARK_WIDTH 1024
+#define BENCHMARK_HEIGHT 768
+#define BENCHMARK_REPETITIONS 50
+#define POLYLINES_PER_REPETITION 10
+#define POINTS_PER_POLYLINE 2000
+
+int main(void) {
+    const int lineWidths[] = {0, 1, 10};
+    const int functions[] = {GXcopy, GXxor};
+    XPoint* points = malloc(sizeof(XPoint) * POLYLINES_PER_REPETITION * POINTS_PER_POLYLINE);
+    size_t i, j, k;
+    int repetition;
+    if (points == NULL) {
+        fprintf(stderr, "Failed to allocate the benchmark points\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < POLYLINES_PER_REPETITION; i++) {
+        for (j = 0; j < POINTS_PER_POLYLINE; j++) {
+            // A zigzag whose segments are a few pixels long, like a plot of noisy samples.
+            int phase = (int) ((j * 7 + i * 13) % 64);
+            XPoint* point = &points[i * POINTS_PER_POLYLINE + j];
+            point->x = (short) (j * BENCHMARK_WIDTH / POINTS_PER_POLYLINE);
+            point->y = (short) (BENCHMARK_HEIGHT / 4 + (phase < 32 ? phase : 64 - phase) * 12);
+        }
+    }
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    printf("%d polylines of %d points, %d repetitions\n", POLYLINES_PER_REPETITION,
+           POINTS_PER_POLYLINE, BENCHMARK_REPETITIONS);
+    for (i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+        for (j = 0; j < sizeof(lineWidths) / sizeof(lineWidths[0]); j++) {
+            XGCValues values;
+            values.function = functions[i];
+            values.foreground = 0x96F00FFFUL;
+            values.line_width = lineWidths[j];
+            GC gc = XCreateGC(display, window, GCFunction | GCForeground | GCLineWidth, &values);
+            XSync(display, False);
+            double startTime = getSeconds();
+            for (repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+                for (k = 0; k < POLYLINES_PER_REPETITION; k++) {
+                    XDrawLines(display, window, gc, &points[k * POINTS_PER_POLYLINE],
+                               POINTS_PER_POLYLINE, CoordModeOrigin);
+                }
+            }
+            XSync(display, False);
+            double seconds = getSeconds() - startTime;
+            printf("%-6s width %2d %8.0f polylines/s\n",
+                   functions[i] == GXcopy ? "GXcopy" : "GXxor", lineWidths[j],
+                   BENCHMARK_REPETITIONS * POLYLINES_PER_REPETITION / seconds);
+            XFreeGC(display, gc);
+        }
+    }
+    XCloseDisplay(display);
+    free(points);
+    return EXIT_SUCCESS;
+}
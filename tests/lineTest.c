@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Checks the cap, join and dash styles of wide and thin lines, and that a polyline draws
+ * every pixel only once while the segments of XDrawSegments are drawn independently.
+ */
+
+#define FOREGROUND_PIXEL 0x96F00FFFUL
+#define BACKGROUND_PIXEL 0x112233FFUL
+#define DESTINATION_PIXEL 0x3C5AA5FFUL
+#define XOR_PIXEL (((FOREGROUND_PIXEL ^ DESTINATION_PIXEL) & 0xFFFFFF00UL) | 0xFFUL)
+
+static GC createLineGC(Display* display, Drawable drawable, int function, int lineWidth,
+                       int lineStyle, int capStyle, int joinStyle) {
+    XGCValues values;
+    values.function = function;
+    values.foreground = FOREGROUND_PIXEL;
+    values.background = BACKGROUND_PIXEL;
+    values.line_width = lineWidth;
+    values.line_style = lineStyle;
+    values.cap_style = capStyle;
+    values.join_style = joinStyle;
+    return XCreateGC(display, drawable, GCFunction | GCForeground | GCBackground | GCLineWidth
+                     | GCLineStyle | GCCapStyle | GCJoinStyle, &values);
+}
+
+static void checkCaps(Display* display) {
+    Pixmap pixmap = createTestPixmap(display, 20, 16, DESTINATION_PIXEL);
+    GC gc = createLineGC(display, pixmap, GXcopy, 4, LineSolid, CapButt, JoinMiter);
+    XDrawLine(display, pixmap, gc, 4, 8, 12, 8);
+    expectPixel(display, pixmap, 5, 8, FOREGROUND_PIXEL, "inside of a butt capped line");
+    expectPixel(display, pixmap, 3, 8, DESTINATION_PIXEL, "before a butt capped line");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    pixmap = createTestPixmap(display, 20, 16, DESTINATION_PIXEL);
+    gc = createLineGC(display, pixmap, GXcopy, 4, LineSolid, CapProjecting, JoinMiter);
+    XDrawLine(display, pixmap, gc, 4, 8, 12, 8);
+    expectPixel(display, pixmap, 3, 8, FOREGROUND_PIXEL, "projecting cap of a line");
+    expectPixel(display, pixmap, 1, 8, DESTINATION_PIXEL, "before a projecting cap");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+}
+
+static void checkJoins(Display* display) {
+    XPoint corner[] = {{4, 4}, {16, 4}, {16, 16}};
+    Pixmap pixmap = createTestPixmap(display, 24, 24, DESTINATION_PIXEL);
+    GC gc = createLineGC(display, pixmap, GXcopy, 6, LineSolid, CapButt, JoinMiter);
+    XDrawLines(display, pixmap, gc, corner, 3, CoordModeOrigin);
+    expectPixel(display, pixmap, 18, 2, FOREGROUND_PIXEL, "outer corner of a miter join");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    pixmap = createTestPixmap(display, 24, 24, DESTINATION_PIXEL);
+    gc = createLineGC(display, pixmap, GXcopy, 6, LineSolid, CapButt, JoinBevel);
+    XDrawLines(display, pixmap, gc, corner, 3, CoordModeOrigin);
+    expectPixel(display, pixmap, 18, 2, DESTINATION_PIXEL, "outer corner of a bevel join");
+    expectPixel(display, pixmap, 17, 3, FOREGROUND_PIXEL, "bevel of a bevel join");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+}
+
+static void checkDashes(Display* display, int lineStyle) {
+    char dashes[] = {4, 4};
+    Pixmap pixmap = createTestPixmap(display, 32, 4, DESTINATION_PIXEL);
+    GC gc = createLineGC(display, pixmap, GXcopy, 0, lineStyle, CapButt, JoinMiter);
+    XSetDashes(display, gc, 0, dashes, 2);
+    XDrawLine(display, pixmap, gc, 0, 2, 31, 2);
+    unsigned long offPixel = lineStyle == LineDoubleDash ? BACKGROUND_PIXEL : DESTINATION_PIXEL;
+    const char* check = lineStyle == LineDoubleDash ? "double dashed line" : "dashed line";
+    expectPixel(display, pixmap, 2, 2, FOREGROUND_PIXEL, check);
+    expectPixel(display, pixmap, 6, 2, offPixel, check);
+    expectPixel(display, pixmap, 10, 2, FOREGROUND_PIXEL, check);
+    expectPixel(display, pixmap, 14, 2, offPixel, check);
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+}
+
+static void checkOverdraw(Display* display) {
+    // The polyline crosses itself at (16, 10) and its segments overlap at every corner.
+    XPoint path[] = {{2, 10}, {30, 10}, {30, 2}, {16, 2}, {16, 20}};
+    Pixmap pixmap = createTestPixmap(display, 32, 24, DESTINATION_PIXEL);
+    GC gc = createLineGC(display, pixmap, GXxor, 3, LineSolid, CapButt, JoinMiter);
+    XDrawLines(display, pixmap, gc, path, 5, CoordModeOrigin);
+    expectPixel(display, pixmap, 8, 10, XOR_PIXEL, "segment of a polyline with GXxor");
+    expectPixel(display, pixmap, 16, 10, XOR_PIXEL, "crossing of a polyline with GXxor");
+    expectPixel(display, pixmap, 30, 10, XOR_PIXEL, "join of a polyline with GXxor");
+    expectPixel(display, pixmap, 30, 2, XOR_PIXEL, "join of a polyline with GXxor");
+    XFreePixmap(display, pixmap);
+    // The segments of XDrawSegments are independent lines, their overlap is drawn twice.
+    XSegment segments[] = {{2, 10, 30, 10}, {16, 2, 16, 20}};
+    pixmap = createTestPixmap(display, 32, 24, DESTINATION_PIXEL);
+    XDrawSegments(display, pixmap, gc, segments, 2);
+    expectPixel(display, pixmap, 8, 10, XOR_PIXEL, "segment with GXxor");
+    expectPixel(display, pixmap, 16, 10, DESTINATION_PIXEL, "crossing segments with GXxor");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+}
+
+int main(void) {
+    Display* display = openTestDisplay();
+    checkCaps(display);
+    checkJoins(display);
+    checkDashes(display, LineOnOffDash);
+    checkDashes(display, LineDoubleDash);
+    checkOverdraw(display);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All line checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pixelFormat.h"
+
+/*
+ * Measures the throughput of the pixel conversion kernels for every client pixel format and
+ * the bitmap expansion, once with the SIMD kernels and once with the scalar reference loops.
+ */
+
+#define BENCHMARK_WIDTH 1920
+#define BENCHMARK_HEIGHT 1080
+#define BENCHMARK_REPETITIONS 5
+
+static Visual defaultVisual;
+
+/* The pixel conversion reads the layout of the default visual (0xRRGGBBAA). */
+Visual* getDefaultVisual(int screenIndex) {
+    (void) screenIndex;
+    defaultVisual.red_mask = 0xFF000000;
+    defaultVisual.green_mask = 0x00FF0000;
+    defaultVisual.blue_mask = 0x0000FF00;
+    return &defaultVisual;
+}
+
+static const char* formatNames[] = {
+        "ARGB8888", "ABGR8888", "RGB888", "RGB565", "INDEXED8", "BITMAP",
+};
+static const int formatBitsPerPixel[] = {32, 32, 24, 16, 8, 1};
+
+static double getSeconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static double getMegapixelsPerSecond(int repetitions, double startTime, double endTime) {
+    return (double) repetitions * BENCHMARK_WIDTH * BENCHMARK_HEIGHT
+           / (endTime - startTime) / 1e6;
+}
+
+int main(void) {
+    size_t size = (size_t) BENCHMARK_WIDTH * BENCHMARK_HEIGHT * 4, i;
+    Uint8* source = malloc(size);
+    Uint8* dest = malloc(size);
+    SDL_Color palette[256];
+    SDL_Color foreground = {1, 2, 3, 4}, background = {250, 251, 252, 253};
+    int type, premultiplied, simd, repetition, row;
+    if (source == NULL || dest == NULL) {
+        fprintf(stderr, "Failed to allocate the benchmark buffers\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < size; i++) {
+        source[i] = (Uint8) rand();
+    }
+    for (i = 0; i < sizeof(palette); i++) {
+        ((Uint8*) palette)[i] = (Uint8) rand();
+    }
+    printf("%dx%d pixels, %d repetitions\n", BENCHMARK_WIDTH, BENCHMARK_HEIGHT,
+           BENCHMARK_REPETITIONS);
+    for (simd = True; simd >= False; simd--) {
+        setenv(PIXEL_CONVERSION_ENV_VARIABLE, simd ? "simd" : "scalar", 1);
+        initPixelConversion();
+        for (type = PIXEL_FORMAT_ARGB8888; type <= PIXEL_FORMAT_BITMAP; type++) {
+            for (premultiplied = False; premultiplied <= True; premultiplied++) {
+                ClientPixelFormat format = {
+                        (PixelFormatType) type, LSBFirst, premultiplied, palette,
+                        type == PIXEL_FORMAT_BITMAP ? 2 : 256,
+                };
+                size_t pitch = ((size_t) BENCHMARK_WIDTH * formatBitsPerPixel[type] + 7) / 8;
+                // Only the 32 bit formats have an alpha channel.
+                if (premultiplied && type > PIXEL_FORMAT_ABGR8888) continue;
+                double startTime = getSeconds();
+                for (repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+                    convertPixelsToRGBA(&format, source, pitch, BENCHMARK_WIDTH,
+                                        BENCHMARK_HEIGHT, dest, BENCHMARK_WIDTH * 4);
+                }
+                double middleTime = getSeconds();
+                // Searching the palette for every pixel is slow, one repetition is enough.
+                int repetitions = type >= PIXEL_FORMAT_INDEXED8 ? 1 : BENCHMARK_REPETITIONS;
+                for (repetition = 0; repetition < repetitions; repetition++) {
+                    convertRGBAToPixels(&format, source, BENCHMARK_WIDTH * 4, BENCHMARK_WIDTH,
+                                        BENCHMARK_HEIGHT, dest, pitch);
+                }
+                double endTime = getSeconds();
+                printf("%-6s %-8s %-13s to RGBA %6.0f Mpixel/s, from RGBA %6.0f Mpixel/s\n",
+                       getPixelConversionKernels(), formatNames[type],
+                       premultiplied ? "premultiplied" : "straight",
+                       getMegapixelsPerSecond(BENCHMARK_REPETITIONS, startTime, middleTime),
+                       getMegapixelsPerSecond(repetitions, middleTime, endTime));
+            }
+        }
+        size_t bitmapPitch = (BENCHMARK_WIDTH + 7) / 8;
+        double startTime = getSeconds();
+        for (repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+            for (row = 0; row < BENCHMARK_HEIGHT; row++) {
+                expandBitmapRow(source + row * bitmapPitch, 0, BENCHMARK_WIDTH, False,
+                                foreground, background, dest);
+            }
+        }
+        printf("%-6s bitmap expansion %6.0f Mpixel/s\n", getPixelConversionKernels(),
+               getMegapixelsPerSecond(BENCHMARK_REPETITIONS, startTime, getSeconds()));
+    }
+    free(source);
+    free(dest);
+    return EXIT_SUCCESS;
+}
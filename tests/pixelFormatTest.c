@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pixelFormat.h"
+
+/*
+ * Checks the SIMD pixel conversion kernels against the scalar reference loops. Every format,
+ * byte order and alpha mode is converted once with each kernel selection and the results must
+ * be identical. The width is odd and the rows are not aligned, so the scalar tails of the SIMD
+ * kernels are exercised as well. Exits with a non zero status if a check fails.
+ */
+
+#define TEST_WIDTH 1021
+#define TEST_HEIGHT 7
+/* The offset of the rows in the buffers, so they are not aligned. */
+#define TEST_ROW_OFFSET 3
+#define TEST_BUFFER_SIZE (TEST_ROW_OFFSET + (size_t) TEST_WIDTH * TEST_HEIGHT * 4)
+
+static int numFailures = 0;
+static Visual defaultVisual;
+
+/* The pixel conversion reads the layout of the default visual (0xRRGGBBAA). */
+Visual* getDefaultVisual(int screenIndex) {
+    (void) screenIndex;
+    defaultVisual.red_mask = 0xFF000000;
+    defaultVisual.green_mask = 0x00FF0000;
+    defaultVisual.blue_mask = 0x0000FF00;
+    return &defaultVisual;
+}
+
+static const char* formatNames[] = {
+        "ARGB8888", "ABGR8888", "RGB888", "RGB565", "INDEXED8", "BITMAP",
+};
+static const int formatBitsPerPixel[] = {32, 32, 24, 16, 8, 1};
+
+static void fail(const char* message, const char* name, int byteOrder, Bool premultiplied) {
+    printf("FAIL: %s for %s, %s, %s alpha\n", message, name,
+           byteOrder == MSBFirst ? "MSBFirst" : "LSBFirst",
+           premultiplied ? "premultiplied" : "straight");
+    numFailures++;
+}
+
+static void fillRandom(Uint8* buffer, size_t size) {
+    size_t i;
+    for (i = 0; i < size; i++) {
+        buffer[i] = (Uint8) rand();
+    }
+}
+
+static void selectKernels(Bool simd) {
+    setenv(PIXEL_CONVERSION_ENV_VARIABLE, simd ? "simd" : "scalar", 1);
+    initPixelConversion();
+}
+
+/*
+ * Convert the client pixel formats with both kernel selections and compare the results.
+ * The formats without palette must also survive the round trip through RGBA unchanged.
+ */
+static void testClientFormats(void) {
+    static Uint8 source[TEST_BUFFER_SIZE], rgba[TEST_BUFFER_SIZE];
+    static Uint8 toRgba[2][TEST_BUFFER_SIZE], toPixels[2][TEST_BUFFER_SIZE];
+    static Uint8 roundTrip[TEST_BUFFER_SIZE];
+    SDL_Color palette[256];
+    int type, byteOrder, premultiplied, simd, row;
+    fillRandom((Uint8*) palette, sizeof(palette));
+    fillRandom(source, sizeof(source));
+    fillRandom(rgba, sizeof(rgba));
+    for (type = PIXEL_FORMAT_ARGB8888; type <= PIXEL_FORMAT_BITMAP; type++) {
+        for (byteOrder = LSBFirst; byteOrder <= MSBFirst; byteOrder++) {
+            for (premultiplied = False; premultiplied <= True; premultiplied++) {
+                ClientPixelFormat format = {
+                        (PixelFormatType) type, byteOrder, premultiplied, palette,
+                        type == PIXEL_FORMAT_BITMAP ? 2 : 200,
+                };
+                size_t pitch = ((size_t) TEST_WIDTH * formatBitsPerPixel[type] + 7) / 8;
+                const char* name = formatNames[type];
+                for (simd = False; simd <= True; simd++) {
+                    selectKernels(simd);
+                    memset(toPixels[simd], 0, sizeof(toPixels[simd]));
+                    if (!convertPixelsToRGBA(&format, source + TEST_ROW_OFFSET, pitch,
+                                             TEST_WIDTH, TEST_HEIGHT,
+                                             toRgba[simd] + TEST_ROW_OFFSET, TEST_WIDTH * 4)) {
+                        fail("conversion to RGBA failed", name, byteOrder, premultiplied);
+                    }
+                    if (!convertRGBAToPixels(&format, rgba + TEST_ROW_OFFSET, TEST_WIDTH * 4,
+                                             TEST_WIDTH, TEST_HEIGHT,
+                                             toPixels[simd] + TEST_ROW_OFFSET, pitch)) {
+                        fail("conversion from RGBA failed", name, byteOrder, premultiplied);
+                    }
+                }
+                if (memcmp(toRgba[False], toRgba[True], sizeof(toRgba[False])) != 0) {
+                    fail("SIMD conversion to RGBA differs", name, byteOrder, premultiplied);
+                }
+                if (memcmp(toPixels[False], toPixels[True], sizeof(toPixels[False])) != 0) {
+                    fail("SIMD conversion from RGBA differs", name, byteOrder, premultiplied);
+                }
+                if (premultiplied || type > PIXEL_FORMAT_RGB565) continue;
+                convertRGBAToPixels(&format, toRgba[True] + TEST_ROW_OFFSET, TEST_WIDTH * 4,
+                                    TEST_WIDTH, TEST_HEIGHT, roundTrip, pitch);
+                for (row = 0; row < TEST_HEIGHT; row++) {
+                    if (memcmp(roundTrip + row * pitch, source + TEST_ROW_OFFSET + row * pitch,
+                               (size_t) TEST_WIDTH * formatBitsPerPixel[type] / 8) != 0) {
+                        fail("round trip through RGBA differs", name, byteOrder, premultiplied);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void initTestImage(XImage* image, int format, int depth, int bitsPerPixel,
+                          int byteOrder, unsigned long redMask, unsigned long greenMask,
+                          unsigned long blueMask, Uint8* data) {
+    memset(image, 0, sizeof(XImage));
+    image->width = TEST_WIDTH;
+    image->height = TEST_HEIGHT;
+    image->format = format;
+    image->data = (char*) data;
+    image->byte_order = byteOrder;
+    image->bitmap_unit = 8;
+    image->bitmap_bit_order = byteOrder;
+    image->bitmap_pad = 8;
+    image->depth = depth;
+    image->bits_per_pixel = bitsPerPixel;
+    image->bytes_per_line = (TEST_WIDTH * bitsPerPixel + 7) / 8;
+    image->red_mask = redMask;
+    image->green_mask = greenMask;
+    image->blue_mask = blueMask;
+}
+
+/*
+ * Convert XImages of all layouts with a kernel to both directions
+ * with both kernel selections and compare the results.
+ */
+static void testImageLayouts(void) {
+    static const struct {
+        const char* name;
+        int depth;
+        int bitsPerPixel;
+        unsigned long redMask, greenMask, blueMask;
+    } layouts[] = {
+            {"default 32 bit", 32, 32, 0, 0, 0},
+            {"default 24 bit", 24, 32, 0, 0, 0},
+            {"ARGB", 32, 32, 0x00FF0000, 0x0000FF00, 0x000000FF},
+            {"ABGR", 32, 32, 0x000000FF, 0x0000FF00, 0x00FF0000},
+            {"BGRA", 32, 32, 0x0000FF00, 0x00FF0000, 0xFF000000},
+            {"xRGB", 24, 32, 0x00FF0000, 0x0000FF00, 0x000000FF},
+            {"RGB888", 24, 24, 0x00FF0000, 0x0000FF00, 0x000000FF},
+            {"RGB565", 16, 16, 0xF800, 0x07E0, 0x001F},
+            {"BGR565", 16, 16, 0x001F, 0x07E0, 0xF800},
+            {"bitmap", 1, 1, 0, 0, 0},
+    };
+    static const unsigned long planeMasks[] = {0xFFFFFFFF, 0x00FFFF00, 0x0F0F0F0F};
+    static Uint8 source[TEST_BUFFER_SIZE], rgba[TEST_BUFFER_SIZE];
+    static Uint8 toRgba[2][TEST_BUFFER_SIZE], toImage[2][TEST_BUFFER_SIZE];
+    SDL_Color foreground = {1, 2, 3, 4}, background = {250, 251, 252, 253};
+    size_t layout, plane;
+    int byteOrder, simd;
+    fillRandom(source, sizeof(source));
+    fillRandom(rgba, sizeof(rgba));
+    for (layout = 0; layout < sizeof(layouts) / sizeof(layouts[0]); layout++) {
+        for (byteOrder = LSBFirst; byteOrder <= MSBFirst; byteOrder++) {
+            for (plane = 0; plane < sizeof(planeMasks) / sizeof(planeMasks[0]); plane++) {
+                const char* name = layouts[layout].name;
+                int format = layouts[layout].depth == 1 ? XYBitmap : ZPixmap;
+                for (simd = False; simd <= True; simd++) {
+                    XImage image;
+                    selectKernels(simd);
+                    initTestImage(&image, format, layouts[layout].depth,
+                                  layouts[layout].bitsPerPixel, byteOrder,
+                                  layouts[layout].redMask, layouts[layout].greenMask,
+                                  layouts[layout].blueMask, source);
+                    // Start at an odd pixel, so bitmaps do not start at a byte boundary.
+                    if (!convertImageToRGBA(&image, 1, 0, TEST_WIDTH - 1, TEST_HEIGHT,
+                                            foreground, background,
+                                            toRgba[simd] + TEST_ROW_OFFSET, TEST_WIDTH * 4)) {
+                        fail("conversion to RGBA failed", name, byteOrder, False);
+                    }
+                    memset(toImage[simd], 0, sizeof(toImage[simd]));
+                    image.data = (char*) toImage[simd];
+                    if (!convertRGBAToImage(rgba + TEST_ROW_OFFSET, TEST_WIDTH * 4,
+                                            TEST_WIDTH - 1, TEST_HEIGHT, planeMasks[plane],
+                                            &image, 1, 0)) {
+                        fail("conversion from RGBA failed", name, byteOrder, False);
+                    }
+                }
+                if (memcmp(toRgba[False], toRgba[True], sizeof(toRgba[False])) != 0) {
+                    fail("SIMD image conversion to RGBA differs", name, byteOrder, False);
+                }
+                if (memcmp(toImage[False], toImage[True], sizeof(toImage[False])) != 0) {
+                    fail("SIMD image conversion from RGBA differs", name, byteOrder, False);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Compare the bitmap expansion with a bit by bit expansion for every start bit.
+ */
+static void testBitmapExpansion(void) {
+    static Uint8 bits[(TEST_WIDTH + 7) / 8], expanded[TEST_WIDTH * 4];
+    SDL_Color foreground = {1, 2, 3, 4}, background = {250, 251, 252, 253};
+    unsigned int firstBit, i;
+    int msbFirst, simd;
+    fillRandom(bits, sizeof(bits));
+    for (simd = False; simd <= True; simd++) {
+        selectKernels(simd);
+        for (msbFirst = False; msbFirst <= True; msbFirst++) {
+            for (firstBit = 0; firstBit < 17; firstBit++) {
+                unsigned int width = TEST_WIDTH - firstBit;
+                expandBitmapRow(bits, firstBit, width, msbFirst, foreground, background,
+                                expanded);
+                for (i = 0; i < width; i++) {
+                    unsigned int bit = firstBit + i;
+                    int isSet = (bits[bit / 8] >> (msbFirst ? 7 - bit % 8 : bit % 8)) & 1;
+                    if (memcmp(&expanded[i * 4], isSet ? &foreground : &background, 4) != 0) {
+                        fail("bitmap expansion differs", getPixelConversionKernels(),
+                             msbFirst ? MSBFirst : LSBFirst, False);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Check a few pixels against values that were calculated by hand.
+ */
+static void testKnownPixels(void) {
+    Uint8 result[4];
+    int simd;
+    for (simd = False; simd <= True; simd++) {
+        selectKernels(simd);
+        // The value 0x44332211 in LSBFirst order is A = 0x44, R = 0x33, G = 0x22, B = 0x11.
+        Uint8 argbPixel[4] = {0x11, 0x22, 0x33, 0x44};
+        ClientPixelFormat argbFormat = {PIXEL_FORMAT_ARGB8888, LSBFirst, False, NULL, 0};
+        convertPixelsToRGBA(&argbFormat, argbPixel, 4, 1, 1, result, 4);
+        if (result[0] != 0x33 || result[1] != 0x22 || result[2] != 0x11 || result[3] != 0x44) {
+            fail("known pixel differs", "ARGB8888", LSBFirst, False);
+        }
+        // Premultiplied, R = 0x80, G = 0x40, B = 0, A = 0x80 in MSBFirst order is 80 00 40 80.
+        Uint8 rgbaPixel[4] = {0xFF, 0x80, 0x00, 0x80};
+        ClientPixelFormat abgrFormat = {PIXEL_FORMAT_ABGR8888, MSBFirst, True, NULL, 0};
+        convertRGBAToPixels(&abgrFormat, rgbaPixel, 4, 1, 1, result, 4);
+        if (result[0] != 0x80 || result[1] != 0x00 || result[2] != 0x40 || result[3] != 0x80) {
+            fail("known pixel differs", "ABGR8888", MSBFirst, True);
+        }
+        // Pure red in RGB565 with LSBFirst order is 0xF800.
+        Uint8 redPixel[4] = {0xFF, 0x00, 0x00, 0xFF};
+        ClientPixelFormat rgb565Format = {PIXEL_FORMAT_RGB565, LSBFirst, False, NULL, 0};
+        convertRGBAToPixels(&rgb565Format, redPixel, 4, 1, 1, result, 2);
+        if (result[0] != 0x00 || result[1] != 0xF8) {
+            fail("known pixel differs", "RGB565", LSBFirst, False);
+        }
+    }
+}
+
+int main(void) {
+    srand(0x5D12);
+    testClientFormats();
+    testImageLayouts();
+    testBitmapExpansion();
+    testKnownPixels();
+    printf("Pixel conversion kernels %s: %d failures\n", PIXEL_FORMAT_SIMD, numFailures);
+    return numFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
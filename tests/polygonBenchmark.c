@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Measures the throughput of XFillPolygon in points per second for polygons of several sizes,
+ * with the convex fast path and with the general tessellation of complex polygons.
+ */
+
+#define BENCHMARK_WIDTH 1024
+#define BENCHMARK_HEIGHT 768
+#define BENCHMARK_POINTS 100000
+
+/*
+ * Create a convex polygon, the points lie on a parabola that is closed by its top edge.
+ */
+static void createConvexPolygon(XPoint* points, int numPoints) {
+    int i, half = numPoints / 2;
+    for (i = 0; i < numPoints; i++) {
+        int offset = (i - half) * 500 / half;
+        points[i].x = (short) (BENCHMARK_WIDTH / 2 + offset);
+        points[i].y = (short) (100 + offset * offset / 400);
+    }
+}
+
+/*
+ * Create a complex polygon from random points, its edges cross each other many times.
+ */
+static void createComplexPolygon(XPoint* points, int numPoints) {
+    int i;
+    for (i = 0; i < numPoints; i++) {
+        points[i].x = (short) (rand() % BENCHMARK_WIDTH);
+        points[i].y = (short) (rand() % BENCHMARK_HEIGHT);
+    }
+}
+
+static double benchmarkPolygon(Display* display, Window window, GC gc, XPoint* points,
+                               int numPoints, int shape) {
+    int i, repetitions = BENCHMARK_POINTS / numPoints;
+    XSync(display, False);
+    double startTime = getSeconds();
+    for (i = 0; i < repetitions; i++) {
+        XSetForeground(display, gc, (unsigned long) i * 2654435761u);
+        XFillPolygon(display, window, gc, points, numPoints, shape, CoordModeOrigin);
+    }
+    XSync(display, False);
+    return (double) repetitions * numPoints / (getSeconds() - startTime) / 1e6;
+}
+
+int main(void) {
+    const int sizes[] = {4, 16, 64, 256, 1024};
+    size_t i;
+    XPoint* points = malloc(sizeof(XPoint) * sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    if (points == NULL) {
+        fprintf(stderr, "Failed to allocate the benchmark points\n");
+        return EXIT_FAILURE;
+    }
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    printf("%d points per measurement\n", BENCHMARK_POINTS);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        createConvexPolygon(points, sizes[i]);
+        double convex = benchmarkPolygon(display, window, gc, points, sizes[i], Convex);
+        createComplexPolygon(points, sizes[i]);
+        XSetFillRule(display, gc, EvenOddRule);
+        double evenOdd = benchmarkPolygon(display, window, gc, points, sizes[i], Complex);
+        XSetFillRule(display, gc, WindingRule);
+        double winding = benchmarkPolygon(display, window, gc, points, sizes[i], Complex);
+        printf("%4d points: convex %6.2f, complex even-odd %6.2f, complex winding %6.2f "
+               "Mpoints/s\n", sizes[i], convex, evenOdd, winding);
+    }
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    free(points);
+    return EXIT_SUCCESS;
+}
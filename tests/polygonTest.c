@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Checks XFillPolygon with the convex, nonconvex and complex shape hints, with relative
+ * coordinates and with the EvenOddRule and WindingRule fill rules of the GC.
+ */
+
+#define TEST_SIZE 40
+#define FOREGROUND_PIXEL 0x96F00FFFUL
+#define DESTINATION_PIXEL 0x3C5AA5FFUL
+
+typedef struct {
+    int x;
+    int y;
+    Bool isFilled;
+} ExpectedPixel;
+
+static void checkPolygon(Display* display, int fillRule, XPoint* points, int numPoints,
+                         int shape, int mode, const ExpectedPixel* expected,
+                         size_t numExpected, const char* check) {
+    size_t i;
+    Pixmap pixmap = createTestPixmap(display, TEST_SIZE, TEST_SIZE, DESTINATION_PIXEL);
+    XGCValues values;
+    values.foreground = FOREGROUND_PIXEL;
+    values.fill_rule = fillRule;
+    GC gc = XCreateGC(display, pixmap, GCForeground | GCFillRule, &values);
+    XFillPolygon(display, pixmap, gc, points, numPoints, shape, mode);
+    for (i = 0; i < numExpected; i++) {
+        expectPixel(display, pixmap, expected[i].x, expected[i].y,
+                    expected[i].isFilled ? FOREGROUND_PIXEL : DESTINATION_PIXEL, check);
+    }
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+}
+
+int main(void) {
+    Display* display = openTestDisplay();
+    XPoint triangle[] = {{4, 4}, {30, 4}, {4, 30}};
+    XPoint relativeTriangle[] = {{4, 4}, {26, 0}, {-26, 26}};
+    ExpectedPixel triangleExpected[] = {{8, 8, True}, {20, 6, True}, {25, 25, False}};
+    checkPolygon(display, EvenOddRule, triangle, 3, Convex, CoordModeOrigin, triangleExpected,
+                 3, "convex polygon");
+    checkPolygon(display, EvenOddRule, relativeTriangle, 3, Convex, CoordModePrevious,
+                 triangleExpected, 3, "convex polygon with relative coordinates");
+    XPoint lShape[] = {{2, 2}, {12, 2}, {12, 10}, {30, 10}, {30, 20}, {2, 20}};
+    ExpectedPixel lShapeExpected[] = {{5, 5, True}, {20, 5, False}, {20, 15, True}};
+    checkPolygon(display, EvenOddRule, lShape, 6, Nonconvex, CoordModeOrigin, lShapeExpected,
+                 3, "nonconvex polygon");
+    // The center of the pentagram is enclosed twice.
+    XPoint pentagram[] = {{20, 2}, {31, 35}, {3, 14}, {37, 14}, {9, 35}};
+    ExpectedPixel evenOddExpected[] = {
+            {20, 20, False}, {20, 6, True}, {20, 32, False}, {1, 1, False},
+    };
+    ExpectedPixel windingExpected[] = {
+            {20, 20, True}, {20, 6, True}, {20, 32, False}, {1, 1, False},
+    };
+    checkPolygon(display, EvenOddRule, pentagram, 5, Complex, CoordModeOrigin,
+                 evenOddExpected, 4, "complex polygon with EvenOddRule");
+    checkPolygon(display, WindingRule, pentagram, 5, Complex, CoordModeOrigin,
+                 windingExpected, 4, "complex polygon with WindingRule");
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All polygon checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Checks that filled rectangles are combined with the destination bit by bit for every
+ * GC function, with all planes and with a plane mask that selects single planes of the
+ * color channels, and that overlapping rectangles of one request are combined in order.
+ */
+
+#define SOURCE_PIXEL 0x96F00FFFUL
+#define DESTINATION_PIXEL 0x3C5AA5FFUL
+/* The alpha channel is not part of the pixel value, it is always opaque. */
+#define ALPHA_PIXEL 0x000000FFUL
+
+static unsigned long applyFunction(int function, unsigned long planeMask,
+                                   unsigned long source, unsigned long destination) {
+    unsigned long value = 0;
+    unsigned long mask = planeMask & ~ALPHA_PIXEL;
+    if (function & 0x1) value |= source & destination;
+    if (function & 0x2) value |= source & ~destination;
+    if (function & 0x4) value |= ~source & destination;
+    if (function & 0x8) value |= ~source & ~destination;
+    return (((value & mask) | (destination & ~mask)) & 0xFFFFFF00UL) | ALPHA_PIXEL;
+}
+
+static void checkFunction(Display* display, Drawable drawable, int function,
+                          unsigned long planeMask) {
+    char check[64];
+    XGCValues values;
+    values.function = function;
+    values.foreground = SOURCE_PIXEL;
+    values.plane_mask = planeMask;
+    GC gc = XCreateGC(display, drawable, GCFunction | GCForeground | GCPlaneMask, &values);
+    XFillRectangle(display, drawable, gc, 2, 2, 4, 4);
+    XFreeGC(display, gc);
+    snprintf(check, sizeof(check), "function %d, plane mask 0x%08lx", function, planeMask);
+    expectPixel(display, drawable, 3, 3,
+                applyFunction(function, planeMask, SOURCE_PIXEL, DESTINATION_PIXEL), check);
+    expectPixel(display, drawable, 0, 0, DESTINATION_PIXEL, check);
+}
+
+int main(void) {
+    const unsigned long planeMasks[] = {AllPlanes, 0x0F0FF0FFUL, 0x81422400UL};
+    Display* display = openTestDisplay();
+    size_t i;
+    int function;
+    for (i = 0; i < sizeof(planeMasks) / sizeof(planeMasks[0]); i++) {
+        for (function = GXclear; function <= GXset; function++) {
+            Pixmap pixmap = createTestPixmap(display, 8, 8, DESTINATION_PIXEL);
+            checkFunction(display, pixmap, function, planeMasks[i]);
+            XFreePixmap(display, pixmap);
+        }
+    }
+    // Overlapping rectangles of one request must see the result of the earlier ones.
+    Pixmap pixmap = createTestPixmap(display, 8, 8, DESTINATION_PIXEL);
+    XGCValues values;
+    values.function = GXxor;
+    values.foreground = SOURCE_PIXEL;
+    GC gc = XCreateGC(display, pixmap, GCFunction | GCForeground, &values);
+    XRectangle rectangles[] = {{0, 0, 6, 6}, {2, 2, 6, 6}};
+    XFillRectangles(display, pixmap, gc, rectangles, 2);
+    XFreeGC(display, gc);
+    expectPixel(display, pixmap, 1, 1,
+                applyFunction(GXxor, AllPlanes, SOURCE_PIXEL, DESTINATION_PIXEL),
+                "first of the overlapping rectangles");
+    expectPixel(display, pixmap, 3, 3, DESTINATION_PIXEL, "overlap of the rectangles");
+    expectPixel(display, pixmap, 7, 7,
+                applyFunction(GXxor, AllPlanes, SOURCE_PIXEL, DESTINATION_PIXEL),
+                "second of the overlapping rectangles");
+    XFreePixmap(display, pixmap);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All raster operation checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+#include "pixmanBackend.h"
+
+/*
+ * Compares the throughput of the SDL_gpu and the pixman render backend for the drawing
+ * primitives, on a small pixmap like an icon or a widget background and on a large window.
+ * Each backend runs in its own process, because the backend is selected once.
+ */
+
+#define WINDOW_WIDTH 1024
+#define WINDOW_HEIGHT 768
+#define PIXMAP_SIZE 64
+#define BENCHMARK_REQUESTS 20000
+
+typedef struct {
+    const char* name;
+    void (*draw)(Display* display, Drawable drawable, GC gc, int size, int request);
+} Primitive;
+
+static XImage* putImage = NULL;
+
+static void fillRectangle(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XFillRectangle(display, drawable, gc, (request * 7) % (size - 16),
+                   (request * 13) % (size - 16), 16, 16);
+}
+
+static void drawLine(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XDrawLine(display, drawable, gc, (request * 7) % size, (request * 13) % size,
+              (request * 17) % size, (request * 23) % size);
+}
+
+static void drawWideLine(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XSetLineAttributes(display, gc, 5, LineSolid, CapRound, JoinRound);
+    drawLine(display, drawable, gc, size, request);
+    XSetLineAttributes(display, gc, 0, LineSolid, CapButt, JoinMiter);
+}
+
+static void fillPolygon(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XPoint points[] = {
+            {(short) ((request * 7) % size), 0}, {(short) (size - 1), (short) (size / 2)},
+            {(short) (size / 2), (short) (size - 1)}, {0, (short) ((request * 13) % size)},
+    };
+    XFillPolygon(display, drawable, gc, points, 4, Convex, CoordModeOrigin);
+}
+
+static void fillTiled(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XSetFillStyle(display, gc, FillTiled);
+    fillRectangle(display, drawable, gc, size, request);
+    XSetFillStyle(display, gc, FillSolid);
+}
+
+static void fillXor(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XSetFunction(display, gc, GXxor);
+    fillRectangle(display, drawable, gc, size, request);
+    XSetFunction(display, gc, GXcopy);
+}
+
+static void putImageArea(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XPutImage(display, drawable, gc, putImage, 0, 0, (request * 7) % (size - 16),
+              (request * 13) % (size - 16), 16, 16);
+}
+
+static void copyArea(Display* display, Drawable drawable, GC gc, int size, int request) {
+    XCopyArea(display, drawable, drawable, gc, (request * 7) % (size - 16),
+              (request * 13) % (size - 16), 16, 16, (request * 17) % (size - 16),
+              (request * 23) % (size - 16));
+}
+
+static const Primitive primitives[] = {
+        {"rectangle", fillRectangle},
+        {"line", drawLine},
+        {"wide line", drawWideLine},
+        {"polygon", fillPolygon},
+        {"tiled rectangle", fillTiled},
+        {"GXxor rectangle", fillXor},
+        {"XPutImage", putImageArea},
+        {"XCopyArea", copyArea},
+};
+
+static double benchmarkPrimitive(Display* display, Drawable drawable, GC gc, int size,
+                                 const Primitive* primitive) {
+    int request;
+    XSync(display, False);
+    double startTime = getSeconds();
+    for (request = 0; request < BENCHMARK_REQUESTS; request++) {
+        XSetForeground(display, gc, (unsigned long) request * 2654435761u);
+        primitive->draw(display, drawable, gc, size, request);
+    }
+    XSync(display, False);
+    return BENCHMARK_REQUESTS / (getSeconds() - startTime) / 1000.0;
+}
+
+static int runBenchmark(const char* backend) {
+    size_t i;
+    setenv(RENDER_BACKEND_ENV_VARIABLE, backend, 1);
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, WINDOW_WIDTH, WINDOW_HEIGHT);
+    Pixmap pixmap = createTestPixmap(display, PIXMAP_SIZE, PIXMAP_SIZE, 0);
+    Pixmap tile = createTestPixmap(display, 8, 8, 0x808080FFUL);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    XSetTile(display, gc, tile);
+    XSetGraphicsExposures(display, gc, False);
+    putImage = XGetImage(display, pixmap, 0, 0, 16, 16, AllPlanes, ZPixmap);
+    if (putImage == NULL) {
+        fprintf(stderr, "Failed to create the image to put\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < sizeof(primitives) / sizeof(primitives[0]); i++) {
+        printf("%-6s %-15s pixmap %7.1f, window %7.1f thousand requests/s\n", backend,
+               primitives[i].name,
+               benchmarkPrimitive(display, pixmap, gc, PIXMAP_SIZE, &primitives[i]),
+               benchmarkPrimitive(display, window, gc, WINDOW_HEIGHT, &primitives[i]));
+    }
+    XDestroyImage(putImage);
+    XFreeGC(display, gc);
+    XFreePixmap(display, tile);
+    XFreePixmap(display, pixmap);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
+
+int main(void) {
+    const char* backends[] = {"gpu", "pixman"};
+    size_t i;
+    printf("%dx%d pixmap, %dx%d window, %d requests per measurement\n", PIXMAP_SIZE,
+           PIXMAP_SIZE, WINDOW_WIDTH, WINDOW_HEIGHT, BENCHMARK_REQUESTS);
+    fflush(stdout);
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        int status;
+        pid_t child = fork();
+        if (child == -1) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (child == 0) {
+            exit(runBenchmark(backends[i]));
+        }
+        if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status)) {
+            printf("The benchmark with the %s backend crashed\n", backends[i]);
+            return EXIT_FAILURE;
+        }
+        if (WEXITSTATUS(status) != EXIT_SUCCESS) return WEXITSTATUS(status);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "xlibTest.h"
+#include "renderThread.h"
+
+/*
+ * Compares the frame throughput and latency with and without the render thread. Every frame
+ * draws many rectangles and lines, does some work of the simulated client and is flushed
+ * with XFlush, like an animation loop. The throughput is measured over a sequence of frames,
+ * the latency is the time that XSync waits for a single frame to be drawn.
+ * Each mode runs in its own process, because the render thread is selected when the display
+ * is opened.
+ */
+
+#define BENCHMARK_WIDTH 1024
+#define BENCHMARK_HEIGHT 768
+#define BENCHMARK_FRAMES 200
+#define BENCHMARK_LATENCY_FRAMES 50
+#define RECTANGLES_PER_FRAME 2000
+#define LINES_PER_FRAME 2000
+/* The time that the simulated client spends on its own work for every frame. */
+#define CLIENT_WORK_SECONDS 0.004
+
+static void drawFrame(Display* display, Window window, GC gc, int frame) {
+    int i;
+    for (i = 0; i < RECTANGLES_PER_FRAME; i++) {
+        XSetForeground(display, gc, (unsigned long) (i * 2654435761u + frame));
+        XFillRectangle(display, window, gc, (i * 37 + frame) % BENCHMARK_WIDTH,
+                       (i * 53) % BENCHMARK_HEIGHT, 16, 16);
+    }
+    for (i = 0; i < LINES_PER_FRAME; i++) {
+        XDrawLine(display, window, gc, (i * 17) % BENCHMARK_WIDTH, (i * 29) % BENCHMARK_HEIGHT,
+                  (i * 31 + frame) % BENCHMARK_WIDTH, (i * 43) % BENCHMARK_HEIGHT);
+    }
+}
+
+static void doClientWork() {
+    double endTime = getSeconds() + CLIENT_WORK_SECONDS;
+    while (getSeconds() < endTime);
+}
+
+static int runBenchmark(const char* mode) {
+    int frame;
+    setenv(RENDER_THREAD_ENV_VARIABLE, mode, 1);
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    XSync(display, False);
+    double startTime = getSeconds();
+    for (frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+        drawFrame(display, window, gc, frame);
+        doClientWork();
+        XFlush(display);
+    }
+    XSync(display, False);
+    double framesPerSecond = BENCHMARK_FRAMES / (getSeconds() - startTime);
+    double latency = 0;
+    for (frame = 0; frame < BENCHMARK_LATENCY_FRAMES; frame++) {
+        drawFrame(display, window, gc, frame);
+        double syncTime = getSeconds();
+        XSync(display, False);
+        latency += getSeconds() - syncTime;
+    }
+    printf("render thread %-3s %7.1f frames/s, %7.3f ms latency\n",
+           mode[0] == '1' ? "on" : "off", framesPerSecond,
+           latency * 1000.0 / BENCHMARK_LATENCY_FRAMES);
+    XFreeGC(display, gc);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
+
+int main(void) {
+    const char* modes[] = {"0", "1"};
+    size_t i;
+    printf("%dx%d window, %d rectangles and %d lines per frame, %.1f ms client work\n",
+           BENCHMARK_WIDTH, BENCHMARK_HEIGHT, RECTANGLES_PER_FRAME, LINES_PER_FRAME,
+           CLIENT_WORK_SECONDS * 1000.0);
+    fflush(stdout);
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        int status;
+        pid_t child = fork();
+        if (child == -1) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (child == 0) {
+            exit(runBenchmark(modes[i]));
+        }
+        if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status)) {
+            printf("The benchmark with render thread mode %s crashed\n", modes[i]);
+            return EXIT_FAILURE;
+        }
+        if (WEXITSTATUS(status) != EXIT_SUCCESS) return WEXITSTATUS(status);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+#include "rfbServer.h"
+
+/*
+ * Measures the throughput and the damage to wire latency of the RFB server for every encoding.
+ * A minimal viewer connects to the server on the loopback interface and requests an update for
+ * every frame. The frames either redraw widgets with a few colors or put a noisy photo.
+ * The latency is the time from flushing a frame until its update was received completely.
+ * Each encoding runs in its own process with its own server port.
+ */
+
+#define BENCHMARK_PORT 15900
+#define BENCHMARK_FRAMES 100
+#define UPDATE_WIDTH 512
+#define UPDATE_HEIGHT 384
+#define ENCODING_RAW 0
+#define ENCODING_TIGHT 7
+#define ENCODING_ZRLE 16
+#define TIGHT_MIN_TO_COMPRESS 12
+
+typedef struct {
+    int socket;
+    unsigned int width;
+    unsigned int height;
+    double bytes;
+    double pixels;
+} Viewer;
+
+static Bool receiveAll(Viewer* viewer, void* data, size_t size) {
+    unsigned char* bytes = data;
+    while (size > 0) {
+        ssize_t received = recv(viewer->socket, bytes, size, 0);
+        if (received <= 0) return False;
+        bytes += received;
+        size -= (size_t) received;
+        viewer->bytes += (double) received;
+    }
+    return True;
+}
+
+static Bool skipBytes(Viewer* viewer, size_t size) {
+    unsigned char buffer[4096];
+    while (size > 0) {
+        size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (!receiveAll(viewer, buffer, chunk)) return False;
+        size -= chunk;
+    }
+    return True;
+}
+
+static unsigned int readU16(const unsigned char* data) {
+    return (unsigned int) data[0] << 8 | data[1];
+}
+
+static unsigned long readU32(const unsigned char* data) {
+    return (unsigned long) data[0] << 24 | (unsigned long) data[1] << 16
+           | (unsigned long) data[2] << 8 | data[3];
+}
+
+/*
+ * Connect to the server, perform the handshake of protocol version 3.8 without security
+ * and select the encoding.
+ */
+static Bool connectViewer(Viewer* viewer, int port, int encoding) {
+    unsigned char data[24];
+    struct sockaddr_in address;
+    int noDelay = 1;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t) port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    viewer->socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (viewer->socket == -1
+        || connect(viewer->socket, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        return False;
+    }
+    setsockopt(viewer->socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    if (!receiveAll(viewer, data, 12)
+        || send(viewer->socket, "RFB 003.008\n", 12, 0) != 12
+        || !receiveAll(viewer, data, 1) || data[0] == 0
+        || !skipBytes(viewer, data[0])) {
+        return False;
+    }
+    // Choose no security and share the desktop.
+    data[0] = 1;
+    if (send(viewer->socket, data, 1, 0) != 1 || !receiveAll(viewer, data, 4)
+        || readU32(data) != 0 || send(viewer->socket, data, 1, 0) != 1
+        || !receiveAll(viewer, data, 24) || !skipBytes(viewer, readU32(data + 20))) {
+        return False;
+    }
+    viewer->width = readU16(data);
+    viewer->height = readU16(data + 2);
+    unsigned char setEncodings[] = {
+            2, 0, 0, 1, 0, 0, (unsigned char) (encoding >> 8), (unsigned char) encoding,
+    };
+    return send(viewer->socket, setEncodings, sizeof(setEncodings), 0)
+           == (ssize_t) sizeof(setEncodings);
+}
+
+static Bool requestUpdate(Viewer* viewer, Bool incremental) {
+    unsigned char request[] = {
+            3, (unsigned char) incremental, 0, 0, 0, 0,
+            (unsigned char) (viewer->width >> 8), (unsigned char) viewer->width,
+            (unsigned char) (viewer->height >> 8), (unsigned char) viewer->height,
+    };
+    return send(viewer->socket, request, sizeof(request), 0) == (ssize_t) sizeof(request);
+}
+
+/*
+ * Skip the data of a Tight rectangle in the server pixel format, whose pixels have three bytes.
+ */
+static Bool skipTightRect(Viewer* viewer, unsigned int width, unsigned int height) {
+    unsigned char data[3];
+    size_t size = (size_t) width * height * 3;
+    if (!receiveAll(viewer, data, 1)) return False;
+    if (data[0] >> 4 == 8) return skipBytes(viewer, 3);
+    if (data[0] & 0x40) {
+        if (!receiveAll(viewer, data, 1)) return False;
+        if (data[0] == 1) {
+            if (!receiveAll(viewer, data, 1)) return False;
+            size_t paletteSize = (size_t) data[0] + 1;
+            if (!skipBytes(viewer, paletteSize * 3)) return False;
+            size = paletteSize == 2 ? (width + 7) / 8 * (size_t) height : (size_t) width * height;
+        }
+    }
+    if (size < TIGHT_MIN_TO_COMPRESS) return skipBytes(viewer, size);
+    // The length of the compressed data has seven bits per byte.
+    size_t length = 0;
+    int i;
+    for (i = 0; i < 3; i++) {
+        if (!receiveAll(viewer, data, 1)) return False;
+        length |= (size_t) (i < 2 ? data[0] & 0x7F : data[0]) << (7 * i);
+        if (i < 2 && !(data[0] & 0x80)) break;
+    }
+    return skipBytes(viewer, length);
+}
+
+/*
+ * Receive one framebuffer update and count its pixels.
+ */
+static Bool receiveUpdate(Viewer* viewer) {
+    unsigned char data[12];
+    unsigned int i;
+    if (!receiveAll(viewer, data, 4) || data[0] != 0) return False;
+    unsigned int numRects = readU16(data + 2);
+    for (i = 0; i < numRects; i++) {
+        if (!receiveAll(viewer, data, 12)) return False;
+        unsigned int width = readU16(data + 4), height = readU16(data + 6);
+        Bool success;
+        switch (readU32(data + 8)) {
+            case ENCODING_RAW:
+                success = skipBytes(viewer, (size_t) width * height * 4);
+                break;
+            case ENCODING_ZRLE:
+                success = receiveAll(viewer, data, 4) && skipBytes(viewer, readU32(data));
+                break;
+            case ENCODING_TIGHT:
+                success = skipTightRect(viewer, width, height);
+                break;
+            default:
+                printf("The server used the unexpected encoding %lu\n", readU32(data + 8));
+                return False;
+        }
+        if (!success) return False;
+        viewer->pixels += (double) width * height;
+    }
+    return True;
+}
+
+/*
+ * Flush the display and keep it flushing until the requested update arrived, because the
+ * damaged areas are read back asynchronously and arrive in the framebuffer with a later flush.
+ */
+static Bool waitForUpdate(Display* display, Viewer* viewer) {
+    struct pollfd fd = {viewer->socket, POLLIN, 0};
+    XFlush(display);
+    while (poll(&fd, 1, 1) == 0) {
+        XSync(display, False);
+    }
+    return receiveUpdate(viewer);
+}
+
+static void drawWidgets(Display* display, Window window, GC gc, int frame) {
+    int x, y;
+    for (y = 0; y < UPDATE_HEIGHT; y += 24) {
+        for (x = 0; x < UPDATE_WIDTH; x += 64) {
+            XSetForeground(display, gc, (x + y + frame) % 3 == 0 ? 0xD9D9D9FFUL : 0xFFFFFFFFUL);
+            XFillRectangle(display, window, gc, x, y, 64, 24);
+            XSetForeground(display, gc, 0x000000FFUL);
+            XDrawRectangle(display, window, gc, x + 2, y + 2, 59, 19);
+        }
+    }
+}
+
+static int runBenchmark(const char* name, int encoding, int port) {
+    char portValue[16];
+    int frame, scene;
+    Viewer viewer = {-1, 0, 0, 0, 0};
+    snprintf(portValue, sizeof(portValue), "%d", port);
+    setenv(RFB_PORT_ENV_VARIABLE, portValue, 1);
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, UPDATE_WIDTH, UPDATE_HEIGHT);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    XImage* photo = XGetImage(display, window, 0, 0, UPDATE_WIDTH, UPDATE_HEIGHT, AllPlanes,
+                              ZPixmap);
+    if (photo == NULL || !connectViewer(&viewer, port, encoding)
+        || !requestUpdate(&viewer, False) || !waitForUpdate(display, &viewer)) {
+        printf("SKIP: Failed to connect to the RFB server\n");
+        return TEST_SKIPPED;
+    }
+    for (scene = 0; scene < 2; scene++) {
+        double latency = 0;
+        viewer.bytes = viewer.pixels = 0;
+        double startTime = getSeconds();
+        for (frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+            if (scene == 0) {
+                drawWidgets(display, window, gc, frame);
+            } else {
+                size_t i, size = (size_t) photo->bytes_per_line * UPDATE_HEIGHT;
+                for (i = 0; i < size; i++) {
+                    photo->data[i] = (char) rand();
+                }
+                XPutImage(display, window, gc, photo, 0, 0, 0, 0, UPDATE_WIDTH, UPDATE_HEIGHT);
+            }
+            double flushTime = getSeconds();
+            if (!requestUpdate(&viewer, True) || !waitForUpdate(display, &viewer)) {
+                printf("The connection to the RFB server failed\n");
+                return EXIT_FAILURE;
+            }
+            latency += getSeconds() - flushTime;
+        }
+        double seconds = getSeconds() - startTime;
+        printf("%-5s %-7s %7.1f Mpixel/s, %5.2f bytes/pixel, %7.3f ms damage to wire\n", name,
+               scene == 0 ? "widgets" : "photo", viewer.pixels / seconds / 1e6,
+               viewer.pixels > 0 ? viewer.bytes / viewer.pixels : 0.0,
+               latency * 1000.0 / BENCHMARK_FRAMES);
+    }
+    close(viewer.socket);
+    XDestroyImage(photo);
+    XFreeGC(display, gc);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
+
+int main(void) {
+    const char* names[] = {"Raw", "ZRLE", "Tight"};
+    const int encodings[] = {ENCODING_RAW, ENCODING_ZRLE, ENCODING_TIGHT};
+    size_t i;
+    printf("%dx%d updates, %d frames per scene\n", UPDATE_WIDTH, UPDATE_HEIGHT,
+           BENCHMARK_FRAMES);
+    fflush(stdout);
+    for (i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+        int status;
+        pid_t child = fork();
+        if (child == -1) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (child == 0) {
+            exit(runBenchmark(names[i], encodings[i], BENCHMARK_PORT + (int) i));
+        }
+        if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status)) {
+            printf("The benchmark with the %s encoding crashed\n", names[i]);
+            return EXIT_FAILURE;
+        }
+        if (WEXITSTATUS(status) != EXIT_SUCCESS) return WEXITSTATUS(status);
+    }
+    return EXIT_SUCCESS;
+}
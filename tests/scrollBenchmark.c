@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "xlibTest.h"
+
+/*
+ * Measures the scroll throughput of a window and a pixmap, like a text widget or a canvas that
+ * moves its content up with XCopyArea and fills the uncovered rows, for several scroll steps.
+ */
+
+#define BENCHMARK_WIDTH 1024
+#define BENCHMARK_HEIGHT 768
+#define BENCHMARK_SCROLLS 500
+
+/*
+ * Scroll the drawable up by the step repeatedly and return the scrolled rows per second.
+ */
+static double benchmarkScroll(Display* display, Drawable drawable, GC gc, int step) {
+    int scroll;
+    XSync(display, False);
+    double startTime = getSeconds();
+    for (scroll = 0; scroll < BENCHMARK_SCROLLS; scroll++) {
+        XCopyArea(display, drawable, drawable, gc, 0, step, BENCHMARK_WIDTH,
+                  BENCHMARK_HEIGHT - step, 0, 0);
+        XSetForeground(display, gc, (unsigned long) scroll * 2654435761u);
+        XFillRectangle(display, drawable, gc, 0, BENCHMARK_HEIGHT - step, BENCHMARK_WIDTH,
+                       (unsigned int) step);
+    }
+    XSync(display, False);
+    return (double) BENCHMARK_SCROLLS * step / (getSeconds() - startTime);
+}
+
+int main(void) {
+    const int steps[] = {1, 16, 64};
+    size_t i;
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    Pixmap pixmap = createTestPixmap(display, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    XSetGraphicsExposures(display, gc, False);
+    printf("%dx%d pixels, %d scrolls\n", BENCHMARK_WIDTH, BENCHMARK_HEIGHT, BENCHMARK_SCROLLS);
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        printf("scroll by %2d rows: window %8.0f rows/s, pixmap %8.0f rows/s\n", steps[i],
+               benchmarkScroll(display, window, gc, steps[i]),
+               benchmarkScroll(display, pixmap, gc, steps[i]));
+    }
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
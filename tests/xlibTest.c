@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "xlibTest.h"
+#include "X11/Xutil.h"
+#include "headless.h"
+
+static int numFailures = 0;
+
+/*
+ * Open the display in the headless mode, unless the environment selects a mode.
+ * Exits the process with TEST_SKIPPED if the display can not be opened.
+ */
+Display* openTestDisplay() {
+    setenv(HEADLESS_ENV_VARIABLE, "1", 0);
+    Display* display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        printf("SKIP: Failed to open the display\n");
+        exit(TEST_SKIPPED);
+    }
+    return display;
+}
+
+/*
+ * Create and map a top level window with a white background.
+ */
+Window createTestWindow(Display* display, unsigned int width, unsigned int height) {
+    Window window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, width, height,
+                                        0, BlackPixel(display, 0), WhitePixel(display, 0));
+    if (window == None) {
+        printf("SKIP: Failed to create a window\n");
+        exit(TEST_SKIPPED);
+    }
+    XMapWindow(display, window);
+    XClearWindow(display, window);
+    return window;
+}
+
+/*
+ * Create a pixmap that is filled with the pixel.
+ */
+Pixmap createTestPixmap(Display* display, unsigned int width, unsigned int height,
+                        unsigned long pixel) {
+    Pixmap pixmap = XCreatePixmap(display, DefaultRootWindow(display), width, height,
+                                  (unsigned int) DefaultDepth(display, 0));
+    if (pixmap == None) {
+        printf("SKIP: Failed to create a pixmap\n");
+        exit(TEST_SKIPPED);
+    }
+    XGCValues values;
+    values.foreground = pixel;
+    GC gc = XCreateGC(display, pixmap, GCForeground, &values);
+    XFillRectangle(display, pixmap, gc, 0, 0, width, height);
+    XFreeGC(display, gc);
+    return pixmap;
+}
+
+/*
+ * Create a pixmap whose pixels are given by the pattern function.
+ */
+Pixmap createPatternPixmap(Display* display, unsigned int width, unsigned int height,
+                          unsigned long (*pattern)(int x, int y, void* data), void* data) {
+    Pixmap pixmap = createTestPixmap(display, width, height, 0);
+    XImage* image = XCreateImage(display, DefaultVisual(display, 0),
+                                 (unsigned int) DefaultDepth(display, 0), ZPixmap, 0, NULL,
+                                 width, height, 32, 0);
+    int x, y;
+    if (image == NULL || (image->data = malloc((size_t) image->bytes_per_line * height)) == NULL) {
+        printf("SKIP: Failed to create the pattern image\n");
+        exit(TEST_SKIPPED);
+    }
+    for (y = 0; y < (int) height; y++) {
+        for (x = 0; x < (int) width; x++) {
+            XPutPixel(image, x, y, pattern(x, y, data));
+        }
+    }
+    GC gc = XCreateGC(display, pixmap, 0, NULL);
+    XPutImage(display, pixmap, gc, image, 0, 0, 0, 0, width, height);
+    XFreeGC(display, gc);
+    XDestroyImage(image);
+    return pixmap;
+}
+
+/*
+ * Read a single pixel of the drawable.
+ */
+unsigned long getTestPixel(Display* display, Drawable drawable, int x, int y) {
+    XImage* image = XGetImage(display, drawable, x, y, 1, 1, AllPlanes, ZPixmap);
+    if (image == NULL) return ~0UL;
+    unsigned long pixel = XGetPixel(image, 0, 0);
+    XDestroyImage(image);
+    return pixel;
+}
+
+/*
+ * Check that the pixel of the drawable has the expected value.
+ */
+void expectPixel(Display* display, Drawable drawable, int x, int y, unsigned long expected,
+                 const char* check) {
+    unsigned long pixel = getTestPixel(display, drawable, x, y);
+    if (pixel != expected) {
+        printf("FAIL: %s: Pixel %d,%d is 0x%08lx instead of 0x%08lx\n", check, x, y,
+               pixel, expected);
+        numFailures++;
+    }
+}
+
+/*
+ * Check every pixel of the area of the drawable against the expected function.
+ * Only the first mismatch is reported.
+ */
+void expectPixels(Display* display, Drawable drawable, const XRectangle* area,
+                  unsigned long (*expected)(int x, int y, void* data), void* data,
+                  const char* check) {
+    XImage* image = XGetImage(display, drawable, area->x, area->y, area->width, area->height,
+                              AllPlanes, ZPixmap);
+    int x, y;
+    if (image == NULL) {
+        printf("FAIL: %s: Failed to read the pixels\n", check);
+        numFailures++;
+        return;
+    }
+    for (y = 0; y < area->height; y++) {
+        for (x = 0; x < area->width; x++) {
+            unsigned long pixel = XGetPixel(image, x, y);
+            unsigned long value = expected(area->x + x, area->y + y, data);
+            if (pixel != value) {
+                printf("FAIL: %s: Pixel %d,%d is 0x%08lx instead of 0x%08lx\n", check,
+                       area->x + x, area->y + y, pixel, value);
+                numFailures++;
+                XDestroyImage(image);
+                return;
+            }
+        }
+    }
+    XDestroyImage(image);
+}
+
+/*
+ * Report a failed check that is not a pixel comparison.
+ */
+void reportTestFailure(const char* check, const char* message) {
+    printf("FAIL: %s: %s\n", check, message);
+    numFailures++;
+}
+
+int getTestFailures() {
+    return numFailures;
+}
+
+double getSeconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
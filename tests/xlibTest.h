@@ -0,0 +1,31 @@
+#ifndef _XLIB_TEST_H_
+#define _XLIB_TEST_H_
+
+#include "X11/Xlib.h"
+
+/*
+ * Helpers for the tests and benchmarks that draw through the emulated Xlib. They run in the
+ * headless mode, so no window is shown, but they need an OpenGL context. If none can be
+ * created, they exit with TEST_SKIPPED, which CTest reports as a skipped test.
+ */
+
+/* The exit status of a test that could not run (the SKIP_RETURN_CODE of the CTest targets). */
+#define TEST_SKIPPED 77
+
+Display* openTestDisplay(void);
+Window createTestWindow(Display* display, unsigned int width, unsigned int height);
+Pixmap createTestPixmap(Display* display, unsigned int width, unsigned int height,
+                        unsigned long pixel);
+Pixmap createPatternPixmap(Display* display, unsigned int width, unsigned int height,
+                          unsigned long (*pattern)(int x, int y, void* data), void* data);
+unsigned long getTestPixel(Display* display, Drawable drawable, int x, int y);
+void expectPixel(Display* display, Drawable drawable, int x, int y, unsigned long expected,
+                 const char* check);
+void expectPixels(Display* display, Drawable drawable, const XRectangle* area,
+                  unsigned long (*expected)(int x, int y, void* data), void* data,
+                  const char* check);
+void reportTestFailure(const char* check, const char* message);
+int getTestFailures(void);
+double getSeconds(void);
+
+#endif /* _XLIB_TEST_H_ */
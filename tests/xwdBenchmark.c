@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "xlibTest.h"
+#include "xwd.h"
+
+/*
+ * Measures the XWD dump of a window that covers the whole screen: the time the client is
+ * blocked by the dump request and the time until the file was written, while the client keeps
+ * drawing frames.
+ */
+
+#define BENCHMARK_DUMPS 20
+
+int main(void) {
+    char fileName[64];
+    int dump, frames = 0;
+    double requestTime = 0, dumpTime = 0;
+    Display* display = openTestDisplay();
+    unsigned int width = (unsigned int) DisplayWidth(display, 0);
+    unsigned int height = (unsigned int) DisplayHeight(display, 0);
+    Window window = createTestWindow(display, width, height);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    snprintf(fileName, sizeof(fileName), "/tmp/xwdBenchmark-%d.xwd", (int) getpid());
+    for (dump = 0; dump < BENCHMARK_DUMPS; dump++) {
+        FILE* file;
+        XSetForeground(display, gc, (unsigned long) dump * 2654435761u);
+        XFillRectangle(display, window, gc, 0, 0, width, height);
+        XSync(display, False);
+        remove(fileName);
+        double startTime = getSeconds();
+        if (!dumpDrawableToXwd(display, window, fileName)) {
+            fprintf(stderr, "Failed to start the dump\n");
+            return EXIT_FAILURE;
+        }
+        requestTime += getSeconds() - startTime;
+        // The dump is written during a later flush, keep drawing frames until it exists.
+        while ((file = fopen(fileName, "rb")) == NULL) {
+            XFillRectangle(display, window, gc, 0, 0, 16, 16);
+            XSync(display, False);
+            frames++;
+        }
+        dumpTime += getSeconds() - startTime;
+        fclose(file);
+    }
+    remove(fileName);
+    printf("%ux%u window, %d dumps\n", width, height, BENCHMARK_DUMPS);
+    printf("request %7.3f ms, written after %7.3f ms (%5.1f frames), %7.1f Mpixel/s\n",
+           requestTime * 1000.0 / BENCHMARK_DUMPS, dumpTime * 1000.0 / BENCHMARK_DUMPS,
+           (double) frames / BENCHMARK_DUMPS,
+           (double) width * height * BENCHMARK_DUMPS / dumpTime / 1e6);
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "xlibTest.h"
+#include "X11/XWDFile.h"
+#include "xwd.h"
+
+/*
+ * Checks the XWD dumps of a window and a pixmap: the header must describe 32 bit TrueColor
+ * pixels of the size of the drawable and the pixels must match what was drawn.
+ */
+
+#define TEST_WIDTH 40
+#define TEST_HEIGHT 24
+/* The maximum time to wait for the asynchronous readback of a dump. */
+#define DUMP_TIMEOUT_SECONDS 5.0
+
+static unsigned long getPatternPixel(int x, int y, void* data) {
+    (void) data;
+    return ((unsigned long) (x * 6) << 24) | ((unsigned long) (y * 10) << 16)
+           | ((unsigned long) ((x ^ y) * 4) << 8) | 0xFFUL;
+}
+
+static unsigned long readU32(const unsigned char* data) {
+    return (unsigned long) data[0] << 24 | (unsigned long) data[1] << 16
+           | (unsigned long) data[2] << 8 | data[3];
+}
+
+/*
+ * Flush the display until the dump file was written, it is written once the pixels were read.
+ */
+static FILE* waitForDump(Display* display, const char* fileName) {
+    double endTime = getSeconds() + DUMP_TIMEOUT_SECONDS;
+    FILE* file;
+    while ((file = fopen(fileName, "rb")) == NULL && getSeconds() < endTime) {
+        XSync(display, False);
+        usleep(1000);
+    }
+    return file;
+}
+
+static void checkDump(Display* display, Drawable drawable, const char* check) {
+    char fileName[64], message[64];
+    XWDFileHeader header;
+    unsigned char row[TEST_WIDTH * 4];
+    int x, y;
+    snprintf(fileName, sizeof(fileName), "/tmp/xwdTest-%d.xwd", (int) getpid());
+    remove(fileName);
+    if (!dumpDrawableToXwd(display, drawable, fileName)) {
+        reportTestFailure(check, "Failed to start the dump");
+        return;
+    }
+    FILE* file = waitForDump(display, fileName);
+    if (file == NULL) {
+        reportTestFailure(check, "The dump file was not written");
+        return;
+    }
+    const unsigned char* values = (const unsigned char*) &header;
+    if (fread(&header, sz_XWDheader, 1, file) != 1
+        || fseek(file, (long) readU32(values), SEEK_SET) != 0) {
+        reportTestFailure(check, "Failed to read the header");
+        fclose(file);
+        remove(fileName);
+        return;
+    }
+    // The values of the header are stored most significant byte first.
+    if (readU32((const unsigned char*) &header.file_version) != XWD_FILE_VERSION
+        || readU32((const unsigned char*) &header.pixmap_width) != TEST_WIDTH
+        || readU32((const unsigned char*) &header.pixmap_height) != TEST_HEIGHT
+        || readU32((const unsigned char*) &header.bits_per_pixel) != 32
+        || readU32((const unsigned char*) &header.visual_class) != TrueColor
+        || readU32((const unsigned char*) &header.red_mask) != 0xFF000000UL
+        || readU32((const unsigned char*) &header.blue_mask) != 0x0000FF00UL) {
+        reportTestFailure(check, "The header does not describe the drawable");
+    }
+    for (y = 0; y < TEST_HEIGHT; y++) {
+        if (fread(row, sizeof(row), 1, file) != 1) {
+            reportTestFailure(check, "The dump ends before the last row");
+            break;
+        }
+        for (x = 0; x < TEST_WIDTH; x++) {
+            unsigned long pixel = readU32(&row[x * 4]);
+            if (pixel != getPatternPixel(x, y, NULL)) {
+                snprintf(message, sizeof(message), "Pixel %d,%d is 0x%08lx instead of 0x%08lx",
+                         x, y, pixel, getPatternPixel(x, y, NULL));
+                reportTestFailure(check, message);
+                y = TEST_HEIGHT;
+                break;
+            }
+        }
+    }
+    fclose(file);
+    remove(fileName);
+}
+
+int main(void) {
+    Display* display = openTestDisplay();
+    Window window = createTestWindow(display, TEST_WIDTH, TEST_HEIGHT);
+    Pixmap pixmap = createPatternPixmap(display, TEST_WIDTH, TEST_HEIGHT, getPatternPixel, NULL);
+    GC gc = XCreateGC(display, window, 0, NULL);
+    XCopyArea(display, pixmap, window, gc, 0, 0, TEST_WIDTH, TEST_HEIGHT, 0, 0);
+    checkDump(display, pixmap, "pixmap dump");
+    checkDump(display, window, "window dump");
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    if (getTestFailures() > 0) {
+        printf("%d checks failed\n", getTestFailures());
+        return EXIT_FAILURE;
+    }
+    printf("All XWD dump checks passed\n");
+    return EXIT_SUCCESS;
+}